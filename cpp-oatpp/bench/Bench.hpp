@@ -0,0 +1,109 @@
+#ifndef Bench_hpp
+#define Bench_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Small and fast pseudo random generator for picking operations and keys in
+ * the benchmark loops.
+ */
+class XorShift {
+public:
+    explicit XorShift(std::uint64_t seed) : state(seed * 2 + 1) {}
+
+    std::uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    std::uint64_t nextBelow(std::uint64_t bound) { return next() % bound; }
+
+private:
+    std::uint64_t state;
+};
+
+/**
+ * Thread counts to run a scaling benchmark with: powers of two up to twice
+ * the number of hardware threads.
+ */
+inline std::vector<unsigned> threadCounts() {
+    auto limit = std::max(1u, std::thread::hardware_concurrency()) * 2;
+    std::vector<unsigned> counts;
+    for (unsigned count = 1; count <= limit; count *= 2) {
+        counts.push_back(count);
+    }
+    return counts;
+}
+
+/**
+ * Runs `body(threadIndex)` on `threads` threads which are released at the
+ * same time, and returns the elapsed seconds until all of them finished.
+ */
+template <typename Body> double runThreads(unsigned threads, Body body) {
+    std::mutex mutex;
+    std::condition_variable startSignal;
+    bool started = false;
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i] {
+            {
+                std::unique_lock lock(mutex);
+                startSignal.wait(lock, [&] { return started; });
+            }
+            body(i);
+        });
+    }
+
+    auto start = Clock::now();
+    {
+        std::unique_lock lock(mutex);
+        started = true;
+    }
+    startSignal.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Percentiles of latency samples, in microseconds.
+ */
+struct LatencySummary {
+    double p50;
+    double p90;
+    double p99;
+    double p999;
+    double max;
+};
+
+/**
+ * Summarizes the latency samples, which are sorted in place.
+ */
+inline LatencySummary summarize(std::vector<double> &samples) {
+    if (samples.empty()) {
+        return {0, 0, 0, 0, 0};
+    }
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double quantile) {
+        return samples[std::size_t(quantile * (samples.size() - 1))];
+    };
+    return {at(0.5), at(0.9), at(0.99), at(0.999), samples.back()};
+}
+
+} // namespace bench
+
+#endif // Bench_hpp
@@ -0,0 +1,176 @@
+#include "BinaryProtocolBench.hpp"
+
+#include "Bench.hpp"
+#include "LoadGenerator.hpp"
+
+#include "binary/BinaryServer.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace {
+
+constexpr unsigned connections = 4;
+constexpr std::chrono::milliseconds duration{2000};
+constexpr std::uint16_t tcpPort = 8100;
+
+// CPU time used by the process, client and server alike, in seconds.
+double cpuSeconds() {
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    auto seconds = [](const timeval &time) {
+        return time.tv_sec + time.tv_usec / 1e6;
+    };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+int connectTo(bool overUnix, const std::string &path) {
+    if (overUnix) {
+        auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        return fd;
+    }
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(tcpPort);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    int noDelay = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return fd;
+}
+
+// Receives `count` response frames, returning false if the connection is
+// closed before.
+bool receiveResponses(int fd, std::string &buffer, std::size_t count) {
+    while (count > 0) {
+        if (buffer.size() >= BinaryProtocol::sizeSize) {
+            auto size = BinaryProtocol::sizeSize +
+                        BinaryProtocol::readUInt32(
+                            reinterpret_cast<const unsigned char *>(
+                                buffer.data()));
+            if (buffer.size() >= size) {
+                buffer.erase(0, size);
+                --count;
+                continue;
+            }
+        }
+        char chunk[64 * 1024];
+        auto received = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<std::size_t>(received));
+    }
+    return true;
+}
+
+struct BinaryResult {
+    double requestsPerSecond;
+    double requestsPerCpuSecond;
+};
+
+// Pushes to and pops from a stack per connection, sending `depth` requests
+// before waiting for their responses.
+BinaryResult runBinaryLoad(bool overUnix, unsigned depth) {
+    auto path = "/tmp/stack-server-binary-bench-" +
+                std::to_string(::getpid()) + ".sock";
+    auto map = std::make_shared<StringStackMap>(16);
+    BinaryServer server(overUnix ? "unix:" + path
+                             : "127.0.0.1:" + std::to_string(tcpPort),
+                        map);
+    server.start();
+
+    std::atomic<std::size_t> requests{0};
+    auto deadline = bench::Clock::now() + duration;
+    auto cpuStart = cpuSeconds();
+    auto seconds = bench::runThreads(connections, [&](unsigned index) {
+        auto fd = connectTo(overUnix, path);
+        auto name = "load-" + std::to_string(index);
+        std::string value(16, 'v');
+        std::string batch;
+        BinaryProtocol::appendRequest(batch, 0, BinaryProtocol::Opcode::Create,
+                                      name);
+        std::string buffer;
+        ::send(fd, batch.data(), batch.size(), MSG_NOSIGNAL);
+        receiveResponses(fd, buffer, 1);
+
+        bench::XorShift random(index);
+        std::uint32_t id = 0;
+        std::size_t local = 0;
+        while (bench::Clock::now() < deadline) {
+            batch.clear();
+            for (unsigned i = 0; i < depth; ++i) {
+                auto push = random.nextBelow(2) == 0;
+                BinaryProtocol::appendRequest(
+                    batch, ++id,
+                    push ? BinaryProtocol::Opcode::Push
+                         : BinaryProtocol::Opcode::Pop,
+                    name, push ? std::string_view(value) : std::string_view());
+            }
+            if (::send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) < 0 ||
+                !receiveResponses(fd, buffer, depth)) {
+                break;
+            }
+            local += depth;
+        }
+        ::close(fd);
+        requests += local;
+    });
+    auto cpu = cpuSeconds() - cpuStart;
+    server.stop();
+    return {requests / seconds, requests / cpu};
+}
+
+void printRow(const char *transport, const char *depth,
+              double requestsPerSecond, double requestsPerCpuSecond) {
+    std::cout << std::setw(10) << transport << std::setw(8) << depth
+              << std::setw(14) << std::fixed << std::setprecision(0)
+              << requestsPerSecond << std::setw(18) << requestsPerCpuSecond
+              << "\n";
+}
+
+} // namespace
+
+void runBinaryProtocolBench() {
+    std::cout << "Binary protocol: " << connections << " connections pushing "
+              << "to and popping from their own stacks\n";
+    std::cout << std::setw(10) << "transport" << std::setw(8) << "depth"
+              << std::setw(14) << "requests/s" << std::setw(18)
+              << "requests/cpu-s" << "\n";
+
+    bench::LoadOptions options;
+    options.workload = {"push/pop", 50, 50, 0, 16, 0};
+    options.loopback = true;
+    options.connections = connections;
+    options.duration = duration;
+    auto cpuStart = cpuSeconds();
+    auto http = bench::runLoad(options);
+    auto cpu = cpuSeconds() - cpuStart;
+    printRow("http", "1", http.requestsPerSecond, http.requests / cpu);
+
+    for (bool overUnix : {true, false}) {
+        for (unsigned depth : {1, 16, 128}) {
+            auto result = runBinaryLoad(overUnix, depth);
+            printRow(overUnix ? "unix" : "tcp", std::to_string(depth).c_str(),
+                     result.requestsPerSecond, result.requestsPerCpuSecond);
+        }
+    }
+    std::cout << std::endl;
+}
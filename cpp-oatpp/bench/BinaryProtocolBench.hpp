@@ -0,0 +1,11 @@
+#ifndef BinaryProtocolBench_hpp
+#define BinaryProtocolBench_hpp
+
+/**
+ * Compares the binary protocol with the HTTP API on push/pop, over a Unix
+ * domain socket and TCP with growing pipeline depths, reporting throughput
+ * and requests per second of CPU time.
+ */
+void runBinaryProtocolBench();
+
+#endif // BinaryProtocolBench_hpp
@@ -0,0 +1,176 @@
+#include "LoadGenerator.hpp"
+
+#include "app/BenchComponent.hpp"
+#include "app/StackApiBenchClient.hpp"
+
+#include "controller/StackAsyncController.hpp"
+#include "controller/StackController.hpp"
+
+#include "oatpp/web/client/HttpRequestExecutor.hpp"
+
+#include "oatpp-test/web/ClientServerTestRunner.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+namespace {
+
+bool isExpected(v_int32 status) {
+    // 405 is the answer to popping an empty stack.
+    return (status >= 200 && status < 300) || status == 405;
+}
+
+} // namespace
+
+LoadResult runLoad(const LoadOptions &options) {
+    BenchComponent component(options.async, options.loopback);
+    LoadResult result{};
+
+    oatpp::test::web::ClientServerTestRunner runner;
+    if (options.async) {
+        runner.addController(std::make_shared<StackAsyncController>());
+    } else {
+        runner.addController(std::make_shared<StackController>());
+    }
+
+    runner.run(
+        [&] {
+            OATPP_COMPONENT(
+                std::shared_ptr<oatpp::network::ClientConnectionProvider>,
+                clientConnectionProvider);
+            OATPP_COMPONENT(std::shared_ptr<oatpp::data::mapping::ObjectMapper>,
+                            objectMapper);
+            auto client = StackApiBenchClient::createShared(
+                oatpp::web::client::HttpRequestExecutor::createShared(
+                    clientConnectionProvider),
+                objectMapper);
+
+            auto &workload = options.workload;
+            auto stacks = workload.sharedStacks > 0 ? workload.sharedStacks
+                                                    : options.connections;
+            std::vector<oatpp::String> names;
+            for (unsigned i = 0; i < stacks; ++i) {
+                names.push_back("load-" + std::to_string(i));
+                client->create(names.back());
+            }
+            oatpp::String value(std::string(workload.valueSize, 'v'));
+
+            std::mutex resultLock;
+            std::vector<double> latencies;
+            auto deadline = Clock::now() + options.duration;
+
+            auto seconds = runThreads(options.connections, [&](unsigned index) {
+                auto connection = client->getConnection();
+                XorShift random(index);
+                oatpp::String copyName("load-copy-" + std::to_string(index));
+                std::vector<double> localLatencies;
+                std::size_t errors = 0;
+
+                auto send = [&](auto request) {
+                    auto start = Clock::now();
+                    try {
+                        auto response = request();
+                        response->readBodyToString();
+                        if (!isExpected(response->getStatusCode())) {
+                            ++errors;
+                        }
+                    } catch (const std::exception &) {
+                        ++errors;
+                        connection = client->getConnection();
+                    }
+                    localLatencies.push_back(
+                        std::chrono::duration<double, std::micro>(Clock::now() -
+                                                                  start)
+                            .count());
+                };
+
+                while (Clock::now() < deadline) {
+                    auto &name = workload.sharedStacks > 0
+                                     ? names[random.nextBelow(stacks)]
+                                     : names[index];
+                    auto op = random.nextBelow(100);
+                    auto popEnd = workload.pushPercent + workload.popPercent;
+                    if (op < workload.pushPercent) {
+                        send([&] {
+                            return client->push(name, value, connection);
+                        });
+                    } else if (op < popEnd) {
+                        send([&] { return client->pop(name, connection); });
+                    } else if (op < popEnd + workload.topPercent) {
+                        send([&] { return client->getTop(name, connection); });
+                    } else {
+                        send([&] {
+                            return client->copy(name, copyName, connection);
+                        });
+                        send([&] {
+                            return client->remove(copyName, connection);
+                        });
+                    }
+                }
+
+                std::lock_guard _lock(resultLock);
+                latencies.insert(latencies.end(), localLatencies.begin(),
+                                 localLatencies.end());
+                result.errors += errors;
+            });
+
+            result.requests = latencies.size();
+            result.requestsPerSecond = latencies.size() / seconds;
+            result.latency = summarize(latencies);
+        },
+        std::chrono::minutes(10));
+
+    OATPP_COMPONENT(std::shared_ptr<oatpp::async::Executor>, executor);
+    executor->waitTasksFinished();
+    executor->stop();
+    executor->join();
+    return result;
+}
+
+} // namespace bench
+
+void runHttpLoadBench() {
+    const bench::Workload workloads[] = {
+        {"push/pop", 50, 50, 0, 16, 0},
+        {"read-heavy", 5, 5, 90, 16, 64},
+        {"hot stack", 45, 45, 8, 16, 1},
+        {"large top", 5, 5, 90, 16384, 64},
+    };
+
+    std::cout << "HTTP load: sync server, keep-alive connections, "
+              << "latencies in us\n";
+    std::cout << std::setw(12) << "workload" << std::setw(10) << "transport"
+              << std::setw(8) << "conns" << std::setw(12) << "requests/s"
+              << std::setw(9) << "errors" << std::setw(9) << "p50"
+              << std::setw(9) << "p90" << std::setw(9) << "p99"
+              << std::setw(9) << "p99.9" << std::setw(10) << "max" << "\n";
+
+    for (auto &workload : workloads) {
+        for (bool loopback : {false, true}) {
+            for (unsigned connections : {1, 16, 64}) {
+                bench::LoadOptions options;
+                options.workload = workload;
+                options.loopback = loopback;
+                options.connections = connections;
+                auto result = bench::runLoad(options);
+                std::cout << std::setw(12) << workload.name << std::setw(10)
+                          << (loopback ? "tcp" : "virtual") << std::setw(8)
+                          << connections << std::setw(12) << std::fixed
+                          << std::setprecision(0) << result.requestsPerSecond
+                          << std::setw(9) << result.errors
+                          << std::setprecision(1) << std::setw(9)
+                          << result.latency.p50 << std::setw(9)
+                          << result.latency.p90 << std::setw(9)
+                          << result.latency.p99 << std::setw(9)
+                          << result.latency.p999 << std::setw(10)
+                          << result.latency.max << "\n";
+            }
+        }
+    }
+    std::cout << std::endl;
+}
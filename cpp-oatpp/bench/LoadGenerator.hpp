@@ -0,0 +1,59 @@
+#ifndef LoadGenerator_hpp
+#define LoadGenerator_hpp
+
+#include "Bench.hpp"
+
+#include <chrono>
+#include <cstddef>
+
+namespace bench {
+
+/**
+ * Mix of requests sent by the load generator. The percentages of push, pop
+ * and top requests add up to at most 100, the rest being copies of a stack,
+ * each followed by the removal of the copy.
+ */
+struct Workload {
+    const char *name;
+    unsigned pushPercent;
+    unsigned popPercent;
+    unsigned topPercent;
+    // Size of the pushed values in bytes.
+    std::size_t valueSize;
+    // Number of stacks shared by all the connections, or 0 for a stack per
+    // connection.
+    unsigned sharedStacks;
+};
+
+struct LoadOptions {
+    Workload workload;
+    bool async = false;
+    // TCP over the loopback interface instead of oatpp virtual interface.
+    bool loopback = false;
+    unsigned connections = 16;
+    std::chrono::milliseconds duration{2000};
+};
+
+struct LoadResult {
+    std::size_t requests;
+    // Requests failed or answered with a status other than 2xx and 405.
+    std::size_t errors;
+    double requestsPerSecond;
+    LatencySummary latency;
+};
+
+/**
+ * Serves the stack API with a fresh map, and drives it with the workload from
+ * a keep-alive connection per client thread for the duration of the run.
+ */
+LoadResult runLoad(const LoadOptions &options);
+
+} // namespace bench
+
+/**
+ * Drives the synchronous server with a set of workloads over both transports,
+ * reporting throughput and latency percentiles.
+ */
+void runHttpLoadBench();
+
+#endif // LoadGenerator_hpp
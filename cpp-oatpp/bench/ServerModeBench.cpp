@@ -0,0 +1,31 @@
+#include "ServerModeBench.hpp"
+
+#include "LoadGenerator.hpp"
+
+#include <iomanip>
+#include <iostream>
+
+void runServerModeBench() {
+    std::cout << "Server modes: keep-alive connections pushing to and popping "
+              << "from their own stacks\n";
+    std::cout << std::setw(8) << "mode" << std::setw(14) << "connections"
+              << std::setw(14) << "requests/s" << std::setw(12) << "p50 us"
+              << std::setw(12) << "p99 us" << "\n";
+
+    for (unsigned connections : {16, 64, 256, 1024}) {
+        for (bool async : {false, true}) {
+            bench::LoadOptions options;
+            options.workload = {"push/pop", 50, 50, 0, 5, 0};
+            options.async = async;
+            options.connections = connections;
+            auto result = bench::runLoad(options);
+            std::cout << std::setw(8) << (async ? "async" : "sync")
+                      << std::setw(14) << connections << std::setw(14)
+                      << std::fixed << std::setprecision(0)
+                      << result.requestsPerSecond << std::setw(12)
+                      << std::setprecision(1) << result.latency.p50
+                      << std::setw(12) << result.latency.p99 << "\n";
+        }
+    }
+    std::cout << std::endl;
+}
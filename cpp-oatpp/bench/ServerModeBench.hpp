@@ -0,0 +1,11 @@
+#ifndef ServerModeBench_hpp
+#define ServerModeBench_hpp
+
+/**
+ * Compares the sync and async server modes with a growing number of
+ * concurrent keep-alive connections, reporting throughput and latency
+ * percentiles.
+ */
+void runServerModeBench();
+
+#endif // ServerModeBench_hpp
@@ -0,0 +1,125 @@
+#include "SnapshotBench.hpp"
+
+#include "Bench.hpp"
+
+#include "Snapshot.hpp"
+#include "StringStackMap.hpp"
+#include "WriteAheadLog.hpp"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace {
+
+constexpr int loadStackCount = 100;
+// Values pushed onto each copy, on top of the tail it shares.
+constexpr int copyDepth = 10;
+
+using Durability = WriteAheadLog::Durability;
+
+std::string createTempFile() {
+    char path[] = "/tmp/stack-server-bench-XXXXXX";
+    auto fd = ::mkstemp(path);
+    ::close(fd);
+    return path;
+}
+
+template <typename Body> double measureMs(Body body) {
+    auto start = bench::Clock::now();
+    body();
+    return std::chrono::duration<double, std::milli>(bench::Clock::now() -
+                                                     start)
+        .count();
+}
+
+// Reads the whole file, as the lower bound of the time of a load.
+std::size_t readFile(const std::string &path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    std::string buffer(1 << 20, '\0');
+    std::size_t total = 0;
+    for (ssize_t count; (count = ::read(fd, &buffer[0], buffer.size())) > 0;) {
+        total += count;
+    }
+    ::close(fd);
+    return total;
+}
+
+struct LoadTimes {
+    std::uint64_t nodes;
+    double megabytes;
+    double readMs;
+    double loadMs;
+    double replayMs;
+};
+
+// Builds `loadStackCount` stacks of `depth` values and a copy of each with
+// `copyDepth` values pushed on top, logged to a write-ahead log, and times
+// loading them back from a snapshot and from the log.
+LoadTimes runLoad(int depth) {
+    auto walPath = createTempFile();
+    auto snapshotPath = createTempFile();
+    LoadTimes times{};
+    {
+        StringStackMap map;
+        map.setLog(std::make_shared<WriteAheadLog>(
+            walPath, Durability::None, std::chrono::milliseconds(10)));
+        oatpp::String value("a value of 24 characters");
+        for (int i = 0; i < loadStackCount; ++i) {
+            auto name = "stack-" + std::to_string(i);
+            map.create(oatpp::String(name));
+            for (int j = 0; j < depth; ++j) {
+                map.push(name, oatpp::String(value));
+            }
+            map.copy(name, oatpp::String("copy-" + std::to_string(i)));
+            for (int j = 0; j < copyDepth; ++j) {
+                map.push("copy-" + std::to_string(i), oatpp::String(value));
+            }
+        }
+        times.nodes = Snapshot::write(map, snapshotPath).nodeCount;
+    }
+
+    times.readMs = measureMs([&] {
+        times.megabytes = readFile(snapshotPath) / double(1 << 20);
+    });
+    {
+        StringStackMap map;
+        times.loadMs = measureMs([&] { Snapshot::load(map, snapshotPath); });
+    }
+    {
+        StringStackMap map;
+        WriteAheadLog log(walPath, Durability::None,
+                          std::chrono::milliseconds(10));
+        times.replayMs = measureMs([&] { log.replay(map); });
+    }
+
+    ::unlink(walPath.c_str());
+    ::unlink(snapshotPath.c_str());
+    return times;
+}
+
+} // namespace
+
+void runSnapshotLoadBench() {
+    std::cout << "Startup: " << loadStackCount
+              << " stacks and a copy of each, loaded from a snapshot or "
+                 "replayed from the log\n";
+    std::cout << std::setw(8) << "depth" << std::setw(12) << "nodes"
+              << std::setw(12) << "file MB" << std::setw(12) << "read ms"
+              << std::setw(12) << "load ms" << std::setw(12) << "replay ms"
+              << "\n";
+    for (int depth : {100, 1000, 10000}) {
+        auto times = runLoad(depth);
+        std::cout << std::setw(8) << depth << std::setw(12) << times.nodes
+                  << std::fixed << std::setprecision(1) << std::setw(12)
+                  << times.megabytes << std::setw(12) << times.readMs
+                  << std::setw(12) << times.loadMs << std::setw(12)
+                  << times.replayMs << "\n";
+    }
+    std::cout << std::endl;
+}
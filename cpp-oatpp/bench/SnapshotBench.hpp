@@ -0,0 +1,11 @@
+#ifndef SnapshotBench_hpp
+#define SnapshotBench_hpp
+
+/**
+ * Compares the startup time of loading a snapshot of stacks with replaying
+ * the write-ahead log they were built by, and with only reading the file of
+ * the snapshot.
+ */
+void runSnapshotLoadBench();
+
+#endif // SnapshotBench_hpp
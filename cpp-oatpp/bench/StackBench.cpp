@@ -0,0 +1,190 @@
+#include "StackBench.hpp"
+
+#include "Bench.hpp"
+
+#include "LockFreeStack.hpp"
+#include "NodePool.hpp"
+#include "SmallString.hpp"
+#include "StackMap.hpp"
+
+#include "oatpp/core/Types.hpp"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace {
+
+constexpr int opsPerThread = 500000;
+
+template <typename S> double runHotStack(unsigned threads) {
+    S stack;
+    auto seconds = bench::runThreads(threads, [&](unsigned index) {
+        bench::XorShift random(index);
+        oatpp::String value("value");
+        for (int i = 0; i < opsPerThread; ++i) {
+            auto op = random.nextBelow(10);
+            try {
+                if (op < 4) {
+                    stack.push(oatpp::String(value));
+                } else if (op < 8) {
+                    stack.pop();
+                } else {
+                    stack.getTop();
+                }
+            } catch (StackEmpty) {
+            }
+        }
+    });
+    return double(opsPerThread) * threads / seconds;
+}
+
+// Each thread works on its own stack, so the allocator is the only thing
+// the threads share.
+template <typename S> double runPushPopBursts(unsigned threads) {
+    auto seconds = bench::runThreads(threads, [&](unsigned index) {
+        S stack;
+        oatpp::String value("value");
+        for (int i = 0; i < opsPerThread / 64; ++i) {
+            for (int j = 0; j < 32; ++j) {
+                stack.push(oatpp::String(value));
+            }
+            for (int j = 0; j < 32; ++j) {
+                stack.pop();
+            }
+        }
+    });
+    return double(opsPerThread) * threads / seconds;
+}
+
+constexpr int layoutValueCount = 100000;
+
+// Bytes of the heap in use, or 0 where the allocator cannot tell.
+std::size_t heapInUse() {
+#if defined(__GLIBC__) &&                                                      \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+    return static_cast<unsigned>(mallinfo().uordblks);
+#else
+    return 0;
+#endif
+}
+
+oatpp::String toResponse(const oatpp::String &value) { return value; }
+oatpp::String toResponse(const SmallString &value) { return value.toString(); }
+
+struct LayoutResult {
+    double bytesPerValue;
+    double topNs;
+    double popNs;
+};
+
+// Fills a stack with values of `valueSize` bytes, then measures the heap it
+// takes and how long reading and popping the values into the `oatpp::String`
+// of a response take.
+template <typename T> LayoutResult runValueLayout(std::size_t valueSize) {
+    std::string content(valueSize, 'v');
+    LayoutResult result{};
+
+    auto heapBefore = heapInUse();
+    {
+        Stack<T> stack;
+        for (int i = 0; i < layoutValueCount; ++i) {
+            stack.push(T(content.data(), content.size()));
+        }
+        result.bytesPerValue =
+            double(heapInUse() - heapBefore) / layoutValueCount;
+
+        std::size_t checksum = 0;
+        auto start = bench::Clock::now();
+        for (int i = 0; i < layoutValueCount; ++i) {
+            checksum += toResponse(stack.getTop())->size();
+        }
+        auto topEnd = bench::Clock::now();
+        for (int i = 0; i < layoutValueCount; ++i) {
+            checksum += toResponse(stack.pop())->size();
+        }
+        auto popEnd = bench::Clock::now();
+
+        if (checksum != 2 * layoutValueCount * valueSize) {
+            std::abort();
+        }
+        result.topNs = std::chrono::duration<double, std::nano>(topEnd - start)
+                           .count() /
+                       layoutValueCount;
+        result.popNs = std::chrono::duration<double, std::nano>(popEnd - topEnd)
+                           .count() /
+                       layoutValueCount;
+    }
+    return result;
+}
+
+} // namespace
+
+void runStackHotBench() {
+    std::cout << "Single hot stack: 40% push / 40% pop / 20% top\n";
+    std::cout << std::setw(10) << "threads" << std::setw(16) << "mutex Mops/s"
+              << std::setw(20) << "lock-free Mops/s" << "\n";
+
+    for (auto threads : bench::threadCounts()) {
+        auto mutexOps = runHotStack<Stack<oatpp::String>>(threads);
+        auto lockFreeOps = runHotStack<LockFreeStack<oatpp::String>>(threads);
+        std::cout << std::setw(10) << threads << std::setw(16) << std::fixed
+                  << std::setprecision(3) << mutexOps / 1e6 << std::setw(20)
+                  << lockFreeOps / 1e6 << "\n";
+    }
+    std::cout << std::endl;
+}
+
+void runNodeAllocationBench() {
+    using PooledStack = Stack<oatpp::String, PoolAllocator<oatpp::String>>;
+
+    std::cout << "Node allocation: "
+              << "bursts of 32 pushes and 32 pops per thread\n";
+    std::cout << std::setw(10) << "threads" << std::setw(16) << "malloc Mops/s"
+              << std::setw(16) << "pool Mops/s" << "\n";
+
+    auto before = PooledStack::NodeAllocator::getStats();
+    for (auto threads : bench::threadCounts()) {
+        auto mallocOps = runPushPopBursts<Stack<oatpp::String>>(threads);
+        auto poolOps = runPushPopBursts<PooledStack>(threads);
+        std::cout << std::setw(10) << threads << std::setw(16) << std::fixed
+                  << std::setprecision(3) << mallocOps / 1e6 << std::setw(16)
+                  << poolOps / 1e6 << "\n";
+    }
+    auto after = PooledStack::NodeAllocator::getStats();
+    std::cout << "pool allocations = " << after.allocations - before.allocations
+              << ", upstream allocations = "
+              << after.upstreamAllocations - before.upstreamAllocations
+              << ", batch transfers = " << after.transfers - before.transfers
+              << "\n"
+              << std::endl;
+}
+
+void runValueLayoutBench() {
+    std::cout << "Value layout: " << layoutValueCount
+              << " values, shared oatpp::String vs inline SmallString\n";
+    std::cout << std::setw(8) << "bytes" << std::setw(14) << "shared B/val"
+              << std::setw(14) << "inline B/val" << std::setw(14)
+              << "shared top ns" << std::setw(14) << "inline top ns"
+              << std::setw(14) << "shared pop ns" << std::setw(14)
+              << "inline pop ns" << "\n";
+
+    for (std::size_t valueSize : {8, 32, 39, 64, 256}) {
+        auto shared = runValueLayout<oatpp::String>(valueSize);
+        auto small = runValueLayout<SmallString>(valueSize);
+        std::cout << std::setw(8) << valueSize << std::fixed
+                  << std::setprecision(1) << std::setw(14)
+                  << shared.bytesPerValue << std::setw(14)
+                  << small.bytesPerValue << std::setw(14) << shared.topNs
+                  << std::setw(14) << small.topNs << std::setw(14)
+                  << shared.popNs << std::setw(14) << small.popNs << "\n";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,23 @@
+#ifndef StackBench_hpp
+#define StackBench_hpp
+
+/**
+ * Compares `Stack` with `LockFreeStack` when all threads hammer a single
+ * stack.
+ */
+void runStackHotBench();
+
+/**
+ * Compares the global allocator with `PoolAllocator` for the nodes of
+ * push/pop-heavy stacks, and reports the allocation counts of the pool.
+ */
+void runNodeAllocationBench();
+
+/**
+ * Compares stacks of shared `oatpp::String` values with stacks of
+ * `SmallString` values, stored inline when short: the heap taken per value,
+ * and the latency of `getTop` and `pop` up to the string of the response.
+ */
+void runValueLayoutBench();
+
+#endif // StackBench_hpp
@@ -0,0 +1,272 @@
+#include "StackMapBench.hpp"
+
+#include "Bench.hpp"
+
+#include "StringStackMap.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int stackCount = 10000;
+constexpr int opsPerThread = 200000;
+
+double runMixedWorkload(std::size_t shards, unsigned threads) {
+    StringStackMap map(shards);
+    std::vector<oatpp::String> names;
+    for (int i = 0; i < stackCount; ++i) {
+        names.push_back("stack-" + std::to_string(i));
+        map.create(oatpp::String(names.back()));
+    }
+
+    auto seconds = bench::runThreads(threads, [&](unsigned index) {
+        bench::XorShift random(index);
+        oatpp::String value("value");
+        oatpp::String copyName("copy-" + std::to_string(index));
+
+        for (int i = 0; i < opsPerThread; ++i) {
+            auto &name = names[random.nextBelow(stackCount)];
+            auto op = random.nextBelow(100);
+            try {
+                if (op < 45) {
+                    map.getStack(name).second.push(oatpp::String(value));
+                } else if (op < 90) {
+                    map.getStack(name).second.pop();
+                } else if (op < 98) {
+                    map.getStack(name).second.getTop();
+                } else {
+                    // Writers to the map take the shard lock exclusively.
+                    map.copy(name, oatpp::String(copyName));
+                    map.remove(copyName);
+                }
+            } catch (StackEmpty) {
+            }
+        }
+    });
+    return double(opsPerThread) * threads / seconds;
+}
+
+enum class Op { Push, Pop, Top, Copy };
+
+// Which stacks the threads operate on.
+enum class Pattern {
+    // All the threads on one stack.
+    Hot,
+    // Each thread on its own stack.
+    Private,
+    // Each operation on a random stack out of `stackCount`.
+    Spread,
+};
+
+constexpr int matrixOpsPerThread = 100000;
+
+const char *nameOf(Op op) {
+    switch (op) {
+    case Op::Push:
+        return "push";
+    case Op::Pop:
+        return "pop";
+    case Op::Top:
+        return "top";
+    default:
+        return "copy+remove";
+    }
+}
+
+const char *nameOf(Pattern pattern) {
+    switch (pattern) {
+    case Pattern::Hot:
+        return "hot";
+    case Pattern::Private:
+        return "private";
+    default:
+        return "spread";
+    }
+}
+
+// Runs `matrixOpsPerThread` operations `op` per thread, on the stacks picked
+// by `pattern`. The stacks are filled beforehand so that pops find values.
+double runSingleOp(Op op, Pattern pattern, unsigned threads) {
+    std::size_t stacks = pattern == Pattern::Hot       ? 1
+                         : pattern == Pattern::Private ? threads
+                                                       : stackCount;
+    StringStackMap map(64);
+    std::vector<oatpp::String> names;
+    // Enough values for the pops to rarely run into an empty stack.
+    auto fill = op == Op::Pop ? matrixOpsPerThread * threads / stacks + 64
+                              : 1;
+    for (std::size_t i = 0; i < stacks; ++i) {
+        names.push_back("stack-" + std::to_string(i));
+        map.create(oatpp::String(names.back()));
+        map.pushMany(names.back(), std::vector<SmallString>(fill, "value"));
+    }
+
+    auto seconds = bench::runThreads(threads, [&](unsigned index) {
+        bench::XorShift random(index);
+        oatpp::String copyName("copy-" + std::to_string(index));
+        for (int i = 0; i < matrixOpsPerThread; ++i) {
+            auto &name = pattern == Pattern::Hot       ? names[0]
+                         : pattern == Pattern::Private ? names[index]
+                                                       : names[random.nextBelow(
+                                                             stacks)];
+            try {
+                switch (op) {
+                case Op::Push:
+                    map.push(name, SmallString("value"));
+                    break;
+                case Op::Pop:
+                    map.pop(name);
+                    break;
+                case Op::Top:
+                    map.getTop(name);
+                    break;
+                case Op::Copy:
+                    map.copy(name, oatpp::String(copyName));
+                    map.remove(copyName);
+                    break;
+                }
+            } catch (StackEmpty) {
+            }
+        }
+    });
+    return double(matrixOpsPerThread) * threads / seconds;
+}
+
+constexpr int errorOpsPerThread = 200000;
+
+// Runs `errorOpsPerThread` operations per thread, of which `errorPercent`
+// fail, alternately popping an empty stack and reading the top of a missing
+// one. The others push a value to a stack of the thread, which the next pops.
+double runErrorPath(bool tryApi, unsigned errorPercent, unsigned threads) {
+    StringStackMap map(64);
+    std::vector<oatpp::String> names, emptyNames;
+    for (unsigned i = 0; i < threads; ++i) {
+        names.push_back("stack-" + std::to_string(i));
+        map.create(oatpp::String(names.back()));
+        emptyNames.push_back("empty-" + std::to_string(i));
+        map.create(oatpp::String(emptyNames.back()));
+    }
+
+    std::size_t failures = 0;
+    std::mutex failuresLock;
+    auto seconds = bench::runThreads(threads, [&](unsigned index) {
+        bench::XorShift random(index);
+        auto &name = names[index];
+        auto &emptyName = emptyNames[index];
+        oatpp::String missing("missing-" + std::to_string(index));
+        std::size_t failed = 0;
+        bool pushed = false;
+        for (int i = 0; i < errorOpsPerThread; ++i) {
+            auto fail = random.nextBelow(100) < errorPercent;
+            if (tryApi) {
+                if (fail) {
+                    failed += i % 2 == 0 ? !map.tryPop(emptyName)
+                                         : !map.tryGetTop(missing);
+                } else if (pushed) {
+                    map.tryPop(name);
+                } else {
+                    map.tryPush(name, SmallString("value"));
+                }
+            } else {
+                try {
+                    if (fail && i % 2 == 0) {
+                        map.pop(emptyName);
+                    } else if (fail) {
+                        map.getTop(missing);
+                    } else if (pushed) {
+                        map.pop(name);
+                    } else {
+                        map.push(name, SmallString("value"));
+                    }
+                } catch (const StackEmpty &) {
+                    ++failed;
+                } catch (const StackNameNotFound &) {
+                    ++failed;
+                }
+            }
+            if (!fail) {
+                pushed = !pushed;
+            }
+        }
+        std::lock_guard _lock(failuresLock);
+        failures += failed;
+    });
+    // Guards against the failing operations being optimized away.
+    if (errorPercent > 0 && failures == 0) {
+        std::cerr << "No operation failed\n";
+    }
+    return double(errorOpsPerThread) * threads / seconds;
+}
+
+} // namespace
+
+void runStackMapContentionBench() {
+    std::cout << "StackMap contention: " << stackCount << " stacks, "
+              << "45% push / 45% pop / 8% top / 2% copy+remove\n";
+    std::cout << std::setw(8) << "shards" << std::setw(10) << "threads"
+              << std::setw(16) << "Mops/s" << "\n";
+
+    for (std::size_t shards : {1, 16, 64}) {
+        for (auto threads : bench::threadCounts()) {
+            auto opsPerSecond = runMixedWorkload(shards, threads);
+            std::cout << std::setw(8) << shards << std::setw(10) << threads
+                      << std::setw(16) << std::fixed << std::setprecision(3)
+                      << opsPerSecond / 1e6 << "\n";
+        }
+    }
+    std::cout << std::endl;
+}
+
+void runStackMapOpsBench() {
+    std::cout << "StackMap operations: one operation per run, on one hot "
+              << "stack, a private stack per thread, or " << stackCount
+              << " stacks picked at random\n";
+    std::cout << std::setw(14) << "op" << std::setw(10) << "pattern"
+              << std::setw(10) << "threads" << std::setw(16) << "Mops/s"
+              << "\n";
+
+    for (auto op : {Op::Push, Op::Pop, Op::Top, Op::Copy}) {
+        for (auto pattern : {Pattern::Hot, Pattern::Private, Pattern::Spread}) {
+            for (auto threads : bench::threadCounts()) {
+                auto opsPerSecond = runSingleOp(op, pattern, threads);
+                std::cout << std::setw(14) << nameOf(op) << std::setw(10)
+                          << nameOf(pattern) << std::setw(10) << threads
+                          << std::setw(16) << std::fixed
+                          << std::setprecision(3) << opsPerSecond / 1e6
+                          << "\n";
+            }
+        }
+    }
+    std::cout << std::endl;
+}
+
+void runStackMapErrorPathBench() {
+    std::cout << "StackMap error path: throwing operations against their try "
+              << "variants, a private stack per thread\n";
+    std::cout << std::setw(8) << "errors" << std::setw(10) << "threads"
+              << std::setw(16) << "throw Mops/s" << std::setw(16)
+              << "try Mops/s" << "\n";
+
+    // Unwinding may contend between threads, so it is also measured with a
+    // thread per CPU.
+    std::vector<unsigned> threadCounts{1};
+    if (std::thread::hardware_concurrency() > 1) {
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+    for (unsigned errorPercent : {0, 10, 50, 90}) {
+        for (auto threads : threadCounts) {
+            auto throwing = runErrorPath(false, errorPercent, threads);
+            auto trying = runErrorPath(true, errorPercent, threads);
+            std::cout << std::setw(7) << errorPercent << "%" << std::setw(10)
+                      << threads << std::setw(16) << std::fixed
+                      << std::setprecision(3) << throwing / 1e6
+                      << std::setw(16) << trying / 1e6 << "\n";
+        }
+    }
+    std::cout << std::endl;
+}
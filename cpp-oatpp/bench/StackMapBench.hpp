@@ -0,0 +1,24 @@
+#ifndef StackMapBench_hpp
+#define StackMapBench_hpp
+
+/**
+ * Measures the throughput of mixed operations on many independent stacks of a
+ * StackMap with different shard counts, scaling the number of threads.
+ */
+void runStackMapContentionBench();
+
+/**
+ * Measures the throughput of each operation of a StackMap on its own, with
+ * all the threads on one stack, on a stack per thread, or spread over many
+ * stacks, scaling the number of threads.
+ */
+void runStackMapOpsBench();
+
+/**
+ * Compares the throwing operations of a StackMap with their `try` variants
+ * on workloads where a growing share of the operations fail, popping an
+ * empty stack or reading a missing one.
+ */
+void runStackMapErrorPathBench();
+
+#endif // StackMapBench_hpp
@@ -0,0 +1,132 @@
+#ifndef BenchComponent_hpp
+#define BenchComponent_hpp
+
+#include "StringStackMap.hpp"
+
+#include "oatpp/web/server/AsyncHttpConnectionHandler.hpp"
+#include "oatpp/web/server/HttpConnectionHandler.hpp"
+
+#include "oatpp/network/tcp/client/ConnectionProvider.hpp"
+#include "oatpp/network/tcp/server/ConnectionProvider.hpp"
+#include "oatpp/network/virtual_/Interface.hpp"
+#include "oatpp/network/virtual_/client/ConnectionProvider.hpp"
+#include "oatpp/network/virtual_/server/ConnectionProvider.hpp"
+
+#include "oatpp/parser/json/mapping/ObjectMapper.hpp"
+
+#include "oatpp/core/macro/component.hpp"
+
+/**
+ * Benchmark Components config, serving in either server mode over oatpp
+ * virtual network interface, or over TCP on the loopback interface
+ */
+class BenchComponent {
+public:
+    /**
+     * Port listened on over the loopback interface.
+     */
+    static constexpr v_uint16 loopbackPort = 8765;
+
+    explicit BenchComponent(bool async, bool loopback = false)
+        : async(async), loopback(loopback) {}
+
+private:
+    // Declared before the components, which are initialized in order.
+    bool async;
+    bool loopback;
+
+public:
+    /**
+     *  Create StackMap component which holds all the stacks
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<StringStackMap>, stackMap)
+    ([] { return std::make_shared<StringStackMap>(16); }());
+
+    /**
+     * Create oatpp virtual network interface for benchmark networking
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::network::virtual_::Interface>,
+                           virtualInterface)
+    ([] {
+        return oatpp::network::virtual_::Interface::obtainShared("benchhost");
+    }());
+
+    /**
+     * Create server ConnectionProvider of oatpp virtual or loopback
+     * connections
+     */
+    OATPP_CREATE_COMPONENT(
+        std::shared_ptr<oatpp::network::ServerConnectionProvider>,
+        serverConnectionProvider)
+    ([this]() -> std::shared_ptr<oatpp::network::ServerConnectionProvider> {
+        if (this->loopback) {
+            return oatpp::network::tcp::server::ConnectionProvider::
+                createShared({"127.0.0.1", loopbackPort,
+                              oatpp::network::Address::IP_4});
+        }
+        OATPP_COMPONENT(std::shared_ptr<oatpp::network::virtual_::Interface>,
+                        _interface);
+        return oatpp::network::virtual_::server::ConnectionProvider::
+            createShared(_interface);
+    }());
+
+    /**
+     * Create client ConnectionProvider of oatpp virtual or loopback
+     * connections
+     */
+    OATPP_CREATE_COMPONENT(
+        std::shared_ptr<oatpp::network::ClientConnectionProvider>,
+        clientConnectionProvider)
+    ([this]() -> std::shared_ptr<oatpp::network::ClientConnectionProvider> {
+        if (this->loopback) {
+            return oatpp::network::tcp::client::ConnectionProvider::
+                createShared({"127.0.0.1", loopbackPort,
+                              oatpp::network::Address::IP_4});
+        }
+        OATPP_COMPONENT(std::shared_ptr<oatpp::network::virtual_::Interface>,
+                        _interface);
+        return oatpp::network::virtual_::client::ConnectionProvider::
+            createShared(_interface);
+    }());
+
+    /**
+     *  Create Router component
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::web::server::HttpRouter>,
+                           httpRouter)
+    ([] { return oatpp::web::server::HttpRouter::createShared(); }());
+
+    /**
+     *  Create async Executor component, only used in async mode
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::async::Executor>, executor)
+    ([] { return std::make_shared<oatpp::async::Executor>(); }());
+
+    /**
+     *  Create ConnectionHandler component of the benchmarked server mode
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::network::ConnectionHandler>,
+                           serverConnectionHandler)
+    ([this]() -> std::shared_ptr<oatpp::network::ConnectionHandler> {
+        OATPP_COMPONENT(std::shared_ptr<oatpp::web::server::HttpRouter>,
+                        router); // get Router component
+        if (this->async) {
+            OATPP_COMPONENT(std::shared_ptr<oatpp::async::Executor>, executor);
+            return oatpp::web::server::AsyncHttpConnectionHandler::
+                createShared(router, executor);
+        }
+        return oatpp::web::server::HttpConnectionHandler::createShared(router);
+    }());
+
+    /**
+     *  Create ObjectMapper component to serialize/deserialize DTOs in
+     * Contoller's API
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::data::mapping::ObjectMapper>,
+                           apiObjectMapper)
+    ([] {
+        return oatpp::parser::json::mapping::ObjectMapper::createShared();
+    }());
+};
+
+#endif // BenchComponent_hpp
@@ -0,0 +1,45 @@
+
+#ifndef StackApiBenchClient_hpp
+#define StackApiBenchClient_hpp
+
+#include "oatpp/core/macro/codegen.hpp"
+#include "oatpp/web/client/ApiClient.hpp"
+
+/* Begin Api Client code generation */
+#include OATPP_CODEGEN_BEGIN(ApiClient)
+
+/**
+ * API client used by the benchmarks to drive the server.
+ */
+class StackApiBenchClient : public oatpp::web::client::ApiClient {
+
+    API_CLIENT_INIT(StackApiBenchClient)
+
+    API_CALL("GET", "/{name}/top", getTop, PATH(String, name))
+
+    API_CALL("POST", "/{name}/push", push, PATH(String, name),
+             BODY_STRING(String, body, "text/plain"))
+
+    API_CALL("POST", "/{name}/pop", pop, PATH(String, name))
+
+    API_CALL("POST", "/{name}/push-many", pushMany, PATH(String, name),
+             BODY_STRING(String, body, "application/octet-stream"))
+
+    API_CALL("POST", "/{name}/pop-many", popMany, PATH(String, name),
+             QUERY(UInt32, count))
+
+    API_CALL("POST", "/{name}", create, PATH(String, name))
+
+    API_CALL("DELETE", "/{name}", remove, PATH(String, name))
+
+    API_CALL("POST", "/{from}/copy", copy, PATH(String, from),
+             QUERY(String, to))
+
+    API_CALL("POST", "/{from}/fork", fork, PATH(String, from),
+             BODY_STRING(String, body, "application/octet-stream"))
+};
+
+/* End Api Client code generation */
+#include OATPP_CODEGEN_END(ApiClient)
+
+#endif // StackApiBenchClient_hpp
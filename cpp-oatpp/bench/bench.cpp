@@ -0,0 +1,51 @@
+#include "BinaryProtocolBench.hpp"
+#include "LoadGenerator.hpp"
+#include "ServerModeBench.hpp"
+#include "SnapshotBench.hpp"
+#include "StackBench.hpp"
+#include "StackMapBench.hpp"
+
+#include "oatpp/core/base/Environment.hpp"
+
+#include <cstring>
+#include <iostream>
+
+void runMicroBenches() {
+    runStackMapOpsBench();
+    runStackMapContentionBench();
+    runStackMapErrorPathBench();
+    runStackHotBench();
+    runNodeAllocationBench();
+    runValueLayoutBench();
+    runSnapshotLoadBench();
+}
+
+void runHttpBenches() {
+    runHttpLoadBench();
+    runServerModeBench();
+    runBinaryProtocolBench();
+}
+
+int main(int argc, char **argv) {
+    // The suite to run: `micro`, `http`, or both by default.
+    const char *suite = argc > 1 ? argv[1] : "all";
+    bool all = std::strcmp(suite, "all") == 0;
+    if (!all && std::strcmp(suite, "micro") != 0 &&
+        std::strcmp(suite, "http") != 0) {
+        std::cerr << "Usage: " << argv[0] << " [micro|http|all]\n";
+        return 1;
+    }
+
+    oatpp::base::Environment::init();
+
+    if (all || std::strcmp(suite, "micro") == 0) {
+        runMicroBenches();
+    }
+    if (all || std::strcmp(suite, "http") == 0) {
+        runHttpBenches();
+    }
+
+    oatpp::base::Environment::destroy();
+
+    return 0;
+}
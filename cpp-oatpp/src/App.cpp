@@ -1,8 +1,7 @@
 #include "./AppComponent.hpp"
+#include "./controller/StackAsyncController.hpp"
 #include "./controller/StackController.hpp"
 
-#include "oatpp/network/Server.hpp"
-
 #include <iostream>
 
 void run() {
@@ -13,27 +12,51 @@ void run() {
     /* Get router component */
     OATPP_COMPONENT(std::shared_ptr<oatpp::web::server::HttpRouter>, router);
 
-    /* Create StackController and add all of its endpoints to router */
-    router->addController(std::make_shared<StackController>());
-
-    /* Get connection handler component */
-    OATPP_COMPONENT(std::shared_ptr<oatpp::network::ConnectionHandler>,
-                    connectionHandler);
-
-    /* Get connection provider component */
-    OATPP_COMPONENT(std::shared_ptr<oatpp::network::ServerConnectionProvider>,
-                    connectionProvider);
+    /* Create the controller matching the connection handler and add all of
+     * its endpoints to router */
+    OATPP_COMPONENT(std::shared_ptr<AppConfig>, config);
+    if (config->async) {
+        router->addController(std::make_shared<StackAsyncController>());
+    } else {
+        router->addController(std::make_shared<StackController>());
+    }
 
-    /* Create server which takes provided TCP connections and passes them to
-     * HTTP connection handler */
-    oatpp::network::Server server(connectionProvider, connectionHandler);
+    /* Get server group component, whose servers take the TCP connections
+     * accepted on the shared port and pass them to their HTTP connection
+     * handlers */
+    OATPP_COMPONENT(std::shared_ptr<ServerGroup>, serverGroup);
 
     /* Print info about server port */
-    OATPP_LOGI("Stack Server", "Server running on port %s",
-               (const char *)connectionProvider->getProperty("port").getData());
-
-    /* Run server */
-    server.run();
+    OATPP_LOGI("Stack Server",
+               "Server running on %s:%u in %s mode with %zu acceptors",
+               config->host.c_str(), (unsigned)config->port,
+               config->async ? "async" : "sync", serverGroup->getCount());
+
+    /* Start the binary listener next to the HTTP servers, if enabled */
+    OATPP_COMPONENT(std::shared_ptr<BinaryServer>, binaryServer);
+    if (binaryServer) {
+        binaryServer->start();
+        OATPP_LOGI("Stack Server", "Binary protocol listening on %s",
+                   binaryServer->getAddress().c_str());
+    }
+
+    /* Stream the mutations to the replicas, or follow the primary, if
+     * enabled */
+    OATPP_COMPONENT(std::shared_ptr<ReplicationServer>, replicationServer);
+    if (replicationServer) {
+        replicationServer->start();
+        OATPP_LOGI("Stack Server", "Replication listening on %s",
+                   replicationServer->getAddress().c_str());
+    }
+    OATPP_COMPONENT(std::shared_ptr<Replica>, replica);
+    if (replica) {
+        replica->start();
+        OATPP_LOGI("Stack Server", "Read-only replica of %s",
+                   replica->getPrimaryAddress().c_str());
+    }
+
+    /* Run servers */
+    serverGroup->run();
 }
 
 /**
@@ -55,6 +78,15 @@ int main(int argc, const char *argv[]) {
     std::cout << "objectsCreated = "
               << oatpp::base::Environment::getObjectsCreated() << "\n\n";
 
+    /* Print how many stack nodes were allocated, and how often the node pool
+     * had to go to the global allocator */
+    auto poolStats = StringStack::NodeAllocator::getStats();
+    std::cout << "Node pool:\n";
+    std::cout << "allocations = " << poolStats.allocations << "\n";
+    std::cout << "deallocations = " << poolStats.deallocations << "\n";
+    std::cout << "upstreamAllocations = " << poolStats.upstreamAllocations
+              << "\n\n";
+
     oatpp::base::Environment::destroy();
 
     return 0;
@@ -1,9 +1,22 @@
 #ifndef AppComponent_hpp
 #define AppComponent_hpp
 
-#include "oatpp/web/server/HttpConnectionHandler.hpp"
+#include "AppConfig.hpp"
+#include "binary/BinaryServer.hpp"
+#include "MemoryBudget.hpp"
+#include "replication/ReadOnlyInterceptor.hpp"
+#include "replication/Replica.hpp"
+#include "replication/ReplicationServer.hpp"
+#include "ServerGroup.hpp"
+#include "Snapshot.hpp"
+#include "SpillStore.hpp"
+#include "StringStackMap.hpp"
+#include "Tierer.hpp"
+#include "ValueInterner.hpp"
+#include "WriteAheadLog.hpp"
 
-#include "oatpp/network/tcp/server/ConnectionProvider.hpp"
+#include "oatpp/web/server/AsyncHttpConnectionHandler.hpp"
+#include "oatpp/web/server/HttpConnectionHandler.hpp"
 
 #include "oatpp/parser/json/mapping/ObjectMapper.hpp"
 
@@ -17,14 +30,146 @@
 class AppComponent {
 public:
     /**
-     *  Create ConnectionProvider component which listens on the port
+     *  Create AppConfig component from the environment variables
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<AppConfig>, appConfig)
+    ([] {
+        return std::make_shared<AppConfig>(AppConfig::fromEnvironment());
+    }());
+
+    /**
+     *  Create StackMap component which holds all the stacks, restored from
+     * the snapshot and the write-ahead log if there are, or left to a Replica
+     * to fill in from the primary
      */
-    OATPP_CREATE_COMPONENT(
-        std::shared_ptr<oatpp::network::ServerConnectionProvider>,
-        serverConnectionProvider)
+    OATPP_CREATE_COMPONENT(std::shared_ptr<StringStackMap>, stackMap)
     ([] {
-        return oatpp::network::tcp::server::ConnectionProvider::createShared(
-            {"0.0.0.0", 8000, oatpp::network::Address::IP_4});
+        OATPP_COMPONENT(std::shared_ptr<AppConfig>, config);
+        auto map = std::make_shared<StringStackMap>(config->shards);
+        ValueInterner::instance().setEnabled(config->internValues);
+        if (!config->tierPath.empty()) {
+            SpillStore::instance().open(config->tierPath,
+                                        std::uint64_t(config->tierMaxMb) << 20);
+        }
+        if (!config->primaryAddress.empty()) {
+            if (!config->walPath.empty() || !config->snapshotPath.empty()) {
+                OATPP_LOGW("Stack Server", "Ignoring the write-ahead log and "
+                                           "the snapshots of a replica");
+            }
+            return map;
+        }
+
+        Snapshot::Info snapshot{0, 0, 0};
+        if (!config->snapshotPath.empty()) {
+            snapshot = Snapshot::load(*map, config->snapshotPath);
+            OATPP_LOGI("Stack Server",
+                       "Loaded %llu stacks and %llu nodes from %s",
+                       (unsigned long long)snapshot.stackCount,
+                       (unsigned long long)snapshot.nodeCount,
+                       config->snapshotPath.c_str());
+        }
+        std::shared_ptr<StringMutationLog> log;
+        if (!config->walPath.empty()) {
+            auto wal = std::make_shared<WriteAheadLog>(
+                config->walPath, config->walDurability,
+                std::chrono::milliseconds(config->walSyncIntervalMs));
+            auto count = wal->replay(*map, snapshot.seq);
+            OATPP_LOGI("Stack Server", "Replayed %llu records from %s",
+                       (unsigned long long)count, config->walPath.c_str());
+            log = std::move(wal);
+        }
+        if (!config->replicationAddress.empty()) {
+            log = std::make_shared<ReplicationLog>(
+                std::move(log),
+                std::size_t(config->replicationBacklogMb) << 20);
+        }
+        if (log != nullptr) {
+            map->setLog(std::move(log));
+        }
+        // The limits only apply to new pushes, not to the restored stacks. A
+        // replica applies none, as it must take what the primary accepted.
+        map->setLimits({config->maxStackLength, config->maxStackBytes});
+        MemoryBudget::instance().setLimit(std::uint64_t(config->memoryLimitMb)
+                                          << 20);
+        return map;
+    }());
+
+    /**
+     *  Create Snapshotter component which periodically writes snapshots of
+     * the stacks, if enabled
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<Snapshotter>, snapshotter)
+    ([]() -> std::shared_ptr<Snapshotter> {
+        OATPP_COMPONENT(std::shared_ptr<AppConfig>, config);
+        OATPP_COMPONENT(std::shared_ptr<StringStackMap>, map);
+        if (config->snapshotPath.empty() || !config->primaryAddress.empty()) {
+            return nullptr;
+        }
+        return std::make_shared<Snapshotter>(
+            map, config->snapshotPath,
+            std::chrono::seconds(config->snapshotIntervalS));
+    }());
+
+    /**
+     *  Create Tierer component which periodically spills the cold tails of
+     * the stacks to the segment file, if enabled
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<Tierer>, tierer)
+    ([]() -> std::shared_ptr<Tierer> {
+        OATPP_COMPONENT(std::shared_ptr<AppConfig>, config);
+        OATPP_COMPONENT(std::shared_ptr<StringStackMap>, map);
+        if (config->tierPath.empty()) {
+            return nullptr;
+        }
+        return std::make_shared<Tierer>(
+            map, config->tierResidentDepth,
+            std::chrono::seconds(config->tierIntervalS));
+    }());
+
+    /**
+     *  Create BinaryServer component which serves the stacks over the binary
+     * protocol, if enabled
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<BinaryServer>, binaryServer)
+    ([]() -> std::shared_ptr<BinaryServer> {
+        OATPP_COMPONENT(std::shared_ptr<AppConfig>, config);
+        OATPP_COMPONENT(std::shared_ptr<StringStackMap>, map);
+        if (config->binaryAddress.empty()) {
+            return nullptr;
+        }
+        return std::make_shared<BinaryServer>(config->binaryAddress, map,
+                                              !config->primaryAddress.empty());
+    }());
+
+    /**
+     *  Create ReplicationServer component which streams the mutations of the
+     * stacks to the replicas, if enabled
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<ReplicationServer>,
+                           replicationServer)
+    ([]() -> std::shared_ptr<ReplicationServer> {
+        OATPP_COMPONENT(std::shared_ptr<AppConfig>, config);
+        OATPP_COMPONENT(std::shared_ptr<StringStackMap>, map);
+        if (config->replicationAddress.empty()) {
+            return nullptr;
+        }
+        return std::make_shared<ReplicationServer>(
+            config->replicationAddress, map,
+            std::dynamic_pointer_cast<ReplicationLog>(map->getLog()));
+    }());
+
+    /**
+     *  Create Replica component which follows the primary, if the server is
+     * a replica
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<Replica>, replica)
+    ([]() -> std::shared_ptr<Replica> {
+        OATPP_COMPONENT(std::shared_ptr<AppConfig>, config);
+        OATPP_COMPONENT(std::shared_ptr<StringStackMap>, map);
+        if (config->primaryAddress.empty()) {
+            return nullptr;
+        }
+        return std::make_shared<Replica>(config->primaryAddress, map);
     }());
 
     /**
@@ -35,15 +180,43 @@ public:
     ([] { return oatpp::web::server::HttpRouter::createShared(); }());
 
     /**
-     *  Create ConnectionHandler component which uses Router component to route
-     * requests
+     *  Create ServerGroup component whose servers share the port, each with a
+     * ConnectionHandler which uses Router component to route requests. In
+     * async mode, connections are served by coroutines on an async executor
+     * of each server instead of one thread each. The handlers of a replica
+     * reject the mutations.
      */
-    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::network::ConnectionHandler>,
-                           serverConnectionHandler)
+    OATPP_CREATE_COMPONENT(std::shared_ptr<ServerGroup>, serverGroup)
     ([] {
+        OATPP_COMPONENT(std::shared_ptr<AppConfig>, config);
         OATPP_COMPONENT(std::shared_ptr<oatpp::web::server::HttpRouter>,
                         router); // get Router component
-        return oatpp::web::server::HttpConnectionHandler::createShared(router);
+        auto async = config->async;
+        auto readOnly = !config->primaryAddress.empty();
+        return std::make_shared<ServerGroup>(
+            config->host, config->port, config->acceptors, config->cpus,
+            [async, readOnly, router]()
+                -> std::shared_ptr<oatpp::network::ConnectionHandler> {
+                if (async) {
+                    auto executor = std::make_shared<oatpp::async::Executor>();
+                    auto handler = oatpp::web::server::
+                        AsyncHttpConnectionHandler::createShared(router,
+                                                                 executor);
+                    if (readOnly) {
+                        handler->addRequestInterceptor(
+                            std::make_shared<ReadOnlyInterceptor>());
+                    }
+                    return handler;
+                }
+                auto handler =
+                    oatpp::web::server::HttpConnectionHandler::createShared(
+                        router);
+                if (readOnly) {
+                    handler->addRequestInterceptor(
+                        std::make_shared<ReadOnlyInterceptor>());
+                }
+                return handler;
+            });
     }());
 
     /**
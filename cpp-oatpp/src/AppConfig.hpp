@@ -0,0 +1,324 @@
+#ifndef AppConfig_hpp
+#define AppConfig_hpp
+
+#include "WriteAheadLog.hpp"
+
+#include "oatpp/core/Types.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Startup configuration of the server, read from environment variables.
+ */
+class AppConfig {
+public:
+    /**
+     * Address the server listens on.
+     * Environment variable: `STACK_SERVER_HOST`.
+     */
+    std::string host = "0.0.0.0";
+
+    /**
+     * Port the server listens on.
+     * Environment variable: `STACK_SERVER_PORT`.
+     */
+    v_uint16 port = 8000;
+
+    /**
+     * Number of servers sharing the port, each accepting connections on its
+     * own socket and thread.
+     * Environment variable: `STACK_SERVER_ACCEPTORS`.
+     */
+    v_uint32 acceptors = 1;
+
+    /**
+     * CPUs the servers are pinned to in turn, empty to leave them unpinned.
+     * Environment variable: `STACK_SERVER_CPUS`, a list of CPUs and ranges of
+     * CPUs like `0-3,8`.
+     */
+    std::vector<int> cpus;
+
+    /**
+     * Address of the binary listener, `unix:<path>` or `<host>:<port>`, empty
+     * to serve the HTTP API only.
+     * Environment variable: `STACK_SERVER_BINARY_ADDRESS`.
+     */
+    std::string binaryAddress;
+
+    /**
+     * Address replicas connect to, `<host>:<port>`, empty not to stream the
+     * mutations to replicas.
+     * Environment variable: `STACK_SERVER_REPLICATION_ADDRESS`.
+     */
+    std::string replicationAddress;
+
+    /**
+     * Megabytes of the latest mutations kept for the replicas, from which a
+     * reconnecting replica resumes rather than loading a snapshot.
+     * Environment variable: `STACK_SERVER_REPLICATION_BACKLOG_MB`.
+     */
+    v_uint32 replicationBacklogMb = 64;
+
+    /**
+     * Replication address of the primary to follow, which makes the server a
+     * read-only replica, empty for a primary.
+     * Environment variable: `STACK_SERVER_PRIMARY_ADDRESS`.
+     */
+    std::string primaryAddress;
+
+    /**
+     * Number of hash-partitioned shards of the stack map.
+     * Environment variable: `STACK_SERVER_SHARDS`.
+     */
+    v_uint32 shards = 16;
+
+    /**
+     * Whether requests are served by coroutines on an async executor instead
+     * of a thread per connection.
+     * Environment variable: `STACK_SERVER_MODE`, `sync` or `async`.
+     */
+    bool async = false;
+
+    /**
+     * Path of the write-ahead log, empty to keep the stacks in memory only.
+     * Environment variable: `STACK_SERVER_WAL_PATH`.
+     */
+    std::string walPath;
+
+    /**
+     * How durable a mutation is before it is acknowledged.
+     * Environment variable: `STACK_SERVER_WAL_DURABILITY`, `none`, `batched`
+     * or `per-op`.
+     */
+    WriteAheadLog::Durability walDurability =
+        WriteAheadLog::Durability::Batched;
+
+    /**
+     * Interval between the fsyncs of the write-ahead log in batched mode, and
+     * between its writes in none mode.
+     * Environment variable: `STACK_SERVER_WAL_SYNC_INTERVAL_MS`.
+     */
+    v_uint32 walSyncIntervalMs = 10;
+
+    /**
+     * Path of the snapshot of the stacks, loaded at startup and rewritten
+     * periodically, empty to disable snapshots.
+     * Environment variable: `STACK_SERVER_SNAPSHOT_PATH`.
+     */
+    std::string snapshotPath;
+
+    /**
+     * Interval between the snapshots in seconds.
+     * Environment variable: `STACK_SERVER_SNAPSHOT_INTERVAL_S`.
+     */
+    v_uint32 snapshotIntervalS = 300;
+
+    /**
+     * Maximum number of values in a stack, 0 for no limit.
+     * Environment variable: `STACK_SERVER_MAX_STACK_LENGTH`.
+     */
+    v_uint32 maxStackLength = 0;
+
+    /**
+     * Maximum total bytes of the values in a stack, 0 for no limit.
+     * Environment variable: `STACK_SERVER_MAX_STACK_BYTES`.
+     */
+    std::uint64_t maxStackBytes = 0;
+
+    /**
+     * Maximum memory held by the stack nodes in megabytes, 0 for no limit.
+     * Environment variable: `STACK_SERVER_MEMORY_LIMIT_MB`.
+     */
+    v_uint32 memoryLimitMb = 0;
+
+    /**
+     * Whether the long values pushed to the stacks are interned, so the
+     * identical ones share their storage.
+     * Environment variable: `STACK_SERVER_INTERN_VALUES`, `off` or `on`.
+     */
+    bool internValues = false;
+
+    /**
+     * Path of the segment file the cold tails of the stacks are spilled to,
+     * empty to keep the stacks in memory.
+     * Environment variable: `STACK_SERVER_TIER_PATH`.
+     */
+    std::string tierPath;
+
+    /**
+     * Number of values at the top of each stack kept in memory.
+     * Environment variable: `STACK_SERVER_TIER_RESIDENT_DEPTH`.
+     */
+    v_uint32 tierResidentDepth = 4096;
+
+    /**
+     * Interval between the passes spilling the cold tails in seconds.
+     * Environment variable: `STACK_SERVER_TIER_INTERVAL_S`.
+     */
+    v_uint32 tierIntervalS = 10;
+
+    /**
+     * Maximum size of the segment file in megabytes.
+     * Environment variable: `STACK_SERVER_TIER_MAX_MB`.
+     */
+    v_uint32 tierMaxMb = 4096;
+
+    static AppConfig fromEnvironment() {
+        AppConfig config;
+        config.host = getString("STACK_SERVER_HOST", config.host.c_str());
+        auto port = getUInt32("STACK_SERVER_PORT", config.port);
+        if (port > UINT16_MAX) {
+            throw std::invalid_argument("Invalid value of STACK_SERVER_PORT: " +
+                                        std::to_string(port));
+        }
+        config.port = static_cast<v_uint16>(port);
+        config.acceptors =
+            getUInt32("STACK_SERVER_ACCEPTORS", config.acceptors);
+        config.cpus = getCpuList("STACK_SERVER_CPUS");
+        config.binaryAddress = getString("STACK_SERVER_BINARY_ADDRESS", "");
+        config.replicationAddress =
+            getString("STACK_SERVER_REPLICATION_ADDRESS", "");
+        config.replicationBacklogMb = getUInt32(
+            "STACK_SERVER_REPLICATION_BACKLOG_MB", config.replicationBacklogMb);
+        config.primaryAddress = getString("STACK_SERVER_PRIMARY_ADDRESS", "");
+        if (!config.replicationAddress.empty() &&
+            !config.primaryAddress.empty()) {
+            throw std::invalid_argument(
+                "A replica cannot have replicas: STACK_SERVER_PRIMARY_ADDRESS "
+                "and STACK_SERVER_REPLICATION_ADDRESS are both set");
+        }
+        config.shards = getUInt32("STACK_SERVER_SHARDS", config.shards);
+        config.async =
+            getChoice("STACK_SERVER_MODE", {"sync", "async"}, 0) == 1;
+        config.walPath = getString("STACK_SERVER_WAL_PATH", "");
+        config.walDurability =
+            static_cast<WriteAheadLog::Durability>(getChoice(
+                "STACK_SERVER_WAL_DURABILITY", {"none", "batched", "per-op"},
+                static_cast<std::size_t>(config.walDurability)));
+        config.walSyncIntervalMs = getUInt32(
+            "STACK_SERVER_WAL_SYNC_INTERVAL_MS", config.walSyncIntervalMs);
+        config.snapshotPath = getString("STACK_SERVER_SNAPSHOT_PATH", "");
+        config.snapshotIntervalS = getUInt32("STACK_SERVER_SNAPSHOT_INTERVAL_S",
+                                             config.snapshotIntervalS);
+        config.maxStackLength = getUInt32("STACK_SERVER_MAX_STACK_LENGTH",
+                                          config.maxStackLength, true);
+        config.maxStackBytes = getUInt64("STACK_SERVER_MAX_STACK_BYTES",
+                                         config.maxStackBytes, true);
+        config.memoryLimitMb = getUInt32("STACK_SERVER_MEMORY_LIMIT_MB",
+                                         config.memoryLimitMb, true);
+        config.internValues =
+            getChoice("STACK_SERVER_INTERN_VALUES", {"off", "on"}, 0) == 1;
+        config.tierPath = getString("STACK_SERVER_TIER_PATH", "");
+        config.tierResidentDepth = getUInt32("STACK_SERVER_TIER_RESIDENT_DEPTH",
+                                             config.tierResidentDepth);
+        config.tierIntervalS =
+            getUInt32("STACK_SERVER_TIER_INTERVAL_S", config.tierIntervalS);
+        config.tierMaxMb =
+            getUInt32("STACK_SERVER_TIER_MAX_MB", config.tierMaxMb);
+        return config;
+    }
+
+private:
+    static std::string getString(const char *name, const char *defaultValue) {
+        const char *value = std::getenv(name);
+        return value == nullptr ? defaultValue : value;
+    }
+
+    // Returns the index of the value among the choices.
+    static std::size_t getChoice(const char *name,
+                                 std::initializer_list<const char *> choices,
+                                 std::size_t defaultIndex) {
+        const char *value = std::getenv(name);
+        if (value == nullptr || *value == '\0') {
+            return defaultIndex;
+        }
+        std::size_t index = 0;
+        for (auto choice : choices) {
+            if (std::strcmp(value, choice) == 0) {
+                return index;
+            }
+            ++index;
+        }
+        throw std::invalid_argument(std::string("Invalid value of ") + name +
+                                    ": " + value);
+    }
+
+    // Parses a list like `0-3,8` into the CPUs it names, in order.
+    static std::vector<int> getCpuList(const char *name) {
+        std::vector<int> cpus;
+        const char *value = std::getenv(name);
+        if (value == nullptr || *value == '\0') {
+            return cpus;
+        }
+        auto invalid = [&] {
+            return std::invalid_argument(std::string("Invalid value of ") +
+                                         name + ": " + value);
+        };
+        for (const char *item = value;;) {
+            char *end;
+            auto first = std::strtol(item, &end, 10);
+            auto last = first;
+            if (end == item || first < 0) {
+                throw invalid();
+            }
+            if (*end == '-') {
+                item = end + 1;
+                last = std::strtol(item, &end, 10);
+                if (end == item || last < first) {
+                    throw invalid();
+                }
+            }
+            for (auto cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+            if (*end == '\0') {
+                return cpus;
+            }
+            if (*end != ',') {
+                throw invalid();
+            }
+            item = end + 1;
+        }
+    }
+
+    /**
+     * Parses the variable `name` as a decimal number, which must be positive
+     * unless `allowZero`, as for the limits where 0 means no limit.
+     */
+    static v_uint32 getUInt32(const char *name, v_uint32 defaultValue,
+                              bool allowZero = false) {
+        return static_cast<v_uint32>(
+            getUInt64(name, defaultValue, allowZero, UINT32_MAX));
+    }
+
+    static std::uint64_t getUInt64(const char *name,
+                                   std::uint64_t defaultValue, bool allowZero,
+                                   std::uint64_t max = UINT64_MAX) {
+        const char *value = std::getenv(name);
+        if (value == nullptr || *value == '\0') {
+            return defaultValue;
+        }
+        char *end;
+        errno = 0;
+        auto parsed = std::strtoull(value, &end, 10);
+        // strtoull skips the spaces and negates after a minus sign, so the
+        // value must start with a digit.
+        if (!std::isdigit(static_cast<unsigned char>(*value)) ||
+            *end != '\0' || errno == ERANGE || (parsed == 0 && !allowZero) ||
+            parsed > max) {
+            throw std::invalid_argument(std::string("Invalid value of ") +
+                                        name + ": " + value);
+        }
+        return parsed;
+    }
+};
+
+#endif /* AppConfig_hpp */
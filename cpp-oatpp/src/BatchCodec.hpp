@@ -0,0 +1,96 @@
+#ifndef BatchCodec_hpp
+#define BatchCodec_hpp
+
+#include "SmallString.hpp"
+
+#include "oatpp/core/Types.hpp"
+
+#include <cstring>
+#include <exception>
+#include <vector>
+
+class BatchMalformed : public std::exception {
+public:
+    const char *what() const noexcept override { return "Batch is malformed"; }
+};
+
+/**
+ * Codec of the bodies of the batch endpoints: a sequence of elements, each
+ * prefixed by its length as a 4-byte big-endian integer. The bodies are sent
+ * with the content type `application/octet-stream`, and an empty body is an
+ * empty batch.
+ */
+class BatchCodec {
+public:
+    static oatpp::String encode(const std::vector<SmallString> &values) {
+        std::size_t size = 0;
+        for (auto &value : values) {
+            size += prefixSize + value.size();
+        }
+
+        oatpp::String body(static_cast<v_buff_size>(size));
+        auto out = reinterpret_cast<unsigned char *>(body->data());
+        for (auto &value : values) {
+            writeLength(out, static_cast<v_uint32>(value.size()));
+            std::memcpy(out + prefixSize, value.data(), value.size());
+            out += prefixSize + value.size();
+        }
+        return body;
+    }
+
+    /**
+     * Decodes the elements of `body` as `T`, throwing `BatchMalformed` if it
+     * is truncated.
+     */
+    template <typename T = SmallString>
+    static std::vector<T> decode(const oatpp::String &body) {
+        if (!body) {
+            return {};
+        }
+        return decode<T>(body->data(), body->size());
+    }
+
+    template <typename T = SmallString>
+    static std::vector<T> decode(const char *data, std::size_t size) {
+        std::vector<T> values;
+        auto in = reinterpret_cast<const unsigned char *>(data);
+        std::size_t remaining = size;
+        while (remaining > 0) {
+            if (remaining < prefixSize) {
+                throw BatchMalformed();
+            }
+            auto length = readLength(in);
+            if (remaining - prefixSize < length) {
+                throw BatchMalformed();
+            }
+            values.emplace_back(reinterpret_cast<const char *>(in + prefixSize),
+                                static_cast<v_buff_size>(length));
+            in += prefixSize + length;
+            remaining -= prefixSize + length;
+        }
+        return values;
+    }
+
+    static constexpr std::size_t prefixSize = 4;
+
+    /**
+     * Writes the prefix of an element of `length` bytes to `out`, for the
+     * bodies streamed element by element.
+     */
+    static void writeLength(unsigned char *out, v_uint32 length) {
+        out[0] = static_cast<unsigned char>(length >> 24);
+        out[1] = static_cast<unsigned char>(length >> 16);
+        out[2] = static_cast<unsigned char>(length >> 8);
+        out[3] = static_cast<unsigned char>(length);
+    }
+
+    /**
+     * Reads a prefix written by `writeLength`.
+     */
+    static v_uint32 readLength(const unsigned char *in) {
+        return (v_uint32(in[0]) << 24) | (v_uint32(in[1]) << 16) |
+               (v_uint32(in[2]) << 8) | v_uint32(in[3]);
+    }
+};
+
+#endif /* BatchCodec_hpp */
@@ -0,0 +1,105 @@
+#ifndef BinaryFormat_hpp
+#define BinaryFormat_hpp
+
+#include "SmallString.hpp"
+
+#include "oatpp/core/Types.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Appends the fields of the files written by the server: big-endian integers
+ * and strings prefixed by their 4-byte length.
+ */
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::string &out) : out(out) {}
+
+    void writeUInt8(v_uint8 value) {
+        this->out.push_back(static_cast<char>(value));
+    }
+    void writeUInt32(v_uint32 value) {
+        char bytes[4];
+        setUInt32(bytes, value);
+        this->out.append(bytes, 4);
+    }
+    void writeUInt64(std::uint64_t value) {
+        this->writeUInt32(static_cast<v_uint32>(value >> 32));
+        this->writeUInt32(static_cast<v_uint32>(value));
+    }
+    void writeString(const oatpp::String &value) {
+        auto size = value ? value->size() : 0;
+        this->writeUInt32(static_cast<v_uint32>(size));
+        if (size > 0) {
+            this->out.append(value->data(), size);
+        }
+    }
+    void writeString(const SmallString &value) {
+        this->writeUInt32(static_cast<v_uint32>(value.size()));
+        this->out.append(value.data(), value.size());
+    }
+
+    static void setUInt32(char *out, v_uint32 value) {
+        out[0] = static_cast<char>(value >> 24);
+        out[1] = static_cast<char>(value >> 16);
+        out[2] = static_cast<char>(value >> 8);
+        out[3] = static_cast<char>(value);
+    }
+    static void setUInt64(char *out, std::uint64_t value) {
+        setUInt32(out, static_cast<v_uint32>(value >> 32));
+        setUInt32(out + 4, static_cast<v_uint32>(value));
+    }
+
+private:
+    std::string &out;
+};
+
+/**
+ * Reads the fields written by `BinaryWriter`, throwing `std::runtime_error`
+ * when they run past the end of the input.
+ */
+class BinaryReader {
+public:
+    BinaryReader(const char *begin, const char *end) : in(begin), end(end) {}
+
+    v_uint8 readUInt8() { return static_cast<v_uint8>(*this->take(1)); }
+    v_uint32 readUInt32() { return getUInt32(this->take(4)); }
+    std::uint64_t readUInt64() { return getUInt64(this->take(8)); }
+    oatpp::String readString() {
+        auto size = this->readUInt32();
+        return oatpp::String(this->take(size), static_cast<v_buff_size>(size));
+    }
+    SmallString readSmallString() {
+        auto size = this->readUInt32();
+        return SmallString(this->take(size), size);
+    }
+
+    const char *take(std::size_t size) {
+        if (this->remaining() < size) {
+            throw std::runtime_error("Unexpected end of data");
+        }
+        auto result = this->in;
+        this->in += size;
+        return result;
+    }
+    std::size_t remaining() const {
+        return static_cast<std::size_t>(this->end - this->in);
+    }
+
+    static v_uint32 getUInt32(const char *in) {
+        auto bytes = reinterpret_cast<const unsigned char *>(in);
+        return (v_uint32(bytes[0]) << 24) | (v_uint32(bytes[1]) << 16) |
+               (v_uint32(bytes[2]) << 8) | v_uint32(bytes[3]);
+    }
+    static std::uint64_t getUInt64(const char *in) {
+        return (std::uint64_t(getUInt32(in)) << 32) | getUInt32(in + 4);
+    }
+
+private:
+    const char *in;
+    const char *end;
+};
+
+#endif /* BinaryFormat_hpp */
@@ -0,0 +1,22 @@
+#ifndef CommitWaiter_hpp
+#define CommitWaiter_hpp
+
+/**
+ * Waiter for a mutation to be committed, registered with
+ * `MutationLog::addCommitWaiter`.
+ *
+ * The log wakes and unregisters the waiter once the mutation is committed or
+ * the log fails. A woken waiter only checks `MutationLog::isCommitted` again.
+ */
+class CommitWaiter {
+public:
+    virtual ~CommitWaiter() = default;
+
+    /**
+     * Called by the log waking the waiter, with the lock of the log held, so
+     * it must not block.
+     */
+    virtual void wake() = 0;
+};
+
+#endif /* CommitWaiter_hpp */
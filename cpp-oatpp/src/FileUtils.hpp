@@ -0,0 +1,103 @@
+#ifndef FileUtils_hpp
+#define FileUtils_hpp
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/**
+ * POSIX file helpers shared by the files written by the server. They throw
+ * `std::runtime_error` with the description of `errno` on failure.
+ */
+class FileUtils {
+public:
+    static void writeAll(int fd, const char *data, std::size_t size) {
+        for (std::size_t written = 0; written < size;) {
+            auto result = ::write(fd, data + written, size - written);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwError("Cannot write");
+            }
+            written += static_cast<std::size_t>(result);
+        }
+    }
+
+    static std::string readAll(int fd) {
+        std::string data;
+        char buffer[1 << 16];
+        for (off_t offset = 0;;) {
+            auto result = ::pread(fd, buffer, sizeof(buffer), offset);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwError("Cannot read");
+            }
+            if (result == 0) {
+                return data;
+            }
+            data.append(buffer, static_cast<std::size_t>(result));
+            offset += result;
+        }
+    }
+
+    /**
+     * Replaces `path` with `tempPath`, whose content must already be synced.
+     * A crash leaves either the old or the new file at `path`.
+     */
+    static void replace(const std::string &tempPath, const std::string &path) {
+        if (::rename(tempPath.c_str(), path.c_str()) != 0) {
+            throwError("Cannot rename " + tempPath);
+        }
+        syncDirectoryOf(path);
+    }
+
+    /**
+     * Syncs the directory containing `path`, which makes the creation or the
+     * renaming of `path` survive a crash.
+     */
+    static void syncDirectoryOf(const std::string &path) {
+        auto slash = path.rfind('/');
+        auto directory = slash == std::string::npos ? std::string(".")
+                         : slash == 0               ? std::string("/")
+                                                    : path.substr(0, slash);
+        auto fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            throwError("Cannot open " + directory);
+        }
+        auto result = ::fsync(fd);
+        ::close(fd);
+        if (result != 0) {
+            throwError("Cannot sync " + directory);
+        }
+    }
+
+    /**
+     * Returns a new path for a temporary file named after `name`, in `TMPDIR`
+     * or `/tmp`, which no other call of this process returns.
+     */
+    static std::string tempPathFor(const std::string &name) {
+        static std::atomic<std::uint64_t> count{0};
+        const char *directory = std::getenv("TMPDIR");
+        return std::string(directory != nullptr && *directory != '\0'
+                               ? directory
+                               : "/tmp") +
+               "/stack-server-" + std::to_string(::getpid()) + "-" +
+               std::to_string(++count) + "-" + name;
+    }
+
+    [[noreturn]] static void throwError(const std::string &message) {
+        throw std::runtime_error(message + ": " + std::strerror(errno));
+    }
+};
+
+#endif /* FileUtils_hpp */
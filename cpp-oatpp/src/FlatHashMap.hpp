@@ -0,0 +1,279 @@
+#ifndef FlatHashMap_hpp
+#define FlatHashMap_hpp
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+
+/**
+ * Open addressing hash map with linear probing.
+ *
+ * The entries are stored in one flat array, and their hashes in another
+ * parallel one, so a probe scans consecutive hashes and only compares the
+ * keys of the entries whose hash matches. The hashes are kept, so growing
+ * the table never hashes the keys again. An erased entry is filled by moving
+ * the following entries of its probe sequence back, which leaves no
+ * tombstones behind.
+ *
+ * The lookups take the hash of the key from the caller, who can compute it
+ * once for several tables, and a key of any type `Q` which `Equal` compares
+ * with `K`, so that they can look up by a view of the key without building a
+ * `K`.
+ *
+ * Inserting and erasing entries move other entries, so the pointers to the
+ * entries are only valid until the next change of the map.
+ *
+ * A map shared under a lock can be grown ahead of its inserts: the larger
+ * slots are allocated by `allocate` without the lock, and `adopt` only moves
+ * the entries into them, so the inserts made under the lock do not grow it.
+ */
+template <typename K, typename V, typename Equal = std::equal_to<>>
+class FlatHashMap {
+public:
+    using Entry = std::pair<K, V>;
+
+    FlatHashMap() : capacity(0), count(0) {}
+    FlatHashMap(FlatHashMap &&other) noexcept
+        : hashes(std::move(other.hashes)), slots(std::move(other.slots)),
+          capacity(other.capacity), count(other.count) {
+        other.capacity = other.count = 0;
+    }
+    FlatHashMap(const FlatHashMap &) = delete;
+    FlatHashMap &operator=(const FlatHashMap &) = delete;
+    ~FlatHashMap() { this->clear(); }
+
+    class Storage;
+
+    std::size_t size() const { return this->count; }
+    bool empty() const { return this->count == 0; }
+
+    /**
+     * Returns the capacity the map needs to take `extra` more entries, which
+     * is its capacity if they fit.
+     */
+    std::size_t capacityFor(std::size_t extra) const {
+        auto capacity = this->capacity;
+        // The load factor is kept under 7/8.
+        while ((this->count + extra) * 8 > capacity * 7) {
+            capacity = capacity == 0 ? minCapacity : capacity * 2;
+        }
+        return capacity;
+    }
+
+    /**
+     * Returns whether the map can take `extra` more entries without growing.
+     */
+    bool fits(std::size_t extra) const {
+        return this->capacityFor(extra) == this->capacity;
+    }
+
+    /**
+     * Allocates empty slots for a map of `capacity`, a power of two.
+     */
+    static Storage allocate(std::size_t capacity) {
+        Storage storage;
+        storage.hashes.reset(new std::size_t[capacity]());
+        storage.slots.reset(new Slot[capacity]);
+        storage.capacity = capacity;
+        return storage;
+    }
+
+    /**
+     * Moves the entries into `storage`, unless it is not larger than the
+     * current slots, which are then kept.
+     */
+    void adopt(Storage &&storage) {
+        if (storage.capacity <= this->capacity) {
+            return;
+        }
+        std::swap(storage.hashes, this->hashes);
+        std::swap(storage.slots, this->slots);
+        std::swap(storage.capacity, this->capacity);
+        for (std::size_t i = 0; i < storage.capacity; ++i) {
+            if (storage.hashes[i] != 0) {
+                auto &entry = *std::launder(
+                    reinterpret_cast<Entry *>(&storage.slots[i]));
+                new (&this->slots[this->place(storage.hashes[i])])
+                    Entry(std::move(entry));
+                entry.~Entry();
+            }
+        }
+    }
+
+    /**
+     * Returns the entry whose key equals `key`, or nullptr.
+     */
+    template <typename Q> Entry *find(const Q &key, std::size_t hash) {
+        if (this->count == 0) {
+            return nullptr;
+        }
+        hash = tagged(hash);
+        auto mask = this->capacity - 1;
+        for (auto i = hash & mask; this->hashes[i] != 0; i = (i + 1) & mask) {
+            if (this->hashes[i] == hash &&
+                Equal{}(this->entryAt(i).first, key)) {
+                return &this->entryAt(i);
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Inserts the entry with the key `key` and the value `value` unless an
+     * entry with an equal key exists. Returns the entry with the key, and
+     * whether it was inserted.
+     */
+    std::pair<Entry *, bool> insert(std::size_t hash, K &&key, V &&value) {
+        if (auto entry = this->find(key, hash)) {
+            return {entry, false};
+        }
+        if (!this->fits(1)) {
+            this->grow();
+        }
+        auto i = this->place(tagged(hash));
+        new (&this->slots[i]) Entry(std::move(key), std::move(value));
+        ++this->count;
+        return {&this->entryAt(i), true};
+    }
+
+    /**
+     * Erases the entry whose key equals `key`. Returns whether there was one.
+     */
+    template <typename Q> bool erase(const Q &key, std::size_t hash) {
+        auto entry = this->find(key, hash);
+        if (entry == nullptr) {
+            return false;
+        }
+        this->erase(entry);
+        return true;
+    }
+
+    /**
+     * Erases `entry`, which must be an entry of the map.
+     */
+    void erase(Entry *entry) {
+        auto mask = this->capacity - 1;
+        auto hole = static_cast<std::size_t>(
+            reinterpret_cast<Slot *>(entry) - this->slots.get());
+        entry->~Entry();
+        // Moves back each following entry of the run whose home slot is not
+        // between the hole and itself, so that it stays reachable.
+        for (auto i = (hole + 1) & mask; this->hashes[i] != 0;
+             i = (i + 1) & mask) {
+            auto home = this->hashes[i] & mask;
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                new (&this->slots[hole]) Entry(std::move(this->entryAt(i)));
+                this->entryAt(i).~Entry();
+                this->hashes[hole] = this->hashes[i];
+                hole = i;
+            }
+        }
+        this->hashes[hole] = 0;
+        --this->count;
+    }
+
+    void clear() {
+        for (std::size_t i = 0; i < this->capacity; ++i) {
+            if (this->hashes[i] != 0) {
+                this->entryAt(i).~Entry();
+                this->hashes[i] = 0;
+            }
+        }
+        this->count = 0;
+    }
+
+    /**
+     * Iterator over the entries, in no particular order.
+     */
+    class Iterator {
+    public:
+        Entry &operator*() const { return this->map->entryAt(this->index); }
+        Entry *operator->() const { return &**this; }
+        Iterator &operator++() {
+            ++this->index;
+            this->skipEmpty();
+            return *this;
+        }
+        bool operator!=(const Iterator &other) const {
+            return this->index != other.index;
+        }
+
+    private:
+        Iterator(FlatHashMap *map, std::size_t index) : map(map), index(index) {
+            this->skipEmpty();
+        }
+
+        void skipEmpty() {
+            while (this->index < this->map->capacity &&
+                   this->map->hashes[this->index] == 0) {
+                ++this->index;
+            }
+        }
+
+        FlatHashMap *map;
+        std::size_t index;
+
+        friend class FlatHashMap;
+    };
+
+    Iterator begin() { return Iterator(this, 0); }
+    Iterator end() { return Iterator(this, this->capacity); }
+
+private:
+    struct alignas(Entry) Slot {
+        unsigned char bytes[sizeof(Entry)];
+    };
+
+    static constexpr std::size_t minCapacity = 8;
+
+public:
+    /**
+     * Slots allocated by `allocate`, for `adopt`.
+     */
+    class Storage {
+        std::unique_ptr<std::size_t[]> hashes;
+        std::unique_ptr<Slot[]> slots;
+        std::size_t capacity = 0;
+
+        friend class FlatHashMap;
+    };
+
+private:
+    // The stored hashes have their top bit set, so that 0 marks an empty slot.
+    // The slot is picked by the low bits, which the tag leaves alone.
+    static std::size_t tagged(std::size_t hash) {
+        return hash | (std::size_t(1) << (sizeof(std::size_t) * CHAR_BIT - 1));
+    }
+
+    Entry &entryAt(std::size_t i) {
+        return *std::launder(reinterpret_cast<Entry *>(&this->slots[i]));
+    }
+
+    // Returns the first empty slot of the probe sequence of `hash`.
+    std::size_t place(std::size_t hash) {
+        auto mask = this->capacity - 1;
+        auto i = hash & mask;
+        while (this->hashes[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        this->hashes[i] = hash;
+        return i;
+    }
+
+    void grow() {
+        // Allocated first, so that the map is left as it was if it throws.
+        this->adopt(allocate(this->capacity == 0 ? minCapacity
+                                                 : this->capacity * 2));
+    }
+
+    std::unique_ptr<std::size_t[]> hashes;
+    std::unique_ptr<Slot[]> slots;
+    std::size_t capacity;
+    std::size_t count;
+};
+
+#endif /* FlatHashMap_hpp */
@@ -0,0 +1,179 @@
+#ifndef HazardPointer_hpp
+#define HazardPointer_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/**
+ * Hazard pointer guarding one object against reclamation.
+ *
+ * A thread publishes the pointer it is about to dereference through
+ * `protect`, and objects handed to `retire` are only deleted once no hazard
+ * pointer refers to them.
+ * https://www.cs.otago.ac.nz/cosc440/readings/hazard-pointers.pdf
+ */
+class HazardPointer {
+public:
+    HazardPointer() : record(Record::acquire()) {}
+    ~HazardPointer() {
+        this->reset();
+        this->record->active.store(false, std::memory_order_release);
+    }
+    HazardPointer(const HazardPointer &) = delete;
+    HazardPointer &operator=(const HazardPointer &) = delete;
+
+    /**
+     * Loads `source` and protects the loaded pointer. The returned pointer is
+     * safe to dereference until `reset` or the destruction of the guard.
+     */
+    template <typename N> N *protect(const std::atomic<N *> &source) {
+        N *ptr = source.load(std::memory_order_relaxed);
+        while (true) {
+            this->record->pointer.store(ptr, std::memory_order_seq_cst);
+            N *current = source.load(std::memory_order_seq_cst);
+            if (current == ptr) {
+                return ptr;
+            }
+            ptr = current;
+        }
+    }
+
+    /**
+     * Publishes `ptr` without validating it. The caller must check afterwards
+     * that `ptr` is still reachable for the protection to be effective.
+     */
+    void set(void *ptr) {
+        this->record->pointer.store(ptr, std::memory_order_seq_cst);
+    }
+
+    void reset() {
+        this->record->pointer.store(nullptr, std::memory_order_release);
+    }
+
+    /**
+     * Defers `deleter(ptr)` until no hazard pointer protects `ptr`.
+     */
+    static void retire(void *ptr, void (*deleter)(void *)) {
+        auto &list = RetireList::local();
+        list.retired.push_back({ptr, deleter});
+        if (list.retired.size() >= scanThreshold()) {
+            list.scan();
+        }
+    }
+
+private:
+    struct Record {
+        std::atomic<void *> pointer{nullptr};
+        std::atomic<bool> active{true};
+        Record *next = nullptr;
+
+        static std::atomic<Record *> &head() {
+            static std::atomic<Record *> head{nullptr};
+            return head;
+        }
+        static std::atomic<std::size_t> &count() {
+            static std::atomic<std::size_t> count{0};
+            return count;
+        }
+
+        // Records are never freed, inactive ones are reused.
+        static Record *acquire() {
+            for (auto record = head().load(std::memory_order_acquire);
+                 record != nullptr; record = record->next) {
+                bool inactive = false;
+                if (!record->active.load(std::memory_order_relaxed) &&
+                    record->active.compare_exchange_strong(
+                        inactive, true, std::memory_order_acquire)) {
+                    return record;
+                }
+            }
+            auto record = new Record();
+            auto oldHead = head().load(std::memory_order_relaxed);
+            do {
+                record->next = oldHead;
+            } while (!head().compare_exchange_weak(oldHead, record,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed));
+            count().fetch_add(1, std::memory_order_relaxed);
+            return record;
+        }
+    };
+
+    struct Retired {
+        void *ptr;
+        void (*deleter)(void *);
+    };
+
+    // Retired objects of one thread. Whatever is still protected when the
+    // thread exits is handed to the orphans and adopted by the next scan.
+    struct RetireList {
+        std::vector<Retired> retired;
+
+        static RetireList &local() {
+            thread_local RetireList list;
+            return list;
+        }
+
+        static std::mutex &orphansLock() {
+            static std::mutex lock;
+            return lock;
+        }
+        static std::vector<Retired> &orphans() {
+            static std::vector<Retired> orphans;
+            return orphans;
+        }
+
+        ~RetireList() {
+            this->scan();
+            if (!this->retired.empty()) {
+                std::lock_guard _lock(orphansLock());
+                auto &orphans = RetireList::orphans();
+                orphans.insert(orphans.end(), this->retired.begin(),
+                               this->retired.end());
+            }
+        }
+
+        void scan() {
+            {
+                std::lock_guard _lock(orphansLock());
+                auto &orphans = RetireList::orphans();
+                this->retired.insert(this->retired.end(), orphans.begin(),
+                                     orphans.end());
+                orphans.clear();
+            }
+
+            std::vector<void *> hazards;
+            for (auto record = Record::head().load(std::memory_order_acquire);
+                 record != nullptr; record = record->next) {
+                auto ptr = record->pointer.load(std::memory_order_seq_cst);
+                if (ptr != nullptr) {
+                    hazards.push_back(ptr);
+                }
+            }
+            std::sort(hazards.begin(), hazards.end());
+
+            // The list is rebuilt with the objects which are still protected.
+            std::vector<Retired> pending;
+            pending.swap(this->retired);
+            for (auto &item : pending) {
+                if (std::binary_search(hazards.begin(), hazards.end(),
+                                       item.ptr)) {
+                    this->retired.push_back(item);
+                } else {
+                    item.deleter(item.ptr);
+                }
+            }
+        }
+    };
+
+    static std::size_t scanThreshold() {
+        return std::max<std::size_t>(
+            64, 2 * Record::count().load(std::memory_order_relaxed));
+    }
+
+    Record *record;
+};
+
+#endif /* HazardPointer_hpp */
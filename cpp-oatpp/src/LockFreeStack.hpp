@@ -0,0 +1,165 @@
+#ifndef LockFreeStack_hpp
+#define LockFreeStack_hpp
+
+#include "HazardPointer.hpp"
+#include "StackMap.hpp"
+
+#include <atomic>
+
+/**
+ * Lock-free variant of `Stack`, a Treiber stack of reference counted nodes.
+ *
+ * The head is replaced by CAS instead of under a lock. Nodes are never
+ * mutated after being linked, so copies share tails just like `Stack` does.
+ * Nodes whose reference counter drops to zero are retired through hazard
+ * pointers, as concurrent readers may still be looking at them.
+ *
+ * It only offers the basic operations of `Stack`, without the sizes, the
+ * limits, the references, the ranges or the spilling `StackMap` relies on, so
+ * it stands on its own: the benchmarks compare it with `Stack` on a single
+ * hot stack, and it is not served.
+ */
+template <typename T> class LockFreeStack {
+public:
+    LockFreeStack() : head(nullptr) {}
+    ~LockFreeStack() {
+        destroyLink(this->head.load(std::memory_order_relaxed));
+    }
+    LockFreeStack(const LockFreeStack &stack) : head(stack.copyHead()) {}
+    LockFreeStack(LockFreeStack &&stack)
+        : head(stack.head.exchange(nullptr, std::memory_order_acq_rel)) {}
+    LockFreeStack &operator=(const LockFreeStack &stack) noexcept {
+        destroyLink(this->head.exchange(stack.copyHead(),
+                                        std::memory_order_acq_rel));
+        return *this;
+    }
+    LockFreeStack &operator=(LockFreeStack &&stack) noexcept {
+        auto newHead = stack.head.exchange(nullptr, std::memory_order_acq_rel);
+        destroyLink(this->head.exchange(newHead, std::memory_order_acq_rel));
+        return *this;
+    }
+
+    T getTop() const {
+        HazardPointer hazard;
+        auto head = hazard.protect(this->head);
+        if (head == nullptr) {
+            throw StackEmpty();
+        }
+        return head->value;
+    }
+    void push(T &&value) {
+        // The reference from the stack to the old head is transferred to the
+        // new node.
+        auto node = new Node(std::move(value),
+                             this->head.load(std::memory_order_relaxed));
+        while (!this->head.compare_exchange_weak(node->next, node,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed)) {
+        }
+    }
+    T pop() {
+        HazardPointer hazard, nextHazard;
+        Node *poppedNode;
+        while (true) {
+            poppedNode = hazard.protect(this->head);
+            if (poppedNode == nullptr) {
+                throw StackEmpty();
+            }
+            // As long as the popped node is still the head, the stack keeps it
+            // and therefore its next alive, so the next is protected from here.
+            auto next = poppedNode->next;
+            nextHazard.set(next);
+            if (this->head.load(std::memory_order_seq_cst) != poppedNode) {
+                continue;
+            }
+            // The stack must own a reference to the new head before it is
+            // visible to other threads.
+            if (next != nullptr && !Node::tryIncRef(next)) {
+                continue;
+            }
+            // `next` of a linked node never changes, so the CAS is correct
+            // even if the head went away and came back in between.
+            if (this->head.compare_exchange_strong(poppedNode, next,
+                                                   std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed)) {
+                break;
+            }
+            destroyLink(next);
+        }
+        nextHazard.reset();
+
+        // The reference of the stack to the popped node is ours now. Unlike
+        // `Stack::pop`, the value can't be moved out even if the node looks
+        // unique, as readers holding hazard pointers may be copying it.
+        auto result = poppedNode->value;
+        hazard.reset();
+        destroyLink(poppedNode);
+        return result;
+    }
+
+private:
+    class Node {
+    public:
+        Node(T &&value, Node *next)
+            : next(next), value(std::move(value)), refcount(1) {}
+
+        static void incRef(Node *node) {
+            node->refcount.fetch_add(1, std::memory_order_relaxed);
+        }
+        // Increments the reference counter unless it has already dropped to
+        // zero, in which case the node is being retired.
+        static bool tryIncRef(Node *node) {
+            auto count = node->refcount.load(std::memory_order_relaxed);
+            while (count != 0) {
+                if (node->refcount.compare_exchange_weak(
+                        count, count + 1, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        // Returns whether its reference counter is 1 before decrement.
+        static bool decRef(Node *node) {
+            if (node->refcount.fetch_sub(1, std::memory_order_release) == 1) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return true;
+            } else {
+                return false;
+            }
+        }
+
+        Node *next;
+        T value;
+
+    private:
+        std::atomic<int> refcount;
+    };
+
+    static void destroyLink(Node *head) {
+        auto ptr = head;
+        while (ptr != nullptr) {
+            if (!Node::decRef(ptr)) {
+                // Still has other reference
+                break;
+            }
+            auto next = ptr->next;
+            HazardPointer::retire(
+                ptr, [](void *node) { delete static_cast<Node *>(node); });
+            ptr = next;
+        }
+    }
+
+    Node *copyHead() const {
+        HazardPointer hazard;
+        while (true) {
+            auto head = hazard.protect(this->head);
+            if (head == nullptr || Node::tryIncRef(head)) {
+                return head;
+            }
+        }
+    }
+
+    std::atomic<Node *> head;
+};
+
+#endif /* LockFreeStack_hpp */
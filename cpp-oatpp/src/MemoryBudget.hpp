@@ -0,0 +1,106 @@
+#ifndef MemoryBudget_hpp
+#define MemoryBudget_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+
+class MemoryLimitExceeded : public std::exception {
+public:
+    const char *what() const noexcept override {
+        return "Memory limit exceeded";
+    }
+};
+
+/**
+ * Accounting of the memory held by the stack nodes of the process, with a
+ * limit checked before new nodes are pushed.
+ *
+ * Each thread accumulates the bytes it charges and releases, and only adds
+ * them to the shared total once they exceed `batchBytes` either way, so
+ * charging stays off the shared cache line. The total may lag behind by up to
+ * `batchBytes` per thread, which is the precision of the limit.
+ */
+class MemoryBudget {
+public:
+    static constexpr std::int64_t batchBytes = 64 * 1024;
+
+    /**
+     * The budget is never destroyed, like `NodePool`, as the nodes may be
+     * released by threads which exit after the static objects are destroyed.
+     */
+    static MemoryBudget &instance() {
+        static auto budget = new MemoryBudget();
+        return *budget;
+    }
+
+    /**
+     * Sets the limit in bytes, 0 for none.
+     */
+    void setLimit(std::uint64_t bytes) {
+        this->limit.store(bytes, std::memory_order_relaxed);
+    }
+    std::uint64_t getLimit() const {
+        return this->limit.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns whether `bytes` more can be charged within the limit.
+     */
+    bool allows(std::uint64_t bytes) const {
+        auto limit = this->getLimit();
+        return limit == 0 || this->getUsed() + bytes <= limit;
+    }
+
+    /**
+     * Throws `MemoryLimitExceeded` if charging `bytes` more would exceed the
+     * limit.
+     */
+    void check(std::uint64_t bytes) const {
+        if (!this->allows(bytes)) {
+            throw MemoryLimitExceeded();
+        }
+    }
+
+    /**
+     * Adds `bytes` to the memory in use, negative to release them.
+     */
+    void charge(std::int64_t bytes) {
+        auto &local = Local::get();
+        local.delta += bytes;
+        if (local.delta >= batchBytes || local.delta <= -batchBytes) {
+            this->total.fetch_add(local.delta, std::memory_order_relaxed);
+            local.delta = 0;
+        }
+    }
+
+    /**
+     * Returns the memory in use, as of the last batches of the threads.
+     */
+    std::uint64_t getUsed() const {
+        auto total = this->total.load(std::memory_order_relaxed);
+        return total > 0 ? static_cast<std::uint64_t>(total) : 0;
+    }
+
+private:
+    struct Local {
+        std::int64_t delta = 0;
+
+        static Local &get() {
+            thread_local Local local;
+            return local;
+        }
+
+        ~Local() {
+            MemoryBudget::instance().total.fetch_add(
+                this->delta, std::memory_order_relaxed);
+        }
+    };
+
+    MemoryBudget() = default;
+
+    std::atomic<std::int64_t> total{0};
+    std::atomic<std::uint64_t> limit{0};
+};
+
+#endif /* MemoryBudget_hpp */
@@ -0,0 +1,473 @@
+#ifndef Metrics_hpp
+#define Metrics_hpp
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Latency histogram with log-linear buckets in the style of HDR histograms.
+ * Each power of two of nanoseconds is split into `subBuckets` linear buckets,
+ * so values are recorded with a relative error below 1 / `subBuckets`.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned subBucketBits = 3;
+    static constexpr std::size_t subBuckets = std::size_t(1) << subBucketBits;
+    // Values from 2^maxExponent ns, about a minute, land in the last bucket.
+    static constexpr unsigned maxExponent = 36;
+    static constexpr std::size_t bucketCount =
+        (maxExponent - subBucketBits + 2) * subBuckets;
+
+    static std::size_t bucketOf(std::uint64_t ns) {
+        if (ns < subBuckets) {
+            return static_cast<std::size_t>(ns);
+        }
+        unsigned exponent = 63 - __builtin_clzll(ns);
+        unsigned shift = exponent - subBucketBits;
+        auto bucket = (shift + 1) * subBuckets +
+                      static_cast<std::size_t>(ns >> shift) - subBuckets;
+        return bucket < bucketCount ? bucket : bucketCount - 1;
+    }
+
+    /**
+     * Returns the exclusive upper bound of the values in `bucket`.
+     */
+    static std::uint64_t upperBoundOf(std::size_t bucket) {
+        if (bucket < subBuckets) {
+            return bucket + 1;
+        }
+        auto shift = bucket / subBuckets - 1;
+        auto mantissa = bucket % subBuckets + subBuckets;
+        return std::uint64_t(mantissa + 1) << shift;
+    }
+
+    /**
+     * Returns the upper bound of the bucket holding the `quantile` of the
+     * values, in nanoseconds, or 0 if there are none.
+     */
+    std::uint64_t quantile(double quantile) const {
+        if (this->count == 0) {
+            return 0;
+        }
+        auto rank = static_cast<std::uint64_t>(quantile * (this->count - 1));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucketCount; ++i) {
+            seen += this->buckets[i];
+            if (seen > rank) {
+                return upperBoundOf(i);
+            }
+        }
+        return upperBoundOf(bucketCount - 1);
+    }
+
+    std::array<std::uint64_t, bucketCount> buckets{};
+    std::uint64_t count = 0;
+    std::uint64_t sumNs = 0;
+};
+
+/**
+ * Instrumentation of the server: request counters and latency histograms by
+ * endpoint, the number of stack nodes, the time spent waiting for the locks of
+ * the stacks, the backlog of `Reclaimer`, and the spilled segments faulted
+ * back in. The sizes of the stacks and the memory they hold are sampled when
+ * the metrics are formatted.
+ *
+ * Each thread records into its own slot, with plain loads and stores rather
+ * than atomic read-modify-writes on shared counters, and `collect` sums the
+ * slots when the metrics are scraped. The slot of an exiting thread is folded
+ * into the totals of the retired threads.
+ */
+class Metrics {
+public:
+    enum class Endpoint {
+        Top,
+        Peek,
+        Size,
+        Push,
+        Pop,
+        PushMany,
+        PopMany,
+        Create,
+        Remove,
+        Copy,
+        Fork,
+        Move,
+    };
+    static constexpr std::size_t endpointCount = 12;
+
+    // The status codes counted separately, the others are counted as
+    // `other`.
+    static constexpr std::array<int, 10> statusCodes = {
+        200, 201, 204, 304, 400, 404, 405, 409, 412, 507};
+    static constexpr std::size_t statusCount = statusCodes.size() + 1;
+
+    static const char *nameOf(Endpoint endpoint) {
+        static const char *const names[endpointCount] = {
+            "top",      "peek",   "size",   "push", "pop", "push_many",
+            "pop_many", "create", "remove", "copy", "fork", "move"};
+        return names[static_cast<std::size_t>(endpoint)];
+    }
+
+    struct Totals {
+        std::uint64_t requests[endpointCount][statusCount] = {};
+        LatencyHistogram latency[endpointCount];
+        std::int64_t nodes = 0;
+        std::int64_t sharedNodes = 0;
+        std::uint64_t lockWaits = 0;
+        std::uint64_t lockWaitNs = 0;
+        std::int64_t reclaimBacklog = 0;
+        std::uint64_t spillFaults = 0;
+    };
+
+    static void recordRequest(Endpoint endpoint, int status,
+                              std::chrono::nanoseconds latency) {
+        auto &slot = Slot::local();
+        auto index = static_cast<std::size_t>(endpoint);
+        auto ns = static_cast<std::uint64_t>(latency.count());
+        slot.requests[index][statusIndexOf(status)].add(1);
+        slot.latency[index][LatencyHistogram::bucketOf(ns)].add(1);
+        slot.latencySumNs[index].add(ns);
+    }
+
+    static void addNodes(std::int64_t delta) { Slot::local().nodes.add(delta); }
+
+    static void addSharedNodes(std::int64_t delta) {
+        Slot::local().sharedNodes.add(delta);
+    }
+
+    static void addReclaimBacklog(std::int64_t delta) {
+        Slot::local().reclaimBacklog.add(delta);
+    }
+
+    static void addSpillFaults(std::int64_t delta) {
+        Slot::local().spillFaults.add(delta);
+    }
+
+    static void recordLockWait(std::chrono::nanoseconds wait) {
+        auto &slot = Slot::local();
+        slot.lockWaits.add(1);
+        slot.lockWaitNs.add(wait.count());
+    }
+
+    /**
+     * Sums the slots of all the threads. The counts of the threads still
+     * running may be off by their latest increments.
+     */
+    static Totals collect() {
+        auto &registry = Registry::instance();
+        Totals totals;
+        std::lock_guard _lock(registry.lock);
+        registry.retired.addTo(totals);
+        for (auto slot : registry.slots) {
+            slot->addTo(totals);
+        }
+        return totals;
+    }
+
+    /**
+     * Gauges sampled from the stack map and the memory budget when the
+     * metrics are scraped, rather than recorded by the threads.
+     */
+    struct Gauges {
+        std::uint64_t stacks = 0;
+        std::uint64_t stackLength = 0;
+        std::uint64_t stackBytes = 0;
+        std::uint64_t memoryBytes = 0;
+        std::uint64_t internedValues = 0;
+        std::uint64_t internedBytes = 0;
+        std::uint64_t internedReferencedBytes = 0;
+        std::uint64_t spilledValues = 0;
+        std::uint64_t spilledBytes = 0;
+        std::uint64_t spillFileBytes = 0;
+    };
+
+    /**
+     * Formats `totals` and `gauges` in the Prometheus text exposition format.
+     */
+    static std::string format(const Totals &totals, const Gauges &gauges) {
+        std::string out;
+        auto line = [&](const std::string &name, const std::string &labels,
+                        const std::string &value) {
+            out += name;
+            if (!labels.empty()) {
+                out += "{" + labels + "}";
+            }
+            out += " " + value + "\n";
+        };
+        auto header = [&](const char *name, const char *type,
+                          const char *help) {
+            out += std::string("# HELP ") + name + " " + help + "\n";
+            out += std::string("# TYPE ") + name + " " + type + "\n";
+        };
+        auto seconds = [](std::uint64_t ns) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.9g", double(ns) / 1e9);
+            return std::string(buffer);
+        };
+
+        header("stack_server_requests_total", "counter",
+               "Requests by endpoint and status code.");
+        for (std::size_t e = 0; e < endpointCount; ++e) {
+            auto endpoint = std::string("endpoint=\"") +
+                            nameOf(static_cast<Endpoint>(e)) + "\"";
+            for (std::size_t s = 0; s < statusCount; ++s) {
+                auto code = s < statusCodes.size()
+                                ? std::to_string(statusCodes[s])
+                                : std::string("other");
+                line("stack_server_requests_total",
+                     endpoint + ",code=\"" + code + "\"",
+                     std::to_string(totals.requests[e][s]));
+            }
+        }
+
+        // The histogram is exported with a bucket per power of two from
+        // about a microsecond, which are bounds of the recorded buckets. The
+        // last recorded bucket, which also holds the longer values, is only
+        // counted in `+Inf`.
+        header("stack_server_request_duration_seconds", "histogram",
+               "Latency of the stack operations by endpoint.");
+        for (std::size_t e = 0; e < endpointCount; ++e) {
+            auto endpoint = std::string("endpoint=\"") +
+                            nameOf(static_cast<Endpoint>(e)) + "\"";
+            auto &histogram = totals.latency[e];
+            std::uint64_t cumulative = 0;
+            std::size_t bucket = 0;
+            for (auto exponent = 10u;
+                 exponent < LatencyHistogram::maxExponent; ++exponent) {
+                auto bound = std::uint64_t(1) << exponent;
+                for (; bucket < LatencyHistogram::bucketCount &&
+                       LatencyHistogram::upperBoundOf(bucket) <= bound;
+                     ++bucket) {
+                    cumulative += histogram.buckets[bucket];
+                }
+                line("stack_server_request_duration_seconds_bucket",
+                     endpoint + ",le=\"" + seconds(bound) + "\"",
+                     std::to_string(cumulative));
+            }
+            line("stack_server_request_duration_seconds_bucket",
+                 endpoint + ",le=\"+Inf\"", std::to_string(histogram.count));
+            line("stack_server_request_duration_seconds_sum", endpoint,
+                 seconds(histogram.sumNs));
+            line("stack_server_request_duration_seconds_count", endpoint,
+                 std::to_string(histogram.count));
+        }
+
+        header("stack_server_request_duration_quantile_seconds", "gauge",
+               "Latency quantiles of the stack operations by endpoint.");
+        for (std::size_t e = 0; e < endpointCount; ++e) {
+            auto endpoint = std::string("endpoint=\"") +
+                            nameOf(static_cast<Endpoint>(e)) + "\"";
+            for (auto quantile : {0.5, 0.9, 0.99, 0.999}) {
+                char label[16];
+                std::snprintf(label, sizeof(label), "%g", quantile);
+                line("stack_server_request_duration_quantile_seconds",
+                     endpoint + ",quantile=\"" + label + "\"",
+                     seconds(totals.latency[e].quantile(quantile)));
+            }
+        }
+
+        header("stack_server_stacks", "gauge", "Number of stacks.");
+        line("stack_server_stacks", "", std::to_string(gauges.stacks));
+        header("stack_server_stack_length", "gauge",
+               "Total length of the stacks, counting a shared tail once for "
+               "each stack.");
+        line("stack_server_stack_length", "",
+             std::to_string(gauges.stackLength));
+        header("stack_server_stack_bytes", "gauge",
+               "Total bytes of the values of the stacks, counting a shared "
+               "tail once for each stack.");
+        line("stack_server_stack_bytes", "", std::to_string(gauges.stackBytes));
+        header("stack_server_memory_bytes", "gauge",
+               "Memory held by the stack nodes and their values.");
+        line("stack_server_memory_bytes", "",
+             std::to_string(gauges.memoryBytes));
+        header("stack_server_interned_values", "gauge",
+               "Number of distinct values in the interning table.");
+        line("stack_server_interned_values", "",
+             std::to_string(gauges.internedValues));
+        header("stack_server_interned_bytes", "gauge",
+               "Bytes of the distinct values in the interning table.");
+        line("stack_server_interned_bytes", "",
+             std::to_string(gauges.internedBytes));
+        header("stack_server_intern_dedup_ratio", "gauge",
+               "Bytes of the interned values counted for each of their "
+               "references, over their bytes counted once.");
+        char ratio[32];
+        std::snprintf(ratio, sizeof(ratio), "%.9g",
+                      gauges.internedBytes == 0
+                          ? 1.0
+                          : double(gauges.internedReferencedBytes) /
+                                double(gauges.internedBytes));
+        line("stack_server_intern_dedup_ratio", "", ratio);
+        header("stack_server_nodes", "gauge", "Number of stack nodes.");
+        line("stack_server_nodes", "", std::to_string(totals.nodes));
+        header("stack_server_shared_nodes", "gauge",
+               "Number of stack nodes referenced more than once.");
+        line("stack_server_shared_nodes", "",
+             std::to_string(totals.sharedNodes));
+        header("stack_server_lock_waits_total", "counter",
+               "Acquisitions of a stack or shard lock which had to wait.");
+        line("stack_server_lock_waits_total", "",
+             std::to_string(totals.lockWaits));
+        header("stack_server_lock_wait_seconds_total", "counter",
+               "Time spent waiting for stack and shard locks.");
+        line("stack_server_lock_wait_seconds_total", "",
+             seconds(totals.lockWaitNs));
+        header("stack_server_reclaim_backlog", "gauge",
+               "Chains of dropped nodes waiting to be freed in the "
+               "background.");
+        line("stack_server_reclaim_backlog", "",
+             std::to_string(totals.reclaimBacklog));
+        header("stack_server_spilled_values", "gauge",
+               "Number of stack values spilled to the segment file.");
+        line("stack_server_spilled_values", "",
+             std::to_string(gauges.spilledValues));
+        header("stack_server_spilled_bytes", "gauge",
+               "Bytes of the live segments of the segment file.");
+        line("stack_server_spilled_bytes", "",
+             std::to_string(gauges.spilledBytes));
+        header("stack_server_spill_file_bytes", "gauge",
+               "Size of the segment file, holes included.");
+        line("stack_server_spill_file_bytes", "",
+             std::to_string(gauges.spillFileBytes));
+        header("stack_server_spill_faults_total", "counter",
+               "Spilled segments faulted back into memory.");
+        line("stack_server_spill_faults_total", "",
+             std::to_string(totals.spillFaults));
+        return out;
+    }
+
+private:
+    /**
+     * Counter written by one thread at a time and read by any.
+     */
+    class Counter {
+    public:
+        void add(std::int64_t delta) {
+            this->value.store(this->value.load(std::memory_order_relaxed) +
+                                  delta,
+                              std::memory_order_relaxed);
+        }
+        std::int64_t get() const {
+            return this->value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<std::int64_t> value{0};
+    };
+
+    struct Slot {
+        Counter requests[endpointCount][statusCount];
+        Counter latency[endpointCount][LatencyHistogram::bucketCount];
+        Counter latencySumNs[endpointCount];
+        Counter nodes;
+        Counter sharedNodes;
+        Counter lockWaits;
+        Counter lockWaitNs;
+        Counter reclaimBacklog;
+        Counter spillFaults;
+
+        static Slot &local() {
+            thread_local Registration registration;
+            return *registration.slot;
+        }
+
+        void addTo(Totals &totals) const {
+            for (std::size_t e = 0; e < endpointCount; ++e) {
+                for (std::size_t s = 0; s < statusCount; ++s) {
+                    totals.requests[e][s] += this->requests[e][s].get();
+                }
+                auto &histogram = totals.latency[e];
+                for (std::size_t b = 0; b < LatencyHistogram::bucketCount;
+                     ++b) {
+                    auto count = this->latency[e][b].get();
+                    histogram.buckets[b] += count;
+                    histogram.count += count;
+                }
+                histogram.sumNs += this->latencySumNs[e].get();
+            }
+            totals.nodes += this->nodes.get();
+            totals.sharedNodes += this->sharedNodes.get();
+            totals.lockWaits += this->lockWaits.get();
+            totals.lockWaitNs += this->lockWaitNs.get();
+            totals.reclaimBacklog += this->reclaimBacklog.get();
+            totals.spillFaults += this->spillFaults.get();
+        }
+
+        void fold(const Slot &other) {
+            for (std::size_t e = 0; e < endpointCount; ++e) {
+                for (std::size_t s = 0; s < statusCount; ++s) {
+                    this->requests[e][s].add(other.requests[e][s].get());
+                }
+                for (std::size_t b = 0; b < LatencyHistogram::bucketCount;
+                     ++b) {
+                    this->latency[e][b].add(other.latency[e][b].get());
+                }
+                this->latencySumNs[e].add(other.latencySumNs[e].get());
+            }
+            this->nodes.add(other.nodes.get());
+            this->sharedNodes.add(other.sharedNodes.get());
+            this->lockWaits.add(other.lockWaits.get());
+            this->lockWaitNs.add(other.lockWaitNs.get());
+            this->reclaimBacklog.add(other.reclaimBacklog.get());
+            this->spillFaults.add(other.spillFaults.get());
+        }
+    };
+
+    struct Registry {
+        std::mutex lock;
+        std::vector<Slot *> slots;
+        // Sum of the slots of the exited threads.
+        Slot retired;
+
+        static Registry &instance() {
+            static Registry registry;
+            return registry;
+        }
+    };
+
+    // Registers the slot of a thread, and folds it into the retired totals
+    // when the thread exits. The slot is allocated apart to keep the
+    // thread-local storage small.
+    struct Registration {
+        std::unique_ptr<Slot> slot = std::make_unique<Slot>();
+
+        Registration() {
+            auto &registry = Registry::instance();
+            std::lock_guard _lock(registry.lock);
+            registry.slots.push_back(this->slot.get());
+        }
+
+        ~Registration() {
+            auto &registry = Registry::instance();
+            std::lock_guard _lock(registry.lock);
+            registry.retired.fold(*this->slot);
+            for (auto &slot : registry.slots) {
+                if (slot == this->slot.get()) {
+                    slot = registry.slots.back();
+                    registry.slots.pop_back();
+                    break;
+                }
+            }
+        }
+    };
+
+    static std::size_t statusIndexOf(int status) {
+        for (std::size_t i = 0; i < statusCodes.size(); ++i) {
+            if (statusCodes[i] == status) {
+                return i;
+            }
+        }
+        return statusCodes.size();
+    }
+};
+
+#endif /* Metrics_hpp */
@@ -0,0 +1,74 @@
+#ifndef MutationLog_hpp
+#define MutationLog_hpp
+
+#include "CommitWaiter.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Receiver of the mutations of a `StackMap`, like `WriteAheadLog`.
+ *
+ * The mutations are reported after they succeeded, while the map still holds
+ * the locks ordering them against the conflicting ones, so the order of the
+ * reports is an order the mutations can be replayed in. The implementations
+ * should therefore only do cheap bookkeeping and leave any IO to later.
+ */
+template <typename K, typename T> class MutationLog {
+public:
+    virtual ~MutationLog() = default;
+
+    virtual void create(const K &name) = 0;
+    virtual void remove(const K &name) = 0;
+    virtual void push(const K &name, const T &value) = 0;
+    virtual void pushMany(const K &name, const std::vector<T> &values) = 0;
+    virtual void pop(const K &name, std::size_t count) = 0;
+    virtual void copy(const K &from, const K &to) = 0;
+    virtual void move(const K &from, const K &to) = 0;
+
+    /**
+     * Returns the sequence number of the last reported mutation.
+     */
+    virtual std::uint64_t getLastSeq() = 0;
+
+    /**
+     * Drops the mutations up to the sequence number `seq`, which are covered
+     * by a snapshot.
+     */
+    virtual void discardUpTo(std::uint64_t seq) = 0;
+
+    /**
+     * Returns the sequence number of the last mutation reported by the
+     * calling thread since the previous call, or 0 if there is none.
+     */
+    virtual std::uint64_t takeLastLogged() = 0;
+
+    /**
+     * Whether the mutation with the sequence number `seq` is committed, that
+     * is as durable as the log is configured to make it, and can be
+     * acknowledged. Always true for 0.
+     */
+    virtual bool isCommitted(std::uint64_t seq) const = 0;
+
+    /**
+     * Blocks until the mutation with the sequence number `seq` is committed.
+     */
+    virtual void waitCommitted(std::uint64_t seq) = 0;
+
+    /**
+     * Registers `waiter` to be woken once the mutation with the sequence
+     * number `seq` is committed, or the log fails. Returns false, without
+     * registering it, if that is already the case.
+     */
+    virtual bool addCommitWaiter(std::uint64_t seq,
+                                 std::shared_ptr<CommitWaiter> waiter) = 0;
+
+    /**
+     * Unregisters `waiter`, which is not woken after this returns.
+     */
+    virtual void cancelCommitWait(const CommitWaiter &waiter) = 0;
+};
+
+#endif /* MutationLog_hpp */
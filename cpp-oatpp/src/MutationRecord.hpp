@@ -0,0 +1,122 @@
+#ifndef MutationRecord_hpp
+#define MutationRecord_hpp
+
+#include "BinaryFormat.hpp"
+#include "StringStackMap.hpp"
+
+#include "oatpp/core/Types.hpp"
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * Encoding of a mutation of a `StringStackMap` as its operation and operands,
+ * written by `BinaryWriter`. Shared by the records of `WriteAheadLog` and the
+ * stream `ReplicationLog` ships to the replicas, which both put the sequence
+ * number of the mutation in front of it.
+ */
+class MutationRecord {
+public:
+    static void writeCreate(BinaryWriter &writer, const oatpp::String &name) {
+        writer.writeUInt8(OP_CREATE);
+        writer.writeString(name);
+    }
+
+    static void writeRemove(BinaryWriter &writer, const oatpp::String &name) {
+        writer.writeUInt8(OP_REMOVE);
+        writer.writeString(name);
+    }
+
+    static void writePush(BinaryWriter &writer, const oatpp::String &name,
+                          const SmallString &value) {
+        writer.writeUInt8(OP_PUSH);
+        writer.writeString(name);
+        writer.writeUInt32(1);
+        writer.writeString(value);
+    }
+
+    static void writePushMany(BinaryWriter &writer, const oatpp::String &name,
+                              const std::vector<SmallString> &values) {
+        writer.writeUInt8(OP_PUSH);
+        writer.writeString(name);
+        writer.writeUInt32(static_cast<v_uint32>(values.size()));
+        for (auto &value : values) {
+            writer.writeString(value);
+        }
+    }
+
+    static void writePop(BinaryWriter &writer, const oatpp::String &name,
+                         std::size_t count) {
+        writer.writeUInt8(OP_POP);
+        writer.writeString(name);
+        writer.writeUInt32(static_cast<v_uint32>(count));
+    }
+
+    static void writeCopy(BinaryWriter &writer, const oatpp::String &from,
+                          const oatpp::String &to) {
+        writer.writeUInt8(OP_COPY);
+        writer.writeString(from);
+        writer.writeString(to);
+    }
+
+    static void writeMove(BinaryWriter &writer, const oatpp::String &from,
+                          const oatpp::String &to) {
+        writer.writeUInt8(OP_MOVE);
+        writer.writeString(from);
+        writer.writeString(to);
+    }
+
+    /**
+     * Reads a mutation and applies it to `map`, throwing the error of the map
+     * if it fails, or `std::runtime_error` if the mutation is malformed.
+     */
+    static void apply(StringStackMap &map, BinaryReader &reader) {
+        auto op = reader.readUInt8();
+        auto name = reader.readString();
+        switch (op) {
+        case OP_CREATE:
+            map.create(std::move(name));
+            break;
+        case OP_REMOVE:
+            map.remove(name);
+            break;
+        case OP_PUSH: {
+            auto count = reader.readUInt32();
+            if (count == 1) {
+                map.push(name, reader.readSmallString());
+                break;
+            }
+            std::vector<SmallString> values(count);
+            for (auto &value : values) {
+                value = reader.readSmallString();
+            }
+            map.pushMany(name, std::move(values));
+            break;
+        }
+        case OP_POP:
+            map.popMany(name, reader.readUInt32());
+            break;
+        case OP_COPY:
+            map.copy(name, reader.readString());
+            break;
+        case OP_MOVE:
+            map.move(name, reader.readString());
+            break;
+        default:
+            throw std::runtime_error("Unknown operation");
+        }
+    }
+
+private:
+    enum Op : v_uint8 {
+        OP_CREATE = 1,
+        OP_REMOVE = 2,
+        OP_PUSH = 3,
+        OP_POP = 4,
+        OP_COPY = 5,
+        OP_MOVE = 6,
+    };
+};
+
+#endif /* MutationRecord_hpp */
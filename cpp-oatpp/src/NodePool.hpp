@@ -0,0 +1,200 @@
+#ifndef NodePool_hpp
+#define NodePool_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * Allocation counters of a node pool.
+ */
+struct NodePoolStats {
+    // Blocks handed out and given back by the pool.
+    std::uint64_t allocations;
+    std::uint64_t deallocations;
+    // Slabs requested from the global allocator, each holding many blocks.
+    std::uint64_t upstreamAllocations;
+    // Batches moved between the thread caches and the shared free list.
+    std::uint64_t transfers;
+};
+
+/**
+ * Pool of fixed size memory blocks with per-thread caches.
+ *
+ * Allocation and deallocation only touch the free list of the calling thread.
+ * A cache which runs dry refills a batch from the shared free list, and a cache
+ * which grows too large gives a batch back, so memory freed by one thread is
+ * rebalanced to the others. Blocks come from slabs which are never released.
+ *
+ * The pool is never destroyed, as the thread caches give their blocks back
+ * when their threads exit, which may be after the static objects are
+ * destroyed, like the worker of `Reclaimer`.
+ */
+template <std::size_t Size, std::size_t Align> class NodePool {
+public:
+    static NodePool &instance() {
+        static auto pool = new NodePool();
+        return *pool;
+    }
+
+    void *allocate() {
+        auto &cache = ThreadCache::local();
+        if (cache.head == nullptr) {
+            this->refill(cache);
+        }
+        auto block = cache.head;
+        cache.head = block->next;
+        --cache.count;
+        ++cache.allocations;
+        return block;
+    }
+
+    void deallocate(void *ptr) {
+        auto &cache = ThreadCache::local();
+        auto block = static_cast<Block *>(ptr);
+        block->next = cache.head;
+        cache.head = block;
+        ++cache.count;
+        ++cache.deallocations;
+        if (cache.count >= 2 * batchSize) {
+            this->flush(cache, batchSize);
+        }
+    }
+
+    /**
+     * The allocation counts are gathered from the thread caches whenever they
+     * exchange a batch, so they may lag behind by up to one batch per thread.
+     */
+    NodePoolStats getStats() const {
+        return {this->allocations.load(std::memory_order_relaxed),
+                this->deallocations.load(std::memory_order_relaxed),
+                this->upstreamAllocations.load(std::memory_order_relaxed),
+                this->transfers.load(std::memory_order_relaxed)};
+    }
+
+private:
+    union Block {
+        Block *next;
+        alignas(Align) unsigned char storage[Size];
+    };
+
+    static constexpr std::size_t alignment = alignof(Block);
+    static constexpr std::size_t batchSize = 64;
+    static constexpr std::size_t slabBlocks = 1024;
+
+    struct ThreadCache {
+        Block *head = nullptr;
+        std::size_t count = 0;
+        std::uint64_t allocations = 0;
+        std::uint64_t deallocations = 0;
+
+        static ThreadCache &local() {
+            thread_local ThreadCache cache;
+            return cache;
+        }
+
+        ~ThreadCache() { NodePool::instance().flush(*this, this->count); }
+    };
+
+    NodePool() = default;
+
+    void refill(ThreadCache &cache) {
+        std::lock_guard _lock(this->lock);
+        this->publishCounts(cache);
+        if (this->freeHead == nullptr) {
+            auto slab = static_cast<Block *>(::operator new(
+                sizeof(Block) * slabBlocks, std::align_val_t(alignment)));
+            this->slabs.push_back(slab);
+            for (std::size_t i = 0; i < slabBlocks; ++i) {
+                slab[i].next = this->freeHead;
+                this->freeHead = &slab[i];
+            }
+            this->upstreamAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < batchSize && this->freeHead != nullptr;
+             ++i) {
+            auto block = this->freeHead;
+            this->freeHead = block->next;
+            block->next = cache.head;
+            cache.head = block;
+            ++cache.count;
+        }
+        this->transfers.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flush(ThreadCache &cache, std::size_t count) {
+        std::lock_guard _lock(this->lock);
+        this->publishCounts(cache);
+        for (std::size_t i = 0; i < count && cache.head != nullptr; ++i) {
+            auto block = cache.head;
+            cache.head = block->next;
+            block->next = this->freeHead;
+            this->freeHead = block;
+            --cache.count;
+        }
+        this->transfers.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void publishCounts(ThreadCache &cache) {
+        this->allocations.fetch_add(cache.allocations,
+                                    std::memory_order_relaxed);
+        this->deallocations.fetch_add(cache.deallocations,
+                                      std::memory_order_relaxed);
+        cache.allocations = 0;
+        cache.deallocations = 0;
+    }
+
+    std::mutex lock;
+    Block *freeHead = nullptr;
+    std::vector<Block *> slabs;
+
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> deallocations{0};
+    std::atomic<std::uint64_t> upstreamAllocations{0};
+    std::atomic<std::uint64_t> transfers{0};
+};
+
+/**
+ * Stateless allocator serving single objects from the `NodePool` of their size
+ * class, to be used as the allocator of `Stack`. Arrays go to the global
+ * allocator.
+ */
+template <typename T> class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template <typename U> PoolAllocator(const PoolAllocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        if (n == 1) {
+            return static_cast<T *>(Pool::instance().allocate());
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, std::size_t n) noexcept {
+        if (n == 1) {
+            Pool::instance().deallocate(ptr);
+        } else {
+            ::operator delete(ptr);
+        }
+    }
+
+    static NodePoolStats getStats() { return Pool::instance().getStats(); }
+
+    template <typename U> bool operator==(const PoolAllocator<U> &) const {
+        return true;
+    }
+    template <typename U> bool operator!=(const PoolAllocator<U> &) const {
+        return false;
+    }
+
+private:
+    using Pool = NodePool<sizeof(T), alignof(T)>;
+};
+
+#endif /* NodePool_hpp */
@@ -0,0 +1,66 @@
+#ifndef PopWaiter_hpp
+#define PopWaiter_hpp
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Pop parked on an empty stack until a value is pushed to it, registered with
+ * `StackMap::popRefOrWait`.
+ *
+ * A push wakes as many waiters as it pushes values, in the order they were
+ * parked, and unregisters them. A woken waiter is not handed the value, it
+ * only retries the pop, and parks again if another pop got there first.
+ */
+class PopWaiter {
+public:
+    virtual ~PopWaiter() = default;
+
+    /**
+     * Called by the push waking the waiter, with the lock of the waiters of
+     * the shard held, so it must not block.
+     */
+    virtual void wake() = 0;
+
+private:
+    // Whether the waiter is in the list of its stack, guarded by the lock of
+    // the waiters of the shard.
+    bool queued = false;
+
+    template <typename K, typename T, typename S> friend class StackMap;
+};
+
+/**
+ * Waiter blocking the thread of the pop.
+ */
+class BlockingPopWaiter : public PopWaiter {
+public:
+    void wake() override {
+        {
+            std::lock_guard _lock(this->lock);
+            this->woken = true;
+        }
+        this->changed.notify_one();
+    }
+
+    /**
+     * Blocks until the waiter is woken or `deadline` passes. Returns whether
+     * it was woken, and consumes the wake.
+     */
+    template <typename Clock, typename Duration>
+    bool waitUntil(const std::chrono::time_point<Clock, Duration> &deadline) {
+        std::unique_lock _lock(this->lock);
+        auto woken = this->changed.wait_until(_lock, deadline,
+                                              [&] { return this->woken; });
+        this->woken = false;
+        return woken;
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable changed;
+    bool woken = false;
+};
+
+#endif /* PopWaiter_hpp */
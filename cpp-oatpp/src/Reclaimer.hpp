@@ -0,0 +1,119 @@
+#ifndef Reclaimer_hpp
+#define Reclaimer_hpp
+
+#include "Metrics.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/**
+ * Background thread freeing the chains of nodes handed over by `Stack`, so
+ * that dropping a long stack does not stall the request dropping it.
+ *
+ * The chains are freed in steps of at most `stepBudget` nodes, taking turns,
+ * so that a very long chain does not hold back the others. The chains which
+ * are still pending when the program exits are freed then.
+ */
+class Reclaimer {
+public:
+    /**
+     * Frees up to `budget` nodes of the chain starting at `head`, and returns
+     * the rest of the chain, or nullptr if it is done.
+     */
+    using Step = void *(*)(void *head, std::size_t budget);
+
+    static constexpr std::size_t stepBudget = 1024;
+
+    static Reclaimer &instance() {
+        static Reclaimer reclaimer;
+        return reclaimer;
+    }
+
+    /**
+     * Queues the chain starting at `head`, which is freed by `step`.
+     */
+    void defer(void *head, Step step) {
+        {
+            std::lock_guard _lock(this->lock);
+            this->chains.push_back({head, step});
+        }
+        Metrics::addReclaimBacklog(1);
+        this->changed.notify_all();
+    }
+
+    /**
+     * Returns the number of chains waiting to be freed.
+     */
+    std::size_t getBacklog() {
+        std::lock_guard _lock(this->lock);
+        return this->chains.size() + (this->busy ? 1 : 0);
+    }
+
+    /**
+     * Blocks until all the chains queued so far are freed.
+     */
+    void drain() {
+        std::unique_lock _lock(this->lock);
+        this->changed.wait(_lock,
+                           [&] { return this->chains.empty() && !this->busy; });
+    }
+
+    ~Reclaimer() {
+        {
+            std::lock_guard _lock(this->lock);
+            this->stopped = true;
+        }
+        this->changed.notify_all();
+        this->worker.join();
+    }
+
+private:
+    struct Chain {
+        void *head;
+        Step step;
+    };
+
+    Reclaimer() : worker([this] { this->run(); }) {}
+
+    void run() {
+        std::unique_lock _lock(this->lock);
+        while (true) {
+            this->changed.wait(
+                _lock, [&] { return this->stopped || !this->chains.empty(); });
+            if (this->chains.empty()) {
+                return;
+            }
+            auto chain = this->chains.front();
+            this->chains.pop_front();
+            this->busy = true;
+            // Freed without a budget once stopping, as nothing waits anymore.
+            auto budget = this->stopped ? SIZE_MAX : stepBudget;
+            _lock.unlock();
+
+            chain.head = chain.step(chain.head, budget);
+
+            _lock.lock();
+            this->busy = false;
+            if (chain.head != nullptr) {
+                this->chains.push_back(chain);
+            } else {
+                Metrics::addReclaimBacklog(-1);
+                this->changed.notify_all();
+            }
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<Chain> chains;
+    bool busy = false;
+    bool stopped = false;
+    // Started last, once the state above is initialized.
+    std::thread worker;
+};
+
+#endif /* Reclaimer_hpp */
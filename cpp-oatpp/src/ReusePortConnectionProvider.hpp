@@ -0,0 +1,144 @@
+#ifndef ReusePortConnectionProvider_hpp
+#define ReusePortConnectionProvider_hpp
+
+#include "FileUtils.hpp"
+
+#include "oatpp/core/provider/Invalidator.hpp"
+#include "oatpp/network/ConnectionProvider.hpp"
+#include "oatpp/network/tcp/Connection.hpp"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+/**
+ * TCP server connection provider whose listening socket is bound with
+ * `SO_REUSEPORT`, so that several providers can listen on the same port. The
+ * kernel then spreads the incoming connections across their sockets, each
+ * with its own accept queue.
+ *
+ * Like the TCP provider of oatpp, connections are accepted with a blocking
+ * `accept`, also in async mode, where only the connections are served by
+ * coroutines.
+ */
+class ReusePortConnectionProvider
+    : public oatpp::network::ServerConnectionProvider {
+public:
+    ReusePortConnectionProvider(const std::string &host, v_uint16 port)
+        : invalidator(std::make_shared<Invalidator>()), closed(false) {
+        this->handle = listenOn(host, port);
+        this->setProperty(PROPERTY_HOST, host.c_str());
+        this->setProperty(PROPERTY_PORT, std::to_string(port).c_str());
+    }
+
+    ~ReusePortConnectionProvider() override { this->stop(); }
+
+    static std::shared_ptr<ReusePortConnectionProvider>
+    createShared(const std::string &host, v_uint16 port) {
+        return std::make_shared<ReusePortConnectionProvider>(host, port);
+    }
+
+    oatpp::provider::ResourceHandle<oatpp::data::stream::IOStream>
+    get() override {
+        while (!this->closed.load()) {
+            auto connection = ::accept(this->handle, nullptr, nullptr);
+            if (connection >= 0) {
+                int noDelay = 1;
+                ::setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &noDelay,
+                             sizeof(noDelay));
+                return oatpp::provider::ResourceHandle<
+                    oatpp::data::stream::IOStream>(
+                    std::make_shared<oatpp::network::tcp::Connection>(
+                        connection),
+                    this->invalidator);
+            }
+            // The errors of a single connection, or of a lack of resources,
+            // do not stop the server, which accepts the next one.
+            if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN &&
+                errno != EMFILE && errno != ENFILE && errno != ENOBUFS &&
+                errno != ENOMEM) {
+                break;
+            }
+        }
+        return nullptr;
+    }
+
+    oatpp::async::CoroutineStarterForResult<
+        const oatpp::provider::ResourceHandle<oatpp::data::stream::IOStream> &>
+    getAsync() override {
+        throw std::runtime_error("[ReusePortConnectionProvider::getAsync()]: "
+                                 "Error. Not implemented.");
+    }
+
+    /**
+     * Closes the listening socket, which wakes up a blocked `get`.
+     */
+    void stop() override {
+        if (!this->closed.exchange(true)) {
+            ::shutdown(this->handle, SHUT_RDWR);
+            ::close(this->handle);
+        }
+    }
+
+private:
+    class Invalidator
+        : public oatpp::provider::Invalidator<oatpp::data::stream::IOStream> {
+    public:
+        void invalidate(const std::shared_ptr<oatpp::data::stream::IOStream>
+                            &connection) override {
+            auto tcp = std::static_pointer_cast<oatpp::network::tcp::Connection>(
+                connection);
+            ::shutdown(tcp->getHandle(), SHUT_RDWR);
+        }
+    };
+
+    static int listenOn(const std::string &host, v_uint16 port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo *addresses;
+        auto service = std::to_string(port);
+        auto error = ::getaddrinfo(host.c_str(), service.c_str(), &hints,
+                                   &addresses);
+        if (error != 0) {
+            throw std::runtime_error("Cannot resolve " + host + ": " +
+                                     ::gai_strerror(error));
+        }
+        std::unique_ptr<addrinfo, decltype(&::freeaddrinfo)> _addresses(
+            addresses, &::freeaddrinfo);
+
+        auto handle = ::socket(addresses->ai_family, addresses->ai_socktype,
+                               addresses->ai_protocol);
+        if (handle < 0) {
+            FileUtils::throwError("Cannot create socket");
+        }
+        int enable = 1;
+        if (::setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, &enable,
+                         sizeof(enable)) != 0 ||
+            ::setsockopt(handle, SOL_SOCKET, SO_REUSEPORT, &enable,
+                         sizeof(enable)) != 0 ||
+            ::bind(handle, addresses->ai_addr, addresses->ai_addrlen) != 0 ||
+            ::listen(handle, SOMAXCONN) != 0) {
+            auto savedErrno = errno;
+            ::close(handle);
+            errno = savedErrno;
+            FileUtils::throwError("Cannot listen on " + host + ":" + service);
+        }
+        return handle;
+    }
+
+    std::shared_ptr<Invalidator> invalidator;
+    std::atomic<bool> closed;
+    int handle;
+};
+
+#endif /* ReusePortConnectionProvider_hpp */
@@ -0,0 +1,110 @@
+#ifndef ServerGroup_hpp
+#define ServerGroup_hpp
+
+#include "ReusePortConnectionProvider.hpp"
+
+#include "oatpp/core/base/Environment.hpp"
+#include "oatpp/network/ConnectionHandler.hpp"
+#include "oatpp/network/Server.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Servers sharing the listening port through `SO_REUSEPORT`, each with its
+ * own socket, accept thread and connection handler, so that the accepts
+ * scale with the number of servers instead of going through a single queue.
+ *
+ * A server may be pinned to a CPU. Its connection handler is created on its
+ * accept thread once pinned, so the threads the handler starts, the thread
+ * of each connection in sync mode and the workers of the executor in async
+ * mode, inherit the affinity and serve the connections on the same CPU.
+ */
+class ServerGroup {
+public:
+    using HandlerFactory =
+        std::function<std::shared_ptr<oatpp::network::ConnectionHandler>()>;
+
+    /**
+     * Binds the sockets of `count` servers on `host` and `port`. Server `i` is
+     * pinned to `cpus[i % cpus.size()]`, or not pinned if `cpus` is empty.
+     */
+    ServerGroup(const std::string &host, v_uint16 port, std::size_t count,
+                std::vector<int> cpus, HandlerFactory createHandler)
+        : cpus(std::move(cpus)), createHandler(std::move(createHandler)) {
+        for (std::size_t i = 0; i < (count == 0 ? 1 : count); ++i) {
+            this->providers.push_back(
+                ReusePortConnectionProvider::createShared(host, port));
+        }
+    }
+
+    std::size_t getCount() const { return this->providers.size(); }
+
+    /**
+     * Runs the servers until they are stopped.
+     */
+    void run() {
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < this->providers.size(); ++i) {
+            threads.emplace_back([this, i] { this->runServer(i); });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    void stop() {
+        std::lock_guard _lock(this->lock);
+        this->stopped = true;
+        for (auto &server : this->servers) {
+            server->stop();
+        }
+        for (auto &provider : this->providers) {
+            provider->stop();
+        }
+    }
+
+private:
+    void runServer(std::size_t index) {
+        if (!this->cpus.empty()) {
+            auto cpu = this->cpus[index % this->cpus.size()];
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if (::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) !=
+                0) {
+                OATPP_LOGW("ServerGroup", "Cannot pin server %zu to CPU %d",
+                           index, cpu);
+            }
+        }
+
+        std::shared_ptr<oatpp::network::Server> server;
+        {
+            std::lock_guard _lock(this->lock);
+            if (this->stopped) {
+                return;
+            }
+            server = std::make_shared<oatpp::network::Server>(
+                this->providers[index], this->createHandler());
+            this->servers.push_back(server);
+        }
+        server->run();
+    }
+
+    std::vector<std::shared_ptr<ReusePortConnectionProvider>> providers;
+    std::vector<int> cpus;
+    HandlerFactory createHandler;
+
+    std::mutex lock;
+    std::vector<std::shared_ptr<oatpp::network::Server>> servers;
+    bool stopped = false;
+};
+
+#endif /* ServerGroup_hpp */
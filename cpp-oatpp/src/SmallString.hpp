@@ -0,0 +1,168 @@
+#ifndef SmallString_hpp
+#define SmallString_hpp
+
+#include "oatpp/core/Types.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string>
+
+/**
+ * Immutable string stored inline when it fits in `inlineCapacity` bytes, and
+ * otherwise kept as a shared `oatpp::String`.
+ *
+ * Most values pushed to the stacks are short, so storing them in the node
+ * itself saves the separate allocation and the pointer chase of the shared
+ * string on every read. The size is fixed, unlike a flexible array at the end
+ * of the node, so that the nodes keep fitting the fixed-size blocks of
+ * `NodePool`; a node of `Stack<SmallString>` takes one 64-byte cache line.
+ */
+class SmallString {
+public:
+    using LargeString = oatpp::String;
+
+    static constexpr std::size_t inlineCapacity = 39;
+
+    SmallString() { this->tag() = 0; }
+
+    SmallString(const char *data, std::size_t size) {
+        if (size <= inlineCapacity) {
+            this->setInline(data, size);
+        } else {
+            new (this->storage)
+                LargeString(data, static_cast<v_buff_size>(size));
+            this->tag() = largeTag;
+        }
+    }
+
+    SmallString(const char *value) : SmallString(value, std::strlen(value)) {}
+
+    /**
+     * Copies a short `value` inline, and shares a long one.
+     */
+    SmallString(const oatpp::String &value) {
+        auto size = value ? value->size() : 0;
+        if (size <= inlineCapacity) {
+            this->setInline(size > 0 ? value->data() : nullptr, size);
+        } else {
+            new (this->storage) LargeString(value);
+            this->tag() = largeTag;
+        }
+    }
+
+    SmallString(const SmallString &other) {
+        if (other.isInline()) {
+            std::memcpy(this->storage, other.storage, sizeof(this->storage));
+        } else {
+            new (this->storage) LargeString(other.large());
+            this->tag() = largeTag;
+        }
+    }
+
+    SmallString(SmallString &&other) noexcept {
+        if (other.isInline()) {
+            std::memcpy(this->storage, other.storage, sizeof(this->storage));
+        } else {
+            new (this->storage) LargeString(std::move(other.large()));
+            this->tag() = largeTag;
+            other.large().~LargeString();
+            other.tag() = 0;
+        }
+    }
+
+    SmallString &operator=(const SmallString &other) {
+        if (this != &other) {
+            SmallString copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    SmallString &operator=(SmallString &&other) noexcept {
+        if (this != &other) {
+            this->~SmallString();
+            new (this) SmallString(std::move(other));
+        }
+        return *this;
+    }
+
+    ~SmallString() {
+        if (!this->isInline()) {
+            this->large().~LargeString();
+        }
+    }
+
+    const char *data() const {
+        return this->isInline() ? this->storage : this->large()->data();
+    }
+    std::size_t size() const {
+        return this->isInline() ? this->tag() : this->large()->size();
+    }
+    bool isInline() const { return this->tag() != largeTag; }
+
+    /**
+     * Returns the value as an `oatpp::String`, which shares a long value and
+     * allocates a copy of a short one.
+     */
+    oatpp::String toString() const {
+        if (this->isInline()) {
+            return oatpp::String(this->storage,
+                                 static_cast<v_buff_size>(this->tag()));
+        }
+        return this->large();
+    }
+
+    friend bool operator==(const SmallString &lhs, const SmallString &rhs) {
+        return lhs.size() == rhs.size() &&
+               std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+    }
+    friend bool operator!=(const SmallString &lhs, const SmallString &rhs) {
+        return !(lhs == rhs);
+    }
+
+private:
+    static constexpr unsigned char largeTag = 0xFF;
+
+    static_assert(sizeof(LargeString) <= inlineCapacity,
+                  "LargeString overlaps the tag of SmallString");
+
+    void setInline(const char *data, std::size_t size) {
+        if (size > 0) {
+            std::memcpy(this->storage, data, size);
+        }
+        this->tag() = static_cast<unsigned char>(size);
+    }
+
+    // The last byte of the storage is the size of the inline value, or
+    // `largeTag` if a `LargeString` is constructed at its start.
+    unsigned char &tag() {
+        return reinterpret_cast<unsigned char &>(this->storage[inlineCapacity]);
+    }
+    unsigned char tag() const {
+        return static_cast<unsigned char>(this->storage[inlineCapacity]);
+    }
+
+    LargeString &large() {
+        return *std::launder(reinterpret_cast<LargeString *>(this->storage));
+    }
+    const LargeString &large() const {
+        return *std::launder(
+            reinterpret_cast<const LargeString *>(this->storage));
+    }
+
+    alignas(LargeString) char storage[inlineCapacity + 1];
+};
+
+/**
+ * Returns the number of bytes of `value` counted by the byte accounting of
+ * the stacks.
+ */
+inline std::size_t payloadSizeOf(const SmallString &value) {
+    return value.size();
+}
+
+static_assert(sizeof(SmallString) <= 40,
+              "SmallString no longer fits a node in a cache line");
+
+#endif /* SmallString_hpp */
@@ -0,0 +1,355 @@
+#ifndef Snapshot_hpp
+#define Snapshot_hpp
+
+#include "BinaryFormat.hpp"
+#include "FileUtils.hpp"
+#include "StringStackMap.hpp"
+
+#include "oatpp/core/base/Environment.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Binary snapshot of a `StringStackMap` which preserves the sharing between
+ * the stacks: every node is written once, however many stacks share it, so
+ * copied stacks do not inflate the snapshot and are loaded as copies again.
+ *
+ * The file starts with a magic, the sequence number of the last logged
+ * mutation included, and the numbers of stacks and nodes. The nodes follow,
+ * each as the id of its next node and its value. They are written tail first,
+ * so every node refers to one loaded before it. The stacks come last, each as
+ * its name and the id of its head. Ids start at 1, 0 standing for none. The
+ * integers and strings are encoded by `BinaryWriter`.
+ *
+ * The runs of values spilled out of memory are written as the nodes they
+ * were, so they are loaded back into memory.
+ */
+class Snapshot {
+public:
+    struct Info {
+        std::uint64_t seq;
+        std::uint64_t stackCount;
+        std::uint64_t nodeCount;
+    };
+
+    /**
+     * Writes the stacks of `map` to `path`, replacing the file at once when
+     * it is complete.
+     *
+     * The mutations are only paused while the heads of the stacks are taken,
+     * the nodes are written afterwards as they never change while shared.
+     */
+    static Info write(StringStackMap &map, const std::string &path) {
+        Info info{0, 0, 0};
+        auto heads = takeHeads(map, info.seq);
+        info.stackCount = heads.size();
+
+        auto tempPath = path + ".tmp";
+        auto fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                         0644);
+        try {
+            if (fd < 0) {
+                FileUtils::throwError("Cannot open " + tempPath);
+            }
+
+            std::string buffer(headerSize, '\0');
+            BinaryWriter writer(buffer);
+            auto flush = [&](std::size_t threshold) {
+                if (buffer.size() >= threshold) {
+                    FileUtils::writeAll(fd, buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            };
+
+            std::unordered_map<const Node *, std::uint64_t> ids;
+            std::vector<const Node *> chain;
+            std::vector<SmallString> spilled;
+            for (auto &head : heads) {
+                // Only the part of the stack which no previous stack shares
+                // is new, it is written from its bottom up.
+                chain.clear();
+                for (const Node *node = head.second;
+                     node != nullptr && ids.find(node) == ids.end();
+                     node = node->next) {
+                    chain.push_back(node);
+                }
+                for (auto node = chain.rbegin(); node != chain.rend(); ++node) {
+                    if (StringStack::isPlaceholder(*node)) {
+                        // The values of a spilled run are written as the
+                        // nodes they were, and the placeholder stands for the
+                        // top one.
+                        spilled.clear();
+                        SpillCodec<SmallString>::load((*node)->value, spilled);
+                        auto next = idOf(ids, (*node)->next);
+                        for (auto value = spilled.rbegin();
+                             value != spilled.rend(); ++value) {
+                            writer.writeUInt64(next);
+                            writer.writeString(*value);
+                            next = ++info.nodeCount;
+                            flush(bufferSize);
+                        }
+                        ids.emplace(*node, next);
+                        continue;
+                    }
+                    writer.writeUInt64(idOf(ids, (*node)->next));
+                    writer.writeString((*node)->value);
+                    ids.emplace(*node, ++info.nodeCount);
+                    flush(bufferSize);
+                }
+            }
+            for (auto &head : heads) {
+                writer.writeString(head.first);
+                writer.writeUInt64(idOf(ids, head.second));
+                flush(bufferSize);
+            }
+            flush(0);
+
+            char header[headerSize];
+            std::memcpy(header, magic, sizeof(magic));
+            BinaryWriter::setUInt64(header + 8, info.seq);
+            BinaryWriter::setUInt64(header + 16, info.stackCount);
+            BinaryWriter::setUInt64(header + 24, info.nodeCount);
+            if (::pwrite(fd, header, headerSize, 0) !=
+                static_cast<ssize_t>(headerSize)) {
+                FileUtils::throwError("Cannot write " + tempPath);
+            }
+            if (::fsync(fd) != 0) {
+                FileUtils::throwError("Cannot sync " + tempPath);
+            }
+            ::close(fd);
+            fd = -1;
+            FileUtils::replace(tempPath, path);
+        } catch (...) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            releaseHeads(heads);
+            throw;
+        }
+        releaseHeads(heads);
+        return info;
+    }
+
+    /**
+     * Loads the stacks of the snapshot at `path` into `map`, which must be
+     * empty. Returns zeros if there is no snapshot.
+     *
+     * The file is mapped only to be read once: every node is decoded and
+     * allocated again, its value copied out of the file, so the load takes
+     * time in the number of nodes rather than of the mutations which built
+     * them, but the stacks do not stay backed by the file.
+     */
+    static Info load(StringStackMap &map, const std::string &path) {
+        Info info{0, 0, 0};
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT) {
+                return info;
+            }
+            FileUtils::throwError("Cannot open " + path);
+        }
+        struct stat status;
+        if (::fstat(fd, &status) != 0 || status.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error("Snapshot " + path + " is malformed");
+        }
+        auto size = static_cast<std::size_t>(status.st_size);
+        auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            FileUtils::throwError("Cannot map " + path);
+        }
+        ::madvise(data, size, MADV_SEQUENTIAL);
+
+        // Holds one reference to each loaded node until the stacks and the
+        // nodes linking to it hold theirs.
+        std::vector<Node *> nodes;
+        try {
+            auto begin = static_cast<const char *>(data);
+            BinaryReader reader(begin, begin + size);
+            if (std::memcmp(reader.take(sizeof(magic)), magic,
+                            sizeof(magic)) != 0) {
+                throw std::runtime_error("Unknown format");
+            }
+            info.seq = reader.readUInt64();
+            info.stackCount = reader.readUInt64();
+            info.nodeCount = reader.readUInt64();
+
+            nodes.reserve(std::min<std::uint64_t>(info.nodeCount, size / 12));
+            for (std::uint64_t i = 0; i < info.nodeCount; ++i) {
+                auto next = nodeOf(nodes, reader.readUInt64());
+                auto value = reader.readSmallString();
+                internValue(value);
+                if (next != nullptr) {
+                    Node::incRef(next);
+                }
+                nodes.push_back(StringStack::createNode(std::move(value), next));
+            }
+            for (std::uint64_t i = 0; i < info.stackCount; ++i) {
+                auto name = reader.readString();
+                auto head = nodeOf(nodes, reader.readUInt64());
+                StringStack stack;
+                if (head != nullptr) {
+                    Node::incRef(head);
+                    stack.head = head;
+                }
+                map.create(oatpp::String(name));
+                map.getStack(name).second = std::move(stack);
+            }
+            if (reader.remaining() != 0) {
+                throw std::runtime_error("Trailing data");
+            }
+        } catch (const std::exception &e) {
+            releaseNodes(nodes);
+            ::munmap(data, size);
+            throw std::runtime_error("Snapshot " + path +
+                                     " is malformed: " + e.what());
+        }
+        releaseNodes(nodes);
+        ::munmap(data, size);
+        return info;
+    }
+
+private:
+    using Node = StringStack::Node;
+
+    static constexpr char magic[8] = {'S', 'T', 'K', 'S', 'N', 'A', 'P', '1'};
+    static constexpr std::size_t headerSize = 32;
+    static constexpr std::size_t bufferSize = 1 << 20;
+
+    // Holding all the shards exclusively pauses every mutation, so the heads
+    // and the sequence number of the log are consistent with each other.
+    static std::vector<std::pair<oatpp::String, Node *>>
+    takeHeads(StringStackMap &map, std::uint64_t &seq) {
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        locks.reserve(map.shardCount);
+        for (std::size_t i = 0; i < map.shardCount; ++i) {
+            locks.emplace_back(map.shards[i].lock);
+        }
+
+        std::vector<std::pair<oatpp::String, Node *>> heads;
+        for (std::size_t i = 0; i < map.shardCount; ++i) {
+            for (auto &entry : map.shards[i].map) {
+                heads.emplace_back(entry.first, entry.second.copyHead());
+            }
+        }
+        seq = map.log != nullptr ? map.log->getLastSeq() : 0;
+        return heads;
+    }
+
+    static void
+    releaseHeads(std::vector<std::pair<oatpp::String, Node *>> &heads) {
+        for (auto &head : heads) {
+            StringStack::destroyLink(head.second);
+        }
+    }
+
+    static void releaseNodes(std::vector<Node *> &nodes) {
+        for (auto node : nodes) {
+            StringStack::destroyLink(node);
+        }
+    }
+
+    static std::uint64_t
+    idOf(const std::unordered_map<const Node *, std::uint64_t> &ids,
+         const Node *node) {
+        return node == nullptr ? 0 : ids.at(node);
+    }
+
+    static Node *nodeOf(const std::vector<Node *> &nodes, std::uint64_t id) {
+        if (id > nodes.size()) {
+            throw std::runtime_error("Unknown node");
+        }
+        return id == 0 ? nullptr : nodes[id - 1];
+    }
+};
+
+/**
+ * Writes a snapshot of a map at a fixed interval on a background thread, and
+ * then discards the records of the log of the map which it covers.
+ */
+class Snapshotter {
+public:
+    Snapshotter(std::shared_ptr<StringStackMap> map, std::string path,
+                std::chrono::seconds interval)
+        : map(std::move(map)), path(std::move(path)), interval(interval) {
+        this->thread = std::thread([this] { this->run(); });
+    }
+
+    ~Snapshotter() {
+        {
+            std::lock_guard _lock(this->stopLock);
+            this->stopping = true;
+        }
+        this->stopCv.notify_one();
+        this->thread.join();
+    }
+
+    Snapshotter(const Snapshotter &) = delete;
+    Snapshotter &operator=(const Snapshotter &) = delete;
+
+    /**
+     * Writes a snapshot now.
+     */
+    Snapshot::Info snapshot() {
+        std::lock_guard _lock(this->writeLock);
+        auto info = Snapshot::write(*this->map, this->path);
+        if (auto &log = this->map->getLog()) {
+            log->discardUpTo(info.seq);
+        }
+        return info;
+    }
+
+private:
+    void run() {
+        std::unique_lock _lock(this->stopLock);
+        while (!this->stopCv.wait_for(_lock, this->interval,
+                                      [&] { return this->stopping; })) {
+            _lock.unlock();
+            try {
+                auto start = std::chrono::steady_clock::now();
+                auto info = this->snapshot();
+                auto elapsed =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start);
+                OATPP_LOGI("Snapshotter",
+                           "Wrote %llu stacks and %llu nodes in %lld ms",
+                           (unsigned long long)info.stackCount,
+                           (unsigned long long)info.nodeCount,
+                           (long long)elapsed.count());
+            } catch (const std::exception &e) {
+                OATPP_LOGE("Snapshotter", "Cannot write snapshot: %s",
+                           e.what());
+            }
+            _lock.lock();
+        }
+    }
+
+    std::shared_ptr<StringStackMap> map;
+    std::string path;
+    std::chrono::seconds interval;
+
+    std::mutex writeLock;
+    std::mutex stopLock;
+    std::condition_variable stopCv;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif /* Snapshot_hpp */
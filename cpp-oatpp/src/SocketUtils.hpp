@@ -0,0 +1,189 @@
+#ifndef SocketUtils_hpp
+#define SocketUtils_hpp
+
+#include "FileUtils.hpp"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Socket helpers shared by the listeners next to the HTTP API and their
+ * clients.
+ *
+ * An address is either `unix:<path>` for a Unix domain socket, or
+ * `<host>:<port>` for TCP.
+ */
+class SocketUtils {
+public:
+    struct Listener {
+        int handle;
+        bool tcp;
+        // The path of the socket file, empty for TCP.
+        std::string unixPath;
+    };
+
+    /**
+     * Binds and listens on `address`. A socket file left behind by a previous
+     * run is replaced.
+     */
+    static Listener listen(const std::string &address) {
+        Listener listener{-1, false, {}};
+        if (address.rfind(unixPrefix, 0) == 0) {
+            listener.unixPath = address.substr(std::strlen(unixPrefix));
+            auto socketAddress = unixAddressOf(listener.unixPath);
+            ::unlink(listener.unixPath.c_str());
+            listener.handle = createSocket(AF_UNIX, SOCK_STREAM, 0);
+            if (::bind(listener.handle,
+                       reinterpret_cast<sockaddr *>(&socketAddress),
+                       sizeof(socketAddress)) != 0) {
+                closeAndThrow(listener.handle, "Cannot bind " + address);
+            }
+        } else {
+            auto addresses = resolve(address, true);
+            listener.handle =
+                createSocket(addresses->ai_family, addresses->ai_socktype,
+                             addresses->ai_protocol);
+            int enable = 1;
+            if (::setsockopt(listener.handle, SOL_SOCKET, SO_REUSEADDR,
+                             &enable, sizeof(enable)) != 0 ||
+                ::bind(listener.handle, addresses->ai_addr,
+                       addresses->ai_addrlen) != 0) {
+                closeAndThrow(listener.handle, "Cannot bind " + address);
+            }
+            listener.tcp = true;
+        }
+        if (::listen(listener.handle, SOMAXCONN) != 0) {
+            closeAndThrow(listener.handle, "Cannot listen on " + address);
+        }
+        return listener;
+    }
+
+    /**
+     * Connects to `address`, with Nagle's algorithm disabled over TCP.
+     */
+    static int connect(const std::string &address) {
+        int handle;
+        if (address.rfind(unixPrefix, 0) == 0) {
+            auto socketAddress =
+                unixAddressOf(address.substr(std::strlen(unixPrefix)));
+            handle = createSocket(AF_UNIX, SOCK_STREAM, 0);
+            if (::connect(handle, reinterpret_cast<sockaddr *>(&socketAddress),
+                          sizeof(socketAddress)) != 0) {
+                closeAndThrow(handle, "Cannot connect to " + address);
+            }
+        } else {
+            auto addresses = resolve(address, false);
+            handle = createSocket(addresses->ai_family, addresses->ai_socktype,
+                                  addresses->ai_protocol);
+            if (::connect(handle, addresses->ai_addr, addresses->ai_addrlen) !=
+                0) {
+                closeAndThrow(handle, "Cannot connect to " + address);
+            }
+            setNoDelay(handle);
+        }
+        return handle;
+    }
+
+    static void setNoDelay(int fd) {
+        int noDelay = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+
+    /**
+     * Sends all of `data`. Returns false if the connection is broken.
+     */
+    static bool sendAll(int fd, const char *data, std::size_t size) {
+        for (std::size_t sent = 0; sent < size;) {
+            auto result = ::send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            sent += static_cast<std::size_t>(result);
+        }
+        return true;
+    }
+
+    /**
+     * Receives exactly `size` bytes. Returns false if the connection is
+     * closed or broken first.
+     */
+    static bool receiveAll(int fd, char *data, std::size_t size) {
+        for (std::size_t received = 0; received < size;) {
+            auto result = ::recv(fd, data + received, size - received, 0);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                return false;
+            }
+            received += static_cast<std::size_t>(result);
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char *unixPrefix = "unix:";
+
+    static sockaddr_un unixAddressOf(const std::string &path) {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path is too long: " + path);
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    static std::unique_ptr<addrinfo, decltype(&::freeaddrinfo)>
+    resolve(const std::string &address, bool passive) {
+        auto colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("Invalid address: " + address);
+        }
+        auto host = address.substr(0, colon);
+        auto port = address.substr(colon + 1);
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo *addresses;
+        auto error = ::getaddrinfo(host.empty() ? nullptr : host.c_str(),
+                                   port.c_str(), &hints, &addresses);
+        if (error != 0) {
+            throw std::runtime_error("Cannot resolve " + address + ": " +
+                                     ::gai_strerror(error));
+        }
+        return {addresses, &::freeaddrinfo};
+    }
+
+    static int createSocket(int family, int type, int protocol) {
+        auto handle = ::socket(family, type | SOCK_CLOEXEC, protocol);
+        if (handle < 0) {
+            FileUtils::throwError("Cannot create socket");
+        }
+        return handle;
+    }
+
+    [[noreturn]] static void closeAndThrow(int handle,
+                                           const std::string &message) {
+        auto savedErrno = errno;
+        ::close(handle);
+        errno = savedErrno;
+        FileUtils::throwError(message);
+    }
+};
+
+#endif /* SocketUtils_hpp */
@@ -0,0 +1,316 @@
+#ifndef SpillStore_hpp
+#define SpillStore_hpp
+
+#include "BinaryFormat.hpp"
+#include "FileUtils.hpp"
+#include "SmallString.hpp"
+#include "StackMap.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Segment file holding the tails `Stack` spills out of memory, mapped into the
+ * address space of the process.
+ *
+ * A segment is the encoded values of a run of nodes. The file is split into
+ * extents of `extentBytes`, and the segments are allocated one after the
+ * other in the current extent, which is replaced by an empty one once full.
+ * An extent becomes empty again when the last of its segments is released,
+ * and its blocks are then punched out of the file. The file grows an extent
+ * at a time up to the capacity it is opened with, and the whole capacity is
+ * mapped at once, so a segment is read in place, without any lock.
+ *
+ * The segments are written with `pwrite`, so writing them does not map their
+ * pages into the process, and the pages of a segment are dropped from the
+ * mapping when it is released, after its values were faulted back in. The
+ * kernel pages the rest in and out as it is read.
+ *
+ * The file is removed as soon as it is opened: it only extends the memory of
+ * the running process, whose stacks the snapshots and the write-ahead log
+ * persist. Spilling is off until the store is opened.
+ */
+class SpillStore {
+public:
+    static constexpr std::size_t extentBytes = 16 << 20;
+    static constexpr std::size_t maxSegmentBytes = 1 << 20;
+
+    /**
+     * Location of a segment in the file, and the number of values in it.
+     */
+    struct Segment {
+        std::uint64_t offset;
+        std::uint32_t size;
+        std::uint32_t count;
+    };
+
+    /**
+     * Sizes of the live segments, and of the file, holes included.
+     */
+    struct Stats {
+        std::uint64_t segments;
+        std::uint64_t values;
+        std::uint64_t bytes;
+        std::uint64_t fileBytes;
+    };
+
+    /**
+     * The store is never destroyed, like `MemoryBudget`, as the segments may
+     * be released by threads which exit after the static objects are
+     * destroyed.
+     */
+    static SpillStore &instance() {
+        static auto store = new SpillStore();
+        return *store;
+    }
+
+    /**
+     * Opens the file at `path`, which grows up to `capacity` bytes rounded up
+     * to extents. Must be called once, before the stacks are shared between
+     * threads.
+     */
+    void open(const std::string &path, std::uint64_t capacity) {
+        auto extentCount = (capacity + extentBytes - 1) / extentBytes;
+        auto size = static_cast<std::size_t>(extentCount * extentBytes);
+        auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                         0600);
+        if (fd < 0) {
+            FileUtils::throwError("Cannot open " + path);
+        }
+        ::unlink(path.c_str());
+        auto data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            FileUtils::throwError("Cannot map " + path);
+        }
+        this->fd = fd;
+        this->extents.assign(extentCount, Extent{});
+        this->base.store(static_cast<const char *>(data),
+                         std::memory_order_release);
+    }
+
+    bool isOpen() const {
+        return this->base.load(std::memory_order_acquire) != nullptr;
+    }
+
+    /**
+     * Writes `data`, the encoding of `count` values, as a new segment.
+     * Returns false if the store is not open, the segment is larger than
+     * `maxSegmentBytes`, or the file is full.
+     */
+    bool write(const std::string &data, std::uint32_t count,
+               Segment &segment) {
+        if (!this->isOpen() || data.empty() || data.size() > maxSegmentBytes) {
+            return false;
+        }
+        segment = {0, static_cast<std::uint32_t>(data.size()), count};
+        {
+            std::lock_guard _lock(this->lock);
+            if (this->current == noExtent ||
+                this->extents[this->current].used + data.size() >
+                    extentBytes) {
+                if (!this->nextExtent()) {
+                    return false;
+                }
+            }
+            auto &extent = this->extents[this->current];
+            segment.offset = this->current * extentBytes + extent.used;
+            extent.used += data.size();
+            extent.live += data.size();
+            ++this->stats.segments;
+            this->stats.values += count;
+            this->stats.bytes += data.size();
+        }
+        // The space is reserved, so it is written without the lock.
+        try {
+            for (std::size_t written = 0; written < data.size();) {
+                auto result =
+                    ::pwrite(this->fd, data.data() + written,
+                             data.size() - written,
+                             static_cast<off_t>(segment.offset + written));
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    FileUtils::throwError("Cannot write the spill file");
+                }
+                written += static_cast<std::size_t>(result);
+            }
+        } catch (...) {
+            this->release(segment);
+            throw;
+        }
+        return true;
+    }
+
+    /**
+     * Returns the data of a live segment, which stays valid until the segment
+     * is released.
+     */
+    const char *dataOf(const Segment &segment) const {
+        return this->base.load(std::memory_order_acquire) + segment.offset;
+    }
+
+    /**
+     * Releases a segment, whose space may be reused right away.
+     */
+    void release(const Segment &segment) {
+        auto base = this->base.load(std::memory_order_acquire);
+        // Only the pages the segment covers whole are dropped, the others
+        // may hold the neighboring segments.
+        auto page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+        auto begin = (segment.offset + page - 1) / page * page;
+        auto end = (segment.offset + segment.size) / page * page;
+        if (begin < end) {
+            ::madvise(const_cast<char *>(base) + begin, end - begin,
+                      MADV_DONTNEED);
+        }
+
+        std::lock_guard _lock(this->lock);
+        auto index = static_cast<std::size_t>(segment.offset / extentBytes);
+        auto &extent = this->extents[index];
+        extent.live -= segment.size;
+        --this->stats.segments;
+        this->stats.values -= segment.count;
+        this->stats.bytes -= segment.size;
+        if (extent.live == 0) {
+            extent.used = 0;
+            if (index != this->current) {
+                this->punch(index);
+                this->freeExtents.push_back(index);
+            }
+        }
+    }
+
+    Stats getStats() {
+        std::lock_guard _lock(this->lock);
+        auto stats = this->stats;
+        stats.fileBytes = this->grownExtents * extentBytes;
+        return stats;
+    }
+
+private:
+    static constexpr std::size_t noExtent = SIZE_MAX;
+
+    struct Extent {
+        // The bytes allocated from the start of the extent, and those of the
+        // live segments among them.
+        std::size_t used = 0;
+        std::size_t live = 0;
+    };
+
+    SpillStore() = default;
+
+    // Replaces the current extent with an empty one, reused or grown, under
+    // the lock. The previous one is freed once its segments are released.
+    bool nextExtent() {
+        std::size_t index;
+        if (!this->freeExtents.empty()) {
+            index = this->freeExtents.back();
+            this->freeExtents.pop_back();
+        } else if (this->grownExtents < this->extents.size()) {
+            index = this->grownExtents;
+            if (::ftruncate(this->fd,
+                            static_cast<off_t>((index + 1) * extentBytes)) !=
+                0) {
+                return false;
+            }
+            ++this->grownExtents;
+        } else {
+            return false;
+        }
+        auto previous = this->current;
+        this->current = index;
+        if (previous != noExtent && this->extents[previous].live == 0) {
+            this->punch(previous);
+            this->freeExtents.push_back(previous);
+        }
+        return true;
+    }
+
+    // Frees the blocks of an empty extent, keeping the size of the file.
+    void punch(std::size_t index) {
+        ::fallocate(this->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    static_cast<off_t>(index * extentBytes),
+                    static_cast<off_t>(extentBytes));
+    }
+
+    std::atomic<const char *> base{nullptr};
+    int fd = -1;
+
+    std::mutex lock;
+    std::vector<Extent> extents;
+    std::vector<std::size_t> freeExtents;
+    std::size_t current = noExtent;
+    std::size_t grownExtents = 0;
+    Stats stats{0, 0, 0, 0};
+};
+
+/**
+ * Spills `SmallString` values to `SpillStore`. A placeholder holds the
+ * location of its segment inline, as 16 bytes.
+ */
+template <> struct SpillCodec<SmallString> {
+    static constexpr bool supported = true;
+    static constexpr std::size_t maxSegmentBytes = SpillStore::maxSegmentBytes;
+
+    static bool enabled() { return SpillStore::instance().isOpen(); }
+
+    static std::size_t sizeOf(const SmallString &value) {
+        return 4 + value.size();
+    }
+
+    static void append(std::string &out, const SmallString &value) {
+        BinaryWriter(out).writeString(value);
+    }
+
+    static bool store(const std::string &data, std::size_t count,
+                      SmallString &placeholder) {
+        SpillStore::Segment segment;
+        if (!SpillStore::instance().write(
+                data, static_cast<std::uint32_t>(count), segment)) {
+            return false;
+        }
+        char bytes[placeholderSize];
+        BinaryWriter::setUInt64(bytes, segment.offset);
+        BinaryWriter::setUInt32(bytes + 8, segment.size);
+        BinaryWriter::setUInt32(bytes + 12, segment.count);
+        placeholder = SmallString(bytes, placeholderSize);
+        return true;
+    }
+
+    static void load(const SmallString &placeholder,
+                     std::vector<SmallString> &values) {
+        auto segment = segmentOf(placeholder);
+        auto data = SpillStore::instance().dataOf(segment);
+        BinaryReader reader(data, data + segment.size);
+        values.reserve(values.size() + segment.count);
+        for (std::uint32_t i = 0; i < segment.count; ++i) {
+            values.push_back(reader.readSmallString());
+        }
+    }
+
+    static void release(const SmallString &placeholder) {
+        SpillStore::instance().release(segmentOf(placeholder));
+    }
+
+private:
+    static constexpr std::size_t placeholderSize = 16;
+
+    static SpillStore::Segment segmentOf(const SmallString &placeholder) {
+        auto bytes = placeholder.data();
+        return {BinaryReader::getUInt64(bytes),
+                BinaryReader::getUInt32(bytes + 8),
+                BinaryReader::getUInt32(bytes + 12)};
+    }
+};
+
+#endif /* SpillStore_hpp */
@@ -1,45 +1,190 @@
 #ifndef stackmap_hpp
 #define stackmap_hpp
 
+#include "FlatHashMap.hpp"
+#include "MemoryBudget.hpp"
+#include "Metrics.hpp"
+#include "MutationLog.hpp"
+#include "PopWaiter.hpp"
+#include "Reclaimer.hpp"
+#include "StackResult.hpp"
+
+#include <algorithm>
 #include <atomic>
-#include <exception>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <random>
 #include <shared_mutex>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
 
-class StackEmpty : public std::exception {
-public:
-    const char *what() const noexcept override { return "Stack is empty"; }
+/**
+ * Locks `lock`, reporting the time spent waiting to `Metrics`. The clock is
+ * only read when the lock is contended.
+ */
+template <typename Lock> void lockTimed(Lock &lock) {
+    if (!lock.try_lock()) {
+        auto start = std::chrono::steady_clock::now();
+        lock.lock();
+        Metrics::recordLockWait(std::chrono::steady_clock::now() - start);
+    }
+}
+
+template <typename Mutex>
+std::unique_lock<Mutex> lockExclusive(Mutex &mutex) {
+    std::unique_lock<Mutex> lock(mutex, std::defer_lock);
+    lockTimed(lock);
+    return lock;
+}
+
+template <typename Mutex>
+std::shared_lock<Mutex> lockShared(Mutex &mutex) {
+    std::shared_lock<Mutex> lock(mutex, std::defer_lock);
+    lockTimed(lock);
+    return lock;
+}
+
+/**
+ * Default of the `onCommit` callbacks of `Stack`, which does nothing.
+ */
+struct NoCommitHook {
+    template <typename... Args> void operator()(const Args &...) const {}
 };
 
-class StackNameAlreadyExists : public std::exception {
-public:
-    const char *what() const noexcept override {
-        return "Stack name already exists";
+/**
+ * Returns the number of bytes of `value` counted by the byte accounting of
+ * the stacks: the size of a string, and the size of the object otherwise.
+ */
+template <typename T> std::size_t payloadSizeOf(const T &) { return sizeof(T); }
+inline std::size_t payloadSizeOf(const std::string &value) {
+    return value.size();
+}
+
+/**
+ * Lets `value` share the storage of an identical value before it is pushed,
+ * like `ValueInterner` does for `SmallString`. Leaves the other types as they
+ * are.
+ */
+template <typename T> void internValue(T &) {}
+
+/**
+ * Encoding of the values `Stack` spills out of memory, and of the placeholders
+ * standing for them in the stacks. Only the types it is specialized for, like
+ * `SmallString` by `SpillStore`, are spilled. A specialization provides:
+ *
+ * - `enabled()`, whether values may be spilled now.
+ * - `maxSegmentBytes`, the maximum size of the encoding of a segment.
+ * - `sizeOf(value)`, the size of the encoding of `value`.
+ * - `append(out, value)`, which appends the encoding of `value` to `out`.
+ * - `store(data, count, placeholder)`, which stores the encoding of `count`
+ *   values as a segment and sets `placeholder` to a value locating it, or
+ *   returns false if it cannot.
+ * - `load(placeholder, values)`, which appends the values of the segment of
+ *   `placeholder` to `values`, in the order they were appended.
+ * - `release(placeholder)`, which frees the segment.
+ */
+template <typename T> struct SpillCodec {
+    static constexpr bool supported = false;
+};
+
+/**
+ * Number of values of a stack and their bytes, as counted by `payloadSizeOf`.
+ */
+struct StackSize {
+    std::uint64_t length;
+    std::uint64_t bytes;
+};
+
+/**
+ * Limits of the size of each stack, checked when values are pushed, 0 for
+ * none. No stack holds more than `maxDepth` values either way.
+ */
+struct StackLimits {
+    // The nodes record their depth in 32 bits.
+    static constexpr std::uint64_t maxDepth = UINT32_MAX;
+
+    std::uint64_t maxLength = 0;
+    std::uint64_t maxBytes = 0;
+
+    bool allows(const StackSize &size) const {
+        return size.length <= maxDepth &&
+               (this->maxLength == 0 || size.length <= this->maxLength) &&
+               (this->maxBytes == 0 || size.bytes <= this->maxBytes);
     }
 };
 
-class StackNameNotFound : public std::exception {
-public:
-    const char *what() const noexcept override {
-        return "Stack name not found";
+/**
+ * Condition of a mutation on the version of the stack, like an HTTP
+ * `If-Match`, and where to report the version the mutation leaves the stack
+ * at.
+ */
+struct VersionCheck {
+    // The version the stack must be at, if any.
+    std::optional<std::uint64_t> ifMatch;
+    // Set to the version after the mutation, unless null.
+    std::uint64_t *version = nullptr;
+
+    bool allows(std::uint64_t current) const {
+        return !this->ifMatch || *this->ifMatch == current;
     }
 };
 
-template <typename T> class Stack {
+/**
+ * Stack of reference counted nodes. Copies of a stack share their nodes.
+ *
+ * The mutations take an optional `onCommit` callback, called after the
+ * mutation succeeded while the lock of the stack is still held, which lets
+ * `StackMap` log them in the order they are applied.
+ *
+ * The nodes are allocated by `Alloc` rebound to the node type, which lets the
+ * stack draw them from a pool like `PoolAllocator`.
+ *
+ * Each node records the size of the chain from it down, so the size of a stack
+ * is read from its head, shared tail included. The nodes are charged to
+ * `MemoryBudget`, whose limit is checked before values are pushed.
+ *
+ * The operations which may fail come in two flavors: the `try` ones return
+ * a `StackResult`, and the others throw the exception of the error.
+ *
+ * Each mutation moves the stack to its next version, which lets the clients
+ * cache its top and make their mutations conditional on it.
+ *
+ * With a `SpillCodec` for `T`, `spill` moves runs of nodes deep in the stack
+ * out of memory, each replaced by a placeholder node holding the location of
+ * their values, and the sizes of the run. A placeholder reaching the top of
+ * the stack is faulted back in, the values of the run becoming nodes again,
+ * and ranges read the values of the placeholders they walk past.
+ */
+template <typename T, typename Alloc = std::allocator<T>> class Stack {
 public:
-    Stack() : head(nullptr) {}
+    Stack() : head(nullptr), version(initialVersion()) {}
     ~Stack() { this->destroyLink(this->head); }
-    Stack(const Stack &stack) : head(stack.copyHead()) {}
-    Stack(Stack &&stack) : head(stack.head) { stack.head = nullptr; }
+    Stack(const Stack &stack)
+        : head(stack.copyHead()), version(initialVersion()) {}
+    template <typename OnCommit>
+    Stack(const Stack &stack, OnCommit onCommit)
+        : head(stack.copyHead(onCommit)), version(initialVersion()) {}
+    // Copies `stack`, and sets `copiedVersion` to the version copied.
+    Stack(const Stack &stack, std::uint64_t *copiedVersion)
+        : head(stack.copyHead([&] { *copiedVersion = stack.version; })),
+          version(initialVersion()) {}
+    Stack(Stack &&stack) : head(stack.head), version(stack.version) {
+        stack.head = nullptr;
+    }
     Stack &operator=(const Stack &stack) noexcept {
         Node *oldHead, *newHead = stack.copyHead();
         {
-            std::unique_lock _lock(stack.lock);
+            auto _lock = lockExclusive(stack.lock);
             oldHead = this->head;
             this->head = newHead;
+            this->bumpVersion();
         }
         this->destroyLink(oldHead);
         return *this;
@@ -48,70 +193,509 @@ public:
         Node *oldHead, *newHead = stack.head;
         stack.head = nullptr;
         {
-            std::unique_lock _lock(stack.lock);
+            auto _lock = lockExclusive(stack.lock);
             oldHead = this->head;
             this->head = newHead;
+            this->bumpVersion();
         }
         this->destroyLink(oldHead);
         return *this;
     }
 
-    T getTop() const {
-        std::shared_lock _lock(this->lock);
+    T getTop() const { return this->tryGetTop().take(); }
+    StackResult<T> tryGetTop() const {
+        auto _lock = this->lockSharedResident();
         if (this->head == nullptr) {
-            throw StackEmpty();
+            return StackError::StackEmpty;
         }
         return this->head->value;
     }
-    void push(T &&value) {
-        std::unique_lock _lock(this->lock);
-        this->head = new Node(std::move(value), this->head);
+
+    StackSize getSize() const {
+        auto _lock = lockShared(this->lock);
+        return sizeOf(this->head);
+    }
+
+    class ValueRef;
+
+    /**
+     * Like `getTop`, but returns a reference pinning the top node instead of a
+     * copy of its value. Sets `version`, unless null, to the version of the
+     * stack the top is read at, even if the stack is empty.
+     */
+    ValueRef getTopRef() const { return this->tryGetTopRef().take(); }
+    StackResult<ValueRef>
+    tryGetTopRef(std::uint64_t *version = nullptr) const {
+        auto _lock = this->lockSharedResident();
+        if (version != nullptr) {
+            *version = this->version;
+        }
+        if (this->head == nullptr) {
+            return StackError::StackEmpty;
+        }
+        Node::incRef(this->head);
+        return ValueRef(this->head);
+    }
+
+    class Range;
+
+    /**
+     * Returns the range of up to `count` values from the top down. The range
+     * pins the head of the stack, so it is walked without the lock, while the
+     * stack keeps being modified, and the values are not copied.
+     */
+    Range peek(std::size_t count) const {
+        return Range(this->copyHead(), count);
+    }
+
+    /**
+     * Like `pop`, but returns a reference pinning the popped node instead of
+     * moving its value out. Fails with `VersionMismatch` if the stack is not
+     * at the version `check` requires.
+     */
+    template <typename OnCommit = NoCommitHook>
+    ValueRef popRef(OnCommit onCommit = {}, const VersionCheck &check = {}) {
+        return this->tryPopRef(onCommit, check).take();
+    }
+    template <typename OnCommit = NoCommitHook>
+    StackResult<ValueRef> tryPopRef(OnCommit onCommit = {},
+                                    const VersionCheck &check = {}) {
+        auto _lock = lockExclusive(this->lock);
+        if (!check.allows(this->version)) {
+            return StackError::VersionMismatch;
+        }
+        this->faultIn();
+        auto poppedNode = this->head;
+        if (poppedNode == nullptr) {
+            return StackError::StackEmpty;
+        }
+
+        // The reference of the stack to the popped node is transferred to the
+        // result, and the popped node keeps its reference to the new head.
+        this->head = poppedNode->next;
+        if (this->head != nullptr) {
+            Node::incRef(this->head);
+        }
+        this->bumpVersion(check);
+        onCommit();
+        return ValueRef(poppedNode);
+    }
+
+    /**
+     * `onCommit` is called with the pushed value. Fails with
+     * `StackLimitExceeded` if the stack would exceed `limits`,
+     * `MemoryLimitExceeded` if the node would exceed the limit of
+     * `MemoryBudget`, and `VersionMismatch` if the stack is not at the version
+     * `check` requires.
+     */
+    template <typename OnCommit = NoCommitHook>
+    void push(T &&value, OnCommit onCommit = {},
+              const StackLimits &limits = {}, const VersionCheck &check = {}) {
+        this->tryPush(std::move(value), onCommit, limits, check).take();
+    }
+    template <typename OnCommit = NoCommitHook>
+    StackResult<void> tryPush(T &&value, OnCommit onCommit = {},
+                              const StackLimits &limits = {},
+                              const VersionCheck &check = {}) {
+        auto payload = payloadSizeOf(value);
+        if (!MemoryBudget::instance().allows(sizeof(Node) + payload)) {
+            return StackError::MemoryLimitExceeded;
+        }
+        internValue(value);
+        auto _lock = lockExclusive(this->lock);
+        if (!check.allows(this->version)) {
+            return StackError::VersionMismatch;
+        }
+        auto size = sizeOf(this->head);
+        if (!limits.allows({size.length + 1, size.bytes + payload})) {
+            return StackError::StackLimitExceeded;
+        }
+        this->head = createNode(std::move(value), this->head);
+        this->bumpVersion(check);
+        onCommit(static_cast<const T &>(this->head->value));
+        return {};
+    }
+    template <typename OnCommit = NoCommitHook>
+    T pop(OnCommit onCommit = {}) {
+        return this->tryPop(onCommit).take();
     }
-    T pop() {
-        std::unique_lock _lock(this->lock);
+    template <typename OnCommit = NoCommitHook>
+    StackResult<T> tryPop(OnCommit onCommit = {}) {
+        auto _lock = lockExclusive(this->lock);
+        this->faultIn();
         auto poppedNode = this->head;
         if (poppedNode == nullptr) {
-            throw StackEmpty();
+            return StackError::StackEmpty;
         }
 
         this->head = poppedNode->next;
+        this->bumpVersion();
+        onCommit();
         if (Node::unique(poppedNode)) {
             // The popped node has only one reference from this stack,
             // we can move the value out, and we don't need to modify the refernce counter of
             // current head, as it just transferred from the next of the popped node to the stack.
-            auto result = std::move(poppedNode->value);
-            delete poppedNode;
+            StackResult<T> result(std::move(poppedNode->value));
+            deleteNode(poppedNode);
             return result;
         } else {
             if (this->head != nullptr) Node::incRef(this->head);
-            auto result = poppedNode->value;
+            StackResult<T> result(poppedNode->value);
             
             // This reference counter decrement must be done after the operations above,
             // otherwise the popped node and the current head may be deleted.
             if (Node::decRef(poppedNode)) {
-                delete poppedNode;
+                deleteNode(poppedNode);
                 if (this->head != nullptr) Node::decRef(this->head); // Must be false since the counter just increases.
             }
             return result;
         }
     }
 
+    /**
+     * Pushes all the values in order, so that the last one ends up on the top.
+     * The nodes are linked before taking the lock, which is then held only to
+     * splice the chain onto the stack, after adding the size of the stack to
+     * the sizes recorded in its nodes. The limits are checked like `push`,
+     * for the whole batch.
+     */
+    template <typename OnCommit = NoCommitHook>
+    void pushMany(std::vector<T> &&values, OnCommit onCommit = {},
+                  const StackLimits &limits = {}) {
+        this->tryPushMany(std::move(values), onCommit, limits).take();
+    }
+    template <typename OnCommit = NoCommitHook>
+    StackResult<void> tryPushMany(std::vector<T> &&values,
+                                  OnCommit onCommit = {},
+                                  const StackLimits &limits = {}) {
+        if (values.empty()) {
+            return {};
+        }
+        std::uint64_t payload = 0;
+        for (auto &value : values) {
+            payload += payloadSizeOf(value);
+        }
+        if (!MemoryBudget::instance().allows(sizeof(Node) * values.size() +
+                                             payload)) {
+            return StackError::MemoryLimitExceeded;
+        }
+        for (auto &value : values) {
+            internValue(value);
+        }
+        auto bottom = createNode(std::move(values.front()), nullptr);
+        auto top = bottom;
+        for (std::size_t i = 1; i < values.size(); ++i) {
+            top = createNode(std::move(values[i]), top);
+        }
+
+        {
+            auto _lock = lockExclusive(this->lock);
+            auto size = sizeOf(this->head);
+            // The depths fit, as the limits allow no more than `maxDepth`.
+            if (limits.allows(
+                    {size.length + values.size(), size.bytes + top->bytes})) {
+                if (this->head != nullptr) {
+                    for (auto node = top; node != nullptr; node = node->next) {
+                        node->depth += static_cast<std::uint32_t>(size.length);
+                        node->bytes += size.bytes;
+                    }
+                }
+                bottom->next = this->head;
+                this->head = top;
+                this->bumpVersion();
+                onCommit();
+                return {};
+            }
+        }
+        destroyLink(top);
+        return StackError::StackLimitExceeded;
+    }
+    /**
+     * Pops up to `count` values, returned from the top down. The popped chain
+     * is cut off under the lock and released after it. `onCommit` is called
+     * with the number of popped values, unless there are none.
+     *
+     * A pop reaching a placeholder faults it in and goes on, so the values
+     * are popped as chains cut off at the placeholders.
+     */
+    template <typename OnCommit = NoCommitHook>
+    std::vector<T> popMany(std::size_t count, OnCommit onCommit = {}) {
+        std::vector<T> result;
+        // The popped chains, each as its head and the node it was cut off at.
+        std::vector<std::pair<Node *, Node *>> chains;
+        {
+            auto _lock = lockExclusive(this->lock);
+            std::size_t popped = 0;
+            while (popped < count) {
+                this->faultIn();
+                auto poppedHead = this->head, newHead = this->head;
+                auto cut = popped;
+                for (; popped < count && newHead != nullptr &&
+                       !isPlaceholder(newHead);
+                     ++popped) {
+                    newHead = newHead->next;
+                }
+                if (popped == cut) {
+                    break;
+                }
+                // The stack takes its own reference to the new head, and the
+                // reference to the popped head is transferred to us.
+                if (newHead != nullptr) Node::incRef(newHead);
+                this->head = newHead;
+                chains.emplace_back(poppedHead, newHead);
+            }
+            if (popped == 0) {
+                return result;
+            }
+            this->bumpVersion();
+            onCommit(popped);
+        }
+
+        for (auto &chain : chains) {
+            auto ptr = chain.first;
+            auto newHead = chain.second;
+            while (ptr != newHead) {
+                if (Node::unique(ptr)) {
+                    // Same as `pop`, the value can be moved out, and the
+                    // reference to the next node is transferred to us.
+                    result.push_back(std::move(ptr->value));
+                    auto next = ptr->next;
+                    deleteNode(ptr);
+                    ptr = next;
+                } else {
+                    // The rest of the popped chain is shared, and stays alive
+                    // while we hold the reference to `ptr`.
+                    for (auto node = ptr; node != newHead; node = node->next) {
+                        result.push_back(node->value);
+                    }
+                    break;
+                }
+            }
+            destroyLink(ptr);
+        }
+        return result;
+    }
+
+    /**
+     * Pops the top of `from` and pushes it onto `to` under the locks of both
+     * stacks, so the value is never missing from both. The locks are taken in
+     * the order of the addresses of the stacks, so moves in opposite
+     * directions cannot deadlock. A node only `from` references is relinked
+     * onto `to` as it is, and a shared one is left to the other stacks, its
+     * value being copied into a new node. `onCommit` is called once the value
+     * is moved.
+     *
+     * Returns a reference pinning the moved node. Fails with `StackEmpty`, or
+     * like `push` if `to` would exceed `limits`. Moving a stack onto itself
+     * leaves it as it is, without calling `onCommit`.
+     */
+    template <typename OnCommit = NoCommitHook>
+    static ValueRef move(Stack &from, Stack &to, OnCommit onCommit = {},
+                         const StackLimits &limits = {}) {
+        return tryMove(from, to, onCommit, limits).take();
+    }
+    template <typename OnCommit = NoCommitHook>
+    static StackResult<ValueRef> tryMove(Stack &from, Stack &to,
+                                         OnCommit onCommit = {},
+                                         const StackLimits &limits = {}) {
+        if (&from == &to) {
+            return from.tryGetTopRef();
+        }
+        auto first = std::less<Stack *>()(&from, &to) ? &from : &to;
+        auto second = first == &from ? &to : &from;
+        auto _firstLock = lockExclusive(first->lock);
+        auto _secondLock = lockExclusive(second->lock);
+        from.faultIn();
+        auto movedNode = from.head;
+        if (movedNode == nullptr) {
+            return StackError::StackEmpty;
+        }
+        auto next = movedNode->next;
+        auto payload = movedNode->bytes - (next != nullptr ? bytesOf(next) : 0);
+        auto size = sizeOf(to.head);
+        if (!limits.allows({size.length + 1, size.bytes + payload})) {
+            return StackError::StackLimitExceeded;
+        }
+
+        // No other reference to the node can be taken while `from` is locked.
+        if (Node::unique(movedNode)) {
+            // The reference of `from` to the node is transferred to `to`, the
+            // one of the node to the next node to `from`, and the one of `to`
+            // to its head to the node, so no counter changes. The charge of
+            // the node to `MemoryBudget` stays the same.
+            from.head = next;
+            movedNode->next = to.head;
+            movedNode->bytes = size.bytes + payload;
+            movedNode->depth = static_cast<std::uint32_t>(size.length + 1);
+            to.head = movedNode;
+        } else {
+            if (!MemoryBudget::instance().allows(sizeof(Node) + payload)) {
+                return StackError::MemoryLimitExceeded;
+            }
+            to.head = createNode(T(movedNode->value), to.head);
+            from.head = next;
+            if (next != nullptr) {
+                Node::incRef(next);
+            }
+            // The other references may have been dropped meanwhile, and the
+            // node is then freed, short of the next node the stack now holds.
+            destroyLink(movedNode);
+        }
+        Node::incRef(to.head);
+        from.bumpVersion();
+        to.bumpVersion();
+        onCommit();
+        return ValueRef(to.head);
+    }
+
+    /**
+     * Calls `onCommit` under the lock of the stack if it is still at
+     * `version`, which orders it against the mutations of the stack like a
+     * mutation of its own. Returns whether it was called.
+     */
+    template <typename OnCommit>
+    bool commitIfAt(std::uint64_t version, OnCommit onCommit) const {
+        auto _lock = lockShared(this->lock);
+        if (this->version != version) {
+            return false;
+        }
+        onCommit();
+        return true;
+    }
+
+    /**
+     * Spills the values more than `residentDepth` from the top out of memory,
+     * as up to `maxSegments` runs of at most `spillBatch` nodes, each replaced
+     * by a placeholder. Returns the number of spilled values, 0 without a
+     * `SpillCodec` for `T` or while it is disabled.
+     *
+     * Only the nodes no other stack, range or reference shares are spilled,
+     * below nodes which are not shared either, so they are unlinked in place.
+     * A run is spilled at a time, by `pickSpillRun`, `SpillRun::store` and
+     * `replaceSpillRun`, so the stack is never locked across the I/O of a
+     * segment.
+     */
+    std::size_t spill(std::size_t residentDepth, std::size_t maxSegments) {
+        std::size_t spilled = 0;
+        for (std::size_t i = 0; i < maxSegments; ++i) {
+            auto run = this->pickSpillRun(residentDepth);
+            auto count = run.store() ? this->replaceSpillRun(run, residentDepth)
+                                     : 0;
+            if (count == 0) {
+                break;
+            }
+            spilled += count;
+        }
+        return spilled;
+    }
+
+    class SpillRun;
+
+    /**
+     * Picks the first cold run of the stack under its lock, and pins it.
+     * Returns an empty run if there is none, or without a `SpillCodec` for
+     * `T` or while it is disabled.
+     */
+    SpillRun pickSpillRun(std::size_t residentDepth) {
+        if constexpr (!SpillCodec<T>::supported) {
+            return SpillRun();
+        } else {
+            if (!SpillCodec<T>::enabled()) {
+                return SpillRun();
+            }
+            auto _lock = lockExclusive(this->lock);
+            if (this->head == nullptr || this->head->depth <= residentDepth) {
+                return SpillRun();
+            }
+            // The nodes at this depth from the bottom and below are cold.
+            auto coldDepth = this->head->depth - residentDepth;
+            for (auto node = this->head; node != nullptr && Node::unique(node);
+                 node = node->next) {
+                if (node->depth > coldDepth || isPlaceholder(node)) {
+                    continue;
+                }
+                auto count = runLengthOf(node);
+                if (count > 0) {
+                    // Pinned, the run can neither be freed nor have its
+                    // values moved out: a pop reaching it finds it shared and
+                    // copies them.
+                    Node::incRef(node);
+                    return SpillRun(node, count);
+                }
+            }
+            return SpillRun();
+        }
+    }
+
+    /**
+     * Replaces the stored `run` by its placeholder under the lock, unless the
+     * stack changed since it was picked so that it is no longer cold or is
+     * shared. Returns the number of spilled values, or 0 if it was not
+     * replaced. The run is freed along with `run`.
+     */
+    std::size_t replaceSpillRun(SpillRun &run, std::size_t residentDepth) {
+        if (!run.stored) {
+            return 0;
+        }
+        auto _lock = lockExclusive(this->lock);
+        auto link = this->linkToRun(run.first, run.count, residentDepth);
+        if (link == nullptr) {
+            return 0;
+        }
+        auto last = run.first;
+        for (std::size_t i = 1; i < run.count; ++i) {
+            last = last->next;
+        }
+        auto end = last->next;
+        // The reference of the run to `end` is transferred to the
+        // placeholder, so `end` stays unique. Cut off from `end`, the last
+        // node of the run refunds the bytes below it when freed, so they are
+        // charged back.
+        auto placeholder =
+            createPlaceholder(std::move(run.value), run.first, end);
+        if (end != nullptr) {
+            MemoryBudget::instance().charge(
+                static_cast<std::int64_t>(bytesOf(end)));
+        }
+        last->next = nullptr;
+        *link = placeholder;
+        // The reference the stack had to the run is now held by `run`, along
+        // with its pin.
+        run.stored = false;
+        run.replaced = true;
+        return run.count;
+    }
+
+    // The maximum number of values spilled as one segment, which is also the
+    // number of values a pop faults in at once, and the minimum.
+    static constexpr std::size_t spillBatch = 1024;
+    static constexpr std::size_t minSpillBatch = 64;
+
 private:
     class Node {
     public:
         Node(T &&value, Node *next)
-            : refcount(1), value(std::move(value)), next(next) {}
+            : next(next), value(std::move(value)),
+              bytes((next != nullptr ? bytesOf(next) : 0) +
+                    payloadSizeOf(this->value)),
+              depth(next != nullptr ? next->depth + 1 : 1), refcount(1) {}
 
         // https://www.boost.org/doc/libs/1_55_0/doc/html/atomic/usage_examples.html#boost_atomic.usage_examples.example_reference_counters
         static void incRef(Node *node) {
-            node->refcount.fetch_add(1, std::memory_order_relaxed);
+            if (node->refcount.fetch_add(1, std::memory_order_relaxed) == 1) {
+                Metrics::addSharedNodes(1);
+            }
         }
         // Returns whether its reference counter is 1 before decrement.
         static bool decRef(Node *node) {
-            if (node->refcount.fetch_sub(1, std::memory_order_release) == 1) {
+            auto count = node->refcount.fetch_sub(1, std::memory_order_release);
+            if (count == 1) {
                 std::atomic_thread_fence(std::memory_order_acquire);
                 return true;
             } else {
+                if (count == 2) {
+                    Metrics::addSharedNodes(-1);
+                }
                 return false;
             }
         }
@@ -119,96 +703,1273 @@ private:
         static bool unique(Node *node) {
             return node->refcount.load(std::memory_order_acquire) == 1;
         }
+        // Returns whether its reference counter is 2, its only reference
+        // besides the one the caller pinned it with.
+        static bool uniquePinned(Node *node) {
+            return node->refcount.load(std::memory_order_acquire) == 2;
+        }
 
         Node *next;
         T value;
+        // The size of the chain from this node down, with `spilledBit` set
+        // on a placeholder.
+        std::uint64_t bytes;
+        std::uint32_t depth;
 
     private:
         std::atomic<int> refcount;
     };
 
+public:
+    using NodeAllocator =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+
+    /**
+     * Reference to the value of a node, which keeps the node alive after it is
+     * popped, so that the value can be read in place after the lock of the
+     * stack is released.
+     */
+    class ValueRef {
+    public:
+        ValueRef() : node(nullptr) {}
+        ValueRef(ValueRef &&other) noexcept : node(other.node) {
+            other.node = nullptr;
+        }
+        ValueRef &operator=(ValueRef &&other) noexcept {
+            if (this != &other) {
+                destroyLink(this->node);
+                this->node = other.node;
+                other.node = nullptr;
+            }
+            return *this;
+        }
+        ValueRef(const ValueRef &) = delete;
+        ValueRef &operator=(const ValueRef &) = delete;
+        ~ValueRef() { destroyLink(this->node); }
+
+        const T &operator*() const { return this->node->value; }
+        const T *operator->() const { return &this->node->value; }
+
+        /**
+         * Returns whether the reference pins a node, which a default
+         * constructed one does not.
+         */
+        explicit operator bool() const { return this->node != nullptr; }
+
+    private:
+        explicit ValueRef(Node *node) : node(node) {}
+
+        Node *node;
+
+        friend class Stack;
+    };
+
+    /**
+     * Run of the cold nodes of a stack picked by `pickSpillRun`, pinned so it
+     * is encoded and stored without holding any lock. Unpins the run when
+     * destroyed, and releases its segment unless it replaced the run.
+     */
+    class SpillRun {
+    public:
+        SpillRun() : first(nullptr), count(0) {}
+        SpillRun(SpillRun &&other) noexcept
+            : first(other.first), count(other.count),
+              value(std::move(other.value)), stored(other.stored),
+              replaced(other.replaced) {
+            other.first = nullptr;
+            other.stored = other.replaced = false;
+        }
+        SpillRun(const SpillRun &) = delete;
+        SpillRun &operator=(const SpillRun &) = delete;
+        ~SpillRun() {
+            if constexpr (SpillCodec<T>::supported) {
+                if (this->stored) {
+                    SpillCodec<T>::release(this->value);
+                }
+            }
+            if (this->replaced) {
+                destroyLink(this->first);
+            }
+            destroyLink(this->first);
+        }
+
+        /**
+         * Returns whether a run was picked.
+         */
+        explicit operator bool() const { return this->first != nullptr; }
+
+        /**
+         * Encodes the values of the run and stores them as a segment, without
+         * any lock. Returns false if there is no run or it cannot be stored.
+         */
+        bool store() {
+            if constexpr (SpillCodec<T>::supported) {
+                if (this->first == nullptr) {
+                    return false;
+                }
+                std::string data;
+                auto node = this->first;
+                for (std::size_t i = 0; i < this->count;
+                     ++i, node = node->next) {
+                    SpillCodec<T>::append(data, node->value);
+                }
+                this->stored =
+                    SpillCodec<T>::store(data, this->count, this->value);
+            }
+            return this->stored;
+        }
+
+    private:
+        SpillRun(Node *first, std::size_t count)
+            : first(first), count(count) {}
+
+        Node *first;
+        std::size_t count;
+        T value;
+        bool stored = false;
+        bool replaced = false;
+
+        friend class Stack;
+    };
+
+    /**
+     * Range of the values of a chain pinned by its head. The nodes of a shared
+     * chain never change, so it reads the same values whatever happens to the
+     * stack it was taken from.
+     */
+    class Range {
+    public:
+        Range(Range &&other) noexcept
+            : head(other.head), current(other.current),
+              remaining(other.remaining), spilled(std::move(other.spilled)),
+              spilledNext(other.spilledNext) {
+            other.head = other.current = nullptr;
+            other.spilledNext = 0;
+        }
+        Range &operator=(Range &&other) noexcept {
+            if (this != &other) {
+                destroyLink(this->head);
+                this->head = other.head;
+                this->current = other.current;
+                this->remaining = other.remaining;
+                this->spilled = std::move(other.spilled);
+                this->spilledNext = other.spilledNext;
+                other.head = other.current = nullptr;
+                other.spilledNext = 0;
+            }
+            return *this;
+        }
+        Range(const Range &) = delete;
+        Range &operator=(const Range &) = delete;
+        ~Range() { destroyLink(this->head); }
+
+        bool empty() const {
+            return (this->current == nullptr &&
+                    this->spilledNext == this->spilled.size()) ||
+                   this->remaining == 0;
+        }
+
+        /**
+         * Returns the next value, or nullptr past the end of the range. The
+         * value of a placeholder is only valid until the next call.
+         */
+        const T *next() {
+            if (this->empty()) {
+                return nullptr;
+            }
+            if constexpr (SpillCodec<T>::supported) {
+                if (this->spilledNext == this->spilled.size() &&
+                    isPlaceholder(this->current)) {
+                    // The values of the placeholder are read, the placeholder
+                    // pinning its segment.
+                    this->spilled.clear();
+                    this->spilledNext = 0;
+                    SpillCodec<T>::load(this->current->value, this->spilled);
+                    this->current = this->current->next;
+                }
+            }
+            --this->remaining;
+            if (this->spilledNext < this->spilled.size()) {
+                return &this->spilled[this->spilledNext++];
+            }
+            auto value = &this->current->value;
+            this->current = this->current->next;
+            return value;
+        }
+
+    private:
+        Range(Node *head, std::size_t count)
+            : head(head), current(head), remaining(count), spilledNext(0) {}
+
+        Node *head;
+        Node *current;
+        std::size_t remaining;
+        // The values of the placeholder last walked past.
+        std::vector<T> spilled;
+        std::size_t spilledNext;
+
+        friend class Stack;
+    };
+
+private:
+    using NodeAllocatorTraits = std::allocator_traits<NodeAllocator>;
+
+    static Node *createNode(T &&value, Node *next) {
+        NodeAllocator allocator;
+        auto node = NodeAllocatorTraits::allocate(allocator, 1);
+        NodeAllocatorTraits::construct(allocator, node, std::move(value), next);
+        Metrics::addNodes(1);
+        MemoryBudget::instance().charge(chargeOf(node));
+        return node;
+    }
+
+    // Creates the placeholder of the run from `first` down to `next`, which
+    // keeps the sizes recorded in `first`.
+    static Node *createPlaceholder(T &&value, const Node *first, Node *next) {
+        NodeAllocator allocator;
+        auto node = NodeAllocatorTraits::allocate(allocator, 1);
+        NodeAllocatorTraits::construct(allocator, node, std::move(value), next);
+        node->bytes = bytesOf(first) | spilledBit;
+        node->depth = first->depth;
+        Metrics::addNodes(1);
+        MemoryBudget::instance().charge(chargeOf(node));
+        return node;
+    }
+
+    static void deleteNode(Node *node) {
+        if constexpr (SpillCodec<T>::supported) {
+            if (isPlaceholder(node)) {
+                SpillCodec<T>::release(node->value);
+            }
+        }
+        MemoryBudget::instance().charge(-chargeOf(node));
+        NodeAllocator allocator;
+        NodeAllocatorTraits::destroy(allocator, node);
+        NodeAllocatorTraits::deallocate(allocator, node, 1);
+        Metrics::addNodes(-1);
+    }
+
+    // The bytes charged to `MemoryBudget` for `node`. The payload is taken
+    // from the recorded sizes rather than from the value, which may have been
+    // moved out before the node is deleted. The next node is still alive, as
+    // the node holds its reference until then. A placeholder is only charged
+    // for itself, the values of its run being out of memory.
+    static std::int64_t chargeOf(const Node *node) {
+        if (isPlaceholder(node)) {
+            return static_cast<std::int64_t>(sizeof(Node));
+        }
+        auto next = node->next != nullptr ? bytesOf(node->next) : 0;
+        return static_cast<std::int64_t>(sizeof(Node) + bytesOf(node) - next);
+    }
+
+    static StackSize sizeOf(const Node *head) {
+        if (head == nullptr) {
+            return {0, 0};
+        }
+        return {head->depth, bytesOf(head)};
+    }
+
+    // The bit of `Node::bytes` marking a placeholder, never reached by the
+    // sizes of the stacks.
+    static constexpr std::uint64_t spilledBit = std::uint64_t(1) << 63;
+
+    static bool isPlaceholder(const Node *node) {
+        return (node->bytes & spilledBit) != 0;
+    }
+
+    static std::uint64_t bytesOf(const Node *node) {
+        return node->bytes & ~spilledBit;
+    }
+
+    // Replaces the placeholder at the head, if any, with the nodes of the
+    // values of its run. The stack must be locked exclusively.
+    void faultIn() {
+        if constexpr (SpillCodec<T>::supported) {
+            auto placeholder = this->head;
+            if (placeholder == nullptr || !isPlaceholder(placeholder)) {
+                return;
+            }
+            std::vector<T> values;
+            SpillCodec<T>::load(placeholder->value, values);
+            auto top = placeholder->next;
+            if (top != nullptr) {
+                Node::incRef(top);
+            }
+            for (auto value = values.rbegin(); value != values.rend();
+                 ++value) {
+                internValue(*value);
+                top = createNode(std::move(*value), top);
+            }
+            this->head = top;
+            Metrics::addSpillFaults(1);
+            // The placeholder is freed, along with its segment, unless other
+            // stacks share it.
+            destroyLink(placeholder);
+        }
+    }
+
+    // Returns the number of nodes of the run to spill from `first`, or 0 if
+    // it is too short to be worth a segment. The run ends at a placeholder, a
+    // shared node, `spillBatch` nodes, or the size of a segment. The stack
+    // must be locked.
+    static std::size_t runLengthOf(Node *first) {
+        std::size_t count = 0, size = 0;
+        bool full = false;
+        for (auto end = first; count < spillBatch && end != nullptr &&
+                               !isPlaceholder(end) && Node::unique(end);
+             ++count, end = end->next) {
+            size += SpillCodec<T>::sizeOf(end->value);
+            if (size > SpillCodec<T>::maxSegmentBytes) {
+                full = true;
+                break;
+            }
+        }
+        // A value too large for a segment is left in memory.
+        return count < minSpillBatch && !full ? 0 : count;
+    }
+
+    // Returns the link to the run of `count` nodes from `first`, pinned by
+    // the caller, if it can still be replaced by its placeholder: it is still
+    // cold, and neither it nor the nodes above it are shared. Returns nullptr
+    // otherwise. The stack must be locked exclusively.
+    Node **linkToRun(Node *first, std::size_t count,
+                     std::size_t residentDepth) {
+        if (this->head == nullptr ||
+            this->head->depth < first->depth + residentDepth) {
+            return nullptr;
+        }
+        auto link = &this->head;
+        while (*link != first) {
+            if (*link == nullptr || !Node::unique(*link) ||
+                (*link)->depth <= first->depth) {
+                return nullptr;
+            }
+            link = &(*link)->next;
+        }
+        if (!Node::uniquePinned(first)) {
+            return nullptr;
+        }
+        auto node = first->next;
+        for (std::size_t i = 1; i < count; ++i, node = node->next) {
+            if (!Node::unique(node)) {
+                return nullptr;
+            }
+        }
+        return link;
+    }
+
+    // Locks the stack shared once its head is not a placeholder, which is
+    // faulted in under the exclusive lock first.
+    std::shared_lock<std::shared_mutex> lockSharedResident() const {
+        auto lock = lockShared(this->lock);
+        while (this->head != nullptr && isPlaceholder(this->head)) {
+            lock.unlock();
+            {
+                auto _lock = lockExclusive(this->lock);
+                // Faulting in changes how the values are stored, not the
+                // values themselves.
+                const_cast<Stack *>(this)->faultIn();
+            }
+            lockTimed(lock);
+        }
+        return lock;
+    }
+
+    // Nodes freed by the thread dropping a chain before handing the rest of
+    // it over to `Reclaimer`.
+    static constexpr std::size_t inlineReclaimBudget = 64;
+
     static void destroyLink(Node *head) {
+        auto rest = destroySome(head, inlineReclaimBudget);
+        if (rest != nullptr) {
+            Reclaimer::instance().defer(rest, &reclaimStep);
+        }
+    }
+
+    // Releases the reference to `head` and frees the nodes left without
+    // references, up to `budget` of them. Returns the node the budget ran out
+    // at, whose reference is still to be released, or nullptr.
+    static Node *destroySome(Node *head, std::size_t budget) {
         auto ptr = head;
-        while (ptr != nullptr) {
+        for (std::size_t i = 0; ptr != nullptr && i < budget; ++i) {
             if (!Node::decRef(ptr)) {
                 // Still has other reference
-                break;
+                return nullptr;
             }
             auto next = ptr->next;
-            delete ptr;
+            deleteNode(ptr);
             ptr = next;
         }
+        return ptr;
+    }
+
+    static void *reclaimStep(void *head, std::size_t budget) {
+        return destroySome(static_cast<Node *>(head), budget);
     }
 
-    Node *copyHead() const {
-        std::shared_lock _lock(this->lock);
+    template <typename OnCommit = NoCommitHook>
+    Node *copyHead(OnCommit onCommit = {}) const {
+        auto _lock = lockShared(this->lock);
         auto head = this->head;
         if (head != nullptr) {
             Node::incRef(head);
         }
+        onCommit();
         return head;
     }
 
+    // The versions of a stack start past those of the stacks created before
+    // it, from a random base, so a stack created again under the same name,
+    // or by another run of the server, does not reuse the versions of the
+    // previous one. A stack has 2^32 versions before those of the next one.
+    static std::uint64_t initialVersion() {
+        static std::atomic<std::uint64_t> next{std::random_device()()};
+        return next.fetch_add(1, std::memory_order_relaxed) << 32;
+    }
+
+    // Moves the stack to its next version, under the exclusive lock, and
+    // reports it to `check`.
+    void bumpVersion(const VersionCheck &check = {}) {
+        ++this->version;
+        if (check.version != nullptr) {
+            *check.version = this->version;
+        }
+    }
+
     Node *head;
+    std::uint64_t version;
     mutable std::shared_mutex lock;
+
+    friend class Snapshot;
+};
+
+/**
+ * Characters of a name of `StackMap`, by which the map hashes and compares
+ * the names, so that a stack can be looked up by any type holding the same
+ * characters, without building a `K`. Specialized for the types which do not
+ * convert to `std::string_view`.
+ */
+template <typename K> struct StackKey {
+    static std::string_view view(const K &name) { return name; }
 };
 
-template <typename K, typename T> class StackMap {
+/**
+ * Map from names to stacks.
+ *
+ * The names are hash-partitioned into shards, each guarded by its own lock, so
+ * operations on stacks in different shards never contend. A map with a single
+ * shard behaves like one globally locked map.
+ *
+ * The stack type `S` is a `Stack` of `T`, a template parameter so that the
+ * map can keep its nodes with another allocator, like `StringStack` does.
+ *
+ * The mutations made through the map, but not those made on the stacks
+ * returned by `getStack`, are reported to the `MutationLog` set by `setLog`.
+ *
+ * Each call hashes the name once, and the hash picks the shard, then the slot
+ * of the flat table of the shard, which keeps it along with the entry. The
+ * lookups which are not logged take any name `StackKey` views.
+ *
+ * Like those of `Stack`, the operations have a `try` flavor returning the
+ * errors in a `StackResult` rather than throwing them.
+ */
+template <typename K, typename T, typename S = Stack<T>> class StackMap {
 public:
-    void create(K &&name) {
-        bool inserted;
-        {
-            std::unique_lock _lock(this->lock);
-            inserted = this->map.insert({std::move(name), Stack<T>()}).second;
+    explicit StackMap(std::size_t shardCount = 1)
+        : shardCount(shardCount == 0 ? 1 : shardCount),
+          shards(new Shard[this->shardCount]) {}
+
+    /**
+     * Sets the log receiving the mutations. Must be called before the map is
+     * shared between threads.
+     */
+    void setLog(std::shared_ptr<MutationLog<K, T>> log) {
+        this->log = std::move(log);
+    }
+    const std::shared_ptr<MutationLog<K, T>> &getLog() const {
+        return this->log;
+    }
+
+    /**
+     * Sets the limits of the size of each stack, checked on push. Must be
+     * called before the map is shared between threads.
+     */
+    void setLimits(const StackLimits &limits) { this->limits = limits; }
+
+    void create(K &&name) { this->tryCreate(std::move(name)).take(); }
+    StackResult<void> tryCreate(K &&name) {
+        auto hash = hashOf(name);
+        auto &shard = this->shardOf(hash);
+        reserve(shard, 1);
+        auto _lock = lockExclusive(shard.lock);
+        auto result = shard.map.insert(hash, std::move(name), S());
+        if (!result.second) {
+            return StackError::StackNameAlreadyExists;
         }
-        if (!inserted) {
-            throw StackNameAlreadyExists();
+        if (this->log != nullptr) {
+            this->log->create(result.first->first);
         }
+        return {};
     }
 
-    void remove(const K &name) {
-        bool removed;
+    void remove(const K &name) { this->tryRemove(name).take(); }
+    StackResult<void> tryRemove(const K &name) {
+        auto hash = hashOf(name);
+        auto &shard = this->shardOf(hash);
         {
-            std::unique_lock _lock(this->lock);
-            removed = this->map.erase(name) > 0;
+            auto _lock = lockExclusive(shard.lock);
+            if (!shard.map.erase(name, hash)) {
+                return StackError::StackNameNotFound;
+            }
+            if (this->log != nullptr) {
+                this->log->remove(name);
+            }
         }
-        if (!removed) {
-            throw StackNameNotFound();
+        // The waiters retry and find the stack gone.
+        this->wakeWaiters(name, hash, SIZE_MAX);
+        return {};
+    }
+
+    template <typename Q>
+    std::pair<std::shared_lock<std::shared_mutex>, S &>
+    getStack(const Q &name) {
+        return this->getStack(name, hashOf(name));
+    }
+
+    template <typename Q> T getTop(const Q &name) {
+        return this->tryGetTop(name).take();
+    }
+    template <typename Q> StackResult<T> tryGetTop(const Q &name) {
+        return this->withStack(name, hashOf(name),
+                               [](S &stack) { return stack.tryGetTop(); });
+    }
+
+    /**
+     * Pushes `value` to the stack `name`, if it is at the version `check`
+     * requires.
+     */
+    void push(const K &name, T &&value, const VersionCheck &check = {}) {
+        this->tryPush(name, std::move(value), check).take();
+    }
+    StackResult<void> tryPush(const K &name, T &&value,
+                              const VersionCheck &check = {}) {
+        auto hash = hashOf(name);
+        auto result = this->withStack(name, hash, [&](S &stack) {
+            return stack.tryPush(
+                std::move(value),
+                [&](const T &pushed) {
+                    if (this->log != nullptr) {
+                        this->log->push(name, pushed);
+                    }
+                },
+                this->limits, check);
+        });
+        if (result) {
+            this->wakeWaiters(name, hash, 1);
         }
+        return result;
     }
 
-    std::pair<std::shared_lock<std::shared_mutex>, Stack<T> &>
-    getStack(const K &name) {
-        std::shared_lock<std::shared_mutex> lock(this->lock);
-        auto stack = this->map.find(name);
-        if (stack == this->map.cend()) {
-            throw StackNameNotFound();
+    T pop(const K &name) { return this->tryPop(name).take(); }
+    StackResult<T> tryPop(const K &name) {
+        return this->withStack(name, hashOf(name), [&](S &stack) {
+            return stack.tryPop([&] {
+                if (this->log != nullptr) {
+                    this->log->pop(name, 1);
+                }
+            });
+        });
+    }
+
+    /**
+     * Like `getTop`, but returns a reference pinning the top node of the stack
+     * `S` instead of a copy of its value. Sets `version`, unless null, to the
+     * version of the stack, even if it is empty.
+     */
+    template <typename Q>
+    auto getTopRef(const Q &name, std::uint64_t *version = nullptr) {
+        return this->tryGetTopRef(name, version).take();
+    }
+    template <typename Q>
+    StackResult<typename S::ValueRef>
+    tryGetTopRef(const Q &name, std::uint64_t *version = nullptr) {
+        return this->withStack(name, hashOf(name), [&](S &stack) {
+            return stack.tryGetTopRef(version);
+        });
+    }
+
+    /**
+     * Returns the range of up to `count` values from the top of the stack `S`
+     * down, which is read without holding any lock.
+     */
+    template <typename Q> auto peek(const Q &name, std::size_t count) {
+        return this->tryPeek(name, count).take();
+    }
+    template <typename Q>
+    StackResult<typename S::Range> tryPeek(const Q &name, std::size_t count) {
+        return this->withStack(
+            name, hashOf(name),
+            [&](S &stack) -> StackResult<typename S::Range> {
+                return stack.peek(count);
+            });
+    }
+
+    /**
+     * Like `pop`, but returns a reference pinning the popped node of the stack
+     * `S` instead of its value, if the stack is at the version `check`
+     * requires.
+     */
+    auto popRef(const K &name, const VersionCheck &check = {}) {
+        return this->tryPopRef(name, check).take();
+    }
+    StackResult<typename S::ValueRef>
+    tryPopRef(const K &name, const VersionCheck &check = {}) {
+        return this->tryPopRef(name, hashOf(name), check);
+    }
+
+    /**
+     * Like `popRef`, but if the stack is empty, parks `waiter` on it to be
+     * woken by the next push, and returns an empty reference. The waiter is
+     * parked before the pop is retried, so a push between the two is not
+     * missed.
+     *
+     * A waiter which gives up must be unregistered by `cancelWait`. Sets
+     * `version`, unless null, to the version the pop leaves the stack at.
+     */
+    typename S::ValueRef
+    popRefOrWait(const K &name, const std::shared_ptr<PopWaiter> &waiter,
+                 std::uint64_t *version = nullptr) {
+        return this->tryPopRefOrWait(name, waiter, version).take();
+    }
+    StackResult<typename S::ValueRef>
+    tryPopRefOrWait(const K &name, const std::shared_ptr<PopWaiter> &waiter,
+                    std::uint64_t *version = nullptr) {
+        auto hash = hashOf(name);
+        VersionCheck check;
+        check.version = version;
+        auto value = this->tryPopRef(name, hash, check);
+        if (value.getError() != StackError::StackEmpty) {
+            return value;
+        }
+        this->addWaiter(name, hash, waiter);
+        try {
+            value = this->tryPopRef(name, hash, check);
+        } catch (...) {
+            this->removeWaiter(name, hash, *waiter);
+            throw;
+        }
+        if (value.getError() == StackError::StackEmpty) {
+            return typename S::ValueRef();
+        }
+        this->removeWaiter(name, hash, *waiter);
+        return value;
+    }
+
+    /**
+     * Unregisters a waiter which gives up waiting. If it was woken meanwhile,
+     * the wake is passed on to the next waiter, so that the pushed value does
+     * not go unnoticed.
+     */
+    void cancelWait(const K &name, PopWaiter &waiter) {
+        auto hash = hashOf(name);
+        if (!this->removeWaiter(name, hash, waiter)) {
+            this->wakeWaiters(name, hash, 1);
+        }
+    }
+
+    /**
+     * Like `popRef`, but if the stack is empty, blocks until a value is pushed
+     * to it or `deadline` passes, then fails with `StackEmpty`.
+     */
+    template <typename Clock, typename Duration>
+    typename S::ValueRef
+    popRefUntil(const K &name,
+                const std::chrono::time_point<Clock, Duration> &deadline,
+                std::uint64_t *version = nullptr) {
+        return this->tryPopRefUntil(name, deadline, version).take();
+    }
+    template <typename Clock, typename Duration>
+    StackResult<typename S::ValueRef>
+    tryPopRefUntil(const K &name,
+                   const std::chrono::time_point<Clock, Duration> &deadline,
+                   std::uint64_t *version = nullptr) {
+        auto waiter = std::make_shared<BlockingPopWaiter>();
+        while (true) {
+            auto value = this->tryPopRefOrWait(name, waiter, version);
+            if (!value || *value) {
+                return value;
+            }
+            if (!waiter->waitUntil(deadline)) {
+                this->cancelWait(name, *waiter);
+                return StackError::StackEmpty;
+            }
         }
-        return {std::move(lock), stack->second};
+    }
+
+    void pushMany(const K &name, std::vector<T> &&values) {
+        this->tryPushMany(name, std::move(values)).take();
+    }
+    StackResult<void> tryPushMany(const K &name, std::vector<T> &&values) {
+        auto hash = hashOf(name);
+        auto count = values.size();
+        auto result = this->withStack(name, hash, [&](S &stack) {
+            // The values are moved into the nodes before the stack is locked.
+            std::vector<T> logged;
+            if (this->log != nullptr) {
+                logged = values;
+            }
+            return stack.tryPushMany(
+                std::move(values),
+                [&] {
+                    if (this->log != nullptr && !logged.empty()) {
+                        this->log->pushMany(name, logged);
+                    }
+                },
+                this->limits);
+        });
+        if (result) {
+            this->wakeWaiters(name, hash, count);
+        }
+        return result;
+    }
+
+    /**
+     * Pops up to `count` values of the stack `name` at once, like
+     * `S::popMany`: no other operation on the stack sees it partly popped. A
+     * stack shorter than `count` is emptied, and an empty one gives no values
+     * rather than failing.
+     */
+    std::vector<T> popMany(const K &name, std::size_t count) {
+        return this->tryPopMany(name, count).take();
+    }
+    StackResult<std::vector<T>> tryPopMany(const K &name, std::size_t count) {
+        return this->withStack(
+            name, hashOf(name), [&](S &stack) -> StackResult<std::vector<T>> {
+                return stack.popMany(count, [&](std::size_t popped) {
+                    if (this->log != nullptr) {
+                        this->log->pop(name, popped);
+                    }
+                });
+            });
     }
 
     void copy(const K &from, K &&to) {
-        bool inserted;
-        {
-            std::unique_lock _lock(this->lock);
+        this->tryCopy(from, std::move(to)).take();
+    }
+    StackResult<void> tryCopy(const K &from, K &&to) {
+        auto fromHash = hashOf(from);
+        auto toHash = hashOf(to);
+        auto fromIndex = this->shardIndexOf(fromHash);
+        auto toIndex = this->shardIndexOf(toHash);
+        auto &fromShard = this->shards[fromIndex];
+        auto &toShard = this->shards[toIndex];
+
+        // The source is copied under the shared locks of its shard and stack
+        // only, before the destination is locked.
+        std::uint64_t version = 0;
+        auto source = this->withStack(
+            from, fromHash,
+            [&](S &stack) -> StackResult<S> { return S(stack, &version); });
+        if (!source) {
+            return source.getError();
+        }
+        auto copied = std::move(*source);
+        reserve(toShard, 1);
+
+        // Both shards are then held to insert the copy, so that it is ordered
+        // against the mutations of both stacks. They are locked in index
+        // order, so copies in opposite directions cannot deadlock. The
+        // source is only locked shared, unless it is in the same shard.
+        std::shared_lock<std::shared_mutex> fromLock(fromShard.lock,
+                                                     std::defer_lock);
+        std::unique_lock<std::shared_mutex> toLock(toShard.lock,
+                                                   std::defer_lock);
+        if (fromIndex < toIndex) {
+            lockTimed(fromLock);
+            lockTimed(toLock);
+        } else if (fromIndex > toIndex) {
+            lockTimed(toLock);
+            lockTimed(fromLock);
+        } else {
+            lockTimed(toLock);
+        }
+
+        auto fromEntry = fromShard.map.find(from, fromHash);
+        if (fromEntry == nullptr) {
+            return StackError::StackNameNotFound;
+        }
+        if (toShard.map.find(to, toHash) != nullptr) {
+            return StackError::StackNameAlreadyExists;
+        }
+
+        // Logged under the lock of the source stack, which orders the copy
+        // against its pushes and pops, if the source is still at the copied
+        // version. Otherwise it is copied again, under the lock.
+        auto logCopy = [&] {
+            if (this->log != nullptr) {
+                this->log->copy(from, to);
+            }
+        };
+        if (!fromEntry->second.commitIfAt(version, logCopy)) {
+            copied = S(fromEntry->second, logCopy);
+        }
+        toShard.map.insert(toHash, std::move(to), std::move(copied));
+        return {};
+    }
+
+    /**
+     * Pops the top of the stack `from` and pushes it onto the stack `to` in
+     * one operation, like `S::move`, and returns a reference pinning the moved
+     * node. Fails with `StackNameNotFound` if either stack is missing.
+     */
+    auto move(const K &from, const K &to) {
+        return this->tryMove(from, to).take();
+    }
+    StackResult<typename S::ValueRef> tryMove(const K &from, const K &to) {
+        auto fromHash = hashOf(from);
+        auto toHash = hashOf(to);
+        auto fromIndex = this->shardIndexOf(fromHash);
+        auto toIndex = this->shardIndexOf(toHash);
+        bool pushed = false;
+        auto result = [&]() -> StackResult<typename S::ValueRef> {
+            // Both shards are only locked shared, in index order like in
+            // `copy`, and the stacks are locked by `S::move`.
+            std::shared_lock<std::shared_mutex> firstLock(
+                this->shards[std::min(fromIndex, toIndex)].lock,
+                std::defer_lock);
+            std::shared_lock<std::shared_mutex> secondLock(
+                this->shards[std::max(fromIndex, toIndex)].lock,
+                std::defer_lock);
+            lockTimed(firstLock);
+            if (fromIndex != toIndex) {
+                lockTimed(secondLock);
+            }
 
-            auto fromIter = this->map.find(from);
-            if (fromIter == this->map.cend()) {
-                throw StackNameNotFound();
+            auto fromEntry = this->shards[fromIndex].map.find(from, fromHash);
+            auto toEntry = this->shards[toIndex].map.find(to, toHash);
+            if (fromEntry == nullptr || toEntry == nullptr) {
+                return StackError::StackNameNotFound;
             }
+            return S::tryMove(
+                fromEntry->second, toEntry->second,
+                [&] {
+                    pushed = true;
+                    if (this->log != nullptr) {
+                        this->log->move(from, to);
+                    }
+                },
+                this->limits);
+        }();
+        if (pushed) {
+            this->wakeWaiters(to, toHash, 1);
+        }
+        return result;
+    }
 
-            inserted =
-                this->map.insert({std::move(to), fromIter->second}).second;
+    /**
+     * Copies the stack `from` to each of `names`, all sharing its nodes. The
+     * fork is atomic: either all the copies are created, or none of them is
+     * if one of the names already exists, or is given twice.
+     */
+    void fork(const K &from, std::vector<K> &&names) {
+        this->tryFork(from, std::move(names)).take();
+    }
+    StackResult<void> tryFork(const K &from, std::vector<K> &&names) {
+        auto fromHash = hashOf(from);
+        auto fromIndex = this->shardIndexOf(fromHash);
+        std::vector<std::string_view> distinct;
+        std::vector<std::size_t> hashes;
+        std::vector<std::size_t> destinations;
+        for (auto &name : names) {
+            distinct.push_back(StackKey<K>::view(name));
+            hashes.push_back(hashOf(name));
+            destinations.push_back(this->shardIndexOf(hashes.back()));
+        }
+        std::sort(distinct.begin(), distinct.end());
+        if (std::adjacent_find(distinct.begin(), distinct.end()) !=
+            distinct.end()) {
+            return StackError::StackNameAlreadyExists;
         }
 
-        if (!inserted) {
-            throw StackNameAlreadyExists();
+        // The head is taken once, under shared locks only, like in `copy`.
+        std::uint64_t version = 0;
+        auto source = this->withStack(
+            from, fromHash,
+            [&](S &stack) -> StackResult<S> { return S(stack, &version); });
+        if (!source) {
+            return source.getError();
+        }
+        auto forked = std::move(*source);
+        std::sort(destinations.begin(), destinations.end());
+        for (auto begin = destinations.begin(); begin != destinations.end();) {
+            auto end = std::upper_bound(begin, destinations.end(), *begin);
+            reserve(this->shards[*begin], end - begin);
+            begin = end;
+        }
+        destinations.erase(
+            std::unique(destinations.begin(), destinations.end()),
+            destinations.end());
+
+        // All the shards involved are locked in index order, like in `copy`,
+        // and the source shard is locked shared unless it is a destination.
+        std::shared_lock<std::shared_mutex> fromLock(
+            this->shards[fromIndex].lock, std::defer_lock);
+        std::vector<std::unique_lock<std::shared_mutex>> toLocks;
+        bool fromIsDestination = std::binary_search(
+            destinations.begin(), destinations.end(), fromIndex);
+        for (auto index : destinations) {
+            if (!fromIsDestination && !fromLock.owns_lock() &&
+                fromIndex < index) {
+                lockTimed(fromLock);
+            }
+            toLocks.emplace_back(this->shards[index].lock, std::defer_lock);
+            lockTimed(toLocks.back());
+        }
+        if (!fromIsDestination && !fromLock.owns_lock()) {
+            lockTimed(fromLock);
+        }
+
+        auto fromEntry = this->shards[fromIndex].map.find(from, fromHash);
+        if (fromEntry == nullptr) {
+            return StackError::StackNameNotFound;
+        }
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            auto &shard = this->shardOf(hashes[i]);
+            if (shard.map.find(names[i], hashes[i]) != nullptr) {
+                return StackError::StackNameAlreadyExists;
+            }
+        }
+
+        // The copies are logged under the lock of the source stack, and the
+        // head taken again if it has changed, like in `copy`.
+        auto logCopies = [&] {
+            if (this->log != nullptr) {
+                for (auto &name : names) {
+                    this->log->copy(from, name);
+                }
+            }
+        };
+        if (!fromEntry->second.commitIfAt(version, logCopies)) {
+            forked = S(fromEntry->second, logCopies);
+        }
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            this->shardOf(hashes[i]).map.insert(hashes[i], std::move(names[i]),
+                                                S(forked));
+        }
+        return {};
+    }
+
+    std::size_t getShardCount() const { return this->shardCount; }
+
+    /**
+     * Returns the number of pops parked on the stacks, waiting for a push.
+     */
+    std::size_t getWaiterCount() const {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < this->shardCount; ++i) {
+            count += this->shards[i].waiting.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    template <typename Q> StackSize getSize(const Q &name) {
+        return this->tryGetSize(name).take();
+    }
+    template <typename Q> StackResult<StackSize> tryGetSize(const Q &name) {
+        return this->withStack(
+            name, hashOf(name),
+            [](S &stack) -> StackResult<StackSize> { return stack.getSize(); });
+    }
+
+    /**
+     * Totals of the sizes of all the stacks, in which a shared tail is counted
+     * once for each stack it is part of.
+     */
+    struct Stats {
+        std::uint64_t stacks;
+        std::uint64_t length;
+        std::uint64_t bytes;
+    };
+
+    /**
+     * Returns the totals of the sizes of the stacks. The shards are visited one
+     * after another, so the totals are not a snapshot of the whole map.
+     */
+    Stats getStats() {
+        Stats stats{0, 0, 0};
+        for (std::size_t i = 0; i < this->shardCount; ++i) {
+            auto _lock = lockShared(this->shards[i].lock);
+            for (auto &entry : this->shards[i].map) {
+                auto size = entry.second.getSize();
+                ++stats.stacks;
+                stats.length += size.length;
+                stats.bytes += size.bytes;
+            }
+        }
+        return stats;
+    }
+
+    /**
+     * Spills the values of each stack more than `residentDepth` from its top
+     * out of memory, like `S::spill`, up to `maxSegments` segments for each
+     * stack. Returns the number of spilled values.
+     *
+     * The shards are visited one after the other, in rounds spilling a run
+     * of each of their stacks. The runs are picked, and later replaced,
+     * under the shared lock of the shard, but stored without it, so neither
+     * the shard nor the stacks are locked across the I/O of the segments.
+     * A stack which has no run left to spill, or changed while its run was
+     * stored, is left out of the next rounds.
+     */
+    std::size_t spill(std::size_t residentDepth, std::size_t maxSegments) {
+        std::size_t spilled = 0;
+        std::vector<std::pair<K, typename S::SpillRun>> runs;
+        for (std::size_t i = 0; i < this->shardCount; ++i) {
+            {
+                auto _lock = lockShared(this->shards[i].lock);
+                for (auto &entry : this->shards[i].map) {
+                    if (auto run = entry.second.pickSpillRun(residentDepth)) {
+                        runs.emplace_back(entry.first, std::move(run));
+                    }
+                }
+            }
+            for (std::size_t round = 0; round < maxSegments && !runs.empty();
+                 ++round) {
+                std::vector<K> names;
+                for (auto &run : runs) {
+                    run.second.store();
+                    auto hash = hashOf(run.first);
+                    auto count = this->withStack(
+                        run.first, hash,
+                        [&](S &stack) -> StackResult<std::size_t> {
+                            return stack.replaceSpillRun(run.second,
+                                                         residentDepth);
+                        });
+                    if (count && *count > 0) {
+                        spilled += *count;
+                        names.push_back(std::move(run.first));
+                    }
+                }
+                // The replaced runs are freed without holding any lock.
+                runs.clear();
+                if (round + 1 == maxSegments) {
+                    break;
+                }
+                for (auto &name : names) {
+                    auto run = this->withStack(
+                        name, hashOf(name),
+                        [&](S &stack) -> StackResult<typename S::SpillRun> {
+                            return stack.pickSpillRun(residentDepth);
+                        });
+                    if (run && *run) {
+                        runs.emplace_back(std::move(name), std::move(*run));
+                    }
+                }
+            }
+            runs.clear();
+        }
+        return spilled;
+    }
+
+    /**
+     * Returns the number of stacks. The shards are counted one after the
+     * other, so the count is not atomic with respect to concurrent changes.
+     */
+    std::size_t size() {
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < this->shardCount; ++i) {
+            auto _lock = lockShared(this->shards[i].lock);
+            size += this->shards[i].map.size();
+        }
+        return size;
+    }
+
+    /**
+     * Removes all the stacks, one shard after the other. It is not logged,
+     * and meant for a replica starting over from a snapshot of its primary,
+     * on which no pop waits.
+     */
+    void clear() {
+        for (std::size_t i = 0; i < this->shardCount; ++i) {
+            auto &shard = this->shards[i];
+            auto _lock = lockExclusive(shard.lock);
+            // The stacks are destroyed once the lock is released.
+            Map removed(std::move(shard.map));
+            _lock.unlock();
         }
     }
 
 private:
-    std::shared_mutex lock;
-    std::unordered_map<K, Stack<T>> map;
+    // Compares the names by their characters, whatever their types.
+    struct NameEqual {
+        template <typename A, typename B>
+        bool operator()(const A &a, const B &b) const {
+            return StackKey<A>::view(a) == StackKey<B>::view(b);
+        }
+    };
+
+    using Map = FlatHashMap<K, S, NameEqual>;
+    using WaiterMap =
+        FlatHashMap<K, std::deque<std::shared_ptr<PopWaiter>>, NameEqual>;
+
+    // Aligned to avoid false sharing between the locks of adjacent shards.
+    struct alignas(64) Shard {
+        std::shared_mutex lock;
+        Map map;
+
+        // The waiters parked on the stacks of the shard, by name. They have
+        // their own lock, which is never held with `lock`.
+        std::mutex waitLock;
+        WaiterMap waiters;
+        // The number of waiters, read by the pushes without the lock. A push
+        // reads it after releasing the lock of the stack, which a waiter
+        // takes to retry the pop after parking, so it sees the waiter, or the
+        // waiter sees the pushed value.
+        std::atomic<std::size_t> waiting{0};
+    };
+
+    template <typename Q>
+    std::pair<std::shared_lock<std::shared_mutex>, S &>
+    getStack(const Q &name, std::size_t hash) {
+        auto &shard = this->shardOf(hash);
+        auto lock = lockShared(shard.lock);
+        auto entry = shard.map.find(name, hash);
+        if (entry == nullptr) {
+            throw StackNameNotFound();
+        }
+        return {std::move(lock), entry->second};
+    }
+
+    // Returns the result of `op` on the stack `name`, called under the lock
+    // of its shard, or `StackNameNotFound`.
+    template <typename Q, typename Op>
+    auto withStack(const Q &name, std::size_t hash, Op op)
+        -> decltype(op(std::declval<S &>())) {
+        auto &shard = this->shardOf(hash);
+        auto _lock = lockShared(shard.lock);
+        auto entry = shard.map.find(name, hash);
+        if (entry == nullptr) {
+            return StackError::StackNameNotFound;
+        }
+        return op(entry->second);
+    }
+
+    StackResult<typename S::ValueRef>
+    tryPopRef(const K &name, std::size_t hash, const VersionCheck &check) {
+        return this->withStack(name, hash, [&](S &stack) {
+            return stack.tryPopRef(
+                [&] {
+                    if (this->log != nullptr) {
+                        this->log->pop(name, 1);
+                    }
+                },
+                check);
+        });
+    }
+
+    void addWaiter(const K &name, std::size_t hash,
+                   const std::shared_ptr<PopWaiter> &waiter) {
+        auto &shard = this->shardOf(hash);
+        std::lock_guard _lock(shard.waitLock);
+        if (!waiter->queued) {
+            waiter->queued = true;
+            auto list = shard.waiters.find(name, hash);
+            if (list == nullptr) {
+                list = shard.waiters.insert(hash, K(name), {}).first;
+            }
+            list->second.push_back(waiter);
+            shard.waiting.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns whether the waiter was still parked, rather than woken.
+    bool removeWaiter(const K &name, std::size_t hash, PopWaiter &waiter) {
+        auto &shard = this->shardOf(hash);
+        std::lock_guard _lock(shard.waitLock);
+        if (!waiter.queued) {
+            return false;
+        }
+        waiter.queued = false;
+        auto list = shard.waiters.find(name, hash);
+        auto &queue = list->second;
+        queue.erase(std::find_if(queue.begin(), queue.end(), [&](auto &parked) {
+            return parked.get() == &waiter;
+        }));
+        if (queue.empty()) {
+            shard.waiters.erase(list);
+        }
+        shard.waiting.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Wakes up to `count` of the waiters parked on the stack `name`, first
+    // parked first.
+    void wakeWaiters(const K &name, std::size_t hash, std::size_t count) {
+        auto &shard = this->shardOf(hash);
+        if (shard.waiting.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        std::lock_guard _lock(shard.waitLock);
+        auto list = shard.waiters.find(name, hash);
+        if (list == nullptr) {
+            return;
+        }
+        auto &queue = list->second;
+        for (; count > 0 && !queue.empty(); --count) {
+            auto waiter = std::move(queue.front());
+            queue.pop_front();
+            waiter->queued = false;
+            shard.waiting.fetch_sub(1, std::memory_order_relaxed);
+            waiter->wake();
+        }
+        if (queue.empty()) {
+            shard.waiters.erase(list);
+        }
+    }
+
+    template <typename Q> static std::size_t hashOf(const Q &name) {
+        return std::hash<std::string_view>{}(StackKey<Q>::view(name));
+    }
+
+    std::size_t shardIndexOf(std::size_t hash) const {
+        // The tables inside the shards consume the low bits of the same hash,
+        // so the shard is picked by the high bits of a multiplicative mix.
+        std::uint64_t mixed = hash;
+        mixed *= 0x9E3779B97F4A7C15ull;
+        return (mixed >> 32) % this->shardCount;
+    }
+
+    Shard &shardOf(std::size_t hash) {
+        return this->shards[this->shardIndexOf(hash)];
+    }
+
+    // Grows the table of `shard` ahead of `extra` inserts, so that they do
+    // not grow it while holding the exclusive lock of the shard, along with
+    // the other locks of their operation. The larger table is allocated
+    // without the lock, and the entries are moved into it in a section of
+    // its own, which still blocks the shard for the time of the moves, once
+    // per doubling of the table. Inserts made meanwhile by others may use
+    // the room up, in which case the insert grows the table as it is.
+    static void reserve(Shard &shard, std::size_t extra) {
+        std::size_t capacity;
+        {
+            auto _lock = lockShared(shard.lock);
+            if (shard.map.fits(extra)) {
+                return;
+            }
+            capacity = shard.map.capacityFor(extra);
+        }
+        auto storage = Map::allocate(capacity);
+        auto _lock = lockExclusive(shard.lock);
+        shard.map.adopt(std::move(storage));
+    }
+
+    std::size_t shardCount;
+    std::unique_ptr<Shard[]> shards;
+    std::shared_ptr<MutationLog<K, T>> log;
+    StackLimits limits;
+
+    friend class Snapshot;
 };
 
 #endif
@@ -0,0 +1,135 @@
+#ifndef StackResult_hpp
+#define StackResult_hpp
+
+#include "MemoryBudget.hpp"
+
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+
+class StackEmpty : public std::exception {
+public:
+    const char *what() const noexcept override { return "Stack is empty"; }
+};
+
+class StackLimitExceeded : public std::exception {
+public:
+    const char *what() const noexcept override {
+        return "Stack limit exceeded";
+    }
+};
+
+class StackNameAlreadyExists : public std::exception {
+public:
+    const char *what() const noexcept override {
+        return "Stack name already exists";
+    }
+};
+
+class StackNameNotFound : public std::exception {
+public:
+    const char *what() const noexcept override {
+        return "Stack name not found";
+    }
+};
+
+class VersionMismatch : public std::exception {
+public:
+    const char *what() const noexcept override {
+        return "Stack version mismatch";
+    }
+};
+
+/**
+ * The errors of the stack operations, each reported by the throwing API as
+ * the exception of the same name.
+ */
+enum class StackError : std::uint8_t {
+    None = 0,
+    StackEmpty,
+    StackNameAlreadyExists,
+    StackNameNotFound,
+    StackLimitExceeded,
+    MemoryLimitExceeded,
+    VersionMismatch,
+};
+
+/**
+ * Throws the exception of `error`, which must not be `StackError::None`.
+ */
+[[noreturn]] inline void throwStackError(StackError error) {
+    switch (error) {
+    case StackError::StackEmpty:
+        throw StackEmpty();
+    case StackError::StackNameAlreadyExists:
+        throw StackNameAlreadyExists();
+    case StackError::StackNameNotFound:
+        throw StackNameNotFound();
+    case StackError::StackLimitExceeded:
+        throw StackLimitExceeded();
+    case StackError::VersionMismatch:
+        throw VersionMismatch();
+    case StackError::MemoryLimitExceeded:
+    case StackError::None:
+        break;
+    }
+    throw MemoryLimitExceeded();
+}
+
+/**
+ * Outcome of the `try` operations of `Stack` and `StackMap`: either a value or
+ * an error. The expected failures, like popping an empty stack, are returned
+ * rather than thrown, so the callers for which they are frequent do not pay
+ * for unwinding.
+ */
+template <typename V> class StackResult {
+public:
+    StackResult(V value) : value(std::move(value)), error(StackError::None) {}
+    StackResult(StackError error) : error(error) {}
+
+    bool ok() const { return this->error == StackError::None; }
+    explicit operator bool() const { return this->ok(); }
+    StackError getError() const { return this->error; }
+
+    V &operator*() { return *this->value; }
+    V *operator->() { return &*this->value; }
+
+    /**
+     * Moves the value out, or throws the exception of the error.
+     */
+    V take() {
+        if (!this->ok()) {
+            throwStackError(this->error);
+        }
+        return std::move(*this->value);
+    }
+
+private:
+    std::optional<V> value;
+    StackError error;
+};
+
+template <> class StackResult<void> {
+public:
+    StackResult() : error(StackError::None) {}
+    StackResult(StackError error) : error(error) {}
+
+    bool ok() const { return this->error == StackError::None; }
+    explicit operator bool() const { return this->ok(); }
+    StackError getError() const { return this->error; }
+
+    /**
+     * Throws the exception of the error, if any.
+     */
+    void take() const {
+        if (!this->ok()) {
+            throwStackError(this->error);
+        }
+    }
+
+private:
+    StackError error;
+};
+
+#endif /* StackResult_hpp */
@@ -0,0 +1,38 @@
+#ifndef StringStackMap_hpp
+#define StringStackMap_hpp
+
+#include "MutationLog.hpp"
+#include "NodePool.hpp"
+#include "SmallString.hpp"
+#include "SpillStore.hpp"
+#include "StackMap.hpp"
+#include "ValueInterner.hpp"
+
+#include "oatpp/core/Types.hpp"
+
+#include <string_view>
+
+/**
+ * Stack of strings with its nodes drawn from a thread-caching pool. The short
+ * values are stored inline in the nodes, and the spilled ones in `SpillStore`.
+ */
+using StringStack = Stack<SmallString, PoolAllocator<SmallString>>;
+
+/**
+ * The names of the API are viewed in place, a null one as the empty name.
+ */
+template <> struct StackKey<oatpp::String> {
+    static std::string_view view(const oatpp::String &name) {
+        return name ? std::string_view(name->data(), name->size())
+                    : std::string_view();
+    }
+};
+
+/**
+ * The map of string stacks served by the API.
+ */
+using StringStackMap = StackMap<oatpp::String, SmallString, StringStack>;
+
+using StringMutationLog = MutationLog<oatpp::String, SmallString>;
+
+#endif /* StringStackMap_hpp */
@@ -0,0 +1,104 @@
+#ifndef Tierer_hpp
+#define Tierer_hpp
+
+#include "StringStackMap.hpp"
+
+#include "oatpp/core/base/Environment.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * Spills the cold tails of the stacks of a map to `SpillStore` at a fixed
+ * interval on a background thread, like `Snapshotter` writes snapshots.
+ *
+ * The values more than `residentDepth` from the top of their stack are cold,
+ * as a stack is only touched at its top, so the resident memory follows the
+ * tops of the stacks rather than their whole length. A pass spills a few
+ * segments of each stack at a time, so a stack is never locked long, and
+ * goes over the map again until there is nothing left to spill.
+ */
+class Tierer {
+public:
+    Tierer(std::shared_ptr<StringStackMap> map, std::size_t residentDepth,
+           std::chrono::seconds interval)
+        : map(std::move(map)), residentDepth(residentDepth),
+          interval(interval) {
+        this->thread = std::thread([this] { this->run(); });
+    }
+
+    ~Tierer() {
+        {
+            std::lock_guard _lock(this->stopLock);
+            this->stopping = true;
+        }
+        this->stopCv.notify_one();
+        this->thread.join();
+    }
+
+    Tierer(const Tierer &) = delete;
+    Tierer &operator=(const Tierer &) = delete;
+
+    /**
+     * Spills the cold tails of the stacks now. Returns the number of spilled
+     * values.
+     */
+    std::size_t spill() {
+        std::size_t total = 0;
+        while (!this->isStopping()) {
+            auto spilled =
+                this->map->spill(this->residentDepth, segmentsPerVisit);
+            if (spilled == 0) {
+                break;
+            }
+            total += spilled;
+        }
+        return total;
+    }
+
+private:
+    // The segments spilled from a stack each time the pass visits it.
+    static constexpr std::size_t segmentsPerVisit = 16;
+
+    void run() {
+        std::unique_lock _lock(this->stopLock);
+        while (!this->stopCv.wait_for(_lock, this->interval,
+                                      [&] { return this->stopping; })) {
+            _lock.unlock();
+            try {
+                auto start = std::chrono::steady_clock::now();
+                auto spilled = this->spill();
+                auto elapsed =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start);
+                if (spilled > 0) {
+                    OATPP_LOGI("Tierer", "Spilled %llu values in %lld ms",
+                               (unsigned long long)spilled,
+                               (long long)elapsed.count());
+                }
+            } catch (const std::exception &e) {
+                OATPP_LOGE("Tierer", "Cannot spill: %s", e.what());
+            }
+            _lock.lock();
+        }
+    }
+
+    bool isStopping() {
+        std::lock_guard _lock(this->stopLock);
+        return this->stopping;
+    }
+
+    std::shared_ptr<StringStackMap> map;
+    std::size_t residentDepth;
+    std::chrono::seconds interval;
+
+    std::mutex stopLock;
+    std::condition_variable stopCv;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif /* Tierer_hpp */
@@ -0,0 +1,170 @@
+#ifndef ValueInterner_hpp
+#define ValueInterner_hpp
+
+#include "FlatHashMap.hpp"
+#include "SmallString.hpp"
+
+#include "oatpp/core/Types.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/**
+ * Table of the long values pushed to the stacks, through which the nodes
+ * holding identical values share one buffer rather than a copy each.
+ *
+ * `intern` looks a value up by its bytes, and replaces it with the buffer of
+ * the table holding the same bytes, or copies it into a new buffer which it
+ * adds to the table. The table only holds weak references to the buffers: a
+ * buffer is owned by the values sharing it, and removes its entry when the
+ * last of them drops it. The short values are stored inline in the nodes, so
+ * only those `SmallString` keeps out of line are interned.
+ *
+ * The table is split into shards, each under its own lock, like `StackMap`.
+ * Interning is off until it is enabled.
+ */
+class ValueInterner {
+public:
+    /**
+     * Sizes of the table. The bytes of the values counted once for each of
+     * their references over their bytes counted once is the ratio by which
+     * interning saves memory.
+     */
+    struct Stats {
+        std::uint64_t values;
+        std::uint64_t bytes;
+        std::uint64_t referencedBytes;
+    };
+
+    /**
+     * The table is never destroyed, like `MemoryBudget`, as the buffers may
+     * be released by threads which exit after the static objects are
+     * destroyed.
+     */
+    static ValueInterner &instance() {
+        static auto interner = new ValueInterner();
+        return *interner;
+    }
+
+    void setEnabled(bool enabled) {
+        this->enabled.store(enabled, std::memory_order_relaxed);
+    }
+    bool isEnabled() const {
+        return this->enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Replaces `value` with a value sharing the interned buffer of the same
+     * bytes, unless interning is off or the value is inline.
+     */
+    void intern(SmallString &value) {
+        if (value.isInline() || !this->isEnabled()) {
+            return;
+        }
+        std::string_view view(value.data(), value.size());
+        auto hash = std::hash<std::string_view>{}(view);
+        std::shared_ptr<std::string> buffer;
+        {
+            auto &shard = this->shardOf(hash);
+            std::lock_guard _lock(shard.lock);
+            auto entry = shard.table.find(view, hash);
+            if (entry != nullptr) {
+                buffer = entry->second.lock();
+            }
+            if (buffer == nullptr) {
+                buffer = std::shared_ptr<std::string>(new std::string(view),
+                                                      Release{this, hash});
+                if (entry != nullptr) {
+                    // The last value sharing the buffer of the entry was just
+                    // dropped, and its release skips the replaced entry.
+                    entry->first = *buffer;
+                    entry->second = buffer;
+                } else {
+                    shard.table.insert(hash, *buffer, buffer);
+                }
+            }
+        }
+        // Assigned without the lock, as the previous buffer of the value may
+        // be released along the way.
+        value = SmallString(oatpp::String(std::move(buffer)));
+    }
+
+    /**
+     * Returns the sizes of the table. The shards are visited one after the
+     * other, so the sizes are not a snapshot of the whole table.
+     */
+    Stats getStats() {
+        Stats stats{0, 0, 0};
+        for (auto &shard : this->shards) {
+            std::lock_guard _lock(shard.lock);
+            for (auto &entry : shard.table) {
+                auto references = entry.second.use_count();
+                if (references > 0) {
+                    ++stats.values;
+                    stats.bytes += entry.first.size();
+                    stats.referencedBytes +=
+                        entry.first.size() *
+                        static_cast<std::uint64_t>(references);
+                }
+            }
+        }
+        return stats;
+    }
+
+private:
+    static constexpr std::size_t shardCount = 64;
+
+    // The deleter of the buffers, which removes their entry before freeing
+    // them, so the key of an entry always views a live buffer.
+    struct Release {
+        ValueInterner *interner;
+        std::size_t hash;
+
+        void operator()(std::string *buffer) const {
+            {
+                auto &shard = this->interner->shardOf(this->hash);
+                std::lock_guard _lock(shard.lock);
+                auto entry =
+                    shard.table.find(std::string_view(*buffer), this->hash);
+                if (entry != nullptr && entry->first.data() == buffer->data()) {
+                    shard.table.erase(entry);
+                }
+            }
+            delete buffer;
+        }
+    };
+
+    // Aligned to avoid false sharing between the locks of adjacent shards.
+    struct alignas(64) Shard {
+        std::mutex lock;
+        FlatHashMap<std::string_view, std::weak_ptr<std::string>> table;
+    };
+
+    ValueInterner() = default;
+
+    Shard &shardOf(std::size_t hash) {
+        // The table consumes the low bits of the hash, so the shard is picked
+        // by the high bits of a multiplicative mix, like in `StackMap`.
+        std::uint64_t mixed = hash;
+        mixed *= 0x9E3779B97F4A7C15ull;
+        return this->shards[(mixed >> 32) % shardCount];
+    }
+
+    std::atomic<bool> enabled{false};
+    Shard shards[shardCount];
+};
+
+/**
+ * Interns a value pushed to a `Stack<SmallString>`.
+ */
+inline void internValue(SmallString &value) {
+    ValueInterner::instance().intern(value);
+}
+
+#endif /* ValueInterner_hpp */
@@ -0,0 +1,503 @@
+#ifndef WriteAheadLog_hpp
+#define WriteAheadLog_hpp
+
+#include "BinaryFormat.hpp"
+#include "FileUtils.hpp"
+#include "MutationLog.hpp"
+#include "MutationRecord.hpp"
+#include "StringStackMap.hpp"
+
+#include "oatpp/core/Types.hpp"
+#include "oatpp/core/base/Environment.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Append-only log of the mutations of a `StringStackMap`, replayed at startup
+ * to restore the stacks.
+ *
+ * Records are appended to an in-memory buffer under the locks of the map, and
+ * a writer thread writes the buffer to the file. This is a group commit: the
+ * records appended while one batch is being written and fsynced all share the
+ * next write and fsync.
+ *
+ * Each record is framed by the length and the CRC-32 of its payload, both
+ * 4-byte big-endian integers. The payload is the 8-byte sequence number and
+ * the `MutationRecord` of the mutation. A torn record at the end of the file, left by a
+ * crash in the middle of a write, fails the check and is cut off by `replay`.
+ *
+ * The records covered by a snapshot are dropped by `discardUpTo`, which has
+ * the writer thread rewrite the file with the records after them.
+ */
+class WriteAheadLog : public StringMutationLog {
+public:
+    /**
+     * How durable a mutation is before it is acknowledged.
+     */
+    enum class Durability {
+        // Written to the file without fsync. Survives a crash of the process
+        // but not of the machine.
+        None,
+        // Fsynced every sync interval, without waiting for it. A crash of the
+        // machine loses at most the last interval.
+        Batched,
+        // Acknowledged once fsynced, concurrent mutations sharing one fsync.
+        PerOp,
+    };
+
+    struct Stats {
+        // Records appended, and the writes and fsyncs they were flushed with.
+        std::uint64_t records;
+        std::uint64_t writes;
+        std::uint64_t syncs;
+    };
+
+    WriteAheadLog(const std::string &path, Durability durability,
+                  std::chrono::milliseconds syncInterval)
+        : path(path), durability(durability), syncInterval(syncInterval) {
+        this->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+                          0644);
+        if (this->fd < 0) {
+            throw std::runtime_error("Cannot open write-ahead log " + path +
+                                     ": " + std::strerror(errno));
+        }
+        this->writer = std::thread([this] { this->runWriter(); });
+    }
+
+    /**
+     * Flushes the records which are still pending.
+     */
+    ~WriteAheadLog() override {
+        {
+            std::lock_guard _lock(this->lock);
+            this->stopping = true;
+        }
+        this->writerCv.notify_one();
+        this->writer.join();
+        ::close(this->fd);
+    }
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    /**
+     * Applies the records of the file after the sequence number `afterSeq`,
+     * that of the snapshot `map` was loaded from if any, to `map`, which must
+     * not be logging to this log yet. The sequence numbers continue after
+     * both. Returns the number of applied records.
+     */
+    std::uint64_t replay(StringStackMap &map, std::uint64_t afterSeq = 0) {
+        auto data = FileUtils::readAll(this->fd);
+        std::size_t offset = 0;
+        std::uint64_t count = 0, lastSeq = afterSeq;
+        while (auto length = validRecordLength(data, offset)) {
+            BinaryReader reader(&data[offset + headerSize],
+                                &data[offset + headerSize + length]);
+            auto seq = reader.readUInt64();
+            if (seq > afterSeq) {
+                try {
+                    MutationRecord::apply(map, reader);
+                } catch (const std::exception &e) {
+                    throw std::runtime_error(
+                        "Cannot replay write-ahead log record " +
+                        std::to_string(seq) + ": " + e.what());
+                }
+                lastSeq = seq;
+                ++count;
+            }
+            offset += headerSize + length;
+        }
+
+        if (offset < data.size()) {
+            OATPP_LOGW("WriteAheadLog", "Cutting off %zu bytes of torn records",
+                       data.size() - offset);
+            if (::ftruncate(this->fd, static_cast<off_t>(offset)) != 0) {
+                FileUtils::throwError("Cannot cut off write-ahead log");
+            }
+        }
+
+        std::lock_guard _lock(this->lock);
+        this->lastSeq = lastSeq;
+        this->committedSeq.store(lastSeq, std::memory_order_release);
+        return count;
+    }
+
+    void create(const oatpp::String &name) override {
+        this->append([&](BinaryWriter &writer) {
+            MutationRecord::writeCreate(writer, name);
+        });
+    }
+
+    void remove(const oatpp::String &name) override {
+        this->append([&](BinaryWriter &writer) {
+            MutationRecord::writeRemove(writer, name);
+        });
+    }
+
+    void push(const oatpp::String &name, const SmallString &value) override {
+        this->append([&](BinaryWriter &writer) {
+            MutationRecord::writePush(writer, name, value);
+        });
+    }
+
+    void pushMany(const oatpp::String &name,
+                  const std::vector<SmallString> &values) override {
+        this->append([&](BinaryWriter &writer) {
+            MutationRecord::writePushMany(writer, name, values);
+        });
+    }
+
+    void pop(const oatpp::String &name, std::size_t count) override {
+        this->append([&](BinaryWriter &writer) {
+            MutationRecord::writePop(writer, name, count);
+        });
+    }
+
+    void copy(const oatpp::String &from, const oatpp::String &to) override {
+        this->append([&](BinaryWriter &writer) {
+            MutationRecord::writeCopy(writer, from, to);
+        });
+    }
+
+    void move(const oatpp::String &from, const oatpp::String &to) override {
+        this->append([&](BinaryWriter &writer) {
+            MutationRecord::writeMove(writer, from, to);
+        });
+    }
+
+    std::uint64_t getLastSeq() override {
+        std::lock_guard _lock(this->lock);
+        return this->lastSeq;
+    }
+
+    void discardUpTo(std::uint64_t seq) override {
+        {
+            std::lock_guard _lock(this->lock);
+            if (seq <= this->discardSeq) {
+                return;
+            }
+            this->discardSeq = seq;
+        }
+        this->writerCv.notify_one();
+    }
+
+    std::uint64_t takeLastLogged() override {
+        auto &last = lastLogged();
+        if (last.log != this) {
+            return 0;
+        }
+        last.log = nullptr;
+        return last.seq;
+    }
+
+    bool isCommitted(std::uint64_t seq) const override {
+        if (this->failed.load(std::memory_order_acquire)) {
+            throw std::runtime_error("Write-ahead log failed");
+        }
+        return this->durability != Durability::PerOp ||
+               this->committedSeq.load(std::memory_order_acquire) >= seq;
+    }
+
+    void waitCommitted(std::uint64_t seq) override {
+        if (this->isCommitted(seq)) {
+            return;
+        }
+        std::unique_lock _lock(this->lock);
+        this->committedCv.wait(_lock, [&] {
+            return this->failed.load(std::memory_order_relaxed) ||
+                   this->committedSeq.load(std::memory_order_relaxed) >= seq;
+        });
+        if (this->failed.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("Write-ahead log failed");
+        }
+    }
+
+    bool addCommitWaiter(std::uint64_t seq,
+                         std::shared_ptr<CommitWaiter> waiter) override {
+        if (this->durability != Durability::PerOp) {
+            return false;
+        }
+        // Checked under the lock, so the commit is not missed.
+        std::lock_guard _lock(this->lock);
+        if (this->failed.load(std::memory_order_relaxed) ||
+            this->committedSeq.load(std::memory_order_relaxed) >= seq) {
+            return false;
+        }
+        this->commitWaiters.emplace_back(seq, std::move(waiter));
+        return true;
+    }
+
+    void cancelCommitWait(const CommitWaiter &waiter) override {
+        std::lock_guard _lock(this->lock);
+        auto &waiters = this->commitWaiters;
+        waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                     [&](const auto &entry) {
+                                         return entry.second.get() == &waiter;
+                                     }),
+                      waiters.end());
+    }
+
+    Stats getStats() const {
+        return {this->records.load(std::memory_order_relaxed),
+                this->writes.load(std::memory_order_relaxed),
+                this->syncs.load(std::memory_order_relaxed)};
+    }
+
+private:
+    static constexpr std::size_t headerSize = 8;
+    // Pending bytes which wake the writer before the sync interval is over.
+    static constexpr std::size_t flushThreshold = 1 << 20;
+
+    struct LastLogged {
+        const WriteAheadLog *log = nullptr;
+        std::uint64_t seq = 0;
+    };
+
+    static LastLogged &lastLogged() {
+        thread_local LastLogged last;
+        return last;
+    }
+
+    // Only the framing and the payload are written under the lock, the CRC is
+    // filled in by the writer thread.
+    template <typename WriteMutation> void append(WriteMutation writeMutation) {
+        std::unique_lock _lock(this->lock);
+        auto start = this->pending.size();
+        this->pending.append(headerSize, '\0');
+        auto seq = ++this->lastSeq;
+        BinaryWriter writer(this->pending);
+        writer.writeUInt64(seq);
+        writeMutation(writer);
+        BinaryWriter::setUInt32(
+            &this->pending[start],
+            static_cast<v_uint32>(this->pending.size() - start - headerSize));
+        bool wake = this->durability == Durability::PerOp ||
+                    this->pending.size() >= flushThreshold;
+        _lock.unlock();
+
+        this->records.fetch_add(1, std::memory_order_relaxed);
+        lastLogged() = {this, seq};
+        if (wake) {
+            this->writerCv.notify_one();
+        }
+    }
+
+    void runWriter() {
+        std::string batch;
+        std::unique_lock _lock(this->lock);
+        while (true) {
+            auto ready = [&] {
+                return this->stopping || this->discardSeq > this->discardedSeq;
+            };
+            if (this->durability == Durability::PerOp) {
+                this->writerCv.wait(_lock, [&] {
+                    return ready() || !this->pending.empty();
+                });
+            } else {
+                this->writerCv.wait_for(_lock, this->syncInterval, [&] {
+                    return ready() || this->pending.size() >= flushThreshold;
+                });
+            }
+
+            if (!this->pending.empty()) {
+                batch.swap(this->pending);
+                auto seq = this->lastSeq;
+                _lock.unlock();
+                bool flushed =
+                    !this->failed.load(std::memory_order_relaxed) &&
+                    this->flush(batch);
+                batch.clear();
+                _lock.lock();
+
+                if (flushed) {
+                    this->committedSeq.store(seq, std::memory_order_release);
+                } else {
+                    this->failed.store(true, std::memory_order_release);
+                }
+                this->committedCv.notify_all();
+                this->wakeCommitWaiters();
+            }
+
+            // The records up to the discarded one have been flushed above.
+            if (this->discardSeq > this->discardedSeq) {
+                auto seq = this->discardSeq;
+                _lock.unlock();
+                if (!this->failed.load(std::memory_order_relaxed)) {
+                    this->compact(seq);
+                }
+                _lock.lock();
+                this->discardedSeq = seq;
+            }
+
+            if (this->stopping && this->pending.empty()) {
+                break;
+            }
+        }
+    }
+
+    // Wakes and unregisters the waiters of the committed mutations, or all of
+    // them if the log failed.
+    void wakeCommitWaiters() {
+        auto failed = this->failed.load(std::memory_order_relaxed);
+        auto seq = this->committedSeq.load(std::memory_order_relaxed);
+        auto &waiters = this->commitWaiters;
+        auto end = std::remove_if(
+            waiters.begin(), waiters.end(), [&](const auto &entry) {
+                if (!failed && entry.first > seq) {
+                    return false;
+                }
+                entry.second->wake();
+                return true;
+            });
+        waiters.erase(end, waiters.end());
+    }
+
+    bool flush(std::string &batch) {
+        for (std::size_t offset = 0; offset < batch.size();) {
+            auto length = BinaryReader::getUInt32(&batch[offset]);
+            BinaryWriter::setUInt32(&batch[offset + 4],
+                                    crc32(&batch[offset + headerSize], length));
+            offset += headerSize + length;
+        }
+
+        try {
+            FileUtils::writeAll(this->fd, batch.data(), batch.size());
+            this->writes.fetch_add(1, std::memory_order_relaxed);
+            if (this->durability != Durability::None) {
+                if (::fdatasync(this->fd) != 0) {
+                    FileUtils::throwError("Cannot sync");
+                }
+                this->syncs.fetch_add(1, std::memory_order_relaxed);
+            }
+            return true;
+        } catch (const std::exception &e) {
+            OATPP_LOGE("WriteAheadLog", "%s", e.what());
+            return false;
+        }
+    }
+
+    // Rewrites the file with the records after `seq` and swaps it in. Only
+    // the writer thread touches the file, so no record is written meanwhile.
+    void compact(std::uint64_t seq) {
+        auto tempPath = this->path + ".tmp";
+        int tempFd = -1;
+        try {
+            auto data = FileUtils::readAll(this->fd);
+            std::size_t offset = 0;
+            while (auto length = validRecordLength(data, offset)) {
+                if (BinaryReader::getUInt64(&data[offset + headerSize]) > seq) {
+                    break;
+                }
+                offset += headerSize + length;
+            }
+
+            tempFd = ::open(tempPath.c_str(),
+                            O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                            0644);
+            if (tempFd < 0) {
+                FileUtils::throwError("Cannot open " + tempPath);
+            }
+            FileUtils::writeAll(tempFd, data.data() + offset,
+                                data.size() - offset);
+            if (::fsync(tempFd) != 0) {
+                FileUtils::throwError("Cannot sync " + tempPath);
+            }
+            if (::rename(tempPath.c_str(), this->path.c_str()) != 0) {
+                FileUtils::throwError("Cannot rename " + tempPath);
+            }
+        } catch (const std::exception &e) {
+            // The old file is still complete, it just keeps the records.
+            OATPP_LOGE("WriteAheadLog", "Cannot compact: %s", e.what());
+            if (tempFd >= 0) {
+                ::close(tempFd);
+            }
+            return;
+        }
+
+        ::close(this->fd);
+        this->fd = tempFd;
+        try {
+            FileUtils::syncDirectoryOf(this->path);
+        } catch (const std::exception &e) {
+            OATPP_LOGE("WriteAheadLog", "Cannot compact: %s", e.what());
+        }
+    }
+
+    // Returns the payload length of the record at `offset` if it is complete
+    // and intact, otherwise 0.
+    static std::size_t validRecordLength(const std::string &data,
+                                         std::size_t offset) {
+        if (data.size() - offset < headerSize) {
+            return 0;
+        }
+        auto length = BinaryReader::getUInt32(&data[offset]);
+        if (length == 0 || data.size() - offset - headerSize < length ||
+            crc32(&data[offset + headerSize], length) !=
+                BinaryReader::getUInt32(&data[offset + 4])) {
+            return 0;
+        }
+        return length;
+    }
+
+    static v_uint32 crc32(const char *data, std::size_t size) {
+        static const auto table = [] {
+            std::array<v_uint32, 256> table{};
+            for (v_uint32 i = 0; i < 256; ++i) {
+                auto c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                table[i] = c;
+            }
+            return table;
+        }();
+        v_uint32 crc = 0xFFFFFFFFu;
+        for (std::size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^
+                  (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    std::string path;
+    Durability durability;
+    std::chrono::milliseconds syncInterval;
+    int fd;
+
+    std::mutex lock;
+    std::condition_variable writerCv;
+    std::condition_variable committedCv;
+    // The waiters of uncommitted mutations, by their sequence numbers.
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<CommitWaiter>>>
+        commitWaiters;
+    std::string pending;
+    std::uint64_t lastSeq = 0;
+    std::uint64_t discardSeq = 0;
+    std::uint64_t discardedSeq = 0;
+    bool stopping = false;
+    std::atomic<std::uint64_t> committedSeq{0};
+    std::atomic<bool> failed{false};
+
+    std::atomic<std::uint64_t> records{0};
+    std::atomic<std::uint64_t> writes{0};
+    std::atomic<std::uint64_t> syncs{0};
+
+    std::thread writer;
+};
+
+#endif /* WriteAheadLog_hpp */
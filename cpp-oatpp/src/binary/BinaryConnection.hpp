@@ -0,0 +1,556 @@
+#ifndef BinaryConnection_hpp
+#define BinaryConnection_hpp
+
+#include "BinaryProtocol.hpp"
+
+#include "BatchCodec.hpp"
+#include "CommitWaiter.hpp"
+#include "MemoryBudget.hpp"
+#include "Metrics.hpp"
+#include "PopWaiter.hpp"
+#include "SocketUtils.hpp"
+#include "StringStackMap.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * The status of the binary protocol for `error`.
+ */
+inline BinaryProtocol::Status binaryStatusOf(StackError error) {
+    using Status = BinaryProtocol::Status;
+    switch (error) {
+    case StackError::None:
+        return Status::Ok;
+    case StackError::StackEmpty:
+        return Status::StackEmpty;
+    case StackError::StackNameAlreadyExists:
+        return Status::StackNameAlreadyExists;
+    case StackError::StackNameNotFound:
+        return Status::StackNameNotFound;
+    case StackError::StackLimitExceeded:
+        return Status::StackLimitExceeded;
+    case StackError::VersionMismatch:
+        // The requests of the protocol carry no version to match.
+        return Status::RequestMalformed;
+    case StackError::MemoryLimitExceeded:
+        break;
+    }
+    return Status::MemoryLimitExceeded;
+}
+
+/**
+ * Runs the implementation of a request of the binary protocol, returning its
+ * status, and turning the errors thrown by the stack map and the batch codec
+ * into the statuses of the protocol, like `runStackApi` does into error
+ * responses.
+ */
+template <typename ApiImplFn>
+BinaryProtocol::Status runBinaryApi(ApiImplFn apiImpl) {
+    using Status = BinaryProtocol::Status;
+    try {
+        return apiImpl();
+    } catch (const StackNameAlreadyExists &) {
+        return Status::StackNameAlreadyExists;
+    } catch (const StackNameNotFound &) {
+        return Status::StackNameNotFound;
+    } catch (const StackEmpty &) {
+        return Status::StackEmpty;
+    } catch (const BatchMalformed &) {
+        return Status::BatchMalformed;
+    } catch (const StackLimitExceeded &) {
+        return Status::StackLimitExceeded;
+    } catch (const MemoryLimitExceeded &) {
+        return Status::MemoryLimitExceeded;
+    }
+}
+
+/**
+ * Connection of the binary listener.
+ *
+ * The reader thread parses the requests as they arrive and serves each right
+ * away, so a client can pipeline them. The responses of the requests read at
+ * once are sent together by the writer thread, which is the only one writing
+ * to the socket. A response waits on the writer until the mutations of its
+ * request are committed to the log, without holding back the responses of
+ * the requests after it. A pop with a timeout on an empty stack is parked,
+ * and retried by the writer once woken by a push. The responses are
+ * therefore sent out of order, and matched to the requests by their ids.
+ */
+class BinaryConnection {
+public:
+    BinaryConnection(int fd, std::shared_ptr<StringStackMap> map,
+                     bool readOnly = false)
+        : fd(fd), map(std::move(map)), readOnly(readOnly) {}
+    BinaryConnection(const BinaryConnection &) = delete;
+    BinaryConnection &operator=(const BinaryConnection &) = delete;
+    ~BinaryConnection() { ::close(this->fd); }
+
+    /**
+     * Serves the connection until the peer closes it, once all the responses
+     * are sent, or until `close` is called.
+     */
+    void run() {
+        std::thread writer([this] { this->write(); });
+        this->read();
+        {
+            std::lock_guard _lock(this->lock);
+            this->inputDone = true;
+        }
+        this->changed.notify_one();
+        writer.join();
+
+        // The pops still parked give up. Only once both threads are done, as
+        // the reader may park pops after the writer stopped, whose waiters
+        // refer to the connection. No waiter is woken after it is cancelled,
+        // as the pushes wake them under the lock `cancelWait` takes, and the
+        // log its commit waiter under the lock `cancelCommitWait` takes.
+        for (auto &pop : this->parked) {
+            this->map->cancelWait(pop.name, *pop.waiter);
+        }
+        this->parked.clear();
+        if (auto &log = this->map->getLog()) {
+            log->cancelCommitWait(*this->committer);
+        }
+    }
+
+    /**
+     * Stops serving the connection, dropping the responses not sent yet.
+     */
+    void close() {
+        ::shutdown(this->fd, SHUT_RDWR);
+        {
+            std::lock_guard _lock(this->lock);
+            this->closed = true;
+        }
+        this->changed.notify_one();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Opcode = BinaryProtocol::Opcode;
+    using Status = BinaryProtocol::Status;
+
+    static constexpr std::size_t initialBufferSize = 64 * 1024;
+
+    class Waiter : public PopWaiter {
+    public:
+        explicit Waiter(BinaryConnection &connection)
+            : connection(connection) {}
+
+        void wake() override {
+            {
+                std::lock_guard _lock(this->connection.lock);
+                this->woken.store(true);
+            }
+            this->connection.changed.notify_one();
+        }
+
+        std::atomic<bool> woken{false};
+
+    private:
+        BinaryConnection &connection;
+    };
+
+    // Wakes the writer to send the held responses once the log commits them.
+    class Committer : public CommitWaiter {
+    public:
+        explicit Committer(BinaryConnection &connection)
+            : connection(connection) {}
+
+        // The writer checks the held responses under the lock, so the commit
+        // is seen either by that check or after this wake.
+        void wake() override {
+            {
+                std::lock_guard _lock(this->connection.lock);
+            }
+            this->connection.changed.notify_one();
+        }
+
+    private:
+        BinaryConnection &connection;
+    };
+
+    // A response held until the mutations of its request are committed.
+    struct Held {
+        std::uint64_t seq;
+        std::string frame;
+    };
+
+    // A pop parked until its stack is pushed to, or its deadline passes.
+    struct ParkedPop {
+        std::uint32_t id;
+        oatpp::String name;
+        Clock::time_point begin;
+        Clock::time_point deadline;
+        std::shared_ptr<Waiter> waiter;
+    };
+
+    void read() {
+        std::vector<char> buffer(initialBufferSize);
+        std::size_t filled = 0;
+        std::string out;
+        std::vector<Held> held;
+        while (true) {
+            if (filled == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            auto received = ::recv(this->fd, buffer.data() + filled,
+                                   buffer.size() - filled, 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                return;
+            }
+            filled += static_cast<std::size_t>(received);
+
+            std::size_t offset = 0;
+            while (true) {
+                BinaryProtocol::Request request;
+                std::size_t consumed;
+                auto parse = BinaryProtocol::parseRequest(
+                    buffer.data() + offset, filled - offset, request, consumed);
+                if (parse == BinaryProtocol::Parse::Incomplete) {
+                    break;
+                }
+                if (parse == BinaryProtocol::Parse::Malformed) {
+                    // The frames cannot be told apart anymore.
+                    this->close();
+                    return;
+                }
+                this->serve(request, out, held);
+                offset += consumed;
+            }
+            std::memmove(buffer.data(), buffer.data() + offset,
+                         filled - offset);
+            filled -= offset;
+
+            if (!out.empty() || !held.empty()) {
+                {
+                    std::lock_guard _lock(this->lock);
+                    this->ready.append(out);
+                    for (auto &response : held) {
+                        this->held.push_back(std::move(response));
+                    }
+                }
+                this->changed.notify_one();
+                out.clear();
+                held.clear();
+            }
+        }
+    }
+
+    void serve(const BinaryProtocol::Request &request, std::string &out,
+               std::vector<Held> &held) {
+        if (!BinaryProtocol::isValid(request.opcode)) {
+            auto frame = BinaryProtocol::beginResponse(
+                out, request.id, Status::RequestMalformed);
+            BinaryProtocol::endResponse(out, frame);
+            return;
+        }
+        auto begin = Clock::now();
+        auto frame = BinaryProtocol::beginResponse(out, request.id, Status::Ok);
+        bool parked = false;
+        auto status = runBinaryApi(
+            [&] { return this->execute(request, begin, out, parked); });
+        if (parked) {
+            out.resize(frame);
+            return;
+        }
+        this->endResponse(request.id, request.opcode, begin, status, frame, out,
+                          held);
+    }
+
+    // Appends the body of the successful response to `out`, and returns the
+    // status of the request. Sets `parked` if the request is parked instead.
+    // The errors of the stack map are returned by its `try` operations, so
+    // only a malformed batch is thrown.
+    Status execute(const BinaryProtocol::Request &request,
+                   Clock::time_point begin, std::string &out, bool &parked) {
+        if (this->readOnly && BinaryProtocol::isMutation(request.opcode)) {
+            return Status::ReadOnly;
+        }
+        auto &map = *this->map;
+        auto &name = request.name;
+        auto &body = request.body;
+        std::uint32_t count;
+        switch (request.opcode) {
+        case Opcode::Top: {
+            auto top = map.tryGetTopRef(name);
+            if (top) {
+                BinaryProtocol::appendValue(out, **top, false);
+            }
+            return binaryStatusOf(top.getError());
+        }
+        case Opcode::Peek: {
+            if (!BinaryProtocol::readUInt32Body(body, count)) {
+                return Status::RequestMalformed;
+            }
+            auto range = map.tryPeek(name, count);
+            if (!range) {
+                return binaryStatusOf(range.getError());
+            }
+            if (count > 0 && range->empty()) {
+                return Status::StackEmpty;
+            }
+            while (auto value = range->next()) {
+                BinaryProtocol::appendValue(out, *value, true);
+            }
+            return Status::Ok;
+        }
+        case Opcode::Size: {
+            auto size = map.tryGetSize(name);
+            if (size) {
+                BinaryProtocol::appendUInt64(out, size->length);
+                BinaryProtocol::appendUInt64(out, size->bytes);
+            }
+            return binaryStatusOf(size.getError());
+        }
+        case Opcode::Push:
+            return binaryStatusOf(
+                map.tryPush(keyOf(name), SmallString(body.data(), body.size()))
+                    .getError());
+        case Opcode::Pop: {
+            std::uint32_t timeoutMs = 0;
+            if (!body.empty() &&
+                !BinaryProtocol::readUInt32Body(body, timeoutMs)) {
+                return Status::RequestMalformed;
+            }
+            auto key = keyOf(name);
+            if (timeoutMs == 0) {
+                auto value = map.tryPopRef(key);
+                if (value) {
+                    BinaryProtocol::appendValue(out, **value, false);
+                }
+                return binaryStatusOf(value.getError());
+            }
+            auto waiter = std::make_shared<Waiter>(*this);
+            auto value = map.tryPopRefOrWait(key, waiter);
+            if (!value) {
+                return binaryStatusOf(value.getError());
+            }
+            if (*value) {
+                BinaryProtocol::appendValue(out, **value, false);
+                return Status::Ok;
+            }
+            {
+                std::lock_guard _lock(this->lock);
+                this->parked.push_back(
+                    {request.id, std::move(key), begin,
+                     begin + std::chrono::milliseconds(timeoutMs),
+                     std::move(waiter)});
+            }
+            this->changed.notify_one();
+            parked = true;
+            return Status::Ok;
+        }
+        case Opcode::PushMany:
+            return binaryStatusOf(
+                map.tryPushMany(keyOf(name),
+                                BatchCodec::decode(body.data(), body.size()))
+                    .getError());
+        case Opcode::PopMany: {
+            if (!BinaryProtocol::readUInt32Body(body, count)) {
+                return Status::RequestMalformed;
+            }
+            auto values = map.tryPopMany(keyOf(name), count);
+            if (values) {
+                for (auto &value : *values) {
+                    BinaryProtocol::appendValue(out, value, true);
+                }
+            }
+            return binaryStatusOf(values.getError());
+        }
+        case Opcode::Create:
+            return binaryStatusOf(map.tryCreate(keyOf(name)).getError());
+        case Opcode::Remove:
+            return binaryStatusOf(map.tryRemove(keyOf(name)).getError());
+        case Opcode::Copy:
+            return binaryStatusOf(
+                map.tryCopy(keyOf(name), keyOf(body)).getError());
+        case Opcode::Fork:
+            return binaryStatusOf(
+                map.tryFork(keyOf(name), BatchCodec::decode<oatpp::String>(
+                                             body.data(), body.size()))
+                    .getError());
+        case Opcode::Move: {
+            auto value = map.tryMove(keyOf(name), keyOf(body));
+            if (value) {
+                BinaryProtocol::appendValue(out, **value, false);
+            }
+            return binaryStatusOf(value.getError());
+        }
+        }
+        return Status::RequestMalformed;
+    }
+
+    // Ends the response started at `frame` in `out`, records it, and moves it
+    // to `held` if the mutations of the request are not committed yet. Must
+    // be called by the thread which served the request, as the log tracks
+    // the mutations per thread.
+    void endResponse(std::uint32_t id, Opcode opcode, Clock::time_point begin,
+                     Status status, std::size_t frame, std::string &out,
+                     std::vector<Held> &held) {
+        if (status != Status::Ok) {
+            out.resize(frame);
+            BinaryProtocol::beginResponse(out, id, status);
+        }
+        BinaryProtocol::endResponse(out, frame);
+        Metrics::recordRequest(BinaryProtocol::endpointOf(opcode),
+                               BinaryProtocol::httpCodeOf(status, opcode),
+                               Clock::now() - begin);
+        if (auto &log = this->map->getLog()) {
+            auto seq = log->takeLastLogged();
+            if (!log->isCommitted(seq) &&
+                log->addCommitWaiter(seq, this->committer)) {
+                held.push_back({seq, out.substr(frame)});
+                out.resize(frame);
+            }
+        }
+    }
+
+    void write() {
+        auto &log = this->map->getLog();
+        std::unique_lock<std::mutex> lock(this->lock);
+        while (!this->closed) {
+            if (log != nullptr) {
+                auto committed = std::stable_partition(
+                    this->held.begin(), this->held.end(),
+                    [&](const Held &response) {
+                        return !log->isCommitted(response.seq);
+                    });
+                for (auto response = committed; response != this->held.end();
+                     ++response) {
+                    this->ready.append(response->frame);
+                }
+                this->held.erase(committed, this->held.end());
+            }
+
+            if (!this->parked.empty()) {
+                auto parked = std::move(this->parked);
+                this->parked.clear();
+                lock.unlock();
+                std::string out;
+                std::vector<Held> held;
+                auto now = Clock::now();
+                std::vector<ParkedPop> still;
+                for (auto &pop : parked) {
+                    if (!this->retry(pop, now, out, held)) {
+                        still.push_back(std::move(pop));
+                    }
+                }
+                lock.lock();
+                for (auto &pop : still) {
+                    this->parked.push_back(std::move(pop));
+                }
+                this->ready.append(out);
+                for (auto &response : held) {
+                    this->held.push_back(std::move(response));
+                }
+            }
+
+            if (!this->ready.empty()) {
+                std::string out;
+                std::swap(out, this->ready);
+                lock.unlock();
+                auto sent = this->sendAll(out);
+                lock.lock();
+                if (!sent) {
+                    break;
+                }
+                continue;
+            }
+            if (this->inputDone && this->parked.empty() &&
+                this->held.empty()) {
+                break;
+            }
+            if (std::any_of(this->parked.begin(), this->parked.end(),
+                            [](const ParkedPop &pop) {
+                                return pop.waiter->woken.load();
+                            })) {
+                continue;
+            }
+
+            auto until = Clock::time_point::max();
+            for (auto &pop : this->parked) {
+                until = std::min(until, pop.deadline);
+            }
+            this->changed.wait_until(lock, until);
+        }
+
+        // Stops the reader, the pops still parked are cancelled by `run`.
+        lock.unlock();
+        ::shutdown(this->fd, SHUT_RDWR);
+    }
+
+    // Retries a parked pop if it was woken, and gives up on it once its
+    // deadline passed. Returns whether the pop is answered.
+    bool retry(ParkedPop &pop, Clock::time_point now, std::string &out,
+               std::vector<Held> &held) {
+        auto frame = BinaryProtocol::beginResponse(out, pop.id, Status::Ok);
+        bool parked = false;
+        auto status = [&] {
+            if (pop.waiter->woken.exchange(false)) {
+                auto value = this->map->tryPopRefOrWait(pop.name, pop.waiter);
+                if (!value) {
+                    return binaryStatusOf(value.getError());
+                }
+                if (*value) {
+                    BinaryProtocol::appendValue(out, **value, false);
+                    return Status::Ok;
+                }
+            }
+            if (now < pop.deadline) {
+                parked = true;
+                return Status::Ok;
+            }
+            this->map->cancelWait(pop.name, *pop.waiter);
+            return Status::StackEmpty;
+        }();
+        if (parked) {
+            out.resize(frame);
+            return false;
+        }
+        this->endResponse(pop.id, Opcode::Pop, pop.begin, status, frame, out,
+                          held);
+        return true;
+    }
+
+    bool sendAll(const std::string &data) {
+        return SocketUtils::sendAll(this->fd, data.data(), data.size());
+    }
+
+    static oatpp::String keyOf(std::string_view name) {
+        return oatpp::String(name.data(),
+                             static_cast<v_buff_size>(name.size()));
+    }
+
+    int fd;
+    std::shared_ptr<StringStackMap> map;
+    bool readOnly;
+
+    // Guards the state shared by the reader and the writer.
+    std::mutex lock;
+    std::condition_variable changed;
+    std::shared_ptr<Committer> committer = std::make_shared<Committer>(*this);
+    std::string ready;
+    std::vector<Held> held;
+    std::vector<ParkedPop> parked;
+    bool inputDone = false;
+    bool closed = false;
+};
+
+#endif /* BinaryConnection_hpp */
@@ -0,0 +1,253 @@
+#ifndef BinaryProtocol_hpp
+#define BinaryProtocol_hpp
+
+#include "BatchCodec.hpp"
+#include "Metrics.hpp"
+#include "SmallString.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * Compact framing of the stack API for the binary listener.
+ *
+ * A request is framed as a 4-byte size of the rest of the frame, a 4-byte id
+ * chosen by the client, a 1-byte opcode, the name of the stack prefixed by
+ * its 2-byte size, and a body taking up the rest of the frame. A response is
+ * framed as a 4-byte size, the id of the request, a 1-byte status and a body.
+ * The integers are big-endian, and batches are encoded like the bodies of the
+ * batch endpoints.
+ *
+ * A client may send any number of requests without waiting for the
+ * responses, which are matched to the requests by their ids, as they are not
+ * necessarily sent in the order of the requests.
+ */
+class BinaryProtocol {
+public:
+    /**
+     * The operations, in the order of `Metrics::Endpoint`. The body of the
+     * request and of the successful response of each is given after it.
+     */
+    enum class Opcode : std::uint8_t {
+        // Empty; the value.
+        Top = 1,
+        // The 4-byte count; the batch of values.
+        Peek,
+        // Empty; the 8-byte length and the 8-byte bytes.
+        Size,
+        // The value; empty.
+        Push,
+        // Empty, or the 4-byte timeout in milliseconds; the value.
+        Pop,
+        // The batch of values; empty.
+        PushMany,
+        // The 4-byte count; the batch of values.
+        PopMany,
+        // Empty; empty.
+        Create,
+        // Empty; empty.
+        Remove,
+        // The name of the copy; empty.
+        Copy,
+        // The batch of names of the copies; empty.
+        Fork,
+        // The name of the destination; the moved value.
+        Move,
+    };
+    static constexpr std::uint8_t opcodeCount = 12;
+
+    /**
+     * The outcomes of a request. The errors have no body.
+     */
+    enum class Status : std::uint8_t {
+        Ok = 0,
+        StackNameAlreadyExists,
+        StackNameNotFound,
+        StackEmpty,
+        BatchMalformed,
+        StackLimitExceeded,
+        MemoryLimitExceeded,
+        // Unknown opcode, or body of the wrong size.
+        RequestMalformed,
+        // A mutation sent to a replica.
+        ReadOnly,
+    };
+
+    static constexpr std::size_t sizeSize = 4;
+    static constexpr std::size_t requestHeaderSize = 4 + 1 + 2;
+    static constexpr std::size_t responseHeaderSize = 4 + 1;
+    // Larger frames close the connection, as their size is likely garbage.
+    static constexpr std::size_t maxFrameSize = 64 << 20;
+
+    struct Request {
+        std::uint32_t id;
+        Opcode opcode;
+        std::string_view name;
+        std::string_view body;
+    };
+
+    /**
+     * Result of parsing the front of a buffer.
+     */
+    enum class Parse { Complete, Incomplete, Malformed };
+
+    /**
+     * Parses the request at the front of `data`, whose frame takes `consumed`
+     * bytes. The views of the request point into `data`.
+     */
+    static Parse parseRequest(const char *data, std::size_t size,
+                              Request &request, std::size_t &consumed) {
+        if (size < sizeSize) {
+            return Parse::Incomplete;
+        }
+        auto in = reinterpret_cast<const unsigned char *>(data);
+        std::size_t frameSize = readUInt32(in);
+        if (frameSize < requestHeaderSize || frameSize > maxFrameSize) {
+            return Parse::Malformed;
+        }
+        if (size - sizeSize < frameSize) {
+            return Parse::Incomplete;
+        }
+        in += sizeSize;
+        std::size_t nameSize = (std::size_t(in[5]) << 8) | in[6];
+        if (requestHeaderSize + nameSize > frameSize) {
+            return Parse::Malformed;
+        }
+        auto name = data + sizeSize + requestHeaderSize;
+        request.id = readUInt32(in);
+        request.opcode = static_cast<Opcode>(in[4]);
+        request.name = std::string_view(name, nameSize);
+        request.body = std::string_view(
+            name + nameSize, frameSize - requestHeaderSize - nameSize);
+        consumed = sizeSize + frameSize;
+        return Parse::Complete;
+    }
+
+    /**
+     * Appends a request to `out`, for the clients.
+     */
+    static void appendRequest(std::string &out, std::uint32_t id,
+                              Opcode opcode, std::string_view name,
+                              std::string_view body = {}) {
+        appendUInt32(out, static_cast<std::uint32_t>(
+                              requestHeaderSize + name.size() + body.size()));
+        appendUInt32(out, id);
+        out.push_back(static_cast<char>(opcode));
+        out.push_back(static_cast<char>(name.size() >> 8));
+        out.push_back(static_cast<char>(name.size()));
+        out.append(name);
+        out.append(body);
+    }
+
+    /**
+     * Appends the header of a response to `out`, and returns its offset to
+     * pass to `endResponse` once the body is appended.
+     */
+    static std::size_t beginResponse(std::string &out, std::uint32_t id,
+                                     Status status) {
+        auto start = out.size();
+        appendUInt32(out, 0);
+        appendUInt32(out, id);
+        out.push_back(static_cast<char>(status));
+        return start;
+    }
+
+    static void endResponse(std::string &out, std::size_t start) {
+        BatchCodec::writeLength(
+            reinterpret_cast<unsigned char *>(&out[start]),
+            static_cast<v_uint32>(out.size() - start - sizeSize));
+    }
+
+    static void appendUInt32(std::string &out, std::uint32_t value) {
+        unsigned char bytes[4];
+        BatchCodec::writeLength(bytes, value);
+        out.append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+    }
+
+    static void appendUInt64(std::string &out, std::uint64_t value) {
+        appendUInt32(out, static_cast<std::uint32_t>(value >> 32));
+        appendUInt32(out, static_cast<std::uint32_t>(value));
+    }
+
+    /**
+     * Appends a batch element, or a bare value if `prefixed` is false.
+     */
+    static void appendValue(std::string &out, const SmallString &value,
+                            bool prefixed) {
+        if (prefixed) {
+            appendUInt32(out, static_cast<std::uint32_t>(value.size()));
+        }
+        out.append(value.data(), value.size());
+    }
+
+    static std::uint32_t readUInt32(const unsigned char *in) {
+        return BatchCodec::readLength(in);
+    }
+
+    static std::uint64_t readUInt64(const unsigned char *in) {
+        return (std::uint64_t(readUInt32(in)) << 32) | readUInt32(in + 4);
+    }
+
+    /**
+     * Reads a 4-byte body into `value`. Returns false if the body is not 4
+     * bytes.
+     */
+    static bool readUInt32Body(std::string_view body, std::uint32_t &value) {
+        if (body.size() != 4) {
+            return false;
+        }
+        value =
+            readUInt32(reinterpret_cast<const unsigned char *>(body.data()));
+        return true;
+    }
+
+    static Metrics::Endpoint endpointOf(Opcode opcode) {
+        return static_cast<Metrics::Endpoint>(
+            static_cast<std::uint8_t>(opcode) - 1);
+    }
+
+    static bool isMutation(Opcode opcode) {
+        return opcode != Opcode::Top && opcode != Opcode::Peek &&
+               opcode != Opcode::Size;
+    }
+
+    static bool isValid(Opcode opcode) {
+        auto value = static_cast<std::uint8_t>(opcode);
+        return value >= 1 && value <= opcodeCount;
+    }
+
+    /**
+     * The status code of the HTTP API for `status`, under which the request
+     * is counted by `Metrics`.
+     */
+    static int httpCodeOf(Status status, Opcode opcode) {
+        switch (status) {
+        case Status::Ok:
+            return opcode == Opcode::Create ? 201
+                   : opcode == Opcode::Top || opcode == Opcode::Peek ||
+                           opcode == Opcode::Size || opcode == Opcode::Pop ||
+                           opcode == Opcode::PopMany || opcode == Opcode::Move
+                       ? 200
+                       : 204;
+        case Status::StackNameAlreadyExists:
+            return 409;
+        case Status::StackNameNotFound:
+            return 404;
+        case Status::StackEmpty:
+            return 405;
+        case Status::BatchMalformed:
+        case Status::RequestMalformed:
+            return 400;
+        case Status::StackLimitExceeded:
+        case Status::MemoryLimitExceeded:
+            return 507;
+        case Status::ReadOnly:
+            return 403;
+        }
+        return 500;
+    }
+};
+
+#endif /* BinaryProtocol_hpp */
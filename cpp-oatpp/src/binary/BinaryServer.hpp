@@ -0,0 +1,156 @@
+#ifndef BinaryServer_hpp
+#define BinaryServer_hpp
+
+#include "BinaryConnection.hpp"
+
+#include "SocketUtils.hpp"
+#include "StringStackMap.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Listener serving the stack map over the binary protocol of
+ * `BinaryProtocol`, next to the HTTP API.
+ *
+ * The address is either `unix:<path>` for a Unix domain socket, or
+ * `<host>:<port>` for TCP. Each connection is served by its own reader and
+ * writer threads, see `BinaryConnection`. A read-only server, that of a
+ * replica, answers the mutations with `Status::ReadOnly`.
+ */
+class BinaryServer {
+public:
+    BinaryServer(const std::string &address,
+                 std::shared_ptr<StringStackMap> map, bool readOnly = false)
+        : address(address), map(std::move(map)), readOnly(readOnly) {
+        auto listener = SocketUtils::listen(address);
+        this->handle = listener.handle;
+        this->tcp = listener.tcp;
+        this->unixPath = std::move(listener.unixPath);
+    }
+    BinaryServer(const BinaryServer &) = delete;
+    BinaryServer &operator=(const BinaryServer &) = delete;
+    ~BinaryServer() {
+        this->stop();
+        ::close(this->handle);
+    }
+
+    const std::string &getAddress() const { return this->address; }
+
+    /**
+     * Starts accepting connections on a background thread.
+     */
+    void start() {
+        this->acceptor = std::thread([this] { this->accept(); });
+    }
+
+    /**
+     * Stops accepting connections, and closes the connections being served.
+     */
+    void stop() {
+        {
+            std::lock_guard _lock(this->lock);
+            if (this->stopped) {
+                return;
+            }
+            this->stopped = true;
+            ::shutdown(this->handle, SHUT_RDWR);
+            for (auto &served : this->connections) {
+                served.connection->close();
+            }
+        }
+        if (this->acceptor.joinable()) {
+            this->acceptor.join();
+        }
+        for (auto &served : this->connections) {
+            served.thread.join();
+        }
+        this->connections.clear();
+        if (!this->unixPath.empty()) {
+            ::unlink(this->unixPath.c_str());
+        }
+    }
+
+private:
+    struct Served {
+        std::shared_ptr<BinaryConnection> connection;
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    void accept() {
+        while (true) {
+            auto fd = ::accept(this->handle, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                {
+                    std::lock_guard _lock(this->lock);
+                    if (this->stopped) {
+                        return;
+                    }
+                }
+                // Out of descriptors or memory, the next accept may succeed
+                // once connections are closed.
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            if (this->tcp) {
+                SocketUtils::setNoDelay(fd);
+            }
+
+            std::lock_guard _lock(this->lock);
+            if (this->stopped) {
+                ::close(fd);
+                return;
+            }
+            this->reap();
+            auto connection = std::make_shared<BinaryConnection>(
+                fd, this->map, this->readOnly);
+            auto done = std::make_shared<std::atomic<bool>>(false);
+            std::thread thread([connection, done] {
+                connection->run();
+                done->store(true);
+            });
+            this->connections.push_back(
+                {std::move(connection), std::move(thread), std::move(done)});
+        }
+    }
+
+    // Joins the threads of the connections which are closed.
+    void reap() {
+        for (auto served = this->connections.begin();
+             served != this->connections.end();) {
+            if (served->done->load()) {
+                served->thread.join();
+                served = this->connections.erase(served);
+            } else {
+                ++served;
+            }
+        }
+    }
+
+    std::string address;
+    std::shared_ptr<StringStackMap> map;
+    bool readOnly;
+    int handle;
+    bool tcp = false;
+    std::string unixPath;
+    std::thread acceptor;
+
+    std::mutex lock;
+    std::list<Served> connections;
+    bool stopped = false;
+};
+
+#endif /* BinaryServer_hpp */
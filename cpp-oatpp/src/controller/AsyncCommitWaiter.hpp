@@ -0,0 +1,47 @@
+#ifndef AsyncCommitWaiter_hpp
+#define AsyncCommitWaiter_hpp
+
+#include "CommitWaiter.hpp"
+
+#include "oatpp/core/async/Coroutine.hpp"
+#include "oatpp/core/async/CoroutineWaitList.hpp"
+
+#include <atomic>
+
+/**
+ * Waiter parking the coroutine of a mutation in a wait list until the log
+ * commits it, so that it holds no thread meanwhile.
+ *
+ * The wake is remembered, like that of `AsyncPopWaiter`, as it may come
+ * before the coroutine enters the list.
+ */
+class AsyncCommitWaiter : public CommitWaiter,
+                          public oatpp::async::CoroutineWaitList::Listener {
+public:
+    AsyncCommitWaiter() { this->list.setListener(this); }
+
+    void wake() override {
+        this->woken.store(true);
+        this->list.notifyAll();
+    }
+
+    /**
+     * Returns the action suspending the coroutine until the waiter is woken,
+     * after which the current step is run again.
+     */
+    oatpp::async::Action wait() {
+        return oatpp::async::Action::createWaitListAction(&this->list);
+    }
+
+    void onNewItem(oatpp::async::CoroutineWaitList &list) override {
+        if (this->woken.load()) {
+            list.notifyAll();
+        }
+    }
+
+private:
+    std::atomic<bool> woken{false};
+    oatpp::async::CoroutineWaitList list;
+};
+
+#endif /* AsyncCommitWaiter_hpp */
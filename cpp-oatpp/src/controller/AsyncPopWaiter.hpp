@@ -0,0 +1,57 @@
+#ifndef AsyncPopWaiter_hpp
+#define AsyncPopWaiter_hpp
+
+#include "PopWaiter.hpp"
+
+#include "oatpp/core/async/Coroutine.hpp"
+#include "oatpp/core/async/CoroutineWaitList.hpp"
+
+#include <atomic>
+#include <chrono>
+
+/**
+ * Waiter parking the coroutine of the pop in a wait list, so that it holds no
+ * thread while the stack is empty.
+ *
+ * The coroutine enters the list only after the step which parked the waiter
+ * returns, so a wake may come first. The wake is therefore remembered, and
+ * the listener of the list resumes a coroutine which enters it afterwards,
+ * like `oatpp::async::Lock` does.
+ */
+class AsyncPopWaiter : public PopWaiter,
+                       public oatpp::async::CoroutineWaitList::Listener {
+public:
+    AsyncPopWaiter() { this->list.setListener(this); }
+
+    void wake() override {
+        this->woken.store(true);
+        this->list.notifyAll();
+    }
+
+    /**
+     * Returns the action suspending the coroutine until the waiter is woken or
+     * `deadline` passes, after which the current step is run again.
+     */
+    oatpp::async::Action
+    wait(const std::chrono::steady_clock::time_point &deadline) {
+        return oatpp::async::Action::createWaitListActionWithTimeout(
+            &this->list, deadline);
+    }
+
+    /**
+     * Forgets a previous wake, before the pop is retried.
+     */
+    void reset() { this->woken.store(false); }
+
+    void onNewItem(oatpp::async::CoroutineWaitList &list) override {
+        if (this->woken.load()) {
+            list.notifyAll();
+        }
+    }
+
+private:
+    std::atomic<bool> woken{false};
+    oatpp::async::CoroutineWaitList list;
+};
+
+#endif /* AsyncPopWaiter_hpp */
@@ -0,0 +1,89 @@
+#ifndef StackApiErrors_hpp
+#define StackApiErrors_hpp
+
+#include "BatchCodec.hpp"
+#include "MemoryBudget.hpp"
+#include "Metrics.hpp"
+#include "StackResult.hpp"
+
+#include "oatpp/web/protocol/http/outgoing/ResponseFactory.hpp"
+
+#include <chrono>
+#include <memory>
+
+/**
+ * Creates the error response of `error`, which must not be `StackError::None`.
+ */
+inline std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+createErrorResponse(StackError error) {
+    using oatpp::web::protocol::http::Status;
+    using oatpp::web::protocol::http::outgoing::ResponseFactory;
+    switch (error) {
+    case StackError::StackNameAlreadyExists:
+        return ResponseFactory::createResponse(Status::CODE_409,
+                                               "STACK_NAME_ALREADY_EXISTS");
+    case StackError::StackNameNotFound:
+        return ResponseFactory::createResponse(Status::CODE_404,
+                                               "STACK_NAME_NOT_FOUND");
+    case StackError::StackEmpty:
+        return ResponseFactory::createResponse(Status::CODE_405,
+                                               "STACK_EMPTY");
+    case StackError::StackLimitExceeded:
+        return ResponseFactory::createResponse(Status::CODE_507,
+                                               "STACK_LIMIT_EXCEEDED");
+    case StackError::VersionMismatch:
+        return ResponseFactory::createResponse(Status::CODE_412,
+                                               "VERSION_MISMATCH");
+    case StackError::MemoryLimitExceeded:
+    case StackError::None:
+        break;
+    }
+    return ResponseFactory::createResponse(Status::CODE_507,
+                                           "MEMORY_LIMIT_EXCEEDED");
+}
+
+/**
+ * Runs the implementation of a stack API, turning the errors of the stack map
+ * and of the batch codec into error responses. Shared by the synchronous and
+ * asynchronous controllers.
+ */
+template <typename ApiImplFn>
+std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+runStackApi(ApiImplFn apiImpl) {
+    using oatpp::web::protocol::http::Status;
+    using oatpp::web::protocol::http::outgoing::ResponseFactory;
+    try {
+        return apiImpl();
+    } catch (StackNameAlreadyExists) {
+        return createErrorResponse(StackError::StackNameAlreadyExists);
+    } catch (StackNameNotFound) {
+        return createErrorResponse(StackError::StackNameNotFound);
+    } catch (StackEmpty) {
+        return createErrorResponse(StackError::StackEmpty);
+    } catch (BatchMalformed) {
+        return ResponseFactory::createResponse(Status::CODE_400,
+                                               "BATCH_MALFORMED");
+    } catch (StackLimitExceeded) {
+        return createErrorResponse(StackError::StackLimitExceeded);
+    } catch (MemoryLimitExceeded) {
+        return createErrorResponse(StackError::MemoryLimitExceeded);
+    } catch (VersionMismatch) {
+        return createErrorResponse(StackError::VersionMismatch);
+    }
+}
+
+/**
+ * Like `runStackApi`, also recording the outcome and the latency of the API to
+ * `Metrics` as the endpoint `endpoint`.
+ */
+template <typename ApiImplFn>
+std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+runStackApi(Metrics::Endpoint endpoint, ApiImplFn apiImpl) {
+    auto start = std::chrono::steady_clock::now();
+    auto response = runStackApi(apiImpl);
+    Metrics::recordRequest(endpoint, response->getStatus().code,
+                           std::chrono::steady_clock::now() - start);
+    return response;
+}
+
+#endif /* StackApiErrors_hpp */
@@ -0,0 +1,459 @@
+#ifndef StackAsyncController_hpp
+#define StackAsyncController_hpp
+
+#include "AsyncCommitWaiter.hpp"
+#include "AsyncPopWaiter.hpp"
+#include "StackApiErrors.hpp"
+#include "StackResponses.hpp"
+#include "StringStackMap.hpp"
+#include "dto/StackSizeDto.hpp"
+
+#include "oatpp/core/macro/codegen.hpp"
+#include "oatpp/core/macro/component.hpp"
+#include "oatpp/core/utils/ConversionUtils.hpp"
+#include "oatpp/web/server/api/ApiController.hpp"
+#include <chrono>
+#include <memory>
+
+#include OATPP_CODEGEN_BEGIN(ApiController) //<-- Begin Codegen
+
+/**
+ * Asynchronous version of `StackController`, serving the same endpoints with
+ * coroutines, to be used with `AsyncHttpConnectionHandler`.
+ *
+ * The stack operations themselves only hold the locks of the map briefly and
+ * never wait for IO, so they run inline in the coroutines. Waiting for the
+ * mutations to be committed to the log is done by polling instead.
+ */
+class StackAsyncController : public oatpp::web::server::api::ApiController {
+public:
+    /**
+     * Constructor with object mapper.
+     * @param objectMapper - default object mapper used to serialize/deserialize
+     * DTOs.
+     * @param map - map of the stacks served by the controller.
+     */
+    StackAsyncController(OATPP_COMPONENT(std::shared_ptr<ObjectMapper>,
+                                         objectMapper),
+                         OATPP_COMPONENT(std::shared_ptr<StringStackMap>, map))
+        : oatpp::web::server::api::ApiController(objectMapper), map(map) {}
+
+public:
+    ENDPOINT_ASYNC("GET", "/{name}/top", GetTop) {
+        ENDPOINT_ASYNC_INIT(GetTop)
+
+        Action act() override {
+            auto name = request->getPathVariable("name");
+            return _return(runStackApi(Metrics::Endpoint::Top, [&] {
+                std::uint64_t version = 0;
+                auto top = controller->map->tryGetTopRef(name, &version);
+                return createTopResponse(top, version, request);
+            }));
+        }
+    };
+
+    ENDPOINT_ASYNC("GET", "/{name}/peek", Peek) {
+        ENDPOINT_ASYNC_INIT(Peek)
+
+        Action act() override {
+            auto name = request->getPathVariable("name");
+            auto countParam = request->getQueryParameter("count");
+            bool success = false;
+            v_uint32 count = 0;
+            if (countParam) {
+                count = oatpp::utils::conversion::strToUInt32(countParam,
+                                                              success);
+            }
+            if (!success) {
+                return _return(controller->createResponse(
+                    Status::CODE_400, "Invalid QUERY parameter 'count'"));
+            }
+            return _return(runStackApi(Metrics::Endpoint::Peek, [&] {
+                auto range = controller->map->tryPeek(name, count);
+                if (!range) {
+                    return createErrorResponse(range.getError());
+                }
+                if (range->empty() && count > 0) {
+                    return createErrorResponse(StackError::StackEmpty);
+                }
+                return createPeekResponse(std::move(*range));
+            }));
+        }
+    };
+
+    ENDPOINT_ASYNC("GET", "/{name}/size", GetSize) {
+        ENDPOINT_ASYNC_INIT(GetSize)
+
+        Action act() override {
+            auto name = request->getPathVariable("name");
+            return _return(runStackApi(Metrics::Endpoint::Size, [&] {
+                auto size = controller->map->tryGetSize(name);
+                if (!size) {
+                    return createErrorResponse(size.getError());
+                }
+                return controller->createDtoResponse(Status::CODE_200,
+                                                     StackSizeDto::of(*size));
+            }));
+        }
+    };
+
+    ENDPOINT_ASYNC("POST", "/{name}/push", Push) {
+        ENDPOINT_ASYNC_INIT(Push)
+
+        Action act() override {
+            return request->readBodyToStringAsync().callbackTo(&Push::onBody);
+        }
+
+        Action onBody(const oatpp::String &body) {
+            auto name = request->getPathVariable("name");
+            return controller
+                ->commit(runStackApi(Metrics::Endpoint::Push, [&] {
+                    std::uint64_t version = 0;
+                    VersionCheck check;
+                    check.version = &version;
+                    if (!readIfMatch(request, check)) {
+                        return createErrorResponse(StackError::VersionMismatch);
+                    }
+                    auto pushed = controller->map->tryPush(
+                        name, SmallString(body), check);
+                    if (!pushed) {
+                        return createErrorResponse(pushed.getError());
+                    }
+                    return withETag(
+                        controller->createResponse(Status::CODE_204, ""),
+                        version);
+                }))
+                .callbackTo(&Push::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("POST", "/{name}/pop", Pop) {
+        ENDPOINT_ASYNC_INIT(Pop)
+
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point deadline;
+        std::shared_ptr<AsyncPopWaiter> waiter;
+        std::uint64_t version = 0;
+
+        Action act() override {
+            auto name = request->getPathVariable("name");
+            v_uint32 timeoutMs = 0;
+            auto timeoutRead = readTimeoutParameter(request, timeoutMs);
+            VersionCheck check;
+            check.version = &this->version;
+            auto ifMatched = readIfMatch(request, check);
+            // A conditional pop does not wait, as any push would change the
+            // version it is conditional on. The malformed requests are
+            // answered here too, so their metrics are recorded.
+            if (!timeoutRead || timeoutMs == 0 || !ifMatched ||
+                check.ifMatch) {
+                return controller
+                    ->commit(runStackApi(Metrics::Endpoint::Pop, [&] {
+                        if (!timeoutRead) {
+                            return controller->createResponse(
+                                Status::CODE_400,
+                                "Invalid QUERY parameter 'timeout'");
+                        }
+                        if (!ifMatched) {
+                            return createErrorResponse(
+                                StackError::VersionMismatch);
+                        }
+                        auto value = controller->map->tryPopRef(name, check);
+                        if (!value) {
+                            return createErrorResponse(value.getError());
+                        }
+                        return withETag(createValueResponse(std::move(*value)),
+                                        this->version);
+                    }))
+                    .callbackTo(&Pop::onCommitted);
+            }
+            this->start = std::chrono::steady_clock::now();
+            this->deadline =
+                this->start + std::chrono::milliseconds(timeoutMs);
+            this->waiter = std::make_shared<AsyncPopWaiter>();
+            return yieldTo(&Pop::attempt);
+        }
+
+        // Run again whenever the waiter is woken or the deadline passes.
+        Action attempt() {
+            auto name = request->getPathVariable("name");
+            this->waiter->reset();
+            auto response = runStackApi(
+                [&]() -> std::shared_ptr<OutgoingResponse> {
+                    auto value = controller->map->tryPopRefOrWait(
+                        name, this->waiter, &this->version);
+                    if (!value) {
+                        return createErrorResponse(value.getError());
+                    }
+                    if (*value) {
+                        return withETag(createValueResponse(std::move(*value)),
+                                        this->version);
+                    }
+                    if (std::chrono::steady_clock::now() < this->deadline) {
+                        return nullptr;
+                    }
+                    controller->map->cancelWait(name, *this->waiter);
+                    return createErrorResponse(StackError::StackEmpty);
+                });
+            if (response == nullptr) {
+                return this->waiter->wait(this->deadline);
+            }
+            Metrics::recordRequest(Metrics::Endpoint::Pop,
+                                   response->getStatus().code,
+                                   std::chrono::steady_clock::now() -
+                                       this->start);
+            return controller->commit(response).callbackTo(
+                &Pop::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("POST", "/{name}/push-many", PushMany) {
+        ENDPOINT_ASYNC_INIT(PushMany)
+
+        Action act() override {
+            return request->readBodyToStringAsync().callbackTo(
+                &PushMany::onBody);
+        }
+
+        Action onBody(const oatpp::String &body) {
+            auto name = request->getPathVariable("name");
+            return controller
+                ->commit(runStackApi(Metrics::Endpoint::PushMany, [&] {
+                    auto values = BatchCodec::decode(body);
+                    auto pushed =
+                        controller->map->tryPushMany(name, std::move(values));
+                    if (!pushed) {
+                        return createErrorResponse(pushed.getError());
+                    }
+                    return controller->createResponse(Status::CODE_204, "");
+                }))
+                .callbackTo(&PushMany::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("POST", "/{name}/pop-many", PopMany) {
+        ENDPOINT_ASYNC_INIT(PopMany)
+
+        Action act() override {
+            auto name = request->getPathVariable("name");
+            auto countParam = request->getQueryParameter("count");
+            bool success = false;
+            v_uint32 count = 0;
+            if (countParam) {
+                count = oatpp::utils::conversion::strToUInt32(countParam,
+                                                              success);
+            }
+            if (!success) {
+                return _return(controller->createResponse(
+                    Status::CODE_400, "Invalid QUERY parameter 'count'"));
+            }
+            return controller
+                ->commit(runStackApi(Metrics::Endpoint::PopMany, [&] {
+                    auto values = controller->map->tryPopMany(name, count);
+                    if (!values) {
+                        return createErrorResponse(values.getError());
+                    }
+                    if (values->empty() && count > 0) {
+                        return createErrorResponse(StackError::StackEmpty);
+                    }
+                    return createBatchResponse(*values);
+                }))
+                .callbackTo(&PopMany::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("POST", "/{name}", Create) {
+        ENDPOINT_ASYNC_INIT(Create)
+
+        Action act() override {
+            auto name = request->getPathVariable("name");
+            return controller
+                ->commit(runStackApi(Metrics::Endpoint::Create, [&] {
+                    auto created = controller->map->tryCreate(std::move(name));
+                    if (!created) {
+                        return createErrorResponse(created.getError());
+                    }
+                    return controller->createResponse(Status::CODE_201, "");
+                }))
+                .callbackTo(&Create::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("DELETE", "/{name}", Remove) {
+        ENDPOINT_ASYNC_INIT(Remove)
+
+        Action act() override {
+            auto name = request->getPathVariable("name");
+            return controller
+                ->commit(runStackApi(Metrics::Endpoint::Remove, [&] {
+                    auto removed = controller->map->tryRemove(name);
+                    if (!removed) {
+                        return createErrorResponse(removed.getError());
+                    }
+                    return controller->createResponse(Status::CODE_204, "");
+                }))
+                .callbackTo(&Remove::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("POST", "/{from}/copy", Copy) {
+        ENDPOINT_ASYNC_INIT(Copy)
+
+        Action act() override {
+            auto from = request->getPathVariable("from");
+            auto to = request->getQueryParameter("to");
+            if (!to) {
+                return _return(controller->createResponse(
+                    Status::CODE_400, "Missing QUERY parameter 'to'"));
+            }
+            return controller
+                ->commit(runStackApi(Metrics::Endpoint::Copy, [&] {
+                    auto copied = controller->map->tryCopy(from, std::move(to));
+                    if (!copied) {
+                        return createErrorResponse(copied.getError());
+                    }
+                    return controller->createResponse(Status::CODE_204, "");
+                }))
+                .callbackTo(&Copy::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("POST", "/{from}/fork", Fork) {
+        ENDPOINT_ASYNC_INIT(Fork)
+
+        Action act() override {
+            return request->readBodyToStringAsync().callbackTo(&Fork::onBody);
+        }
+
+        Action onBody(const oatpp::String &body) {
+            auto from = request->getPathVariable("from");
+            return controller
+                ->commit(runStackApi(Metrics::Endpoint::Fork, [&] {
+                    auto names = BatchCodec::decode<String>(body);
+                    auto forked =
+                        controller->map->tryFork(from, std::move(names));
+                    if (!forked) {
+                        return createErrorResponse(forked.getError());
+                    }
+                    return controller->createResponse(Status::CODE_204, "");
+                }))
+                .callbackTo(&Fork::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("POST", "/{from}/move", Move) {
+        ENDPOINT_ASYNC_INIT(Move)
+
+        Action act() override {
+            auto from = request->getPathVariable("from");
+            auto to = request->getQueryParameter("to");
+            if (!to) {
+                return _return(controller->createResponse(
+                    Status::CODE_400, "Missing QUERY parameter 'to'"));
+            }
+            return controller
+                ->commit(runStackApi(Metrics::Endpoint::Move, [&] {
+                    auto value = controller->map->tryMove(from, to);
+                    if (!value) {
+                        return createErrorResponse(value.getError());
+                    }
+                    return createValueResponse(std::move(*value));
+                }))
+                .callbackTo(&Move::onCommitted);
+        }
+
+        Action onCommitted(const std::shared_ptr<OutgoingResponse> &response) {
+            return _return(response);
+        }
+    };
+
+    ENDPOINT_ASYNC("GET", "/metrics", GetMetrics) {
+        ENDPOINT_ASYNC_INIT(GetMetrics)
+
+        Action act() override {
+            return _return(createMetricsResponse(*controller->map));
+        }
+    };
+
+private:
+    /**
+     * Finishes with the response once the mutation logged as `seq` is
+     * committed.
+     */
+    class AwaitCommit
+        : public oatpp::async::CoroutineWithResult<
+              AwaitCommit, const std::shared_ptr<OutgoingResponse> &> {
+    public:
+        AwaitCommit(std::shared_ptr<StringMutationLog> log, std::uint64_t seq,
+                    std::shared_ptr<OutgoingResponse> response)
+            : log(std::move(log)), seq(seq), response(std::move(response)) {}
+
+        // Run again once the waiter is woken.
+        Action act() override {
+            if (this->log == nullptr || this->log->isCommitted(this->seq)) {
+                return _return(this->response);
+            }
+            if (this->waiter == nullptr) {
+                this->waiter = std::make_shared<AsyncCommitWaiter>();
+                if (!this->log->addCommitWaiter(this->seq, this->waiter)) {
+                    return repeat();
+                }
+            }
+            return this->waiter->wait();
+        }
+
+    private:
+        std::shared_ptr<StringMutationLog> log;
+        std::uint64_t seq;
+        std::shared_ptr<OutgoingResponse> response;
+        std::shared_ptr<AsyncCommitWaiter> waiter;
+    };
+
+    // Must be called in the same step of the coroutine as the mutations, as
+    // the log tracks them per thread.
+    oatpp::async::CoroutineStarterForResult<
+        const std::shared_ptr<OutgoingResponse> &>
+    commit(std::shared_ptr<OutgoingResponse> response) {
+        auto &log = this->map->getLog();
+        auto seq = log != nullptr ? log->takeLastLogged() : 0;
+        return AwaitCommit::startForResult(log, seq, std::move(response));
+    }
+
+    std::shared_ptr<StringStackMap> map;
+};
+
+#include OATPP_CODEGEN_END(ApiController) //<-- End Codegen
+
+#endif /* StackAsyncController_hpp */
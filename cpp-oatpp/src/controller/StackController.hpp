@@ -1,11 +1,15 @@
 #ifndef StackController_hpp
 #define StackController_hpp
 
-#include "StackMap.hpp"
+#include "StackApiErrors.hpp"
+#include "StackResponses.hpp"
+#include "StringStackMap.hpp"
+#include "dto/StackSizeDto.hpp"
 
 #include "oatpp/core/macro/codegen.hpp"
 #include "oatpp/core/macro/component.hpp"
 #include "oatpp/web/server/api/ApiController.hpp"
+#include <chrono>
 #include <memory>
 
 #include OATPP_CODEGEN_BEGIN(ApiController) //<-- Begin Codegen
@@ -19,72 +23,198 @@ public:
      * Constructor with object mapper.
      * @param objectMapper - default object mapper used to serialize/deserialize
      * DTOs.
+     * @param map - map of the stacks served by the controller.
      */
     StackController(OATPP_COMPONENT(std::shared_ptr<ObjectMapper>,
-                                    objectMapper))
-        : oatpp::web::server::api::ApiController(objectMapper) {}
+                                    objectMapper),
+                    OATPP_COMPONENT(std::shared_ptr<StringStackMap>, map))
+        : oatpp::web::server::api::ApiController(objectMapper), map(map) {}
 
 public:
-    ENDPOINT("GET", "/{name}/top", getTop, PATH(String, name)) {
-        return this->run([&]() mutable {
-            auto result = this->map.getStack(name).second.getTop();
-            return createResponse(Status::CODE_200, result);
+    ENDPOINT("GET", "/{name}/top", getTop, PATH(String, name),
+             REQUEST(std::shared_ptr<IncomingRequest>, request)) {
+        return this->run(Metrics::Endpoint::Top, [&]() mutable {
+            std::uint64_t version = 0;
+            auto top = this->map->tryGetTopRef(name, &version);
+            return createTopResponse(top, version, request);
+        });
+    }
+
+    ENDPOINT("GET", "/{name}/peek", peek, PATH(String, name),
+             QUERY(UInt32, count)) {
+        return this->run(Metrics::Endpoint::Peek, [&]() mutable {
+            auto range = this->map->tryPeek(name, *count);
+            if (!range) {
+                return createErrorResponse(range.getError());
+            }
+            if (range->empty() && *count > 0) {
+                return createErrorResponse(StackError::StackEmpty);
+            }
+            return createPeekResponse(std::move(*range));
+        });
+    }
+
+    ENDPOINT("GET", "/{name}/size", getSize, PATH(String, name)) {
+        return this->run(Metrics::Endpoint::Size, [&]() mutable {
+            auto size = this->map->tryGetSize(name);
+            if (!size) {
+                return createErrorResponse(size.getError());
+            }
+            return createDtoResponse(Status::CODE_200,
+                                     StackSizeDto::of(*size));
         });
     }
 
     ENDPOINT("POST", "/{name}/push", push,
-             BODY_STRING(String, body, "text/plain"), PATH(String, name)) {
-        return this->run([&]() mutable {
-            auto s = this->map.getStack(name);
-            s.second.push(String(body));
+             BODY_STRING(String, body, "text/plain"), PATH(String, name),
+             REQUEST(std::shared_ptr<IncomingRequest>, request)) {
+        return this->run(Metrics::Endpoint::Push, [&]() mutable {
+            std::uint64_t version = 0;
+            VersionCheck check;
+            check.version = &version;
+            if (!readIfMatch(request, check)) {
+                return createErrorResponse(StackError::VersionMismatch);
+            }
+            auto pushed = this->map->tryPush(name, SmallString(body), check);
+            if (!pushed) {
+                return createErrorResponse(pushed.getError());
+            }
+            return withETag(createResponse(Status::CODE_204, ""), version);
+        });
+    }
+
+    ENDPOINT("POST", "/{name}/pop", pop, PATH(String, name),
+             REQUEST(std::shared_ptr<IncomingRequest>, request)) {
+        return this->run(Metrics::Endpoint::Pop, [&]() mutable {
+            v_uint32 timeoutMs = 0;
+            if (!readTimeoutParameter(request, timeoutMs)) {
+                return createResponse(Status::CODE_400,
+                                      "Invalid QUERY parameter 'timeout'");
+            }
+            std::uint64_t version = 0;
+            VersionCheck check;
+            check.version = &version;
+            if (!readIfMatch(request, check)) {
+                return createErrorResponse(StackError::VersionMismatch);
+            }
+            // Blocks the thread of the connection while the stack is empty,
+            // if there is a timeout. A conditional pop does not wait, as any
+            // push would change the version it is conditional on.
+            auto value =
+                timeoutMs == 0 || check.ifMatch
+                    ? this->map->tryPopRef(name, check)
+                    : this->map->tryPopRefUntil(
+                          name,
+                          std::chrono::steady_clock::now() +
+                              std::chrono::milliseconds(timeoutMs),
+                          &version);
+            if (!value) {
+                return createErrorResponse(value.getError());
+            }
+            return withETag(createValueResponse(std::move(*value)), version);
+        });
+    }
+
+    ENDPOINT("POST", "/{name}/push-many", pushMany,
+             BODY_STRING(String, body, "application/octet-stream"),
+             PATH(String, name)) {
+        return this->run(Metrics::Endpoint::PushMany, [&]() mutable {
+            auto values = BatchCodec::decode(body);
+            auto pushed = this->map->tryPushMany(name, std::move(values));
+            if (!pushed) {
+                return createErrorResponse(pushed.getError());
+            }
             return createResponse(Status::CODE_204, "");
         });
     }
 
-    ENDPOINT("POST", "/{name}/pop", pop, PATH(String, name)) {
-        return this->run([&]() mutable {
-            return createResponse(Status::CODE_200,
-                                  this->map.getStack(name).second.pop());
+    ENDPOINT("POST", "/{name}/pop-many", popMany, PATH(String, name),
+             QUERY(UInt32, count)) {
+        return this->run(Metrics::Endpoint::PopMany, [&]() mutable {
+            auto values = this->map->tryPopMany(name, *count);
+            if (!values) {
+                return createErrorResponse(values.getError());
+            }
+            if (values->empty() && *count > 0) {
+                return createErrorResponse(StackError::StackEmpty);
+            }
+            return createBatchResponse(*values);
         });
     }
 
     ENDPOINT("POST", "/{name}", create, PATH(String, name)) {
-        return this->run([&]() mutable {
-            this->map.create(String(name));
+        return this->run(Metrics::Endpoint::Create, [&]() mutable {
+            auto created = this->map->tryCreate(std::move(name));
+            if (!created) {
+                return createErrorResponse(created.getError());
+            }
             return createResponse(Status::CODE_201, "");
         });
     }
 
     ENDPOINT("DELETE", "/{name}", remove, PATH(String, name)) {
-        return this->run([&]() mutable {
-            this->map.remove(String(name));
+        return this->run(Metrics::Endpoint::Remove, [&]() mutable {
+            auto removed = this->map->tryRemove(name);
+            if (!removed) {
+                return createErrorResponse(removed.getError());
+            }
             return createResponse(Status::CODE_204, "");
         });
     }
 
     ENDPOINT("POST", "/{from}/copy", copy, PATH(String, from),
              QUERY(String, to)) {
-        return this->run([&]() mutable {
-            this->map.copy(from, String(to));
+        return this->run(Metrics::Endpoint::Copy, [&]() mutable {
+            auto copied = this->map->tryCopy(from, std::move(to));
+            if (!copied) {
+                return createErrorResponse(copied.getError());
+            }
+            return createResponse(Status::CODE_204, "");
+        });
+    }
+
+    ENDPOINT("POST", "/{from}/fork", fork,
+             BODY_STRING(String, body, "application/octet-stream"),
+             PATH(String, from)) {
+        return this->run(Metrics::Endpoint::Fork, [&]() mutable {
+            auto names = BatchCodec::decode<String>(body);
+            auto forked = this->map->tryFork(from, std::move(names));
+            if (!forked) {
+                return createErrorResponse(forked.getError());
+            }
             return createResponse(Status::CODE_204, "");
         });
     }
 
+    ENDPOINT("POST", "/{from}/move", move, PATH(String, from),
+             QUERY(String, to)) {
+        return this->run(Metrics::Endpoint::Move, [&]() mutable {
+            auto value = this->map->tryMove(from, to);
+            if (!value) {
+                return createErrorResponse(value.getError());
+            }
+            return createValueResponse(std::move(*value));
+        });
+    }
+
+    ENDPOINT("GET", "/metrics", metrics) {
+        return createMetricsResponse(*this->map);
+    }
+
 private:
-    StackMap<String, String> map;
+    std::shared_ptr<StringStackMap> map;
 
+    // The response is held back until the mutations made by the API are
+    // committed to the log, if any. The errors of the stack map are returned
+    // by its `try` operations, so only a malformed batch is thrown.
     template <typename ApiImplFn>
-    std::shared_ptr<OutgoingResponse> run(ApiImplFn apiImpl) {
-        try {
-            return apiImpl();
-        } catch (StackNameAlreadyExists) {
-            return createResponse(Status::CODE_409,
-                                  "STACK_NAME_ALREADY_EXISTS");
-        } catch (StackNameNotFound) {
-            return createResponse(Status::CODE_404, "STACK_NAME_NOT_FOUND");
-        } catch (StackEmpty) {
-            return createResponse(Status::CODE_405, "STACK_EMPTY");
+    std::shared_ptr<OutgoingResponse> run(Metrics::Endpoint endpoint,
+                                          ApiImplFn apiImpl) {
+        auto response = runStackApi(endpoint, apiImpl);
+        if (auto &log = this->map->getLog()) {
+            log->waitCommitted(log->takeLastLogged());
         }
+        return response;
     }
 };
 
@@ -0,0 +1,84 @@
+#ifndef StackPeekBody_hpp
+#define StackPeekBody_hpp
+
+#include "BatchCodec.hpp"
+#include "StringStackMap.hpp"
+
+#include "oatpp/web/protocol/http/outgoing/Body.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Response body streaming the values of a range of a stack, encoded like the
+ * bodies of the batch endpoints.
+ *
+ * The values are read from the nodes pinned by the range as the body is
+ * written, so the response is neither built up front nor held under the lock
+ * of the stack. The size is not known ahead, so the body is sent with chunked
+ * transfer encoding.
+ */
+class StackPeekBody : public oatpp::web::protocol::http::outgoing::Body {
+public:
+    explicit StackPeekBody(StringStack::Range range)
+        : range(std::move(range)), value(nullptr), position(0) {}
+
+    v_io_size read(void *buffer, v_buff_size count,
+                   oatpp::async::Action &action) override {
+        (void)action;
+        auto out = static_cast<char *>(buffer);
+        v_buff_size written = 0;
+        while (written < count) {
+            if (this->value == nullptr) {
+                this->value = this->range.next();
+                if (this->value == nullptr) {
+                    break;
+                }
+                BatchCodec::writeLength(
+                    this->prefix, static_cast<v_uint32>(this->value->size()));
+                this->position = 0;
+            }
+
+            // The element is its prefix followed by the value.
+            const char *source;
+            std::size_t available;
+            if (this->position < BatchCodec::prefixSize) {
+                source = reinterpret_cast<const char *>(this->prefix) +
+                         this->position;
+                available = BatchCodec::prefixSize - this->position;
+            } else {
+                auto offset = this->position - BatchCodec::prefixSize;
+                source = this->value->data() + offset;
+                available = this->value->size() - offset;
+            }
+            auto size = std::min<std::size_t>(
+                available, static_cast<std::size_t>(count - written));
+            std::memcpy(out + written, source, size);
+            written += static_cast<v_buff_size>(size);
+            this->position += size;
+            if (this->position ==
+                BatchCodec::prefixSize + this->value->size()) {
+                this->value = nullptr;
+            }
+        }
+        return written;
+    }
+
+    void declareHeaders(Headers &headers) override {
+        headers.putIfNotExists(oatpp::web::protocol::http::Header::CONTENT_TYPE,
+                               "application/octet-stream");
+    }
+
+    p_char8 getKnownData() override { return nullptr; }
+
+    v_int64 getKnownSize() override { return -1; }
+
+private:
+    StringStack::Range range;
+    // The value being written, with its prefix, or nullptr between values.
+    const SmallString *value;
+    unsigned char prefix[BatchCodec::prefixSize];
+    std::size_t position;
+};
+
+#endif /* StackPeekBody_hpp */
@@ -0,0 +1,229 @@
+#ifndef StackResponses_hpp
+#define StackResponses_hpp
+
+#include "BatchCodec.hpp"
+#include "MemoryBudget.hpp"
+#include "Metrics.hpp"
+#include "SpillStore.hpp"
+#include "StackApiErrors.hpp"
+#include "StackMap.hpp"
+#include "StackPeekBody.hpp"
+#include "StackValueBody.hpp"
+#include "StringStackMap.hpp"
+#include "ValueInterner.hpp"
+
+#include "oatpp/core/utils/ConversionUtils.hpp"
+#include "oatpp/web/protocol/http/incoming/Request.hpp"
+#include "oatpp/web/protocol/http/outgoing/ResponseFactory.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * Reads the query parameter `timeout` of a blocking pop, in milliseconds,
+ * leaving `timeoutMs` unchanged if it is absent. Returns false if it is
+ * malformed.
+ */
+inline bool readTimeoutParameter(
+    const std::shared_ptr<oatpp::web::protocol::http::incoming::Request>
+        &request,
+    v_uint32 &timeoutMs) {
+    auto parameter = request->getQueryParameter("timeout");
+    if (!parameter) {
+        return true;
+    }
+    bool success = false;
+    timeoutMs = oatpp::utils::conversion::strToUInt32(parameter, success);
+    return success;
+}
+
+/**
+ * Formats the version of a stack as the strong entity tag of its top.
+ */
+inline oatpp::String formatETag(std::uint64_t version) {
+    char tag[20];
+    std::snprintf(tag, sizeof(tag), "\"%016llx\"",
+                  (unsigned long long)version);
+    return oatpp::String(tag);
+}
+
+/**
+ * Adds the entity tag of `version` to `response`, and returns it.
+ */
+inline std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+withETag(std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+             response,
+         std::uint64_t version) {
+    response->putHeader("ETag", formatETag(version));
+    return response;
+}
+
+/**
+ * Returns whether the `If-None-Match` header `tags`, a list of entity tags or
+ * `*`, matches the tag of `version`. The tags are compared weakly, as the
+ * header asks.
+ */
+inline bool matchesIfNoneMatch(const oatpp::String &tags,
+                               std::uint64_t version) {
+    auto tag = formatETag(version);
+    std::string_view current(*tag);
+    std::string_view list(*tags);
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        auto entry = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view()
+                                                : list.substr(comma + 1);
+        auto begin = entry.find_first_not_of(" \t");
+        if (begin == std::string_view::npos) {
+            continue;
+        }
+        entry = entry.substr(begin, entry.find_last_not_of(" \t") + 1 - begin);
+        if (entry.substr(0, 2) == "W/") {
+            entry.remove_prefix(2);
+        }
+        if (entry == "*" || entry == current) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Reads the `If-Match` header of a mutation into `check`. `*`, or no header,
+ * puts no condition on the version. Only a single strong tag, as
+ * `formatETag` formats them, can match a version: returns false for any other
+ * value, which can never match.
+ */
+inline bool readIfMatch(
+    const std::shared_ptr<oatpp::web::protocol::http::incoming::Request>
+        &request,
+    VersionCheck &check) {
+    auto header = request->getHeader("If-Match");
+    if (!header) {
+        return true;
+    }
+    std::string_view tag(*header);
+    auto begin = tag.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) {
+        return false;
+    }
+    tag = tag.substr(begin, tag.find_last_not_of(" \t") + 1 - begin);
+    if (tag == "*") {
+        return true;
+    }
+    if (tag.size() != 18 || tag.front() != '"' || tag.back() != '"') {
+        return false;
+    }
+    std::uint64_t version = 0;
+    for (auto digit : tag.substr(1, 16)) {
+        version <<= 4;
+        if (digit >= '0' && digit <= '9') {
+            version |= digit - '0';
+        } else if (digit >= 'a' && digit <= 'f') {
+            version |= digit - 'a' + 10;
+        } else {
+            return false;
+        }
+    }
+    check.ifMatch = version;
+    return true;
+}
+
+/**
+ * Creates the response of a batch endpoint carrying the encoded values.
+ */
+inline std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+createBatchResponse(const std::vector<SmallString> &values) {
+    using oatpp::web::protocol::http::Header;
+    using oatpp::web::protocol::http::Status;
+    using oatpp::web::protocol::http::outgoing::ResponseFactory;
+    auto response = ResponseFactory::createResponse(Status::CODE_200,
+                                                    BatchCodec::encode(values));
+    response->putHeader(Header::CONTENT_TYPE, "application/octet-stream");
+    return response;
+}
+
+/**
+ * Creates the response carrying the value pinned by `value`, which is sent
+ * from the node without being copied.
+ */
+inline std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+createValueResponse(StringStack::ValueRef value) {
+    using oatpp::web::protocol::http::Status;
+    using oatpp::web::protocol::http::outgoing::Response;
+    return Response::createShared(
+        Status::CODE_200, std::make_shared<StackValueBody>(std::move(value)));
+}
+
+/**
+ * Creates the response of a read of the top of a stack at `version`, tagged
+ * with it: the value, or 304 without it if the `If-None-Match` header of the
+ * request matches the tag. The error response of an empty stack is tagged as
+ * well, so the clients can make their first push conditional on it.
+ */
+inline std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+createTopResponse(
+    StackResult<StringStack::ValueRef> &top, std::uint64_t version,
+    const std::shared_ptr<oatpp::web::protocol::http::incoming::Request>
+        &request) {
+    using oatpp::web::protocol::http::Status;
+    using oatpp::web::protocol::http::outgoing::ResponseFactory;
+    if (!top) {
+        auto response = createErrorResponse(top.getError());
+        if (top.getError() == StackError::StackEmpty) {
+            withETag(response, version);
+        }
+        return response;
+    }
+    auto ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch && matchesIfNoneMatch(ifNoneMatch, version)) {
+        return withETag(ResponseFactory::createResponse(Status::CODE_304, ""),
+                        version);
+    }
+    return withETag(createValueResponse(std::move(*top)), version);
+}
+
+/**
+ * Creates the response streaming the values of `range`, encoded like a batch.
+ */
+inline std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+createPeekResponse(StringStack::Range range) {
+    using oatpp::web::protocol::http::Status;
+    using oatpp::web::protocol::http::outgoing::Response;
+    return Response::createShared(
+        Status::CODE_200, std::make_shared<StackPeekBody>(std::move(range)));
+}
+
+/**
+ * Creates the response of the metrics endpoint, in the Prometheus text format.
+ */
+inline std::shared_ptr<oatpp::web::protocol::http::outgoing::Response>
+createMetricsResponse(StringStackMap &map) {
+    using oatpp::web::protocol::http::Header;
+    using oatpp::web::protocol::http::Status;
+    using oatpp::web::protocol::http::outgoing::ResponseFactory;
+    auto stats = map.getStats();
+    Metrics::Gauges gauges;
+    gauges.stacks = stats.stacks;
+    gauges.stackLength = stats.length;
+    gauges.stackBytes = stats.bytes;
+    gauges.memoryBytes = MemoryBudget::instance().getUsed();
+    auto interned = ValueInterner::instance().getStats();
+    gauges.internedValues = interned.values;
+    gauges.internedBytes = interned.bytes;
+    gauges.internedReferencedBytes = interned.referencedBytes;
+    auto spilled = SpillStore::instance().getStats();
+    gauges.spilledValues = spilled.values;
+    gauges.spilledBytes = spilled.bytes;
+    gauges.spillFileBytes = spilled.fileBytes;
+    auto response = ResponseFactory::createResponse(
+        Status::CODE_200,
+        oatpp::String(Metrics::format(Metrics::collect(), gauges)));
+    response->putHeader(Header::CONTENT_TYPE, "text/plain; version=0.0.4");
+    return response;
+}
+
+#endif /* StackResponses_hpp */
@@ -0,0 +1,58 @@
+#ifndef StackValueBody_hpp
+#define StackValueBody_hpp
+
+#include "StringStackMap.hpp"
+
+#include "oatpp/web/protocol/http/outgoing/Body.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Response body reading a value in place from the node of the stack, which
+ * it keeps pinned until the response is sent.
+ *
+ * The value is exposed as known data, so the response writes it to the
+ * connection straight from the node rather than from a copy of it.
+ */
+class StackValueBody : public oatpp::web::protocol::http::outgoing::Body {
+public:
+    explicit StackValueBody(StringStack::ValueRef value,
+                            const oatpp::String &contentType = "text/plain")
+        : value(std::move(value)), contentType(contentType), position(0) {}
+
+    v_io_size read(void *buffer, v_buff_size count,
+                   oatpp::async::Action &action) override {
+        (void)action;
+        auto size = std::min<v_buff_size>(
+            count, static_cast<v_buff_size>(this->value->size()) -
+                       this->position);
+        std::memcpy(buffer, this->value->data() + this->position, size);
+        this->position += size;
+        return size;
+    }
+
+    void declareHeaders(Headers &headers) override {
+        if (this->contentType) {
+            headers.putIfNotExists(
+                oatpp::web::protocol::http::Header::CONTENT_TYPE,
+                this->contentType);
+        }
+    }
+
+    p_char8 getKnownData() override {
+        return reinterpret_cast<p_char8>(
+            const_cast<char *>(this->value->data()));
+    }
+
+    v_int64 getKnownSize() override {
+        return static_cast<v_int64>(this->value->size());
+    }
+
+private:
+    StringStack::ValueRef value;
+    oatpp::String contentType;
+    v_buff_size position;
+};
+
+#endif /* StackValueBody_hpp */
@@ -0,0 +1,39 @@
+#ifndef StackSizeDto_hpp
+#define StackSizeDto_hpp
+
+#include "StackMap.hpp"
+
+#include "oatpp/core/Types.hpp"
+#include "oatpp/core/macro/codegen.hpp"
+
+#include OATPP_CODEGEN_BEGIN(DTO)
+
+/**
+ * Size of a stack, as returned by `GET /{name}/size`.
+ */
+class StackSizeDto : public oatpp::DTO {
+
+    DTO_INIT(StackSizeDto, DTO)
+
+    /**
+     * Number of values in the stack.
+     */
+    DTO_FIELD(UInt64, length);
+
+    /**
+     * Total bytes of the values in the stack.
+     */
+    DTO_FIELD(UInt64, bytes);
+
+public:
+    static oatpp::Object<StackSizeDto> of(const StackSize &size) {
+        auto dto = StackSizeDto::createShared();
+        dto->length = size.length;
+        dto->bytes = size.bytes;
+        return dto;
+    }
+};
+
+#include OATPP_CODEGEN_END(DTO)
+
+#endif /* StackSizeDto_hpp */
@@ -0,0 +1,27 @@
+#ifndef ReadOnlyInterceptor_hpp
+#define ReadOnlyInterceptor_hpp
+
+#include "oatpp/web/protocol/http/outgoing/ResponseFactory.hpp"
+#include "oatpp/web/server/interceptor/RequestInterceptor.hpp"
+
+/**
+ * Rejects the requests to a replica which would mutate the stacks, that is
+ * all but the GET ones, with 403 READ_ONLY_REPLICA. The stacks of a replica
+ * only change by following its primary.
+ */
+class ReadOnlyInterceptor
+    : public oatpp::web::server::interceptor::RequestInterceptor {
+public:
+    std::shared_ptr<OutgoingResponse>
+    intercept(const std::shared_ptr<IncomingRequest> &request) override {
+        using oatpp::web::protocol::http::Status;
+        using oatpp::web::protocol::http::outgoing::ResponseFactory;
+        if (request->getStartingLine().method == "GET") {
+            return nullptr;
+        }
+        return ResponseFactory::createResponse(Status::CODE_403,
+                                               "READ_ONLY_REPLICA");
+    }
+};
+
+#endif /* ReadOnlyInterceptor_hpp */
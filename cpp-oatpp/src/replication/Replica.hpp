@@ -0,0 +1,286 @@
+#ifndef Replica_hpp
+#define Replica_hpp
+
+#include "ReplicationProtocol.hpp"
+
+#include "BinaryFormat.hpp"
+#include "FileUtils.hpp"
+#include "MutationRecord.hpp"
+#include "Snapshot.hpp"
+#include "SocketUtils.hpp"
+#include "StringStackMap.hpp"
+
+#include "oatpp/core/base/Environment.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/**
+ * Follower of a primary, applying the mutations the primary streams, see
+ * `ReplicationServer`, to a local stack map which serves the reads.
+ *
+ * The replica starts from a snapshot of the primary, then applies the records
+ * after it. When the stream breaks, it reconnects and resumes after the last
+ * record it applied, or starts over from a new snapshot if the primary cannot
+ * resume it. The map is cleared and loaded again meanwhile, so the reads may
+ * miss stacks until the snapshot is loaded. The replication is asynchronous:
+ * the reads lag behind the primary by the records in flight.
+ */
+class Replica {
+public:
+    Replica(const std::string &primaryAddress,
+            std::shared_ptr<StringStackMap> map)
+        : primaryAddress(primaryAddress), map(std::move(map)) {}
+    Replica(const Replica &) = delete;
+    Replica &operator=(const Replica &) = delete;
+    ~Replica() { this->stop(); }
+
+    const std::string &getPrimaryAddress() const {
+        return this->primaryAddress;
+    }
+
+    /**
+     * Starts following the primary on a background thread.
+     */
+    void start() {
+        this->thread = std::thread([this] { this->run(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard _lock(this->lock);
+            if (this->stopped) {
+                return;
+            }
+            this->stopped = true;
+            if (this->fd >= 0) {
+                ::shutdown(this->fd, SHUT_RDWR);
+            }
+        }
+        this->stopCv.notify_one();
+        if (this->thread.joinable()) {
+            this->thread.join();
+        }
+    }
+
+    /**
+     * Returns the sequence number of the last mutation applied.
+     */
+    std::uint64_t getAppliedSeq() const {
+        return this->appliedSeq.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Returns the sequence number of the last mutation of the primary, as of
+     * the last frame received.
+     */
+    std::uint64_t getPrimarySeq() const {
+        return this->primarySeq.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns the number of snapshots loaded.
+     */
+    std::uint64_t getSnapshotCount() const {
+        return this->snapshots.load(std::memory_order_relaxed);
+    }
+
+private:
+    using Frame = ReplicationProtocol::Frame;
+
+    static constexpr std::chrono::milliseconds retryInterval{500};
+    // Several heartbeats of the primary, after which it is deemed gone.
+    static constexpr std::chrono::seconds receiveTimeout{10};
+
+    void run() {
+        while (true) {
+            try {
+                auto fd = SocketUtils::connect(this->primaryAddress);
+                {
+                    std::lock_guard _lock(this->lock);
+                    if (this->stopped) {
+                        ::close(fd);
+                        return;
+                    }
+                    this->fd = fd;
+                }
+                OATPP_LOGI("Replica", "Following %s after %llu",
+                           this->primaryAddress.c_str(),
+                           (unsigned long long)this->getAppliedSeq());
+                this->follow(fd);
+            } catch (const std::exception &e) {
+                std::lock_guard _lock(this->lock);
+                if (!this->stopped) {
+                    OATPP_LOGW("Replica", "Stream from %s broken: %s",
+                               this->primaryAddress.c_str(), e.what());
+                }
+            }
+
+            std::unique_lock _lock(this->lock);
+            if (this->fd >= 0) {
+                ::close(this->fd);
+                this->fd = -1;
+            }
+            if (this->stopCv.wait_for(_lock, retryInterval,
+                                      [&] { return this->stopped; })) {
+                return;
+            }
+        }
+    }
+
+    void follow(int fd) {
+        auto hello =
+            ReplicationProtocol::hello(this->runId, this->getAppliedSeq());
+        if (!SocketUtils::sendAll(fd, hello.data(), hello.size())) {
+            throw std::runtime_error("Connection closed");
+        }
+
+        std::string payload;
+        std::string snapshotPath;
+        int snapshotFd = -1;
+        try {
+            while (true) {
+                char header[ReplicationProtocol::frameHeaderSize];
+                if (!SocketUtils::receiveAll(fd, header, sizeof(header))) {
+                    throw std::runtime_error("Connection closed");
+                }
+                std::size_t size = BinaryReader::getUInt32(header);
+                if (size > ReplicationProtocol::maxFrameSize) {
+                    throw std::runtime_error("Frame too large");
+                }
+                payload.resize(size);
+                if (!SocketUtils::receiveAll(fd, payload.data(), size)) {
+                    throw std::runtime_error("Connection closed");
+                }
+
+                switch (static_cast<Frame>(header[4])) {
+                case Frame::SnapshotChunk:
+                    if (snapshotFd < 0) {
+                        snapshotPath =
+                            FileUtils::tempPathFor("replica.snapshot");
+                        snapshotFd = ::open(snapshotPath.c_str(),
+                                            O_WRONLY | O_CREAT | O_TRUNC |
+                                                O_CLOEXEC,
+                                            0644);
+                        if (snapshotFd < 0) {
+                            FileUtils::throwError("Cannot open " +
+                                                  snapshotPath);
+                        }
+                    }
+                    FileUtils::writeAll(snapshotFd, payload.data(), size);
+                    break;
+                case Frame::SnapshotEnd: {
+                    if (snapshotFd < 0) {
+                        throw std::runtime_error("Empty snapshot");
+                    }
+                    BinaryReader reader(payload.data(), payload.data() + size);
+                    auto runId = reader.readUInt64();
+                    ::close(snapshotFd);
+                    snapshotFd = -1;
+                    try {
+                        this->loadSnapshot(snapshotPath);
+                    } catch (...) {
+                        ::unlink(snapshotPath.c_str());
+                        throw;
+                    }
+                    ::unlink(snapshotPath.c_str());
+                    this->runId = runId;
+                    break;
+                }
+                case Frame::Records:
+                    this->applyRecords(payload);
+                    // Only a stream which has started is expected to keep
+                    // up with the heartbeats, not one waiting for a snapshot.
+                    setReceiveTimeout(fd);
+                    break;
+                default:
+                    throw std::runtime_error("Unknown frame");
+                }
+            }
+        } catch (...) {
+            if (snapshotFd >= 0) {
+                ::close(snapshotFd);
+                ::unlink(snapshotPath.c_str());
+            }
+            throw;
+        }
+    }
+
+    void loadSnapshot(const std::string &path) {
+        // A failed load leaves a partial map, which the next snapshot
+        // replaces.
+        this->runId = 0;
+        this->map->clear();
+        auto info = Snapshot::load(*this->map, path);
+        this->appliedSeq.store(info.seq, std::memory_order_release);
+        this->snapshots.fetch_add(1, std::memory_order_relaxed);
+        OATPP_LOGI("Replica", "Loaded %llu stacks and %llu nodes at %llu",
+                   (unsigned long long)info.stackCount,
+                   (unsigned long long)info.nodeCount,
+                   (unsigned long long)info.seq);
+    }
+
+    void applyRecords(const std::string &payload) {
+        BinaryReader frame(payload.data(), payload.data() + payload.size());
+        this->primarySeq.store(frame.readUInt64(), std::memory_order_relaxed);
+        auto seq = this->getAppliedSeq();
+        while (frame.remaining() > 0) {
+            auto length = frame.readUInt32();
+            auto record = frame.take(length);
+            BinaryReader reader(record, record + length);
+            auto recordSeq = reader.readUInt64();
+            if (recordSeq != seq + 1) {
+                this->runId = 0;
+                throw std::runtime_error("Expected record " +
+                                         std::to_string(seq + 1) + ", got " +
+                                         std::to_string(recordSeq));
+            }
+            try {
+                MutationRecord::apply(*this->map, reader);
+            } catch (const std::exception &e) {
+                // The map diverged from the primary, it is replaced by a
+                // snapshot.
+                this->runId = 0;
+                throw std::runtime_error("Cannot apply record " +
+                                         std::to_string(recordSeq) + ": " +
+                                         e.what());
+            }
+            seq = recordSeq;
+            this->appliedSeq.store(seq, std::memory_order_release);
+        }
+    }
+
+    static void setReceiveTimeout(int fd) {
+        timeval timeout{};
+        timeout.tv_sec = receiveTimeout.count();
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    std::string primaryAddress;
+    std::shared_ptr<StringStackMap> map;
+    std::thread thread;
+
+    // Only used by the thread following the primary.
+    std::uint64_t runId = 0;
+    std::atomic<std::uint64_t> appliedSeq{0};
+    std::atomic<std::uint64_t> primarySeq{0};
+    std::atomic<std::uint64_t> snapshots{0};
+
+    std::mutex lock;
+    std::condition_variable stopCv;
+    int fd = -1;
+    bool stopped = false;
+};
+
+#endif /* Replica_hpp */
@@ -0,0 +1,297 @@
+#ifndef ReplicationLog_hpp
+#define ReplicationLog_hpp
+
+#include "BinaryFormat.hpp"
+#include "MutationLog.hpp"
+#include "MutationRecord.hpp"
+#include "StringStackMap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Log of the mutations of a primary `StringStackMap`, kept in memory for its
+ * replicas, in front of the log the map would use otherwise, if any, like
+ * `WriteAheadLog`.
+ *
+ * Every mutation is passed on to the inner log and appended to a backlog as a
+ * record: its 4-byte big-endian length, then its 8-byte sequence number and
+ * its `MutationRecord`. The sequence numbers are those of the inner log, so
+ * the snapshots, the write-ahead log and the replicas agree on them. The
+ * backlog is a queue of segments, the oldest of which are dropped once it
+ * holds more than its capacity, so a replica further behind than the backlog
+ * starts over from a snapshot.
+ *
+ * The commits are those of the inner log: the replication is asynchronous,
+ * and a mutation is acknowledged without waiting for the replicas.
+ */
+class ReplicationLog : public StringMutationLog {
+public:
+    /**
+     * Position of a reader of the backlog, after the record `seq`.
+     */
+    struct Cursor {
+        std::uint64_t seq;
+        // The segment the reader is in, by its first record, and the offset
+        // of the record after `seq` in it.
+        std::uint64_t segmentSeq = 0;
+        std::size_t offset = 0;
+    };
+
+    static constexpr std::size_t lengthSize = 4;
+
+    ReplicationLog(std::shared_ptr<StringMutationLog> inner,
+                   std::size_t backlogBytes)
+        : inner(std::move(inner)), runId(newRunId()),
+          backlogBytes(backlogBytes),
+          segmentBytes(std::clamp<std::size_t>(backlogBytes / 16, 4096,
+                                               maxSegmentBytes)) {
+        this->lastSeq =
+            this->inner != nullptr ? this->inner->getLastSeq() : 0;
+    }
+
+    ReplicationLog(const ReplicationLog &) = delete;
+    ReplicationLog &operator=(const ReplicationLog &) = delete;
+
+    void create(const oatpp::String &name) override {
+        this->append([&](StringMutationLog &log) { log.create(name); },
+                     [&](BinaryWriter &writer) {
+                         MutationRecord::writeCreate(writer, name);
+                     });
+    }
+
+    void remove(const oatpp::String &name) override {
+        this->append([&](StringMutationLog &log) { log.remove(name); },
+                     [&](BinaryWriter &writer) {
+                         MutationRecord::writeRemove(writer, name);
+                     });
+    }
+
+    void push(const oatpp::String &name, const SmallString &value) override {
+        this->append([&](StringMutationLog &log) { log.push(name, value); },
+                     [&](BinaryWriter &writer) {
+                         MutationRecord::writePush(writer, name, value);
+                     });
+    }
+
+    void pushMany(const oatpp::String &name,
+                  const std::vector<SmallString> &values) override {
+        this->append(
+            [&](StringMutationLog &log) { log.pushMany(name, values); },
+            [&](BinaryWriter &writer) {
+                MutationRecord::writePushMany(writer, name, values);
+            });
+    }
+
+    void pop(const oatpp::String &name, std::size_t count) override {
+        this->append([&](StringMutationLog &log) { log.pop(name, count); },
+                     [&](BinaryWriter &writer) {
+                         MutationRecord::writePop(writer, name, count);
+                     });
+    }
+
+    void copy(const oatpp::String &from, const oatpp::String &to) override {
+        this->append([&](StringMutationLog &log) { log.copy(from, to); },
+                     [&](BinaryWriter &writer) {
+                         MutationRecord::writeCopy(writer, from, to);
+                     });
+    }
+
+    void move(const oatpp::String &from, const oatpp::String &to) override {
+        this->append([&](StringMutationLog &log) { log.move(from, to); },
+                     [&](BinaryWriter &writer) {
+                         MutationRecord::writeMove(writer, from, to);
+                     });
+    }
+
+    /**
+     * Returns the id of this log, which tells apart the logs of the runs of a
+     * primary, whose sequence numbers may be reused for other mutations
+     * after a restart. Never 0, which a new replica sends.
+     */
+    std::uint64_t getRunId() const { return this->runId; }
+
+    std::uint64_t getLastSeq() override {
+        std::lock_guard _lock(this->lock);
+        return this->lastSeq;
+    }
+
+    void discardUpTo(std::uint64_t seq) override {
+        if (this->inner != nullptr) {
+            this->inner->discardUpTo(seq);
+        }
+    }
+
+    std::uint64_t takeLastLogged() override {
+        return this->inner != nullptr ? this->inner->takeLastLogged() : 0;
+    }
+
+    bool isCommitted(std::uint64_t seq) const override {
+        return this->inner == nullptr || this->inner->isCommitted(seq);
+    }
+
+    void waitCommitted(std::uint64_t seq) override {
+        if (this->inner != nullptr) {
+            this->inner->waitCommitted(seq);
+        }
+    }
+
+    bool addCommitWaiter(std::uint64_t seq,
+                         std::shared_ptr<CommitWaiter> waiter) override {
+        return this->inner != nullptr &&
+               this->inner->addCommitWaiter(seq, std::move(waiter));
+    }
+
+    void cancelCommitWait(const CommitWaiter &waiter) override {
+        if (this->inner != nullptr) {
+            this->inner->cancelCommitWait(waiter);
+        }
+    }
+
+    /**
+     * Appends to `out` the records after the cursor, about `maxBytes` of them
+     * at most, and moves the cursor past them. Waits up to `timeout` for a
+     * record if there is none yet. Returns false if the record after the
+     * cursor has been dropped from the backlog, or was never in it.
+     */
+    bool read(Cursor &cursor, std::string &out, std::size_t maxBytes,
+              std::chrono::milliseconds timeout) {
+        std::unique_lock _lock(this->lock);
+        if (this->lastSeq <= cursor.seq) {
+            ++this->readersWaiting;
+            auto wakes = this->wakes;
+            this->appended.wait_for(_lock, timeout, [&] {
+                return this->lastSeq > cursor.seq || this->wakes != wakes;
+            });
+            --this->readersWaiting;
+            if (this->lastSeq <= cursor.seq) {
+                return this->lastSeq == cursor.seq;
+            }
+        }
+
+        // The segment holding the record after the cursor.
+        auto segment = std::upper_bound(
+            this->segments.begin(), this->segments.end(), cursor.seq,
+            [](std::uint64_t seq, const std::unique_ptr<Segment> &segment) {
+                return seq < segment->lastSeq;
+            });
+        if (segment == this->segments.end() ||
+            (*segment)->firstSeq > cursor.seq + 1) {
+            return false;
+        }
+        if ((*segment)->firstSeq != cursor.segmentSeq) {
+            cursor.segmentSeq = (*segment)->firstSeq;
+            cursor.offset = 0;
+            auto &data = (*segment)->data;
+            while (BinaryReader::getUInt64(&data[cursor.offset + lengthSize]) <=
+                   cursor.seq) {
+                cursor.offset +=
+                    lengthSize + BinaryReader::getUInt32(&data[cursor.offset]);
+            }
+        }
+
+        auto start = out.size();
+        while (out.size() - start < maxBytes) {
+            auto &data = (*segment)->data;
+            out.append(data, cursor.offset, std::string::npos);
+            cursor.seq = (*segment)->lastSeq;
+            cursor.offset = data.size();
+            if (++segment == this->segments.end()) {
+                break;
+            }
+            cursor.segmentSeq = (*segment)->firstSeq;
+            cursor.offset = 0;
+        }
+        return true;
+    }
+
+    /**
+     * Wakes the readers waiting for a record, which return early.
+     */
+    void wakeReaders() {
+        std::lock_guard _lock(this->lock);
+        ++this->wakes;
+        this->appended.notify_all();
+    }
+
+private:
+    // A segment is dropped at once, so it should stay small next to the
+    // backlog, and it may be copied whole by `read` under the lock.
+    static constexpr std::size_t maxSegmentBytes = 256 << 10;
+
+    struct Segment {
+        std::uint64_t firstSeq;
+        std::uint64_t lastSeq;
+        std::string data;
+    };
+
+    static std::uint64_t newRunId() {
+        std::random_device random;
+        return (std::uint64_t(random()) << 32 | random()) |
+               std::uint64_t(1) << 63;
+    }
+
+    // The record is appended under the lock which orders it against the
+    // records of the other threads, so its sequence number is the last one
+    // of the inner log.
+    template <typename LogInner, typename WriteMutation>
+    void append(LogInner logInner, WriteMutation writeMutation) {
+        std::lock_guard _lock(this->lock);
+        if (this->inner != nullptr) {
+            logInner(*this->inner);
+            this->lastSeq = this->inner->getLastSeq();
+        } else {
+            ++this->lastSeq;
+        }
+
+        if (this->segments.empty() ||
+            this->segments.back()->data.size() >= this->segmentBytes) {
+            this->segments.push_back(std::make_unique<Segment>(
+                Segment{this->lastSeq, this->lastSeq, {}}));
+            this->segments.back()->data.reserve(this->segmentBytes);
+        }
+        auto &segment = *this->segments.back();
+        auto start = segment.data.size();
+        segment.data.append(lengthSize, '\0');
+        BinaryWriter writer(segment.data);
+        writer.writeUInt64(this->lastSeq);
+        writeMutation(writer);
+        BinaryWriter::setUInt32(&segment.data[start],
+                                static_cast<v_uint32>(segment.data.size() -
+                                                      start - lengthSize));
+        segment.lastSeq = this->lastSeq;
+        this->heldBytes += segment.data.size() - start;
+
+        while (this->heldBytes > this->backlogBytes &&
+               this->segments.size() > 1) {
+            this->heldBytes -= this->segments.front()->data.size();
+            this->segments.pop_front();
+        }
+        if (this->readersWaiting > 0) {
+            this->appended.notify_all();
+        }
+    }
+
+    std::shared_ptr<StringMutationLog> inner;
+    std::uint64_t runId;
+    std::size_t backlogBytes;
+    std::size_t segmentBytes;
+
+    std::mutex lock;
+    std::condition_variable appended;
+    std::size_t readersWaiting = 0;
+    std::uint64_t wakes = 0;
+    std::uint64_t lastSeq;
+    std::deque<std::unique_ptr<Segment>> segments;
+    std::size_t heldBytes = 0;
+};
+
+#endif /* ReplicationLog_hpp */
@@ -0,0 +1,80 @@
+#ifndef ReplicationProtocol_hpp
+#define ReplicationProtocol_hpp
+
+#include "BinaryFormat.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Framing of the stream from a primary to a replica.
+ *
+ * The replica opens the stream with a hello: a magic, the id of the run of
+ * the primary it follows and the sequence number of the last mutation it
+ * applied, both 0 if it has none yet. The primary answers with frames, each
+ * the 4-byte size of its payload, a 1-byte type and the payload. If the run
+ * is the same and the backlog of its `ReplicationLog` still holds the records
+ * after that sequence number, the primary resumes from there. Otherwise it
+ * first sends a snapshot in chunks, ended by the id of its run, then streams
+ * the records after the snapshot. The integers are big-endian.
+ */
+class ReplicationProtocol {
+public:
+    enum class Frame : std::uint8_t {
+        // A chunk of the file written by `Snapshot`.
+        SnapshotChunk = 1,
+        // The 8-byte id of the run of the primary.
+        SnapshotEnd,
+        // The 8-byte sequence number of the last mutation of the primary,
+        // then the records of `ReplicationLog` following the previous ones,
+        // if any. A frame without records is a heartbeat.
+        Records,
+    };
+
+    static constexpr char magic[8] = {'S', 'T', 'K', 'R', 'E', 'P', 'L', '1'};
+    static constexpr std::size_t helloSize = sizeof(magic) + 8 + 8;
+    static constexpr std::size_t frameHeaderSize = 4 + 1;
+    // Larger frames close the connection, as their size is likely garbage.
+    static constexpr std::size_t maxFrameSize = 64 << 20;
+
+    static std::string hello(std::uint64_t runId, std::uint64_t seq) {
+        std::string out(magic, sizeof(magic));
+        BinaryWriter writer(out);
+        writer.writeUInt64(runId);
+        writer.writeUInt64(seq);
+        return out;
+    }
+
+    /**
+     * Parses a hello. Returns false if it does not start with the magic.
+     */
+    static bool parseHello(const char *hello, std::uint64_t &runId,
+                           std::uint64_t &seq) {
+        if (std::memcmp(hello, magic, sizeof(magic)) != 0) {
+            return false;
+        }
+        runId = BinaryReader::getUInt64(hello + sizeof(magic));
+        seq = BinaryReader::getUInt64(hello + sizeof(magic) + 8);
+        return true;
+    }
+
+    /**
+     * Appends the header of a frame to `out`, and returns its offset to pass
+     * to `endFrame` once the payload is appended.
+     */
+    static std::size_t beginFrame(std::string &out, Frame frame) {
+        auto start = out.size();
+        out.append(4, '\0');
+        out.push_back(static_cast<char>(frame));
+        return start;
+    }
+
+    static void endFrame(std::string &out, std::size_t start) {
+        BinaryWriter::setUInt32(&out[start],
+                                static_cast<v_uint32>(out.size() - start -
+                                                      frameHeaderSize));
+    }
+};
+
+#endif /* ReplicationProtocol_hpp */
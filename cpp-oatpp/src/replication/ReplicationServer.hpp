@@ -0,0 +1,282 @@
+#ifndef ReplicationServer_hpp
+#define ReplicationServer_hpp
+
+#include "ReplicationLog.hpp"
+#include "ReplicationProtocol.hpp"
+
+#include "FileUtils.hpp"
+#include "Snapshot.hpp"
+#include "SocketUtils.hpp"
+#include "StringStackMap.hpp"
+
+#include "oatpp/core/base/Environment.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Listener of a primary streaming the mutations of its stack map to its
+ * replicas, see `ReplicationProtocol` and `Replica`.
+ *
+ * Each replica is served by its own thread, which reads the records from the
+ * backlog of the `ReplicationLog` of the map as they are appended, and sends
+ * them in batches. A replica the backlog cannot resume is sent a snapshot,
+ * which is written to a temporary file first, like those of `Snapshotter`;
+ * the backlog should hold the mutations made while a snapshot is written and
+ * sent, otherwise the replica is dropped and sent another one when it
+ * reconnects.
+ */
+class ReplicationServer {
+public:
+    ReplicationServer(const std::string &address,
+                      std::shared_ptr<StringStackMap> map,
+                      std::shared_ptr<ReplicationLog> log)
+        : address(address), map(std::move(map)), log(std::move(log)) {
+        auto listener = SocketUtils::listen(address);
+        this->handle = listener.handle;
+        this->tcp = listener.tcp;
+        this->unixPath = std::move(listener.unixPath);
+    }
+    ReplicationServer(const ReplicationServer &) = delete;
+    ReplicationServer &operator=(const ReplicationServer &) = delete;
+    ~ReplicationServer() {
+        this->stop();
+        ::close(this->handle);
+    }
+
+    const std::string &getAddress() const { return this->address; }
+
+    /**
+     * Starts accepting replicas on a background thread.
+     */
+    void start() {
+        this->acceptor = std::thread([this] { this->accept(); });
+    }
+
+    /**
+     * Stops accepting replicas, and closes the streams to them.
+     */
+    void stop() {
+        {
+            std::lock_guard _lock(this->lock);
+            if (this->stopped.exchange(true)) {
+                return;
+            }
+            ::shutdown(this->handle, SHUT_RDWR);
+            for (auto &served : this->replicas) {
+                ::shutdown(served.fd, SHUT_RDWR);
+            }
+        }
+        this->log->wakeReaders();
+        if (this->acceptor.joinable()) {
+            this->acceptor.join();
+        }
+        for (auto &served : this->replicas) {
+            served.thread.join();
+            ::close(served.fd);
+        }
+        this->replicas.clear();
+        if (!this->unixPath.empty()) {
+            ::unlink(this->unixPath.c_str());
+        }
+    }
+
+    /**
+     * Returns the number of snapshots sent to the replicas.
+     */
+    std::uint64_t getSnapshotCount() const {
+        return this->snapshots.load(std::memory_order_relaxed);
+    }
+
+private:
+    using Frame = ReplicationProtocol::Frame;
+
+    struct Served {
+        int fd;
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    // Interval of the heartbeats sent when there is no record.
+    static constexpr std::chrono::milliseconds heartbeatInterval{1000};
+    static constexpr std::size_t batchBytes = 256 << 10;
+    static constexpr std::size_t chunkBytes = 1 << 20;
+
+    void accept() {
+        while (true) {
+            auto fd = ::accept4(this->handle, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (this->stopped.load()) {
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            if (this->tcp) {
+                SocketUtils::setNoDelay(fd);
+            }
+
+            std::lock_guard _lock(this->lock);
+            if (this->stopped.load()) {
+                ::close(fd);
+                return;
+            }
+            this->reap();
+            auto done = std::make_shared<std::atomic<bool>>(false);
+            std::thread thread([this, fd, done] {
+                try {
+                    this->serve(fd);
+                } catch (const std::exception &e) {
+                    OATPP_LOGW("ReplicationServer", "Replica dropped: %s",
+                               e.what());
+                }
+                ::shutdown(fd, SHUT_RDWR);
+                done->store(true);
+            });
+            this->replicas.push_back({fd, std::move(thread), std::move(done)});
+        }
+    }
+
+    // Joins the threads of the replicas which are gone.
+    void reap() {
+        for (auto served = this->replicas.begin();
+             served != this->replicas.end();) {
+            if (served->done->load()) {
+                served->thread.join();
+                ::close(served->fd);
+                served = this->replicas.erase(served);
+            } else {
+                ++served;
+            }
+        }
+    }
+
+    void serve(int fd) {
+        char hello[ReplicationProtocol::helloSize];
+        std::uint64_t runId, seq;
+        if (!SocketUtils::receiveAll(fd, hello, sizeof(hello)) ||
+            !ReplicationProtocol::parseHello(hello, runId, seq)) {
+            return;
+        }
+
+        ReplicationLog::Cursor cursor{seq};
+        std::string out;
+        auto frame = beginRecords(out);
+        if (runId == this->log->getRunId() &&
+            this->log->read(cursor, out, batchBytes,
+                            std::chrono::milliseconds(0))) {
+            OATPP_LOGI("ReplicationServer", "Resuming a replica after %llu",
+                       (unsigned long long)seq);
+        } else {
+            cursor = ReplicationLog::Cursor{this->sendSnapshot(fd)};
+            out.clear();
+            frame = beginRecords(out);
+        }
+
+        while (true) {
+            BinaryWriter::setUInt64(
+                &out[frame + ReplicationProtocol::frameHeaderSize],
+                this->log->getLastSeq());
+            ReplicationProtocol::endFrame(out, frame);
+            if (!SocketUtils::sendAll(fd, out.data(), out.size()) ||
+                this->stopped.load()) {
+                return;
+            }
+            out.clear();
+            frame = beginRecords(out);
+            if (!this->log->read(cursor, out, batchBytes, heartbeatInterval)) {
+                throw std::runtime_error("Replica fell behind the backlog");
+            }
+        }
+    }
+
+    // Begins a frame of records, whose sequence number is filled in last.
+    static std::size_t beginRecords(std::string &out) {
+        auto frame = ReplicationProtocol::beginFrame(out, Frame::Records);
+        out.append(8, '\0');
+        return frame;
+    }
+
+    // Sends a snapshot of the map, and returns its sequence number.
+    std::uint64_t sendSnapshot(int fd) {
+        auto path = FileUtils::tempPathFor("replication.snapshot");
+        this->snapshots.fetch_add(1, std::memory_order_relaxed);
+        auto info = Snapshot::write(*this->map, path);
+        auto file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        ::unlink(path.c_str());
+        if (file < 0) {
+            FileUtils::throwError("Cannot open " + path);
+        }
+        OATPP_LOGI("ReplicationServer",
+                   "Sending a snapshot of %llu stacks and %llu nodes",
+                   (unsigned long long)info.stackCount,
+                   (unsigned long long)info.nodeCount);
+
+        std::string out;
+        bool sent = true;
+        while (sent) {
+            out.clear();
+            auto frame = ReplicationProtocol::beginFrame(out,
+                                                         Frame::SnapshotChunk);
+            out.resize(out.size() + chunkBytes);
+            auto result = ::read(
+                file, &out[frame + ReplicationProtocol::frameHeaderSize],
+                chunkBytes);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                ::close(file);
+                FileUtils::throwError("Cannot read " + path);
+            }
+            if (result == 0) {
+                break;
+            }
+            out.resize(frame + ReplicationProtocol::frameHeaderSize +
+                       static_cast<std::size_t>(result));
+            ReplicationProtocol::endFrame(out, frame);
+            sent = SocketUtils::sendAll(fd, out.data(), out.size());
+        }
+        ::close(file);
+        if (!sent) {
+            throw std::runtime_error("Connection closed");
+        }
+
+        out.clear();
+        auto frame = ReplicationProtocol::beginFrame(out, Frame::SnapshotEnd);
+        BinaryWriter(out).writeUInt64(this->log->getRunId());
+        ReplicationProtocol::endFrame(out, frame);
+        if (!SocketUtils::sendAll(fd, out.data(), out.size())) {
+            throw std::runtime_error("Connection closed");
+        }
+        return info.seq;
+    }
+
+    std::string address;
+    std::shared_ptr<StringStackMap> map;
+    std::shared_ptr<ReplicationLog> log;
+    int handle;
+    bool tcp = false;
+    std::string unixPath;
+    std::thread acceptor;
+    std::atomic<std::uint64_t> snapshots{0};
+
+    std::mutex lock;
+    std::list<Served> replicas;
+    std::atomic<bool> stopped{false};
+};
+
+#endif /* ReplicationServer_hpp */
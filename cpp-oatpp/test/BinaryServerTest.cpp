@@ -0,0 +1,287 @@
+#include "BinaryServerTest.hpp"
+
+#include "WriteAheadLog.hpp"
+#include "binary/BinaryServer.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Opcode = BinaryProtocol::Opcode;
+using Status = BinaryProtocol::Status;
+
+struct Response {
+    std::uint32_t id;
+    Status status;
+    std::string body;
+};
+
+// Client of the binary protocol over a Unix domain socket.
+class Client {
+public:
+    explicit Client(const std::string &path) {
+        this->fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        OATPP_ASSERT(::connect(this->fd,
+                               reinterpret_cast<sockaddr *>(&address),
+                               sizeof(address)) == 0);
+    }
+    ~Client() { ::close(this->fd); }
+
+    // Stops receiving, so the responses sent to the client fail.
+    void stopReceiving() { ::shutdown(this->fd, SHUT_RD); }
+
+    void send(const std::string &requests) {
+        OATPP_ASSERT(::send(this->fd, requests.data(), requests.size(),
+                            MSG_NOSIGNAL) ==
+                     static_cast<ssize_t>(requests.size()));
+    }
+
+    // Returns false if the connection is closed before a whole response.
+    bool receive(Response &response) {
+        while (true) {
+            if (this->buffer.size() >= BinaryProtocol::sizeSize) {
+                auto in = reinterpret_cast<const unsigned char *>(
+                    this->buffer.data());
+                std::size_t size = BinaryProtocol::readUInt32(in);
+                if (this->buffer.size() >= BinaryProtocol::sizeSize + size) {
+                    response.id = BinaryProtocol::readUInt32(in + 4);
+                    response.status = static_cast<Status>(in[8]);
+                    response.body = this->buffer.substr(
+                        BinaryProtocol::sizeSize +
+                            BinaryProtocol::responseHeaderSize,
+                        size - BinaryProtocol::responseHeaderSize);
+                    this->buffer.erase(0, BinaryProtocol::sizeSize + size);
+                    return true;
+                }
+            }
+            char chunk[4096];
+            auto received = ::recv(this->fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                return false;
+            }
+            this->buffer.append(chunk, static_cast<std::size_t>(received));
+        }
+    }
+
+    std::map<std::uint32_t, Response> receive(std::size_t count) {
+        std::map<std::uint32_t, Response> responses;
+        for (std::size_t i = 0; i < count; ++i) {
+            Response response;
+            OATPP_ASSERT(this->receive(response));
+            responses[response.id] = response;
+        }
+        return responses;
+    }
+
+private:
+    int fd;
+    std::string buffer;
+};
+
+std::string request(std::uint32_t id, Opcode opcode, std::string_view name,
+                    std::string_view body = {}) {
+    std::string out;
+    BinaryProtocol::appendRequest(out, id, opcode, name, body);
+    return out;
+}
+
+std::string uint32Body(std::uint32_t value) {
+    std::string out;
+    BinaryProtocol::appendUInt32(out, value);
+    return out;
+}
+
+std::string batch(const std::vector<std::string> &values) {
+    std::string out;
+    for (auto &value : values) {
+        BinaryProtocol::appendUInt32(
+            out, static_cast<std::uint32_t>(value.size()));
+        out.append(value);
+    }
+    return out;
+}
+
+} // namespace
+
+void BinaryServerTest::onRun() {
+    auto path = "/tmp/stack-server-binary-test-" + std::to_string(::getpid()) +
+                ".sock";
+    auto map = std::make_shared<StringStackMap>(4);
+    BinaryServer server("unix:" + path, map);
+    server.start();
+
+    // Test pipelined requests are all answered
+    {
+        Client client(path);
+        client.send(request(1, Opcode::Create, "stack") +
+                    request(2, Opcode::Push, "stack", "a") +
+                    request(3, Opcode::Push, "stack", "bc") +
+                    request(4, Opcode::Size, "stack") +
+                    request(5, Opcode::Pop, "stack") +
+                    request(6, Opcode::Top, "stack") +
+                    request(7, Opcode::Top, "missing") +
+                    request(8, Opcode::Create, "stack") +
+                    request(9, static_cast<Opcode>(99), "stack"));
+        auto responses = client.receive(9);
+        OATPP_ASSERT(responses[1].status == Status::Ok);
+        OATPP_ASSERT(responses[2].status == Status::Ok);
+        OATPP_ASSERT(responses[3].status == Status::Ok);
+        auto size = reinterpret_cast<const unsigned char *>(
+            responses[4].body.data());
+        OATPP_ASSERT(responses[4].body.size() == 16);
+        OATPP_ASSERT(BinaryProtocol::readUInt64(size) == 2);
+        OATPP_ASSERT(BinaryProtocol::readUInt64(size + 8) == 3);
+        OATPP_ASSERT(responses[5].status == Status::Ok &&
+                     responses[5].body == "bc");
+        OATPP_ASSERT(responses[6].status == Status::Ok &&
+                     responses[6].body == "a");
+        OATPP_ASSERT(responses[7].status == Status::StackNameNotFound);
+        OATPP_ASSERT(responses[8].status == Status::StackNameAlreadyExists);
+        OATPP_ASSERT(responses[9].status == Status::RequestMalformed);
+    }
+
+    // Test the batch operations, copies, moves and malformed bodies
+    {
+        Client client(path);
+        client.send(request(1, Opcode::PushMany, "stack", batch({"b", "c"})) +
+                    request(2, Opcode::Peek, "stack", uint32Body(2)) +
+                    request(3, Opcode::Copy, "stack", "copy") +
+                    request(4, Opcode::Fork, "stack", batch({"f1", "f2"})) +
+                    request(5, Opcode::PopMany, "stack", uint32Body(10)) +
+                    request(6, Opcode::PopMany, "f2", uint32Body(1)) +
+                    request(7, Opcode::PopMany, "stack", "x") +
+                    request(8, Opcode::PushMany, "stack", "xyz") +
+                    request(9, Opcode::Remove, "copy") +
+                    request(10, Opcode::Top, "copy") +
+                    request(11, Opcode::Move, "f1", "f2"));
+        auto responses = client.receive(11);
+        for (std::uint32_t id : {1, 3, 4, 9}) {
+            OATPP_ASSERT(responses[id].status == Status::Ok);
+        }
+        OATPP_ASSERT(responses[2].body == batch({"c", "b"}));
+        OATPP_ASSERT(responses[5].body == batch({"c", "b", "a"}));
+        OATPP_ASSERT(responses[6].body == batch({"c"}));
+        OATPP_ASSERT(responses[7].status == Status::RequestMalformed);
+        OATPP_ASSERT(responses[8].status == Status::BatchMalformed);
+        OATPP_ASSERT(responses[10].status == Status::StackNameNotFound);
+        OATPP_ASSERT(responses[11].status == Status::Ok &&
+                     responses[11].body == "c");
+    }
+
+    // Test a waiting pop is answered after the requests following it
+    {
+        Client client(path);
+        Client pusher(path);
+        client.send(request(1, Opcode::Create, "waited") +
+                    request(2, Opcode::Pop, "waited", uint32Body(10000)) +
+                    request(3, Opcode::Size, "waited"));
+        Response response;
+        OATPP_ASSERT(client.receive(response) && response.id == 1);
+        OATPP_ASSERT(client.receive(response) && response.id == 3);
+        pusher.send(request(1, Opcode::Push, "waited", "w"));
+        OATPP_ASSERT(pusher.receive(response) &&
+                     response.status == Status::Ok);
+        OATPP_ASSERT(client.receive(response) && response.id == 2);
+        OATPP_ASSERT(response.status == Status::Ok && response.body == "w");
+
+        client.send(request(4, Opcode::Pop, "waited", uint32Body(20)));
+        OATPP_ASSERT(client.receive(response) && response.id == 4);
+        OATPP_ASSERT(response.status == Status::StackEmpty);
+    }
+
+    // Test a malformed frame closes the connection
+    {
+        Client client(path);
+        client.send(std::string(4, '\0'));
+        Response response;
+        OATPP_ASSERT(!client.receive(response));
+    }
+
+    // Test the pops parked by clients which leave are cancelled, so that no
+    // push wakes their connections once destroyed. The requests take several
+    // reads, so the writer usually fails to send the first responses, and
+    // stops, before the reader parks the pop.
+    for (int i = 0; i < 50; ++i) {
+        Client client(path);
+        client.stopReceiving();
+        std::string requests;
+        for (std::uint32_t id = 1; id <= 8000; ++id) {
+            requests += request(id, Opcode::Size, "waited");
+        }
+        client.send(requests +
+                    request(8001, Opcode::Pop, "waited", uint32Body(60000)));
+    }
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (map->getWaiterCount() > 0 &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    OATPP_ASSERT(map->getWaiterCount() == 0);
+
+    // Test the connections being served are closed on stop
+    {
+        Client client(path);
+        client.send(request(1, Opcode::Pop, "waited", uint32Body(60000)));
+        client.send(request(2, Opcode::Size, "waited"));
+        Response response;
+        OATPP_ASSERT(client.receive(response) && response.id == 2);
+        server.stop();
+        OATPP_ASSERT(!client.receive(response));
+    }
+    OATPP_ASSERT(::access(path.c_str(), F_OK) != 0);
+
+    // Test a read-only server answers the mutations with ReadOnly
+    {
+        BinaryServer readOnly("unix:" + path, map, true);
+        readOnly.start();
+        Client client(path);
+        client.send(request(1, Opcode::Push, "waited", "x") +
+                    request(2, Opcode::Size, "waited") +
+                    request(3, Opcode::Create, "new"));
+        auto responses = client.receive(3);
+        OATPP_ASSERT(responses[1].status == Status::ReadOnly);
+        OATPP_ASSERT(responses[2].status == Status::Ok);
+        OATPP_ASSERT(responses[3].status == Status::ReadOnly);
+    }
+
+    // Test the responses held until their mutations are committed are sent
+    // once the log commits them
+    {
+        auto walPath = path + ".wal";
+        auto logged = std::make_shared<StringStackMap>(4);
+        logged->setLog(std::make_shared<WriteAheadLog>(
+            walPath, WriteAheadLog::Durability::PerOp,
+            std::chrono::milliseconds(1)));
+        BinaryServer durable("unix:" + path, logged);
+        durable.start();
+        Client client(path);
+        std::string requests = request(1, Opcode::Create, "logged");
+        for (std::uint32_t id = 2; id <= 1000; ++id) {
+            requests += request(id, Opcode::Push, "logged", "v");
+        }
+        client.send(requests + request(1001, Opcode::Size, "logged"));
+        auto responses = client.receive(1001);
+        for (std::uint32_t id = 1; id <= 1000; ++id) {
+            OATPP_ASSERT(responses[id].status == Status::Ok);
+        }
+        auto size = reinterpret_cast<const unsigned char *>(
+            responses[1001].body.data());
+        OATPP_ASSERT(BinaryProtocol::readUInt64(size) == 999);
+        durable.stop();
+        ::unlink(walPath.c_str());
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef BinaryServerTest_hpp
+#define BinaryServerTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class BinaryServerTest : public oatpp::test::UnitTest {
+public:
+    BinaryServerTest() : UnitTest("TEST[BinaryServerTest]") {}
+    void onRun() override;
+};
+
+#endif // BinaryServerTest_hpp
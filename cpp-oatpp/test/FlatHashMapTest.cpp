@@ -0,0 +1,130 @@
+#include "FlatHashMapTest.hpp"
+
+#include "FlatHashMap.hpp"
+#include "StackMap.hpp"
+
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace {
+
+using Map = FlatHashMap<std::string, int>;
+
+std::size_t hashOf(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+// Checks that `map` holds exactly the entries of `expected`.
+bool matches(Map &map, std::map<std::string, int> &expected,
+             std::size_t (*hash)(std::string_view)) {
+    if (map.size() != expected.size()) {
+        return false;
+    }
+    std::size_t visited = 0;
+    for (auto &entry : map) {
+        auto other = expected.find(entry.first);
+        if (other == expected.end() || other->second != entry.second) {
+            return false;
+        }
+        ++visited;
+    }
+    for (auto &entry : expected) {
+        auto found = map.find(entry.first, hash(entry.first));
+        if (found == nullptr || found->second != entry.second) {
+            return false;
+        }
+    }
+    return visited == expected.size();
+}
+
+} // namespace
+
+void FlatHashMapTest::onRun() {
+    // Test insert, find and erase
+    {
+        Map map;
+        OATPP_ASSERT(map.find(std::string_view("a"), hashOf("a")) == nullptr);
+        OATPP_ASSERT(map.insert(hashOf("a"), "a", 1).second);
+        OATPP_ASSERT(!map.insert(hashOf("a"), "a", 2).second);
+        OATPP_ASSERT(map.find(std::string_view("a"), hashOf("a"))->second == 1);
+        OATPP_ASSERT(map.size() == 1);
+        OATPP_ASSERT(!map.erase(std::string_view("b"), hashOf("b")));
+        OATPP_ASSERT(map.erase(std::string_view("a"), hashOf("a")));
+        OATPP_ASSERT(map.empty());
+        OATPP_ASSERT(map.find(std::string_view("a"), hashOf("a")) == nullptr);
+    }
+
+    // Test random changes against std::map, with few distinct hashes, so that
+    // the entries collide, and the erases shift long runs which wrap around
+    // the end of the table
+    for (auto hash : {+[](std::string_view key) { return hashOf(key); },
+                      +[](std::string_view key) { return hashOf(key) % 5; },
+                      +[](std::string_view key) {
+                          return hashOf(key) % 3 + 6;
+                      }}) {
+        Map map;
+        std::map<std::string, int> expected;
+        std::mt19937 random(42);
+        for (int i = 0; i < 20000; ++i) {
+            auto key = std::to_string(random() % 200);
+            if (random() % 3 == 0) {
+                auto erased = map.erase(key, hash(key));
+                OATPP_ASSERT(erased == (expected.erase(key) > 0));
+            } else {
+                auto inserted =
+                    map.insert(hash(key), std::string(key), int(i));
+                OATPP_ASSERT(inserted.second == expected.emplace(key, i).second);
+                OATPP_ASSERT(inserted.first->first == key);
+            }
+            if (i % 1000 == 0) {
+                OATPP_ASSERT(matches(map, expected, hash));
+            }
+        }
+        OATPP_ASSERT(matches(map, expected, hash));
+    }
+
+    // Test growing ahead of the inserts keeps the entries, and lets them be
+    // inserted without growing
+    {
+        Map map;
+        for (int i = 0; i < 100; ++i) {
+            auto key = std::to_string(i);
+            map.insert(hashOf(key), std::string(key), int(i));
+        }
+        OATPP_ASSERT(!map.fits(100));
+        map.adopt(Map::allocate(map.capacityFor(100)));
+        OATPP_ASSERT(map.fits(100));
+        auto capacity = map.capacityFor(0);
+        map.adopt(Map::allocate(capacity / 2));
+        OATPP_ASSERT(map.capacityFor(0) == capacity);
+        for (int i = 100; i < 200; ++i) {
+            auto key = std::to_string(i);
+            map.insert(hashOf(key), std::string(key), int(i));
+        }
+        OATPP_ASSERT(map.capacityFor(0) == capacity);
+        for (int i = 0; i < 200; ++i) {
+            auto key = std::to_string(i);
+            OATPP_ASSERT(map.find(std::string_view(key), hashOf(key))->second ==
+                         i);
+        }
+    }
+
+    // Test the stack map looks names up by views
+    {
+        StackMap<std::string, int> stackMap(4);
+        stackMap.create("stack");
+        stackMap.push("stack", 1);
+        std::string_view view("stack");
+        OATPP_ASSERT(stackMap.getTop(view) == 1);
+        OATPP_ASSERT(stackMap.getSize(view).length == 1);
+        bool notFound = false;
+        try {
+            stackMap.getTop(std::string_view("other"));
+        } catch (const StackNameNotFound &) {
+            notFound = true;
+        }
+        OATPP_ASSERT(notFound);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef FlatHashMapTest_hpp
+#define FlatHashMapTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class FlatHashMapTest : public oatpp::test::UnitTest {
+public:
+    FlatHashMapTest() : UnitTest("TEST[FlatHashMapTest]") {}
+    void onRun() override;
+};
+
+#endif // FlatHashMapTest_hpp
@@ -0,0 +1,117 @@
+#include "LockFreeStackTest.hpp"
+
+#include "LockFreeStack.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+void LockFreeStackTest::onRun() {
+    LockFreeStack<int> stack;
+
+    // Test empty stack
+    try {
+        stack.getTop();
+        OATPP_ASSERT(false);
+    } catch (StackEmpty) {
+    }
+    try {
+        stack.pop();
+        OATPP_ASSERT(false);
+    } catch (StackEmpty) {
+    }
+
+    // Test push
+    for (int i = 1; i <= 5; ++i) {
+        stack.push(int(i));
+        OATPP_ASSERT(stack.getTop() == i);
+    }
+
+    // Test copy sharing the nodes
+    auto copied = LockFreeStack<int>(stack);
+    OATPP_ASSERT(copied.pop() == 5);
+    OATPP_ASSERT(stack.getTop() == 5);
+
+    // Test pop
+    for (int i = 5; i >= 1; --i) {
+        OATPP_ASSERT(stack.getTop() == i);
+        OATPP_ASSERT(stack.pop() == i);
+    }
+    try {
+        stack.getTop();
+        OATPP_ASSERT(false);
+    } catch (StackEmpty) {
+    }
+    OATPP_ASSERT(copied.getTop() == 4);
+}
+
+void LockFreeStackConcurrentTest::onRun() {
+    LockFreeStack<int> stack;
+    stack.push(1);
+    stack.push(2);
+    stack.push(3);
+
+    std::vector<std::thread> threads;
+
+    std::vector<int> popElements[3];
+    std::mutex popElemMutexes[3];
+
+    for (int i = 0; i < 3; ++i) {
+        auto cloneThread = std::thread([&, i]() mutable {
+            auto stk = LockFreeStack(stack);
+            auto &popElem = popElements[i];
+            auto &popElemMu = popElemMutexes[i];
+
+            std::vector<std::thread> threads;
+
+            for (int j = 0; j < 3; ++j) {
+                auto sharedThread = std::thread([&]() mutable {
+                    // Contend on the head with many pushes before draining.
+                    // Another thread may already be draining, so the stack
+                    // can be empty in between.
+                    for (int k = 0; k < 1000; ++k) {
+                        stk.push(4);
+                        stk.push(5);
+                        try {
+                            stk.getTop();
+                            auto elem = stk.pop();
+                            std::unique_lock lock(popElemMu);
+                            popElem.push_back(std::move(elem));
+                        } catch (StackEmpty) {
+                        }
+                    }
+
+                    while (true) {
+                        try {
+                            auto elem = stk.pop();
+                            std::unique_lock lock(popElemMu);
+                            popElem.push_back(std::move(elem));
+                        } catch (StackEmpty) {
+                            break;
+                        }
+                    }
+                });
+                threads.push_back(std::move(sharedThread));
+            }
+
+            for (auto &t : threads) {
+                t.join();
+            }
+        });
+        threads.push_back(std::move(cloneThread));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        auto &popElem = popElements[i];
+        OATPP_ASSERT(std::count(popElem.begin(), popElem.end(), 1) == 1);
+        OATPP_ASSERT(std::count(popElem.begin(), popElem.end(), 2) == 1);
+        OATPP_ASSERT(std::count(popElem.begin(), popElem.end(), 3) == 1);
+        OATPP_ASSERT(std::count(popElem.begin(), popElem.end(), 4) == 3000);
+        OATPP_ASSERT(std::count(popElem.begin(), popElem.end(), 5) == 3000);
+    }
+    OATPP_ASSERT(stack.pop() == 3);
+}
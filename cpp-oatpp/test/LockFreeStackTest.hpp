@@ -0,0 +1,18 @@
+#ifndef LockFreeStackTest_hpp
+#define LockFreeStackTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class LockFreeStackTest : public oatpp::test::UnitTest {
+public:
+    LockFreeStackTest() : UnitTest("TEST[LockFreeStackTest]") {}
+    void onRun() override;
+};
+class LockFreeStackConcurrentTest : public oatpp::test::UnitTest {
+public:
+    LockFreeStackConcurrentTest()
+        : UnitTest("TEST[LockFreeStackConcurrentTest]") {}
+    void onRun() override;
+};
+
+#endif // LockFreeStackTest_hpp
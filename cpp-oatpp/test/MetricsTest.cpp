@@ -0,0 +1,83 @@
+#include "MetricsTest.hpp"
+
+#include "Metrics.hpp"
+#include "StackMap.hpp"
+
+#include <string>
+#include <thread>
+
+void MetricsTest::onRun() {
+    // Test the buckets cover the values contiguously within their precision
+    for (std::uint64_t ns : {0ull, 1ull, 7ull, 8ull, 15ull, 1000ull,
+                             123456789ull, 1ull << 35}) {
+        auto bucket = LatencyHistogram::bucketOf(ns);
+        OATPP_ASSERT(ns < LatencyHistogram::upperBoundOf(bucket));
+        OATPP_ASSERT(bucket == 0 ||
+                     ns >= LatencyHistogram::upperBoundOf(bucket - 1));
+        OATPP_ASSERT(LatencyHistogram::upperBoundOf(bucket) - ns <=
+                     ns / LatencyHistogram::subBuckets + 1);
+    }
+    OATPP_ASSERT(LatencyHistogram::bucketOf(~0ull) ==
+                 LatencyHistogram::bucketCount - 1);
+
+    LatencyHistogram histogram;
+    for (std::uint64_t ns = 1; ns <= 1000; ++ns) {
+        ++histogram.buckets[LatencyHistogram::bucketOf(ns * 1000)];
+        ++histogram.count;
+    }
+    auto p50 = histogram.quantile(0.5);
+    OATPP_ASSERT(p50 >= 500000 && p50 <= 500000 * 9 / 8 + 1);
+    OATPP_ASSERT(histogram.quantile(1) >= 1000000);
+
+    // Test the requests recorded by an exited thread are kept
+    auto before = Metrics::collect();
+    std::thread([] {
+        Metrics::recordRequest(Metrics::Endpoint::Pop, 405,
+                               std::chrono::microseconds(3));
+        Metrics::recordRequest(Metrics::Endpoint::Pop, 599,
+                               std::chrono::microseconds(5));
+    }).join();
+    auto after = Metrics::collect();
+    auto pop = static_cast<std::size_t>(Metrics::Endpoint::Pop);
+    OATPP_ASSERT(after.requests[pop][6] - before.requests[pop][6] == 1);
+    OATPP_ASSERT(after.requests[pop][Metrics::statusCount - 1] -
+                     before.requests[pop][Metrics::statusCount - 1] ==
+                 1);
+    OATPP_ASSERT(after.latency[pop].count - before.latency[pop].count == 2);
+    OATPP_ASSERT(after.latency[pop].sumNs - before.latency[pop].sumNs ==
+                 8000);
+
+    // Test the node gauges follow the stacks
+    before = Metrics::collect();
+    {
+        Stack<int> stack;
+        stack.pushMany({1, 2, 3});
+        Stack<int> copied(stack);
+        stack.push(4);
+        auto totals = Metrics::collect();
+        OATPP_ASSERT(totals.nodes - before.nodes == 4);
+        // Only the node of 3 is referenced twice.
+        OATPP_ASSERT(totals.sharedNodes - before.sharedNodes == 1);
+
+        copied.pop();
+        totals = Metrics::collect();
+        OATPP_ASSERT(totals.nodes - before.nodes == 4);
+        OATPP_ASSERT(totals.sharedNodes - before.sharedNodes == 1);
+    }
+    after = Metrics::collect();
+    OATPP_ASSERT(after.nodes == before.nodes);
+    OATPP_ASSERT(after.sharedNodes == before.sharedNodes);
+
+    // Test the exposition
+    StackMap<std::string, int> map;
+    map.create("a");
+    Metrics::Gauges gauges;
+    gauges.stacks = map.size();
+    auto text = Metrics::format(Metrics::collect(), gauges);
+    OATPP_ASSERT(text.find("stack_server_stacks 1\n") != std::string::npos);
+    OATPP_ASSERT(text.find("stack_server_requests_total{endpoint=\"pop\","
+                           "code=\"405\"}") != std::string::npos);
+    OATPP_ASSERT(text.find("stack_server_request_duration_seconds_bucket{"
+                           "endpoint=\"pop\",le=\"+Inf\"}") !=
+                 std::string::npos);
+}
@@ -0,0 +1,12 @@
+#ifndef MetricsTest_hpp
+#define MetricsTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class MetricsTest : public oatpp::test::UnitTest {
+public:
+    MetricsTest() : UnitTest("TEST[MetricsTest]") {}
+    void onRun() override;
+};
+
+#endif // MetricsTest_hpp
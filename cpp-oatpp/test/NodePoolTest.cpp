@@ -0,0 +1,138 @@
+#include "NodePoolTest.hpp"
+
+#include "NodePool.hpp"
+#include "StackMap.hpp"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Payload {
+    long values[5];
+};
+
+struct OtherPayload {
+    long values[7];
+};
+
+} // namespace
+
+void NodePoolTest::onRun() {
+    PoolAllocator<Payload> allocator;
+    auto before = PoolAllocator<Payload>::getStats();
+
+    // Blocks are distinct and reused after being given back
+    std::vector<Payload *> blocks;
+    for (int i = 0; i < 1000; ++i) {
+        auto block = allocator.allocate(1);
+        block->values[0] = i;
+        blocks.push_back(block);
+    }
+    auto sorted = blocks;
+    std::sort(sorted.begin(), sorted.end());
+    OATPP_ASSERT(std::adjacent_find(sorted.begin(), sorted.end()) ==
+                 sorted.end());
+    for (int i = 0; i < 1000; ++i) {
+        OATPP_ASSERT(blocks[i]->values[0] == i);
+        allocator.deallocate(blocks[i], 1);
+    }
+
+    // Blocks freed by another thread are rebalanced back
+    std::thread([&] {
+        std::vector<Payload *> blocks;
+        for (int i = 0; i < 1000; ++i) {
+            blocks.push_back(allocator.allocate(1));
+        }
+        for (auto block : blocks) {
+            allocator.deallocate(block, 1);
+        }
+    }).join();
+
+    for (int round = 0; round < 100; ++round) {
+        for (int i = 0; i < 1000; ++i) {
+            blocks[i] = allocator.allocate(1);
+        }
+        for (int i = 0; i < 1000; ++i) {
+            allocator.deallocate(blocks[i], 1);
+        }
+    }
+
+    auto after = PoolAllocator<Payload>::getStats();
+    // A single slab covers everything, and the hot loop never went upstream
+    OATPP_ASSERT(after.upstreamAllocations - before.upstreamAllocations <= 2);
+    OATPP_ASSERT(after.allocations - before.allocations >= 2000);
+
+    // A different size class has its own pool
+    auto other = PoolAllocator<OtherPayload>::getStats();
+    OATPP_ASSERT(other.allocations == 0);
+}
+
+void PooledStackConcurrentTest::onRun() {
+    using PooledStack = Stack<int, PoolAllocator<int>>;
+    PooledStack stack;
+    stack.push(1);
+    stack.push(2);
+    stack.push(3);
+
+    std::vector<std::thread> threads;
+    std::vector<int> popElements[3];
+    std::mutex popElemMutexes[3];
+
+    for (int i = 0; i < 3; ++i) {
+        threads.emplace_back([&, i] {
+            auto stk = PooledStack(stack);
+            std::vector<std::thread> threads;
+            for (int j = 0; j < 3; ++j) {
+                threads.emplace_back([&] {
+                    stk.push(4);
+                    stk.push(5);
+                    // Churn the pool. Another thread may be draining the
+                    // stack meanwhile, which can also take the 6s.
+                    for (int k = 0; k < 1000; ++k) {
+                        stk.push(6);
+                        try {
+                            auto elem = stk.pop();
+                            if (elem == 6) {
+                                continue;
+                            }
+                            std::unique_lock lock(popElemMutexes[i]);
+                            popElements[i].push_back(elem);
+                        } catch (StackEmpty) {
+                        }
+                    }
+                    while (true) {
+                        try {
+                            auto elem = stk.pop();
+                            if (elem == 6) {
+                                continue;
+                            }
+                            std::unique_lock lock(popElemMutexes[i]);
+                            popElements[i].push_back(elem);
+                        } catch (StackEmpty) {
+                            break;
+                        }
+                    }
+                });
+            }
+            for (auto &t : threads) {
+                t.join();
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::vector<int> expectedPop{1, 2, 3, 4, 4, 4, 5, 5, 5};
+    for (int i = 0; i < 3; ++i) {
+        auto &popElem = popElements[i];
+        std::sort(popElem.begin(), popElem.end());
+        OATPP_ASSERT(popElem == expectedPop);
+    }
+    OATPP_ASSERT(stack.getTop() == 3);
+
+    auto stats = PooledStack::NodeAllocator::getStats();
+    OATPP_ASSERT(stats.upstreamAllocations <= 2);
+}
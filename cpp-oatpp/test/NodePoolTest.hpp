@@ -0,0 +1,18 @@
+#ifndef NodePoolTest_hpp
+#define NodePoolTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class NodePoolTest : public oatpp::test::UnitTest {
+public:
+    NodePoolTest() : UnitTest("TEST[NodePoolTest]") {}
+    void onRun() override;
+};
+class PooledStackConcurrentTest : public oatpp::test::UnitTest {
+public:
+    PooledStackConcurrentTest()
+        : UnitTest("TEST[PooledStackConcurrentTest]") {}
+    void onRun() override;
+};
+
+#endif // NodePoolTest_hpp
@@ -0,0 +1,60 @@
+#include "ReclaimerTest.hpp"
+
+#include "Metrics.hpp"
+#include "Reclaimer.hpp"
+#include "StackMap.hpp"
+
+#include <chrono>
+#include <vector>
+
+namespace {
+
+constexpr int nodeCount = 200000;
+
+std::int64_t liveNodes() { return Metrics::collect().nodes; }
+
+} // namespace
+
+void ReclaimerTest::onRun() {
+    auto &reclaimer = Reclaimer::instance();
+    reclaimer.drain();
+    auto before = liveNodes();
+
+    // Test a long chain is handed over after the inline budget
+    {
+        Stack<int> stack;
+        stack.pushMany(std::vector<int>(nodeCount, 1));
+        OATPP_ASSERT(liveNodes() - before == nodeCount);
+    }
+    OATPP_ASSERT(liveNodes() - before < nodeCount);
+    reclaimer.drain();
+    OATPP_ASSERT(liveNodes() == before);
+    OATPP_ASSERT(reclaimer.getBacklog() == 0);
+
+    // Test the reclamation stops at the nodes still shared
+    {
+        Stack<int> stack;
+        stack.pushMany(std::vector<int>(nodeCount, 1));
+        Stack<int> copied(stack);
+        stack.pushMany(std::vector<int>(nodeCount, 2));
+        stack = Stack<int>();
+        reclaimer.drain();
+        OATPP_ASSERT(liveNodes() - before == nodeCount);
+        OATPP_ASSERT(copied.popMany(nodeCount).size() == nodeCount);
+    }
+    reclaimer.drain();
+    OATPP_ASSERT(liveNodes() == before);
+
+    // Test many chains dropped at once, from several stack types
+    {
+        std::vector<Stack<int>> stacks(16);
+        for (auto &stack : stacks) {
+            stack.pushMany(std::vector<int>(nodeCount / 16, 3));
+        }
+        Stack<std::string> strings;
+        strings.pushMany(std::vector<std::string>(1000, "value"));
+    }
+    reclaimer.drain();
+    OATPP_ASSERT(liveNodes() == before);
+    OATPP_ASSERT(Metrics::collect().reclaimBacklog == 0);
+}
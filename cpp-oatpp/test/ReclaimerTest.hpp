@@ -0,0 +1,12 @@
+#ifndef ReclaimerTest_hpp
+#define ReclaimerTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class ReclaimerTest : public oatpp::test::UnitTest {
+public:
+    ReclaimerTest() : UnitTest("TEST[ReclaimerTest]") {}
+    void onRun() override;
+};
+
+#endif // ReclaimerTest_hpp
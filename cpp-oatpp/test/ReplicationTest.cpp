@@ -0,0 +1,229 @@
+#include "ReplicationTest.hpp"
+
+#include "replication/Replica.hpp"
+#include "replication/ReplicationServer.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Predicate>
+bool waitUntil(Predicate predicate,
+               std::chrono::milliseconds timeout = std::chrono::seconds(10)) {
+    auto deadline = Clock::now() + timeout;
+    while (!predicate()) {
+        if (Clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+bool caughtUp(const Replica &replica, ReplicationLog &log) {
+    return waitUntil(
+        [&] { return replica.getAppliedSeq() == log.getLastSeq(); });
+}
+
+// The values of each of the stacks, top first, or a marker for a missing one.
+std::vector<std::vector<std::string>>
+contents(StringStackMap &map, const std::vector<const char *> &names) {
+    std::vector<std::vector<std::string>> result;
+    for (auto name : names) {
+        auto &values = result.emplace_back();
+        auto range = map.tryPeek(std::string_view(name), SIZE_MAX);
+        if (!range) {
+            values.emplace_back("<missing>");
+            continue;
+        }
+        while (auto value = range->next()) {
+            values.emplace_back(value->data(), value->size());
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+void ReplicationTest::onRun() {
+    auto address = "unix:/tmp/stack-server-replication-test-" +
+                   std::to_string(::getpid()) + ".sock";
+    auto primary = std::make_shared<StringStackMap>(4);
+    // A small backlog, of 4 KiB segments.
+    auto log = std::make_shared<ReplicationLog>(nullptr, 64 << 10);
+    primary->setLog(log);
+    std::vector<const char *> names = {"a", "b", "c", "d", "gone"};
+
+    primary->create("a");
+    primary->pushMany("a", {"1", "2", "3"});
+    primary->copy("a", "b");
+    primary->push("b", "4");
+    primary->create("gone");
+    primary->remove("gone");
+
+    // Test a new replica loads a snapshot, then follows the stream
+    auto server = std::make_unique<ReplicationServer>(address, primary, log);
+    server->start();
+    auto map = std::make_shared<StringStackMap>(4);
+    Replica replica(address, map);
+    replica.start();
+    OATPP_ASSERT(caughtUp(replica, *log));
+    OATPP_ASSERT(replica.getSnapshotCount() == 1);
+    OATPP_ASSERT(contents(*map, names) == contents(*primary, names));
+
+    primary->create("c");
+    primary->pushMany("c", {"5", "6"});
+    primary->pop("a");
+    primary->copy("b", "d");
+    primary->remove("b");
+    OATPP_ASSERT(caughtUp(replica, *log));
+    OATPP_ASSERT(replica.getSnapshotCount() == 1);
+    OATPP_ASSERT(contents(*map, names) == contents(*primary, names));
+
+    // Test a replica resumes from the backlog when the stream breaks
+    server.reset();
+    primary->push("a", "7");
+    primary->popMany("d", 2);
+    server = std::make_unique<ReplicationServer>(address, primary, log);
+    server->start();
+    OATPP_ASSERT(caughtUp(replica, *log));
+    OATPP_ASSERT(replica.getSnapshotCount() == 1);
+    OATPP_ASSERT(server->getSnapshotCount() == 0);
+    OATPP_ASSERT(contents(*map, names) == contents(*primary, names));
+
+    // Test a replica further behind than the backlog starts over from a
+    // snapshot
+    server.reset();
+    for (int i = 0; i < 2000; ++i) {
+        auto value = std::string(64, 'x') + std::to_string(i);
+        primary->push("c", SmallString(value));
+    }
+    server = std::make_unique<ReplicationServer>(address, primary, log);
+    server->start();
+    OATPP_ASSERT(caughtUp(replica, *log));
+    OATPP_ASSERT(replica.getSnapshotCount() == 2);
+    OATPP_ASSERT(server->getSnapshotCount() == 1);
+    OATPP_ASSERT(contents(*map, names) == contents(*primary, names));
+
+    // Test a replica starts over from a snapshot when the primary restarts
+    auto restarted = std::make_shared<StringStackMap>(4);
+    auto restartedLog = std::make_shared<ReplicationLog>(nullptr, 64 << 10);
+    restarted->setLog(restartedLog);
+    restarted->create("a");
+    server.reset();
+    server =
+        std::make_unique<ReplicationServer>(address, restarted, restartedLog);
+    server->start();
+    OATPP_ASSERT(waitUntil([&] { return replica.getSnapshotCount() == 3; }));
+    OATPP_ASSERT(caughtUp(replica, *restartedLog));
+    OATPP_ASSERT(contents(*map, names) == contents(*restarted, names));
+
+    replica.stop();
+    server->stop();
+}
+
+void ReplicationLagTest::onRun() {
+    constexpr const char *address = "127.0.0.1:8101";
+    constexpr std::size_t replicaCount = 2;
+    constexpr int pusherCount = 2;
+    constexpr auto duration = std::chrono::seconds(1);
+    std::vector<const char *> names = {"s0", "s1", "s2", "s3"};
+
+    auto primary = std::make_shared<StringStackMap>(16);
+    auto log = std::make_shared<ReplicationLog>(nullptr, 64 << 20);
+    primary->setLog(log);
+    for (auto name : names) {
+        primary->create(name);
+    }
+    ReplicationServer server(address, primary, log);
+    server.start();
+
+    std::vector<std::shared_ptr<StringStackMap>> maps;
+    std::vector<std::unique_ptr<Replica>> replicas;
+    for (std::size_t i = 0; i < replicaCount; ++i) {
+        maps.push_back(std::make_shared<StringStackMap>(16));
+        replicas.push_back(std::make_unique<Replica>(address, maps.back()));
+        replicas.back()->start();
+    }
+    for (auto &replica : replicas) {
+        OATPP_ASSERT(caughtUp(*replica, *log));
+    }
+
+    // Sustained pushes, the stacks being emptied now and then so that they
+    // do not grow for the whole run.
+    std::atomic<bool> running{true};
+    std::atomic<std::uint64_t> mutations{0};
+    std::vector<std::thread> pushers;
+    for (int t = 0; t < pusherCount; ++t) {
+        pushers.emplace_back([&, t] {
+            oatpp::String name(names[t % names.size()]);
+            std::uint64_t count = 0;
+            for (int i = 0; running.load(std::memory_order_relaxed); ++i) {
+                primary->push(name, SmallString(std::to_string(i)));
+                ++count;
+                if (i % 1000 == 999) {
+                    primary->popMany(name, 1000);
+                    ++count;
+                }
+            }
+            mutations.fetch_add(count);
+        });
+    }
+
+    // The lag of a sample is the time from the moment a mutation is logged
+    // until every replica has applied it.
+    std::vector<double> lags;
+    auto start = Clock::now();
+    while (Clock::now() - start < duration) {
+        auto seq = log->getLastSeq();
+        auto logged = Clock::now();
+        OATPP_ASSERT(waitUntil([&] {
+            return std::all_of(replicas.begin(), replicas.end(),
+                               [&](auto &replica) {
+                                   return replica->getAppliedSeq() >= seq;
+                               });
+        }));
+        lags.push_back(
+            std::chrono::duration<double, std::milli>(Clock::now() - logged)
+                .count());
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    running = false;
+    for (auto &pusher : pushers) {
+        pusher.join();
+    }
+    auto elapsed =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (std::size_t i = 0; i < replicaCount; ++i) {
+        OATPP_ASSERT(caughtUp(*replicas[i], *log));
+        OATPP_ASSERT(replicas[i]->getSnapshotCount() == 1);
+        OATPP_ASSERT(contents(*maps[i], names) == contents(*primary, names));
+    }
+
+    std::sort(lags.begin(), lags.end());
+    auto quantile = [&](double q) {
+        return lags[std::min(lags.size() - 1,
+                             static_cast<std::size_t>(q * lags.size()))];
+    };
+    OATPP_LOGI("ReplicationLagTest",
+               "%zu replicas at %.0f mutations/s: lag p50 %.3f ms, p99 %.3f "
+               "ms, max %.3f ms over %zu samples",
+               replicaCount, mutations.load() / elapsed, quantile(0.5),
+               quantile(0.99), lags.back(), lags.size());
+
+    for (auto &replica : replicas) {
+        replica->stop();
+    }
+    server.stop();
+}
@@ -0,0 +1,17 @@
+#ifndef ReplicationTest_hpp
+#define ReplicationTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class ReplicationTest : public oatpp::test::UnitTest {
+public:
+    ReplicationTest() : UnitTest("TEST[ReplicationTest]") {}
+    void onRun() override;
+};
+class ReplicationLagTest : public oatpp::test::UnitTest {
+public:
+    ReplicationLagTest() : UnitTest("TEST[ReplicationLagTest]") {}
+    void onRun() override;
+};
+
+#endif // ReplicationTest_hpp
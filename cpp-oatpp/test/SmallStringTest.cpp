@@ -0,0 +1,46 @@
+#include "SmallStringTest.hpp"
+
+#include "SmallString.hpp"
+#include "StringStackMap.hpp"
+
+#include <string>
+#include <utility>
+
+void SmallStringTest::onRun() {
+    std::string fits(SmallString::inlineCapacity, 'a');
+    std::string spills(SmallString::inlineCapacity + 1, 'b');
+
+    // Values up to the inline capacity are stored inline
+    OATPP_ASSERT(SmallString().isInline() && SmallString().size() == 0);
+    SmallString small(fits.data(), fits.size());
+    OATPP_ASSERT(small.isInline());
+    OATPP_ASSERT(std::string(small.data(), small.size()) == fits);
+    OATPP_ASSERT(small.toString() == oatpp::String(fits));
+
+    // Longer values share the string they are created from
+    oatpp::String largeString(spills);
+    SmallString large(largeString);
+    OATPP_ASSERT(!large.isInline());
+    OATPP_ASSERT(large.toString().get() == largeString.get());
+    OATPP_ASSERT(SmallString(oatpp::String(nullptr)).size() == 0);
+
+    // Copies and moves keep the value
+    SmallString copied(large);
+    OATPP_ASSERT(copied == large && copied.toString().get() == largeString.get());
+    SmallString moved(std::move(copied));
+    OATPP_ASSERT(moved == large && copied.size() == 0 && copied.isInline());
+    moved = small;
+    OATPP_ASSERT(moved == small && moved.isInline());
+    moved = std::move(large);
+    OATPP_ASSERT(moved.toString().get() == largeString.get());
+    OATPP_ASSERT(SmallString("a") != SmallString("b"));
+
+    // A stack keeps both kinds of values
+    StringStack stack;
+    stack.push(SmallString(fits.data(), fits.size()));
+    stack.push(SmallString(largeString));
+    StringStack shared(stack);
+    OATPP_ASSERT(stack.pop().toString().get() == largeString.get());
+    OATPP_ASSERT(stack.pop().toString() == oatpp::String(fits));
+    OATPP_ASSERT(shared.getTop() == SmallString(largeString));
+}
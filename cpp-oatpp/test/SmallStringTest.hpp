@@ -0,0 +1,12 @@
+#ifndef SmallStringTest_hpp
+#define SmallStringTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class SmallStringTest : public oatpp::test::UnitTest {
+public:
+    SmallStringTest() : UnitTest("TEST[SmallStringTest]") {}
+    void onRun() override;
+};
+
+#endif // SmallStringTest_hpp
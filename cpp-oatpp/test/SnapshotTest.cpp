@@ -0,0 +1,152 @@
+#include "SnapshotTest.hpp"
+
+#include "Snapshot.hpp"
+#include "WriteAheadLog.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string createTempDirectory() {
+    char path[] = "/tmp/stack-server-snapshot-XXXXXX";
+    OATPP_ASSERT(::mkdtemp(path) != nullptr);
+    return path;
+}
+
+std::vector<std::string> popAll(StringStackMap &map, const char *name) {
+    std::vector<std::string> result;
+    for (auto &value : map.popMany(name, SIZE_MAX)) {
+        result.emplace_back(value.data(), value.size());
+    }
+    return result;
+}
+
+std::vector<std::string> range(int from, int to) {
+    std::vector<std::string> result;
+    for (int i = from; i >= to; --i) {
+        result.push_back(std::to_string(i));
+    }
+    return result;
+}
+
+} // namespace
+
+void SnapshotTest::onRun() {
+    auto directory = createTempDirectory();
+    auto path = directory + "/snapshot";
+
+    // There is nothing to load without a snapshot
+    {
+        StringStackMap map;
+        auto info = Snapshot::load(map, path);
+        OATPP_ASSERT(info.seq == 0 && info.stackCount == 0);
+    }
+
+    StringStackMap map(4);
+    map.create("a");
+    for (int i = 1; i <= 100; ++i) {
+        map.push("a", oatpp::String(std::to_string(i)));
+    }
+    for (auto name : {"b", "c", "d"}) {
+        map.copy("a", name);
+    }
+    map.push("b", "101");
+    map.popMany("c", 10);
+    map.create("empty");
+
+    // Shared nodes are written once
+    auto info = Snapshot::write(map, path);
+    OATPP_ASSERT(info.stackCount == 5);
+    OATPP_ASSERT(info.nodeCount == 101);
+
+    StringStackMap loaded(2);
+    auto loadedInfo = Snapshot::load(loaded, path);
+    OATPP_ASSERT(loadedInfo.stackCount == 5);
+    OATPP_ASSERT(loadedInfo.nodeCount == 101);
+
+    // And are shared again once loaded
+    auto rewritten = Snapshot::write(loaded, path);
+    OATPP_ASSERT(rewritten.nodeCount == 101);
+
+    OATPP_ASSERT(popAll(loaded, "a") == range(100, 1));
+    OATPP_ASSERT(popAll(loaded, "b") == range(101, 1));
+    OATPP_ASSERT(popAll(loaded, "c") == range(90, 1));
+    OATPP_ASSERT(popAll(loaded, "d") == range(100, 1));
+    OATPP_ASSERT(popAll(loaded, "empty").empty());
+
+    // A malformed snapshot is rejected
+    OATPP_ASSERT(::truncate(path.c_str(), 100) == 0);
+    try {
+        StringStackMap map;
+        Snapshot::load(map, path);
+        OATPP_ASSERT(false);
+    } catch (std::runtime_error &) {
+    }
+
+    ::unlink(path.c_str());
+    ::rmdir(directory.c_str());
+}
+
+void SnapshotRecoveryTest::onRun() {
+    auto directory = createTempDirectory();
+    auto snapshotPath = directory + "/snapshot";
+    auto walPath = directory + "/wal";
+    using Durability = WriteAheadLog::Durability;
+
+    {
+        auto map = std::make_shared<StringStackMap>(4);
+        map->setLog(std::make_shared<WriteAheadLog>(
+            walPath, Durability::PerOp, std::chrono::milliseconds(1)));
+        Snapshotter snapshotter(map, snapshotPath, std::chrono::hours(1));
+
+        map->create("a");
+        for (int i = 1; i <= 50; ++i) {
+            map->push("a", oatpp::String(std::to_string(i)));
+        }
+        map->copy("a", "b");
+        auto info = snapshotter.snapshot();
+        OATPP_ASSERT(info.seq == 52);
+
+        // The records after the snapshot are kept
+        map->push("a", "51");
+        map->pop("b");
+        map->remove("a");
+        map->create("a");
+        map->push("a", "1");
+        auto &log = map->getLog();
+        log->waitCommitted(log->takeLastLogged());
+    }
+
+    // Only the records after the snapshot are replayed, the others were
+    // discarded from the log
+    {
+        StringStackMap map(4);
+        auto info = Snapshot::load(map, snapshotPath);
+        OATPP_ASSERT(info.seq == 52);
+        WriteAheadLog log(walPath, Durability::PerOp,
+                          std::chrono::milliseconds(1));
+        OATPP_ASSERT(log.replay(map, info.seq) == 5);
+        OATPP_ASSERT(log.getLastSeq() == 57);
+        OATPP_ASSERT(popAll(map, "a") == range(1, 1));
+        OATPP_ASSERT(popAll(map, "b") == range(49, 1));
+    }
+    {
+        StringStackMap map;
+        WriteAheadLog log(walPath, Durability::PerOp,
+                          std::chrono::milliseconds(1));
+        try {
+            log.replay(map);
+            OATPP_ASSERT(false);
+        } catch (std::runtime_error &) {
+            // The first kept record pushes to a stack created before
+        }
+    }
+
+    ::unlink(snapshotPath.c_str());
+    ::unlink(walPath.c_str());
+    ::rmdir(directory.c_str());
+}
@@ -0,0 +1,17 @@
+#ifndef SnapshotTest_hpp
+#define SnapshotTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class SnapshotTest : public oatpp::test::UnitTest {
+public:
+    SnapshotTest() : UnitTest("TEST[SnapshotTest]") {}
+    void onRun() override;
+};
+class SnapshotRecoveryTest : public oatpp::test::UnitTest {
+public:
+    SnapshotRecoveryTest() : UnitTest("TEST[SnapshotRecoveryTest]") {}
+    void onRun() override;
+};
+
+#endif // SnapshotTest_hpp
@@ -0,0 +1,218 @@
+#include "SpillStoreTest.hpp"
+
+#include "Snapshot.hpp"
+#include "SpillStore.hpp"
+#include "StringStackMap.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string createTempDirectory() {
+    char path[] = "/tmp/stack-server-spill-XXXXXX";
+    OATPP_ASSERT(::mkdtemp(path) != nullptr);
+    return path;
+}
+
+// Every tenth value is too long to be stored inline.
+std::string valueOf(int i) {
+    auto value = std::to_string(i);
+    return i % 10 == 0 ? value + std::string(60, 'x') : value;
+}
+
+std::string toString(const SmallString &value) {
+    return std::string(value.data(), value.size());
+}
+
+std::vector<std::string> peekAll(StringStackMap &map, const char *name) {
+    std::vector<std::string> result;
+    auto range = map.peek(std::string_view(name), SIZE_MAX);
+    while (auto value = range.next()) {
+        result.push_back(toString(*value));
+    }
+    return result;
+}
+
+std::vector<std::string> range(int from, int to) {
+    std::vector<std::string> result;
+    for (int i = from; i >= to; --i) {
+        result.push_back(valueOf(i));
+    }
+    return result;
+}
+
+} // namespace
+
+void SpillStoreTest::onRun() {
+    auto directory = createTempDirectory();
+    auto &store = SpillStore::instance();
+    store.open(directory + "/segments", 64 << 20);
+    // The file is only held open
+    OATPP_ASSERT(::access((directory + "/segments").c_str(), F_OK) != 0);
+
+    StringStackMap map(4);
+    map.create("a");
+    for (int i = 1; i <= 5000; ++i) {
+        map.push("a", oatpp::String(valueOf(i)));
+    }
+    auto size = map.getSize(std::string_view("a"));
+    auto memory = MemoryBudget::instance().getUsed();
+
+    // Test the values below the resident depth are spilled, keeping the size
+    OATPP_ASSERT(map.spill(100, SIZE_MAX) == 4900);
+    OATPP_ASSERT(map.spill(100, SIZE_MAX) == 0);
+    Reclaimer::instance().drain();
+    auto stats = store.getStats();
+    OATPP_ASSERT(stats.values == 4900);
+    OATPP_ASSERT(stats.segments == 5);
+    OATPP_ASSERT(stats.fileBytes == SpillStore::extentBytes);
+    auto spilledSize = map.getSize(std::string_view("a"));
+    OATPP_ASSERT(spilledSize.length == size.length);
+    OATPP_ASSERT(spilledSize.bytes == size.bytes);
+    OATPP_ASSERT(MemoryBudget::instance().getUsed() < memory);
+
+    // Test a range reads the spilled values in place
+    OATPP_ASSERT(peekAll(map, "a") == range(5000, 1));
+
+    // Test a snapshot writes the spilled values as nodes, shared ones once
+    map.copy("a", "b");
+    auto info = Snapshot::write(map, directory + "/snapshot");
+    OATPP_ASSERT(info.nodeCount == 5000);
+    {
+        StringStackMap loaded;
+        Snapshot::load(loaded, directory + "/snapshot");
+        OATPP_ASSERT(peekAll(loaded, "b") == range(5000, 1));
+    }
+
+    // Test the pops fault the spilled values back in
+    std::vector<std::string> popped;
+    for (auto &value : map.popMany("a", 150)) {
+        popped.push_back(toString(value));
+    }
+    OATPP_ASSERT(popped == range(5000, 4851));
+    OATPP_ASSERT(toString(map.getTop(std::string_view("a"))) == valueOf(4850));
+    for (int i = 4850; i > 3000; --i) {
+        OATPP_ASSERT(toString(map.pop("a")) == valueOf(i));
+    }
+    popped.clear();
+    for (auto &value : map.popMany("a", SIZE_MAX)) {
+        popped.push_back(toString(value));
+    }
+    OATPP_ASSERT(popped == range(3000, 1));
+    OATPP_ASSERT(map.getSize(std::string_view("a")).length == 0);
+    // The copy keeps the placeholders it shares
+    OATPP_ASSERT(peekAll(map, "b") == range(5000, 1));
+
+    // Test the segments are released with the last placeholder
+    map.remove("b");
+    Reclaimer::instance().drain();
+    OATPP_ASSERT(store.getStats().values == 0);
+
+    // Test a stack whose top is shared is not spilled
+    for (int i = 1; i <= 1000; ++i) {
+        map.push("a", oatpp::String(valueOf(i)));
+    }
+    {
+        auto top = map.getTopRef(std::string_view("a"));
+        OATPP_ASSERT(map.spill(10, SIZE_MAX) == 0);
+    }
+    OATPP_ASSERT(map.spill(10, SIZE_MAX) == 990);
+
+    // Test spilling while the stack is pushed and popped
+    std::atomic<bool> done{false};
+    std::thread spiller([&] {
+        while (!done.load()) {
+            map.spill(10, 1);
+        }
+    });
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 1001; i <= 1200; ++i) {
+            map.push("a", oatpp::String(valueOf(i)));
+        }
+        for (int i = 1200; i > 1000; --i) {
+            OATPP_ASSERT(toString(map.pop("a")) == valueOf(i));
+        }
+        OATPP_ASSERT(peekAll(map, "a") == range(1000, 1));
+    }
+    done.store(true);
+    spiller.join();
+    map.remove("a");
+    Reclaimer::instance().drain();
+    OATPP_ASSERT(store.getStats().values == 0);
+
+    // Test a segment of each stack is spilled in a round, and the stacks
+    // removed and created again while their runs are stored are left alone
+    for (auto name : {"a", "b", "c", "d"}) {
+        map.create(oatpp::String(name));
+        for (int i = 1; i <= 3000; ++i) {
+            map.push(name, oatpp::String(valueOf(i)));
+        }
+    }
+    OATPP_ASSERT(map.spill(10, 1) == 4 * 1024);
+    done.store(false);
+    std::thread recreator([&] {
+        while (!done.load()) {
+            map.remove("d");
+            map.create("d");
+            map.copy("c", "e");
+            map.remove("e");
+        }
+    });
+    map.spill(10, SIZE_MAX);
+    done.store(true);
+    recreator.join();
+    for (auto name : {"a", "b", "c"}) {
+        OATPP_ASSERT(peekAll(map, name) == range(3000, 1));
+        map.remove(name);
+    }
+    OATPP_ASSERT(peekAll(map, "d").empty());
+    map.remove("d");
+    Reclaimer::instance().drain();
+    OATPP_ASSERT(store.getStats().values == 0);
+
+    // Test the memory budget follows the values spilled and faulted in. The
+    // map is used from threads of their own, which charge the budget in full
+    // when they exit, and the nodes freed by `Reclaimer` may be charged up to
+    // a batch late.
+    auto &budget = MemoryBudget::instance();
+    auto tolerance = static_cast<std::int64_t>(2 * MemoryBudget::batchBytes);
+    auto used = [&] {
+        Reclaimer::instance().drain();
+        return static_cast<std::int64_t>(budget.getUsed());
+    };
+    auto inThread = [](auto op) { std::thread(op).join(); };
+    map.create("a");
+    auto empty = used();
+    inThread([&] {
+        for (int i = 0; i < 5000; ++i) {
+            map.push("a", oatpp::String(std::to_string(i) +
+                                        std::string(200, 'x')));
+        }
+    });
+    auto full = used();
+    // The charge of a value, node included. A placeholder is only charged a
+    // node, less than that.
+    auto perValue = (full - empty) / 5000;
+    inThread([&] { OATPP_ASSERT(map.spill(100, SIZE_MAX) == 4900); });
+    auto spilled = used();
+    OATPP_ASSERT(spilled >= empty + 100 * perValue - tolerance);
+    OATPP_ASSERT(spilled <= empty + 105 * perValue + tolerance);
+    // The first pop past the resident values faults in a run of 1024
+    inThread([&] { map.popMany("a", 101); });
+    auto faulted = used();
+    OATPP_ASSERT(faulted >= empty + 1023 * perValue - tolerance);
+    OATPP_ASSERT(faulted <= empty + 1027 * perValue + tolerance);
+    inThread([&] { map.remove("a"); });
+    OATPP_ASSERT(std::abs(used() - empty) <= tolerance);
+    OATPP_ASSERT(store.getStats().values == 0);
+
+    ::unlink((directory + "/snapshot").c_str());
+    ::rmdir(directory.c_str());
+}
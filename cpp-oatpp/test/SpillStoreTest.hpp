@@ -0,0 +1,12 @@
+#ifndef SpillStoreTest_hpp
+#define SpillStoreTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class SpillStoreTest : public oatpp::test::UnitTest {
+public:
+    SpillStoreTest() : UnitTest("TEST[SpillStoreTest]") {}
+    void onRun() override;
+};
+
+#endif // SpillStoreTest_hpp
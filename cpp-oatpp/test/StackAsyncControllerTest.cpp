@@ -0,0 +1,57 @@
+#include "StackAsyncControllerTest.hpp"
+#include "StackControllerTest.hpp"
+
+#include "controller/StackAsyncController.hpp"
+
+#include "app/AsyncTestComponent.hpp"
+#include "app/StackApiTestClient.hpp"
+
+#include "oatpp/web/client/HttpRequestExecutor.hpp"
+
+#include "oatpp-test/web/ClientServerTestRunner.hpp"
+
+void StackAsyncControllerTest::onRun() {
+
+    /* Register test components */
+    AsyncTestComponent component;
+
+    /* Create client-server test runner */
+    oatpp::test::web::ClientServerTestRunner runner;
+
+    /* Add StackAsyncController endpoints to the router of the test server */
+    runner.addController(std::make_shared<StackAsyncController>());
+
+    /* Run test */
+    runner.run(
+        [this, &runner] {
+            /* Get client connection provider for Api Client */
+            OATPP_COMPONENT(
+                std::shared_ptr<oatpp::network::ClientConnectionProvider>,
+                clientConnectionProvider);
+
+            /* Get object mapper component */
+            OATPP_COMPONENT(std::shared_ptr<oatpp::data::mapping::ObjectMapper>,
+                            objectMapper);
+
+            /* Create http request executor for Api Client */
+            auto requestExecutor =
+                oatpp::web::client::HttpRequestExecutor::createShared(
+                    clientConnectionProvider);
+
+            /* Create Test API client */
+            auto client =
+                StackApiTestClient::createShared(requestExecutor, objectMapper);
+
+            runStackApiTest(client);
+        },
+        std::chrono::minutes(10) /* test timeout */);
+
+    /* wait all server threads finished */
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    /* stop the executor of the server coroutines */
+    OATPP_COMPONENT(std::shared_ptr<oatpp::async::Executor>, executor);
+    executor->waitTasksFinished();
+    executor->stop();
+    executor->join();
+}
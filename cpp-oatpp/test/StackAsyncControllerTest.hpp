@@ -0,0 +1,12 @@
+#ifndef StackAsyncControllerTest_hpp
+#define StackAsyncControllerTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class StackAsyncControllerTest : public oatpp::test::UnitTest {
+public:
+    StackAsyncControllerTest() : UnitTest("TEST[StackAsyncControllerTest]") {}
+    void onRun() override;
+};
+
+#endif // StackAsyncControllerTest_hpp
@@ -1,5 +1,6 @@
 #include "StackControllerTest.hpp"
 
+#include "BatchCodec.hpp"
 #include "controller/StackController.hpp"
 
 #include "app/StackApiTestClient.hpp"
@@ -10,7 +11,219 @@
 #include "oatpp-test/web/ClientServerTestRunner.hpp"
 #include <oatpp/core/base/Environment.hpp>
 
+#include <chrono>
 #include <sstream>
+#include <thread>
+
+void runStackApiTest(const std::shared_ptr<StackApiTestClient> &client) {
+    /* Test not found */
+    OATPP_ASSERT(client->getTop("not-exists")->getStatusCode() == 404);
+    OATPP_ASSERT(client->push("not-exists", "content")->getStatusCode() == 404);
+    OATPP_ASSERT(client->pop("not-exists")->getStatusCode() == 404);
+    OATPP_ASSERT(client->remove("not-exists")->getStatusCode() == 404);
+    OATPP_ASSERT(client->copy("not-exists", "new")->getStatusCode() == 404);
+
+    /* Test confliction */
+    OATPP_ASSERT(client->create("stack")->getStatusCode() == 201);
+    OATPP_ASSERT(client->create("stack")->getStatusCode() == 409);
+    OATPP_ASSERT(client->create("new-stack")->getStatusCode() == 201);
+    OATPP_ASSERT(client->copy("stack", "new-stack")->getStatusCode() == 409);
+
+    /* Test batches */
+    OATPP_ASSERT(client->create("batch")->getStatusCode() == 201);
+    OATPP_ASSERT(
+        client->pushMany("batch", BatchCodec::encode({"a", "bb", ""}))
+            ->getStatusCode() == 204);
+    OATPP_ASSERT(client->pushMany("batch", "\x01")->getStatusCode() == 400);
+    auto popped = client->popMany("batch", 2);
+    OATPP_ASSERT(popped->getStatusCode() == 200);
+    auto values = BatchCodec::decode(popped->readBodyToString());
+    OATPP_ASSERT(values.size() == 2 && values[0] == "" && values[1] == "bb");
+    OATPP_ASSERT(client->pop("batch")->readBodyToString() == "a");
+    OATPP_ASSERT(client->popMany("batch", 2)->getStatusCode() == 405);
+
+    /* Test peek */
+    OATPP_ASSERT(client->peek("not-exists", 1)->getStatusCode() == 404);
+    OATPP_ASSERT(client->peek("batch", 1)->getStatusCode() == 405);
+    OATPP_ASSERT(client->pushMany("batch", BatchCodec::encode({"a", "bb", ""}))
+                     ->getStatusCode() == 204);
+    auto peeked = client->peek("batch", 2);
+    OATPP_ASSERT(peeked->getStatusCode() == 200);
+    values = BatchCodec::decode(peeked->readBodyToString());
+    OATPP_ASSERT(values.size() == 2 && values[0] == "" && values[1] == "bb");
+    values = BatchCodec::decode(client->peek("batch", 5)->readBodyToString());
+    OATPP_ASSERT(values.size() == 3 && values[2] == "a");
+    OATPP_ASSERT(client->popMany("batch", 3)->getStatusCode() == 200);
+
+    /* Test size and limits */
+    OATPP_ASSERT(client->getSize("not-exists")->getStatusCode() == 404);
+    OATPP_ASSERT(client->pushMany("batch", BatchCodec::encode({"a", "bb", ""}))
+                     ->getStatusCode() == 204);
+    auto size = client->getSize("batch");
+    OATPP_ASSERT(size->getStatusCode() == 200);
+    auto sizeBody = size->readBodyToString();
+    OATPP_ASSERT(sizeBody->find("\"length\":3") != std::string::npos);
+    OATPP_ASSERT(sizeBody->find("\"bytes\":3") != std::string::npos);
+    std::vector<SmallString> tooMany(98, "x");
+    auto exceeded = client->pushMany("batch", BatchCodec::encode(tooMany));
+    OATPP_ASSERT(exceeded->getStatusCode() == 507);
+    OATPP_ASSERT(exceeded->readBodyToString() == "STACK_LIMIT_EXCEEDED");
+    tooMany.pop_back();
+    OATPP_ASSERT(client->pushMany("batch", BatchCodec::encode(tooMany))
+                     ->getStatusCode() == 204);
+    OATPP_ASSERT(client->push("batch", "x")->getStatusCode() == 507);
+    OATPP_ASSERT(client->popMany("batch", 100)->getStatusCode() == 200);
+
+    /* Test blocking pop */
+    OATPP_ASSERT(client->popWaiting("batch", 20)->getStatusCode() == 405);
+    OATPP_ASSERT(client->popWaitingFor("batch", "soon")->getStatusCode() ==
+                 400);
+    OATPP_ASSERT(client->popWaiting("not-exists", 20)->getStatusCode() ==
+                 404);
+    std::thread pusher([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        OATPP_ASSERT(client->push("batch", "w")->getStatusCode() == 204);
+    });
+    auto waited = client->popWaiting("batch", 10000);
+    pusher.join();
+    OATPP_ASSERT(waited->getStatusCode() == 200);
+    OATPP_ASSERT(waited->readBodyToString() == "w");
+
+    /* Test fork */
+    OATPP_ASSERT(client->push("batch", "f")->getStatusCode() == 204);
+    OATPP_ASSERT(client->fork("batch", BatchCodec::encode({"fork-a", "fork-b"}))
+                     ->getStatusCode() == 204);
+    OATPP_ASSERT(client->fork("batch", BatchCodec::encode({"fork-c", "fork-a"}))
+                     ->getStatusCode() == 409);
+    OATPP_ASSERT(client->getTop("fork-c")->getStatusCode() == 404);
+    OATPP_ASSERT(client->fork("not-exists", BatchCodec::encode({"fork-c"}))
+                     ->getStatusCode() == 404);
+    OATPP_ASSERT(client->pop("fork-a")->readBodyToString() == "f");
+    OATPP_ASSERT(client->pop("fork-b")->readBodyToString() == "f");
+    OATPP_ASSERT(client->pop("batch")->readBodyToString() == "f");
+
+    /* Test move */
+    OATPP_ASSERT(client->push("fork-a", "m")->getStatusCode() == 204);
+    auto moved = client->move("fork-a", "fork-b");
+    OATPP_ASSERT(moved->getStatusCode() == 200);
+    OATPP_ASSERT(moved->readBodyToString() == "m");
+    OATPP_ASSERT(client->move("fork-a", "fork-b")->getStatusCode() == 405);
+    OATPP_ASSERT(client->move("fork-b", "not-exists")->getStatusCode() == 404);
+    OATPP_ASSERT(client->move("not-exists", "fork-b")->getStatusCode() == 404);
+    OATPP_ASSERT(client->pop("fork-b")->readBodyToString() == "m");
+
+    /* Test versions */
+    OATPP_ASSERT(client->create("versioned")->getStatusCode() == 201);
+    auto empty = client->getTop("versioned");
+    OATPP_ASSERT(empty->getStatusCode() == 405);
+    auto etag = empty->getHeader("ETag");
+    OATPP_ASSERT(etag && etag->size() == 18);
+    OATPP_ASSERT(
+        client->pushIfMatch("versioned", "\"0000000000000000\"", "v")
+            ->getStatusCode() == 412);
+    OATPP_ASSERT(
+        client->pushIfMatch("versioned", "W/" + etag, "v")->getStatusCode() ==
+        412);
+    auto pushed = client->pushIfMatch("versioned", etag, "v");
+    OATPP_ASSERT(pushed->getStatusCode() == 204);
+    auto pushedETag = pushed->getHeader("ETag");
+    OATPP_ASSERT(pushedETag && pushedETag != etag);
+    OATPP_ASSERT(client->pushIfMatch("versioned", etag, "w")->getStatusCode() ==
+                 412);
+    auto top = client->getTop("versioned");
+    OATPP_ASSERT(top->getHeader("ETag") == pushedETag);
+    OATPP_ASSERT(top->readBodyToString() == "v");
+    auto notModified = client->getTopIfNoneMatch("versioned", pushedETag);
+    OATPP_ASSERT(notModified->getStatusCode() == 304);
+    OATPP_ASSERT(notModified->getHeader("ETag") == pushedETag);
+    OATPP_ASSERT(
+        client->getTopIfNoneMatch("versioned", etag + ", W/" + pushedETag)
+            ->getStatusCode() == 304);
+    OATPP_ASSERT(
+        client->getTopIfNoneMatch("versioned", etag)->getStatusCode() == 200);
+    OATPP_ASSERT(client->popIfMatch("versioned", etag)->getStatusCode() == 412);
+    auto popped = client->popIfMatch("versioned", pushedETag);
+    OATPP_ASSERT(popped->getStatusCode() == 200);
+    OATPP_ASSERT(popped->readBodyToString() == "v");
+    OATPP_ASSERT(popped->getHeader("ETag") != pushedETag);
+    OATPP_ASSERT(client->popIfMatch("versioned", "*")->getStatusCode() == 405);
+
+    /* Test metrics */
+    auto metrics = client->getMetrics();
+    OATPP_ASSERT(metrics->getStatusCode() == 200);
+    auto text = metrics->readBodyToString();
+    OATPP_ASSERT(text->find("stack_server_requests_total{endpoint=\"pop_many\","
+                            "code=\"405\"}") != std::string::npos);
+    // A malformed timeout is counted too
+    OATPP_ASSERT(text->find("stack_server_requests_total{endpoint=\"pop\","
+                            "code=\"400\"}") != std::string::npos);
+
+    /* Concurrent Test */
+    OATPP_ASSERT(client->push("stack", "1")->getStatusCode() == 204);
+    OATPP_ASSERT(client->push("stack", "2")->getStatusCode() == 204);
+    OATPP_ASSERT(client->push("stack", "3")->getStatusCode() == 204);
+
+    std::vector<std::thread> threads;
+
+    std::vector<std::string> popElements[3];
+    std::mutex popElemMutexes[3];
+
+    for (int i = 0; i < 3; ++i) {
+        auto cloneThread = std::thread([&, i]() mutable {
+            std::stringstream stkNameStream;
+            stkNameStream << "stack-" << i;
+            std::string stkName = stkNameStream.str();
+
+            OATPP_ASSERT(client->copy("stack", stkName)->getStatusCode() ==
+                         204);
+
+            auto &popElem = popElements[i];
+            auto &popElemMu = popElemMutexes[i];
+
+            std::vector<std::thread> threads;
+
+            for (int j = 0; j < 3; ++j) {
+                auto sharedThread = std::thread([&]() mutable {
+                    {
+                        OATPP_ASSERT(
+                            client->push(stkName, "4")->getStatusCode() == 204);
+                        OATPP_ASSERT(
+                            client->push(stkName, "5")->getStatusCode() == 204);
+                    }
+
+                    while (true) {
+                        auto resp = client->pop(stkName);
+                        if (resp->getStatusCode() == 405) {
+                            break;
+                        }
+                        OATPP_ASSERT(resp->getStatusCode() == 200);
+
+                        auto elem = resp->readBodyToString();
+                        std::unique_lock lock(popElemMu);
+                        popElem.push_back(std::move(elem));
+                    }
+                });
+                threads.push_back(std::move(sharedThread));
+            }
+
+            for (auto &t : threads) {
+                t.join();
+            }
+        });
+        threads.push_back(std::move(cloneThread));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::vector<std::string> expectedPop{"1", "2", "3", "4", "4",
+                                         "4", "5", "5", "5"};
+    for (int i = 0; i < 3; ++i) {
+        auto &popElem = popElements[i];
+        std::sort(popElem.begin(), popElem.end());
+        OATPP_ASSERT(popElem == expectedPop);
+    }
+}
 
 void StackControllerTest::onRun() {
 
@@ -44,87 +257,7 @@ void StackControllerTest::onRun() {
             auto client =
                 StackApiTestClient::createShared(requestExecutor, objectMapper);
 
-            /* Test not found */
-            OATPP_ASSERT(client->getTop("not-exists")->getStatusCode() == 404);
-            OATPP_ASSERT(
-                client->push("not-exists", "content")->getStatusCode() == 404);
-            OATPP_ASSERT(client->pop("not-exists")->getStatusCode() == 404);
-            OATPP_ASSERT(client->remove("not-exists")->getStatusCode() == 404);
-            OATPP_ASSERT(client->copy("not-exists", "new")->getStatusCode() ==
-                         404);
-
-            /* Test confliction */
-            OATPP_ASSERT(client->create("stack")->getStatusCode() == 201);
-            OATPP_ASSERT(client->create("stack")->getStatusCode() == 409);
-            OATPP_ASSERT(client->create("new-stack")->getStatusCode() == 201);
-            OATPP_ASSERT(client->copy("stack", "new-stack")->getStatusCode() ==
-                         409);
-
-            /* Concurrent Test */
-            OATPP_ASSERT(client->push("stack", "1")->getStatusCode() == 204);
-            OATPP_ASSERT(client->push("stack", "2")->getStatusCode() == 204);
-            OATPP_ASSERT(client->push("stack", "3")->getStatusCode() == 204);
-
-            std::vector<std::thread> threads;
-
-            std::vector<std::string> popElements[3];
-            std::mutex popElemMutexes[3];
-
-            for (int i = 0; i < 3; ++i) {
-                auto cloneThread = std::thread([&, i]() mutable {
-                    std::stringstream stkNameStream;
-                    stkNameStream << "stack-" << i;
-                    std::string stkName = stkNameStream.str();
-
-                    OATPP_ASSERT(
-                        client->copy("stack", stkName)->getStatusCode() == 204);
-
-                    auto &popElem = popElements[i];
-                    auto &popElemMu = popElemMutexes[i];
-
-                    std::vector<std::thread> threads;
-
-                    for (int j = 0; j < 3; ++j) {
-                        auto sharedThread = std::thread([&]() mutable {
-                            {
-                                OATPP_ASSERT(client->push(stkName, "4")
-                                                 ->getStatusCode() == 204);
-                                OATPP_ASSERT(client->push(stkName, "5")
-                                                 ->getStatusCode() == 204);
-                            }
-
-                            while (true) {
-                                auto resp = client->pop(stkName);
-                                if (resp->getStatusCode() == 405) {
-                                    break;
-                                }
-                                OATPP_ASSERT(resp->getStatusCode() == 200);
-
-                                auto elem = resp->readBodyToString();
-                                std::unique_lock lock(popElemMu);
-                                popElem.push_back(std::move(elem));
-                            }
-                        });
-                        threads.push_back(std::move(sharedThread));
-                    }
-
-                    for (auto &t : threads) {
-                        t.join();
-                    }
-                });
-                threads.push_back(std::move(cloneThread));
-            }
-            for (auto &t : threads) {
-                t.join();
-            }
-
-            std::vector<std::string> expectedPop{"1", "2", "3", "4", "4",
-                                                 "4", "5", "5", "5"};
-            for (int i = 0; i < 3; ++i) {
-                auto &popElem = popElements[i];
-                std::sort(popElem.begin(), popElem.end());
-                OATPP_ASSERT(popElem == expectedPop);
-            }
+            runStackApiTest(client);
         },
         std::chrono::minutes(10) /* test timeout */);
 
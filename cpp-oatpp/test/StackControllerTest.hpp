@@ -3,6 +3,16 @@
 
 #include "oatpp-test/UnitTest.hpp"
 
+#include <memory>
+
+class StackApiTestClient;
+
+/**
+ * Runs the API scenario shared by the tests of the sync and async
+ * controllers.
+ */
+void runStackApiTest(const std::shared_ptr<StackApiTestClient> &client);
+
 class StackControllerTest : public oatpp::test::UnitTest {
 public:
     StackControllerTest() : UnitTest("TEST[StackControllerTest]") {}
@@ -3,6 +3,7 @@
 #include "StackMap.hpp"
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
@@ -53,6 +54,214 @@ void StackTest::onRun() {
     }
 }
 
+void StackBatchTest::onRun() {
+    Stack<int> stack;
+    stack.push(1);
+
+    // Test push many
+    stack.pushMany({2, 3, 4});
+    OATPP_ASSERT(stack.getTop() == 4);
+    stack.pushMany({});
+    OATPP_ASSERT(stack.getTop() == 4);
+
+    // Test pop many from a unique chain
+    OATPP_ASSERT(stack.popMany(2) == std::vector<int>({4, 3}));
+    OATPP_ASSERT(stack.getTop() == 2);
+
+    // Test pop many from a shared chain
+    stack.pushMany({3, 4});
+    auto copied = Stack(stack);
+    OATPP_ASSERT(stack.popMany(3) == std::vector<int>({4, 3, 2}));
+    OATPP_ASSERT(copied.popMany(10) == std::vector<int>({4, 3, 2, 1}));
+    OATPP_ASSERT(copied.popMany(10).empty());
+    OATPP_ASSERT(stack.popMany(10) == std::vector<int>({1}));
+
+    // Test pop many partially shared, with the shared part below
+    stack.pushMany({1, 2});
+    copied = stack;
+    stack.pushMany({3, 4});
+    OATPP_ASSERT(stack.popMany(3) == std::vector<int>({4, 3, 2}));
+    OATPP_ASSERT(stack.getTop() == 1);
+    OATPP_ASSERT(copied.getTop() == 2);
+}
+
+void StackValueRefTest::onRun() {
+    Stack<std::string> stack;
+    stack.pushMany({"1", "2", "3"});
+
+    // Test the pinned top outliving the pop of its node
+    auto top = stack.getTopRef();
+    OATPP_ASSERT(*top == "3");
+    auto popped = stack.popRef();
+    OATPP_ASSERT(*popped == "3" && stack.getTop() == "2");
+    stack.push("4");
+    OATPP_ASSERT(*top == "3" && top->size() == 1);
+
+    // Test popping from a shared chain
+    auto copied = Stack(stack);
+    OATPP_ASSERT(*stack.popRef() == "4");
+    auto sharedPopped = stack.popRef();
+    OATPP_ASSERT(*sharedPopped == "2");
+    stack = Stack<std::string>();
+    copied = Stack<std::string>();
+    OATPP_ASSERT(*sharedPopped == "2");
+
+    // Test moving the references
+    Stack<std::string>::ValueRef moved(std::move(popped));
+    popped = std::move(moved);
+    OATPP_ASSERT(*popped == "3");
+
+    bool empty = false;
+    try {
+        stack.popRef();
+    } catch (StackEmpty) {
+        empty = true;
+    }
+    OATPP_ASSERT(empty);
+}
+
+void StackPeekTest::onRun() {
+    Stack<std::string> stack;
+    OATPP_ASSERT(stack.peek(3).empty());
+    stack.pushMany({"1", "2", "3", "4"});
+
+    // Test the range is bounded by the count and by the stack
+    auto range = stack.peek(2);
+    OATPP_ASSERT(*range.next() == "4" && *range.next() == "3");
+    OATPP_ASSERT(range.next() == nullptr && range.empty());
+    std::vector<std::string> all;
+    for (auto rest = stack.peek(10); auto value = rest.next();) {
+        all.push_back(*value);
+    }
+    OATPP_ASSERT((all == std::vector<std::string>{"4", "3", "2", "1"}));
+
+    // Test the range outliving the changes of the stack
+    auto pinned = stack.peek(3);
+    OATPP_ASSERT(stack.pop() == "4");
+    OATPP_ASSERT(stack.popMany(3).size() == 3);
+    stack.push("5");
+    OATPP_ASSERT(*pinned.next() == "4" && *pinned.next() == "3");
+    auto moved = std::move(pinned);
+    OATPP_ASSERT(*moved.next() == "2" && moved.next() == nullptr);
+
+    // Test walking ranges while the stack is popped and pushed
+    stack.pushMany(std::vector<std::string>(1000, "6"));
+    std::thread writer([&] {
+        for (int i = 0; i < 1000; ++i) {
+            stack.pop();
+            stack.push("7");
+            stack.pop();
+        }
+    });
+    for (int i = 0; i < 100; ++i) {
+        auto walked = stack.peek(2000);
+        std::size_t count = 0;
+        while (auto value = walked.next()) {
+            OATPP_ASSERT(*value == "5" || *value == "6" || *value == "7");
+            ++count;
+        }
+        OATPP_ASSERT(count <= 1001);
+    }
+    writer.join();
+    OATPP_ASSERT(stack.peek(1).next() != nullptr);
+
+    StackMap<std::string, std::string> stackMap;
+    bool notFound = false;
+    try {
+        stackMap.peek("not-exists", 1);
+    } catch (StackNameNotFound) {
+        notFound = true;
+    }
+    OATPP_ASSERT(notFound);
+}
+
+void StackSizeTest::onRun() {
+    auto sizeIs = [](const StackSize &size, std::uint64_t length,
+                     std::uint64_t bytes) {
+        return size.length == length && size.bytes == bytes;
+    };
+
+    Stack<std::string> stack;
+    OATPP_ASSERT(sizeIs(stack.getSize(), 0, 0));
+    stack.push("1");
+    stack.pushMany({"22", "333"});
+    OATPP_ASSERT(sizeIs(stack.getSize(), 3, 6));
+
+    // Test the sizes of stacks sharing a tail
+    Stack<std::string> copied(stack);
+    copied.pushMany({"4444", "55555"});
+    stack.pop();
+    OATPP_ASSERT(sizeIs(stack.getSize(), 2, 3));
+    OATPP_ASSERT(sizeIs(copied.getSize(), 5, 15));
+    OATPP_ASSERT(copied.popMany(4).size() == 4);
+    OATPP_ASSERT(sizeIs(copied.getSize(), 1, 1));
+
+    // Test the limits of a stack, the batches being all or nothing
+    StackLimits limits{4, 10};
+    stack.push("4444", {}, limits);
+    OATPP_ASSERT(sizeIs(stack.getSize(), 3, 7));
+    bool exceeded = false;
+    try {
+        stack.push("4444", {}, limits);
+    } catch (StackLimitExceeded) {
+        exceeded = true;
+    }
+    OATPP_ASSERT(exceeded);
+    exceeded = false;
+    try {
+        stack.pushMany({"a", "b"}, {}, limits);
+    } catch (StackLimitExceeded) {
+        exceeded = true;
+    }
+    OATPP_ASSERT(exceeded && sizeIs(stack.getSize(), 3, 7));
+    stack.pushMany({"a"}, {}, limits);
+    OATPP_ASSERT(sizeIs(stack.getSize(), 4, 8));
+    // The depth recorded by the nodes is not allowed to wrap around
+    OATPP_ASSERT(StackLimits().allows({StackLimits::maxDepth, 0}));
+    OATPP_ASSERT(!StackLimits().allows({StackLimits::maxDepth + 1, 0}));
+
+    // Test the memory budget, once the chains dropped by the other tests are
+    // freed
+    Reclaimer::instance().drain();
+    auto &budget = MemoryBudget::instance();
+    budget.setLimit(budget.getUsed() + 1);
+    exceeded = false;
+    try {
+        stack.push("x");
+    } catch (MemoryLimitExceeded) {
+        exceeded = true;
+    }
+    budget.setLimit(0);
+    OATPP_ASSERT(exceeded && sizeIs(stack.getSize(), 4, 8));
+    auto before = budget.getUsed();
+    std::thread([] {
+        Stack<std::string> stack;
+        stack.pushMany(std::vector<std::string>(1000, "value"));
+        Stack<std::string> kept(stack);
+        stack = Stack<std::string>();
+        kept.popMany(1000);
+    }).join();
+    OATPP_ASSERT(budget.getUsed() == before);
+
+    // Test the sizes and the limits in a map
+    StackMap<std::string, std::string> stackMap(4);
+    stackMap.setLimits({2, 0});
+    stackMap.create("a");
+    stackMap.create("b");
+    stackMap.pushMany("a", {"1", "22"});
+    stackMap.copy("a", "c");
+    OATPP_ASSERT(sizeIs(stackMap.getSize("c"), 2, 3));
+    exceeded = false;
+    try {
+        stackMap.push("c", "333");
+    } catch (StackLimitExceeded) {
+        exceeded = true;
+    }
+    OATPP_ASSERT(exceeded);
+    auto stats = stackMap.getStats();
+    OATPP_ASSERT(stats.stacks == 3 && stats.length == 4 && stats.bytes == 6);
+}
+
 void StackConcurrentTest::onRun() {
     Stack<int> stack;
     stack.push(1);
@@ -175,3 +384,449 @@ void StackMapConcurrentTest::onRun() {
         OATPP_ASSERT(popElem == expectedPop);
     }
 }
+
+void StackMapShardedTest::onRun() {
+    StackMap<std::string, int> stackMap(8);
+    OATPP_ASSERT(stackMap.getShardCount() == 8);
+
+    // Enough names to land in every shard
+    for (int i = 0; i < 64; ++i) {
+        stackMap.create("stack-" + std::to_string(i));
+        stackMap.getStack("stack-" + std::to_string(i)).second.push(int(i));
+    }
+    try {
+        stackMap.create("stack-0");
+        OATPP_ASSERT(false);
+    } catch (StackNameAlreadyExists) {
+    }
+
+    // Copy every stack to names which are mostly in other shards
+    for (int i = 0; i < 64; ++i) {
+        stackMap.copy("stack-" + std::to_string(i),
+                      "copy-" + std::to_string(i));
+    }
+    try {
+        stackMap.copy("stack-1", "copy-0");
+        OATPP_ASSERT(false);
+    } catch (StackNameAlreadyExists) {
+    }
+    try {
+        stackMap.copy("not-exists", "copy-not-exists");
+        OATPP_ASSERT(false);
+    } catch (StackNameNotFound) {
+    }
+
+    for (int i = 0; i < 64; ++i) {
+        auto name = "stack-" + std::to_string(i);
+        stackMap.remove(name);
+        try {
+            stackMap.getStack(name);
+            OATPP_ASSERT(false);
+        } catch (StackNameNotFound) {
+        }
+        OATPP_ASSERT(
+            stackMap.getStack("copy-" + std::to_string(i)).second.pop() == i);
+    }
+}
+
+namespace {
+
+class CountingWaiter : public PopWaiter {
+public:
+    void wake() override { ++this->wakes; }
+
+    int wakes = 0;
+};
+
+} // namespace
+
+void StackMapWaitTest::onRun() {
+    using namespace std::chrono;
+    StackMap<std::string, std::string> stackMap(4);
+    stackMap.create("stack");
+
+    // Test a wait timing out
+    auto start = steady_clock::now();
+    bool empty = false;
+    try {
+        stackMap.popRefUntil("stack", start + milliseconds(20));
+    } catch (StackEmpty) {
+        empty = true;
+    }
+    OATPP_ASSERT(empty && steady_clock::now() - start >= milliseconds(20));
+
+    // Test a waiting pop of a value already there
+    stackMap.push("stack", "1");
+    OATPP_ASSERT(*stackMap.popRefUntil("stack", steady_clock::now()) == "1");
+
+    // Test each pushed value waking one waiter, first parked first
+    auto first = std::make_shared<CountingWaiter>();
+    auto second = std::make_shared<CountingWaiter>();
+    OATPP_ASSERT(!stackMap.popRefOrWait("stack", first));
+    OATPP_ASSERT(!stackMap.popRefOrWait("stack", second));
+    stackMap.push("stack", "2");
+    OATPP_ASSERT(first->wakes == 1 && second->wakes == 0);
+
+    // Test a woken waiter giving up passing the wake on
+    stackMap.cancelWait("stack", *first);
+    OATPP_ASSERT(second->wakes == 1);
+    OATPP_ASSERT(*stackMap.popRefOrWait("stack", second) == "2");
+    OATPP_ASSERT(!stackMap.popRefOrWait("stack", first));
+    stackMap.cancelWait("stack", *first);
+    stackMap.push("stack", "3");
+    OATPP_ASSERT(first->wakes == 1);
+    stackMap.pop("stack");
+
+    // Test blocked pops getting one value each
+    std::vector<std::thread> threads;
+    std::vector<std::string> popped(8);
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&, i] {
+            auto deadline = steady_clock::now() + seconds(10);
+            popped[i] = *stackMap.popRefUntil("stack", deadline);
+        });
+    }
+    std::this_thread::sleep_for(milliseconds(20));
+    stackMap.push("stack", "a");
+    stackMap.pushMany("stack", {"b", "c", "d", "e", "f", "g"});
+    stackMap.push("stack", "h");
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    std::sort(popped.begin(), popped.end());
+    OATPP_ASSERT((popped == std::vector<std::string>{"a", "b", "c", "d", "e",
+                                                     "f", "g", "h"}));
+
+    // Test the removal of the stack waking the waiters
+    std::thread removed([&] {
+        bool notFound = false;
+        try {
+            stackMap.popRefUntil("stack", steady_clock::now() + seconds(10));
+        } catch (StackNameNotFound) {
+            notFound = true;
+        }
+        OATPP_ASSERT(notFound);
+    });
+    std::this_thread::sleep_for(milliseconds(20));
+    stackMap.remove("stack");
+    removed.join();
+}
+
+void StackMapForkTest::onRun() {
+    StackMap<std::string, int> stackMap(8);
+    stackMap.create("source");
+    stackMap.getStack("source").second.pushMany({1, 2, 3});
+
+    // Fork to names spread over the shards, the source's one included
+    std::vector<std::string> names;
+    for (int i = 0; i < 32; ++i) {
+        names.push_back("fork-" + std::to_string(i));
+    }
+    stackMap.fork("source", std::vector<std::string>(names));
+    stackMap.getStack("source").second.push(4);
+    for (auto &name : names) {
+        OATPP_ASSERT(stackMap.getStack(name).second.popMany(10) ==
+                     std::vector<int>({3, 2, 1}));
+    }
+
+    // Test the fork is all or nothing
+    try {
+        stackMap.fork("source", {"new-0", "fork-3", "new-1"});
+        OATPP_ASSERT(false);
+    } catch (StackNameAlreadyExists) {
+    }
+    try {
+        stackMap.fork("source", {"new-0", "new-0"});
+        OATPP_ASSERT(false);
+    } catch (StackNameAlreadyExists) {
+    }
+    try {
+        stackMap.fork("not-exists", {"new-0"});
+        OATPP_ASSERT(false);
+    } catch (StackNameNotFound) {
+    }
+    for (auto name : {"new-0", "new-1"}) {
+        try {
+            stackMap.getStack(name);
+            OATPP_ASSERT(false);
+        } catch (StackNameNotFound) {
+        }
+    }
+
+    // Test forks and copies between the same shards in opposite directions
+    // do not deadlock
+    stackMap.create("other");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&stackMap, t] {
+            auto from = t % 2 == 0 ? "source" : "other";
+            for (int i = 0; i < 200; ++i) {
+                auto prefix = "t" + std::to_string(t) + "-" + std::to_string(i);
+                stackMap.fork(from, {prefix + "-a", prefix + "-b"});
+                stackMap.copy(prefix + "-a", prefix + "-c");
+                stackMap.remove(prefix + "-a");
+                stackMap.remove(prefix + "-b");
+                stackMap.remove(prefix + "-c");
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    OATPP_ASSERT(stackMap.size() == 2 + names.size());
+}
+
+void StackMapMoveTest::onRun() {
+    StackMap<std::string, std::string> stackMap(8);
+    stackMap.create("pending");
+    stackMap.create("in-flight");
+    stackMap.pushMany("pending", {"1", "2", "3"});
+
+    // Test a node only the source holds is relinked, with the sizes of the
+    // destination
+    Reclaimer::instance().drain();
+    auto nodes = Metrics::collect().nodes;
+    OATPP_ASSERT(*stackMap.move("pending", "in-flight") == "3");
+    OATPP_ASSERT(*stackMap.move("pending", "in-flight") == "2");
+    OATPP_ASSERT(Metrics::collect().nodes == nodes);
+    OATPP_ASSERT(stackMap.getSize("in-flight").length == 2);
+    OATPP_ASSERT(stackMap.getSize("in-flight").bytes == 2);
+    OATPP_ASSERT(stackMap.getSize("pending").length == 1);
+
+    // Test a shared node is left to the other stacks
+    stackMap.copy("in-flight", "copy");
+    OATPP_ASSERT(*stackMap.move("in-flight", "pending") == "2");
+    OATPP_ASSERT(stackMap.popMany("copy", 10) ==
+                 std::vector<std::string>({"2", "3"}));
+    OATPP_ASSERT(stackMap.popMany("pending", 10) ==
+                 std::vector<std::string>({"2", "1"}));
+    OATPP_ASSERT(stackMap.popMany("in-flight", 10) ==
+                 std::vector<std::string>({"3"}));
+
+    // Test the errors leave both stacks as they are
+    OATPP_ASSERT(stackMap.tryMove("pending", "in-flight").getError() ==
+                 StackError::StackEmpty);
+    OATPP_ASSERT(stackMap.tryMove("missing", "pending").getError() ==
+                 StackError::StackNameNotFound);
+    stackMap.push("pending", "4");
+    OATPP_ASSERT(stackMap.tryMove("pending", "missing").getError() ==
+                 StackError::StackNameNotFound);
+    StackMap<std::string, std::string> limited;
+    StackLimits limits;
+    limits.maxLength = 1;
+    limited.setLimits(limits);
+    limited.create("a");
+    limited.create("b");
+    limited.push("a", "1");
+    limited.push("b", "2");
+    OATPP_ASSERT(limited.tryMove("a", "b").getError() ==
+                 StackError::StackLimitExceeded);
+    OATPP_ASSERT(limited.getTop("a") == "1" && limited.getTop("b") == "2");
+    OATPP_ASSERT(*limited.move("a", "a") == "1");
+    OATPP_ASSERT(limited.getSize("a").length == 1);
+
+    // Test a move wakes a pop waiting on the destination
+    std::thread waiter([&] {
+        auto value = stackMap.popRefUntil(
+            "in-flight",
+            std::chrono::steady_clock::now() + std::chrono::seconds(10));
+        OATPP_ASSERT(*value == "4");
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    stackMap.move("pending", "in-flight");
+    waiter.join();
+
+    // Test moves in opposite directions do not deadlock, and lose nothing
+    std::vector<std::string> values(100, "x");
+    stackMap.pushMany("pending", std::vector<std::string>(values));
+    stackMap.pushMany("in-flight", std::vector<std::string>(values));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&stackMap, t] {
+            auto from = t % 2 == 0 ? "pending" : "in-flight";
+            auto to = t % 2 == 0 ? "in-flight" : "pending";
+            for (int i = 0; i < 1000; ++i) {
+                stackMap.tryMove(from, to);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    OATPP_ASSERT(stackMap.getSize("pending").length +
+                     stackMap.getSize("in-flight").length ==
+                 200);
+}
+
+void StackMapVersionTest::onRun() {
+    StackMap<std::string, std::string> stackMap(4);
+    stackMap.create("stack");
+
+    // Test every mutation moves the stack to its next version, and a read
+    // does not
+    std::uint64_t version = 0, next = 0;
+    OATPP_ASSERT(stackMap.tryGetTopRef("stack", &version).getError() ==
+                 StackError::StackEmpty);
+    VersionCheck check;
+    check.version = &next;
+    stackMap.push("stack", "1", check);
+    OATPP_ASSERT(next == version + 1);
+    std::uint64_t read = 0;
+    OATPP_ASSERT(*stackMap.getTopRef("stack", &read) == "1");
+    OATPP_ASSERT(read == next);
+    stackMap.pushMany("stack", {"2", "3"});
+    stackMap.getTopRef("stack", &read);
+    OATPP_ASSERT(read == next + 1);
+    OATPP_ASSERT(*stackMap.popRef("stack", check) == "3");
+    OATPP_ASSERT(next == read + 1);
+    stackMap.popMany("stack", 1);
+    stackMap.getTopRef("stack", &read);
+    OATPP_ASSERT(read == next + 1);
+    stackMap.getStack("stack").second = Stack<std::string>();
+    stackMap.tryGetTopRef("stack", &version);
+    OATPP_ASSERT(version == read + 1);
+
+    // Test a mutation conditional on another version fails, and leaves the
+    // stack as it is
+    check.ifMatch = version + 1;
+    OATPP_ASSERT(stackMap.tryPush("stack", "1", check).getError() ==
+                 StackError::VersionMismatch);
+    OATPP_ASSERT(stackMap.tryPopRef("stack", check).getError() ==
+                 StackError::VersionMismatch);
+    try {
+        stackMap.push("stack", "1", check);
+        OATPP_ASSERT(false);
+    } catch (VersionMismatch) {
+    }
+    OATPP_ASSERT(stackMap.getSize("stack").length == 0);
+    stackMap.tryGetTopRef("stack", &read);
+    OATPP_ASSERT(read == version);
+
+    // Test a mutation conditional on the current version succeeds, and only
+    // once
+    check.ifMatch = version;
+    OATPP_ASSERT(stackMap.tryPush("stack", "1", check).ok());
+    OATPP_ASSERT(next == version + 1);
+    OATPP_ASSERT(stackMap.tryPush("stack", "2", check).getError() ==
+                 StackError::VersionMismatch);
+    check.ifMatch = next;
+    OATPP_ASSERT(**stackMap.tryPopRef("stack", check) == "1");
+    OATPP_ASSERT(stackMap.tryPopRef("stack", check).getError() ==
+                 StackError::VersionMismatch);
+    check.ifMatch = next;
+    OATPP_ASSERT(stackMap.tryPopRef("stack", check).getError() ==
+                 StackError::StackEmpty);
+
+    // Test a move moves both stacks to their next version
+    stackMap.create("other");
+    stackMap.push("stack", "1");
+    std::uint64_t from = 0, to = 0;
+    stackMap.tryGetTopRef("stack", &from);
+    stackMap.tryGetTopRef("other", &to);
+    stackMap.move("stack", "other");
+    stackMap.tryGetTopRef("stack", &read);
+    OATPP_ASSERT(read == from + 1);
+    stackMap.tryGetTopRef("other", &read);
+    OATPP_ASSERT(read == to + 1);
+
+    // Test a stack created again does not reuse the versions of the removed
+    // one, nor does a copy those of its source
+    stackMap.remove("other");
+    stackMap.create("other");
+    stackMap.tryGetTopRef("other", &read);
+    OATPP_ASSERT(read > to + 1);
+    stackMap.copy("stack", "copy");
+    stackMap.tryGetTopRef("stack", &from);
+    stackMap.tryGetTopRef("copy", &to);
+    OATPP_ASSERT(from != to);
+}
+
+void StackMapResultTest::onRun() {
+    // Test the results of a stack
+    Stack<std::string> stack;
+    OATPP_ASSERT(stack.tryGetTop().getError() == StackError::StackEmpty);
+    OATPP_ASSERT(stack.tryPop().getError() == StackError::StackEmpty);
+    OATPP_ASSERT(stack.tryPopRef().getError() == StackError::StackEmpty);
+    OATPP_ASSERT(stack.tryPush("1").ok());
+    OATPP_ASSERT(*stack.tryGetTop() == "1");
+    OATPP_ASSERT(**stack.tryGetTopRef() == "1");
+    StackLimits limits;
+    limits.maxLength = 1;
+    OATPP_ASSERT(stack.tryPush("2", {}, limits).getError() ==
+                 StackError::StackLimitExceeded);
+    OATPP_ASSERT(stack.tryPushMany({"2"}, {}, limits).getError() ==
+                 StackError::StackLimitExceeded);
+    OATPP_ASSERT(stack.tryPop().take() == "1");
+
+    // Test the results of a map
+    StackMap<std::string, std::string> stackMap(4);
+    OATPP_ASSERT(stackMap.tryCreate("stack").ok());
+    OATPP_ASSERT(stackMap.tryCreate("stack").getError() ==
+                 StackError::StackNameAlreadyExists);
+    for (auto error : {stackMap.tryGetTop("missing").getError(),
+                       stackMap.tryGetTopRef("missing").getError(),
+                       stackMap.tryPeek("missing", 1).getError(),
+                       stackMap.tryGetSize("missing").getError(),
+                       stackMap.tryPush("missing", "1").getError(),
+                       stackMap.tryPop("missing").getError(),
+                       stackMap.tryPopRef("missing").getError(),
+                       stackMap.tryPushMany("missing", {"1"}).getError(),
+                       stackMap.tryPopMany("missing", 1).getError(),
+                       stackMap.tryRemove("missing").getError(),
+                       stackMap.tryCopy("missing", "copy").getError(),
+                       stackMap.tryFork("missing", {"copy"}).getError()}) {
+        OATPP_ASSERT(error == StackError::StackNameNotFound);
+    }
+    OATPP_ASSERT(stackMap.tryPop("stack").getError() ==
+                 StackError::StackEmpty);
+    OATPP_ASSERT(stackMap.tryPopRef("stack").getError() ==
+                 StackError::StackEmpty);
+    OATPP_ASSERT(stackMap.tryPopMany("stack", 1)->empty());
+
+    OATPP_ASSERT(stackMap.tryPush("stack", "1").ok());
+    OATPP_ASSERT(stackMap.tryPushMany("stack", {"2", "3"}).ok());
+    OATPP_ASSERT(*stackMap.tryGetTop("stack") == "3");
+    OATPP_ASSERT(stackMap.tryGetSize("stack")->length == 3);
+    OATPP_ASSERT(*stackMap.tryPeek("stack", 2)->next() == "3");
+    OATPP_ASSERT(stackMap.tryCopy("stack", "copy").ok());
+    OATPP_ASSERT(stackMap.tryCopy("stack", "copy").getError() ==
+                 StackError::StackNameAlreadyExists);
+    OATPP_ASSERT(stackMap.tryFork("stack", {"fork", "fork"}).getError() ==
+                 StackError::StackNameAlreadyExists);
+    OATPP_ASSERT(stackMap.tryFork("stack", {"fork", "copy"}).getError() ==
+                 StackError::StackNameAlreadyExists);
+    OATPP_ASSERT(stackMap.tryFork("stack", {"fork"}).ok());
+    OATPP_ASSERT(*stackMap.tryPop("copy") == "3");
+    OATPP_ASSERT(**stackMap.tryPopRef("fork") == "3");
+    OATPP_ASSERT(stackMap.tryPopMany("stack", 5)->size() == 3);
+    OATPP_ASSERT(stackMap.tryRemove("copy").ok());
+
+    // Test a waiting pop timing out
+    auto deadline = std::chrono::steady_clock::now();
+    OATPP_ASSERT(stackMap.tryPopRefUntil("stack", deadline).getError() ==
+                 StackError::StackEmpty);
+    OATPP_ASSERT(stackMap.tryPopRefUntil("missing", deadline).getError() ==
+                 StackError::StackNameNotFound);
+
+    // Test the memory budget
+    Reclaimer::instance().drain();
+    auto &budget = MemoryBudget::instance();
+    budget.setLimit(budget.getUsed() + 1);
+    OATPP_ASSERT(stackMap.tryPush("stack", "x").getError() ==
+                 StackError::MemoryLimitExceeded);
+    OATPP_ASSERT(stackMap.tryPushMany("stack", {"x"}).getError() ==
+                 StackError::MemoryLimitExceeded);
+    budget.setLimit(0);
+
+    // Test the throwing operations rethrowing the errors
+    try {
+        stackMap.tryPop("stack").take();
+        OATPP_ASSERT(false);
+    } catch (StackEmpty) {
+    }
+    try {
+        stackMap.tryRemove("missing").take();
+        OATPP_ASSERT(false);
+    } catch (StackNameNotFound) {
+    }
+}
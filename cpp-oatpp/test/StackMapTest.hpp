@@ -8,6 +8,26 @@ public:
     StackTest() : UnitTest("TEST[StackTest]") {}
     void onRun() override;
 };
+class StackBatchTest : public oatpp::test::UnitTest {
+public:
+    StackBatchTest() : UnitTest("TEST[StackBatchTest]") {}
+    void onRun() override;
+};
+class StackValueRefTest : public oatpp::test::UnitTest {
+public:
+    StackValueRefTest() : UnitTest("TEST[StackValueRefTest]") {}
+    void onRun() override;
+};
+class StackPeekTest : public oatpp::test::UnitTest {
+public:
+    StackPeekTest() : UnitTest("TEST[StackPeekTest]") {}
+    void onRun() override;
+};
+class StackSizeTest : public oatpp::test::UnitTest {
+public:
+    StackSizeTest() : UnitTest("TEST[StackSizeTest]") {}
+    void onRun() override;
+};
 class StackConcurrentTest : public oatpp::test::UnitTest {
 public:
     StackConcurrentTest() : UnitTest("TEST[StackConcurrentTest]") {}
@@ -18,5 +38,35 @@ public:
     StackMapConcurrentTest() : UnitTest("TEST[StackMapConcurrentTest]") {}
     void onRun() override;
 };
+class StackMapShardedTest : public oatpp::test::UnitTest {
+public:
+    StackMapShardedTest() : UnitTest("TEST[StackMapShardedTest]") {}
+    void onRun() override;
+};
+class StackMapWaitTest : public oatpp::test::UnitTest {
+public:
+    StackMapWaitTest() : UnitTest("TEST[StackMapWaitTest]") {}
+    void onRun() override;
+};
+class StackMapForkTest : public oatpp::test::UnitTest {
+public:
+    StackMapForkTest() : UnitTest("TEST[StackMapForkTest]") {}
+    void onRun() override;
+};
+class StackMapMoveTest : public oatpp::test::UnitTest {
+public:
+    StackMapMoveTest() : UnitTest("TEST[StackMapMoveTest]") {}
+    void onRun() override;
+};
+class StackMapVersionTest : public oatpp::test::UnitTest {
+public:
+    StackMapVersionTest() : UnitTest("TEST[StackMapVersionTest]") {}
+    void onRun() override;
+};
+class StackMapResultTest : public oatpp::test::UnitTest {
+public:
+    StackMapResultTest() : UnitTest("TEST[StackMapResultTest]") {}
+    void onRun() override;
+};
 
 #endif // StackMapTest_hpp
@@ -0,0 +1,79 @@
+#include "ValueInternerTest.hpp"
+
+#include "StringStackMap.hpp"
+#include "ValueInterner.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char *topData(StringStackMap &map, const char *name) {
+    return map.getTopRef(std::string_view(name))->data();
+}
+
+} // namespace
+
+void ValueInternerTest::onRun() {
+    auto &interner = ValueInterner::instance();
+    std::string job(100, 'j');
+    StringStackMap map(4);
+    map.create("a");
+    map.create("b");
+
+    // Test the values are not shared while interning is off
+    map.push("a", SmallString(job.data(), job.size()));
+    map.push("b", SmallString(job.data(), job.size()));
+    OATPP_ASSERT(topData(map, "a") != topData(map, "b"));
+    OATPP_ASSERT(interner.getStats().values == 0);
+
+    // Test the identical long values pushed share one buffer
+    interner.setEnabled(true);
+    map.push("a", SmallString(job.data(), job.size()));
+    map.push("b", SmallString(job.data(), job.size()));
+    map.pushMany("b", {SmallString(job.data(), job.size()), "short"});
+    map.pop("b");
+    OATPP_ASSERT(topData(map, "a") == topData(map, "b"));
+    OATPP_ASSERT(map.popMany("b", 1)[0] == SmallString(job.data(), job.size()));
+    auto stats = interner.getStats();
+    OATPP_ASSERT(stats.values == 1);
+    OATPP_ASSERT(stats.bytes == job.size());
+    OATPP_ASSERT(stats.referencedBytes == 2 * job.size());
+
+    // Test the entry is freed along with the last value sharing it, and a
+    // value pushed again is interned anew
+    map.pop("a");
+    map.pop("b");
+    OATPP_ASSERT(interner.getStats().values == 0);
+    map.push("a", SmallString(job.data(), job.size()));
+    OATPP_ASSERT(interner.getStats().referencedBytes == job.size());
+    map.remove("a");
+    OATPP_ASSERT(interner.getStats().values == 0);
+
+    // Test concurrent pushes and pops of the same values
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&map, t] {
+            for (int i = 0; i < 2000; ++i) {
+                std::string value(64, static_cast<char>('a' + i % 8));
+                auto name = t % 2 == 0 ? "a" : "b";
+                if (t < 2) {
+                    map.tryPush(name, SmallString(value.data(), value.size()));
+                } else {
+                    map.tryPop(name);
+                }
+            }
+        });
+    }
+    map.create("a");
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    OATPP_ASSERT(interner.getStats().values <= 8);
+    map.remove("a");
+    map.remove("b");
+    Reclaimer::instance().drain();
+    OATPP_ASSERT(interner.getStats().values == 0);
+    interner.setEnabled(false);
+}
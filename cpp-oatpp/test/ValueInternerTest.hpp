@@ -0,0 +1,12 @@
+#ifndef ValueInternerTest_hpp
+#define ValueInternerTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class ValueInternerTest : public oatpp::test::UnitTest {
+public:
+    ValueInternerTest() : UnitTest("TEST[ValueInternerTest]") {}
+    void onRun() override;
+};
+
+#endif // ValueInternerTest_hpp
@@ -0,0 +1,255 @@
+#include "WriteAheadLogTest.hpp"
+
+#include "WriteAheadLog.hpp"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Durability = WriteAheadLog::Durability;
+
+std::string createTempFile() {
+    char path[] = "/tmp/stack-server-wal-XXXXXX";
+    auto fd = ::mkstemp(path);
+    OATPP_ASSERT(fd >= 0);
+    ::close(fd);
+    return path;
+}
+
+off_t fileSize(const std::string &path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    auto size = ::lseek(fd, 0, SEEK_END);
+    ::close(fd);
+    return size;
+}
+
+std::vector<SmallString> popAll(StringStackMap &map, const char *name) {
+    return map.popMany(name, SIZE_MAX);
+}
+
+bool equals(const std::vector<SmallString> &values,
+            std::initializer_list<const char *> expected) {
+    return std::equal(values.begin(), values.end(), expected.begin(),
+                      expected.end(),
+                      [](const SmallString &value, const char *other) {
+                          return value == other;
+                      });
+}
+
+// Replays the log at `path` into a new map.
+std::shared_ptr<StringStackMap> recover(const std::string &path,
+                                        std::uint64_t expectedRecords) {
+    auto map = std::make_shared<StringStackMap>(4);
+    WriteAheadLog log(path, Durability::None, std::chrono::milliseconds(1));
+    OATPP_ASSERT(log.replay(*map) == expectedRecords);
+    return map;
+}
+
+class BlockingCommitWaiter : public CommitWaiter {
+public:
+    void wake() override {
+        {
+            std::lock_guard _lock(this->lock);
+            this->woken = true;
+        }
+        this->changed.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock _lock(this->lock);
+        this->changed.wait(_lock, [&] { return this->woken; });
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable changed;
+    bool woken = false;
+};
+
+} // namespace
+
+void WriteAheadLogTest::onRun() {
+    for (auto durability :
+         {Durability::None, Durability::Batched, Durability::PerOp}) {
+        auto path = createTempFile();
+        {
+            StringStackMap map(4);
+            map.setLog(std::make_shared<WriteAheadLog>(
+                path, durability, std::chrono::milliseconds(1)));
+
+            // Failed mutations are not logged
+            map.create("a");
+            try {
+                map.create("a");
+            } catch (StackNameAlreadyExists &) {
+            }
+            map.push("a", "1");
+            map.pushMany("a", {"2", "3", "4"});
+            OATPP_ASSERT(map.pop("a") == "4");
+            map.copy("a", "b");
+            OATPP_ASSERT(map.popMany("a", 2).size() == 2);
+            map.push("b", "5");
+            map.move("b", "a");
+            OATPP_ASSERT(!map.tryMove("b", "c"));
+            map.create("c");
+            map.remove("c");
+
+            auto &log = map.getLog();
+            log->waitCommitted(log->takeLastLogged());
+            OATPP_ASSERT(log->takeLastLogged() == 0);
+        }
+
+        // The log is flushed when destroyed
+        auto map = recover(path, 10);
+        OATPP_ASSERT(equals(popAll(*map, "a"), {"5", "1"}));
+        OATPP_ASSERT(equals(popAll(*map, "b"), {"3", "2", "1"}));
+        try {
+            map->getTop("c");
+            OATPP_ASSERT(false);
+        } catch (StackNameNotFound &) {
+        }
+
+        ::unlink(path.c_str());
+    }
+
+    // A torn record at the end is cut off, and the log continues after the
+    // records before it
+    auto path = createTempFile();
+    {
+        StringStackMap map;
+        map.setLog(std::make_shared<WriteAheadLog>(
+            path, Durability::PerOp, std::chrono::milliseconds(1)));
+        map.create("a");
+        map.push("a", "1");
+    }
+    auto size = fileSize(path);
+    {
+        auto fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        OATPP_ASSERT(::write(fd, "\0\0\0\x20torn", 8) == 8);
+        ::close(fd);
+    }
+    {
+        StringStackMap map;
+        auto log = std::make_shared<WriteAheadLog>(
+            path, Durability::PerOp, std::chrono::milliseconds(1));
+        OATPP_ASSERT(log->replay(map) == 2);
+        OATPP_ASSERT(fileSize(path) == size);
+        map.setLog(log);
+        map.push("a", "2");
+    }
+    auto map = recover(path, 3);
+    OATPP_ASSERT(equals(popAll(*map, "a"), {"2", "1"}));
+
+    // A corrupted record stops the replay
+    {
+        auto fd = ::open(path.c_str(), O_WRONLY);
+        OATPP_ASSERT(::pwrite(fd, "X", 1, size - 1) == 1);
+        ::close(fd);
+    }
+    map = recover(path, 1);
+    OATPP_ASSERT(popAll(*map, "a").empty());
+
+    ::unlink(path.c_str());
+
+    // Copies and forks taken while the source is pushed to are logged at the
+    // point they copied
+    path = createTempFile();
+    constexpr int pushCount = 2000;
+    constexpr int copyCount = 200;
+    std::vector<std::vector<SmallString>> copies;
+    {
+        StringStackMap map(4);
+        map.setLog(std::make_shared<WriteAheadLog>(
+            path, Durability::None, std::chrono::milliseconds(1)));
+        map.create("source");
+        std::thread pusher([&] {
+            for (int i = 0; i < pushCount; ++i) {
+                map.push("source", oatpp::String(std::to_string(i)));
+            }
+        });
+        for (int i = 0; i < copyCount; ++i) {
+            auto name = std::to_string(i);
+            map.copy("source", "copy-" + name);
+            map.fork("source", {"fork-" + name + "-a", "fork-" + name + "-b"});
+        }
+        pusher.join();
+        for (int i = 0; i < copyCount; ++i) {
+            auto name = std::to_string(i);
+            for (auto copy : {"copy-" + name, "fork-" + name + "-a",
+                              "fork-" + name + "-b"}) {
+                copies.push_back(map.getStack(copy).second.popMany(SIZE_MAX));
+            }
+        }
+    }
+    map = recover(path, 1 + pushCount + 3 * copyCount);
+    for (int i = 0, j = 0; i < copyCount; ++i) {
+        auto name = std::to_string(i);
+        for (auto copy :
+             {"copy-" + name, "fork-" + name + "-a", "fork-" + name + "-b"}) {
+            OATPP_ASSERT(popAll(*map, copy.c_str()) == copies[j++]);
+        }
+    }
+
+    ::unlink(path.c_str());
+}
+
+void WriteAheadLogGroupCommitTest::onRun() {
+    constexpr int threadCount = 8;
+    constexpr int pushCount = 200;
+
+    auto path = createTempFile();
+    {
+        StringStackMap map(4);
+        auto log = std::make_shared<WriteAheadLog>(
+            path, Durability::PerOp, std::chrono::milliseconds(1));
+        map.setLog(log);
+        map.create("stack");
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < threadCount; ++i) {
+            threads.emplace_back([&] {
+                for (int j = 0; j < pushCount; ++j) {
+                    map.push("stack", oatpp::String(std::to_string(j)));
+                    auto seq = log->takeLastLogged();
+                    OATPP_ASSERT(seq > 0);
+                    // Half the mutations are waited for with a waiter
+                    auto waiter = std::make_shared<BlockingCommitWaiter>();
+                    if (j % 2 == 0) {
+                        log->waitCommitted(seq);
+                    } else if (log->addCommitWaiter(seq, waiter)) {
+                        waiter->wait();
+                    }
+                    OATPP_ASSERT(log->isCommitted(seq));
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        // Concurrent mutations share fsyncs
+        auto stats = log->getStats();
+        OATPP_ASSERT(stats.records == threadCount * pushCount + 1);
+        OATPP_ASSERT(stats.syncs <= stats.writes);
+        OATPP_ASSERT(stats.syncs < stats.records);
+
+        // A cancelled waiter is not woken
+        auto waiter = std::make_shared<BlockingCommitWaiter>();
+        OATPP_ASSERT(!log->addCommitWaiter(log->getLastSeq(), waiter));
+        OATPP_ASSERT(log->addCommitWaiter(log->getLastSeq() + 1, waiter));
+        log->cancelCommitWait(*waiter);
+        OATPP_ASSERT(waiter.use_count() == 1);
+    }
+
+    auto map = recover(path, threadCount * pushCount + 1);
+    OATPP_ASSERT(popAll(*map, "stack").size() == threadCount * pushCount);
+
+    ::unlink(path.c_str());
+}
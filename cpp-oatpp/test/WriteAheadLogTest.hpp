@@ -0,0 +1,18 @@
+#ifndef WriteAheadLogTest_hpp
+#define WriteAheadLogTest_hpp
+
+#include "oatpp-test/UnitTest.hpp"
+
+class WriteAheadLogTest : public oatpp::test::UnitTest {
+public:
+    WriteAheadLogTest() : UnitTest("TEST[WriteAheadLogTest]") {}
+    void onRun() override;
+};
+class WriteAheadLogGroupCommitTest : public oatpp::test::UnitTest {
+public:
+    WriteAheadLogGroupCommitTest()
+        : UnitTest("TEST[WriteAheadLogGroupCommitTest]") {}
+    void onRun() override;
+};
+
+#endif // WriteAheadLogTest_hpp
@@ -0,0 +1,105 @@
+#ifndef AsyncTestComponent_hpp
+#define AsyncTestComponent_hpp
+
+#include "StringStackMap.hpp"
+
+#include "oatpp/web/server/AsyncHttpConnectionHandler.hpp"
+
+#include "oatpp/network/virtual_/Interface.hpp"
+#include "oatpp/network/virtual_/client/ConnectionProvider.hpp"
+#include "oatpp/network/virtual_/server/ConnectionProvider.hpp"
+
+#include "oatpp/parser/json/mapping/ObjectMapper.hpp"
+
+#include "oatpp/core/macro/component.hpp"
+
+/**
+ * Test Components config of the async server mode
+ */
+class AsyncTestComponent {
+public:
+    /**
+     *  Create StackMap component, sharded so that tests cover cross-shard
+     * operations
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<StringStackMap>, stackMap)
+    ([] {
+        auto map = std::make_shared<StringStackMap>(4);
+        map->setLimits({100, 0});
+        return map;
+    }());
+
+    /**
+     * Create oatpp virtual network interface for test networking
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::network::virtual_::Interface>,
+                           virtualInterface)
+    ([] {
+        return oatpp::network::virtual_::Interface::obtainShared("virtualhost");
+    }());
+
+    /**
+     * Create server ConnectionProvider of oatpp virtual connections for test
+     */
+    OATPP_CREATE_COMPONENT(
+        std::shared_ptr<oatpp::network::ServerConnectionProvider>,
+        serverConnectionProvider)
+    ([] {
+        OATPP_COMPONENT(std::shared_ptr<oatpp::network::virtual_::Interface>,
+                        _interface);
+        return oatpp::network::virtual_::server::ConnectionProvider::
+            createShared(_interface);
+    }());
+
+    /**
+     * Create client ConnectionProvider of oatpp virtual connections for test
+     */
+    OATPP_CREATE_COMPONENT(
+        std::shared_ptr<oatpp::network::ClientConnectionProvider>,
+        clientConnectionProvider)
+    ([] {
+        OATPP_COMPONENT(std::shared_ptr<oatpp::network::virtual_::Interface>,
+                        _interface);
+        return oatpp::network::virtual_::client::ConnectionProvider::
+            createShared(_interface);
+    }());
+
+    /**
+     *  Create Router component
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::web::server::HttpRouter>,
+                           httpRouter)
+    ([] { return oatpp::web::server::HttpRouter::createShared(); }());
+
+    /**
+     *  Create async Executor component to run the coroutines of the server
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::async::Executor>, executor)
+    ([] { return std::make_shared<oatpp::async::Executor>(); }());
+
+    /**
+     *  Create async ConnectionHandler component which uses Router component to
+     * route requests
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::network::ConnectionHandler>,
+                           serverConnectionHandler)
+    ([] {
+        OATPP_COMPONENT(std::shared_ptr<oatpp::web::server::HttpRouter>,
+                        router); // get Router component
+        OATPP_COMPONENT(std::shared_ptr<oatpp::async::Executor>, executor);
+        return oatpp::web::server::AsyncHttpConnectionHandler::createShared(
+            router, executor);
+    }());
+
+    /**
+     *  Create ObjectMapper component to serialize/deserialize DTOs in
+     * Contoller's API
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<oatpp::data::mapping::ObjectMapper>,
+                           apiObjectMapper)
+    ([] {
+        return oatpp::parser::json::mapping::ObjectMapper::createShared();
+    }());
+};
+
+#endif // AsyncTestComponent_hpp
@@ -18,17 +18,52 @@ class StackApiTestClient : public oatpp::web::client::ApiClient {
 
     API_CALL("GET", "/{name}/top", getTop, PATH(String, name))
 
+    API_CALL("GET", "/{name}/top", getTopIfNoneMatch, PATH(String, name),
+             HEADER(String, ifNoneMatch, "If-None-Match"))
+
+    API_CALL("GET", "/{name}/peek", peek, PATH(String, name),
+             QUERY(UInt32, count))
+
+    API_CALL("GET", "/{name}/size", getSize, PATH(String, name))
+
+    API_CALL("GET", "/metrics", getMetrics)
+
     API_CALL("POST", "/{name}/push", push, PATH(String, name),
              BODY_STRING(String, body, "text/plain"))
 
+    API_CALL("POST", "/{name}/push", pushIfMatch, PATH(String, name),
+             HEADER(String, ifMatch, "If-Match"),
+             BODY_STRING(String, body, "text/plain"))
+
     API_CALL("POST", "/{name}/pop", pop, PATH(String, name))
 
+    API_CALL("POST", "/{name}/pop", popIfMatch, PATH(String, name),
+             HEADER(String, ifMatch, "If-Match"))
+
+    API_CALL("POST", "/{name}/pop", popWaiting, PATH(String, name),
+             QUERY(UInt32, timeout))
+
+    API_CALL("POST", "/{name}/pop", popWaitingFor, PATH(String, name),
+             QUERY(String, timeout))
+
+    API_CALL("POST", "/{name}/push-many", pushMany, PATH(String, name),
+             BODY_STRING(String, body, "application/octet-stream"))
+
+    API_CALL("POST", "/{name}/pop-many", popMany, PATH(String, name),
+             QUERY(UInt32, count))
+
     API_CALL("POST", "/{name}", create, PATH(String, name))
 
     API_CALL("DELETE", "/{name}", remove, PATH(String, name))
 
     API_CALL("POST", "/{from}/copy", copy, PATH(String, from),
              QUERY(String, to))
+
+    API_CALL("POST", "/{from}/fork", fork, PATH(String, from),
+             BODY_STRING(String, body, "application/octet-stream"))
+
+    API_CALL("POST", "/{from}/move", move, PATH(String, from),
+             QUERY(String, to))
 };
 
 /* End Api Client code generation */
@@ -1,6 +1,8 @@
 #ifndef TestComponent_htpp
 #define TestComponent_htpp
 
+#include "StringStackMap.hpp"
+
 #include "oatpp/web/server/HttpConnectionHandler.hpp"
 
 #include "oatpp/network/virtual_/Interface.hpp"
@@ -16,6 +18,17 @@
  */
 class TestComponent {
 public:
+    /**
+     *  Create StackMap component, sharded so that tests cover cross-shard
+     * operations
+     */
+    OATPP_CREATE_COMPONENT(std::shared_ptr<StringStackMap>, stackMap)
+    ([] {
+        auto map = std::make_shared<StringStackMap>(4);
+        map->setLimits({100, 0});
+        return map;
+    }());
+
     /**
      * Create oatpp virtual network interface for test networking
      */
@@ -1,12 +1,53 @@
+#include "BinaryServerTest.hpp"
+#include "FlatHashMapTest.hpp"
+#include "LockFreeStackTest.hpp"
+#include "MetricsTest.hpp"
+#include "NodePoolTest.hpp"
+#include "ReclaimerTest.hpp"
+#include "ReplicationTest.hpp"
+#include "SmallStringTest.hpp"
+#include "SnapshotTest.hpp"
+#include "SpillStoreTest.hpp"
+#include "StackAsyncControllerTest.hpp"
 #include "StackControllerTest.hpp"
 #include "StackMapTest.hpp"
+#include "ValueInternerTest.hpp"
+#include "WriteAheadLogTest.hpp"
 #include <iostream>
 
 void runTests() {
     // OATPP_RUN_TEST(StackTest);
     // OATPP_RUN_TEST(StackConcurrentTest);
     // OATPP_RUN_TEST(StackMapConcurrentTest);
+    OATPP_RUN_TEST(StackBatchTest);
+    OATPP_RUN_TEST(StackValueRefTest);
+    OATPP_RUN_TEST(StackPeekTest);
+    OATPP_RUN_TEST(StackSizeTest);
+    OATPP_RUN_TEST(StackMapShardedTest);
+    OATPP_RUN_TEST(StackMapWaitTest);
+    OATPP_RUN_TEST(StackMapForkTest);
+    OATPP_RUN_TEST(StackMapMoveTest);
+    OATPP_RUN_TEST(StackMapVersionTest);
+    OATPP_RUN_TEST(StackMapResultTest);
+    OATPP_RUN_TEST(FlatHashMapTest);
+    OATPP_RUN_TEST(LockFreeStackTest);
+    OATPP_RUN_TEST(LockFreeStackConcurrentTest);
+    OATPP_RUN_TEST(NodePoolTest);
+    OATPP_RUN_TEST(PooledStackConcurrentTest);
+    OATPP_RUN_TEST(ReclaimerTest);
+    OATPP_RUN_TEST(SmallStringTest);
+    OATPP_RUN_TEST(ValueInternerTest);
+    OATPP_RUN_TEST(MetricsTest);
+    OATPP_RUN_TEST(WriteAheadLogTest);
+    OATPP_RUN_TEST(WriteAheadLogGroupCommitTest);
+    OATPP_RUN_TEST(SnapshotTest);
+    OATPP_RUN_TEST(SnapshotRecoveryTest);
+    OATPP_RUN_TEST(SpillStoreTest);
+    OATPP_RUN_TEST(ReplicationTest);
+    OATPP_RUN_TEST(ReplicationLagTest);
     OATPP_RUN_TEST(StackControllerTest);
+    OATPP_RUN_TEST(BinaryServerTest);
+    OATPP_RUN_TEST(StackAsyncControllerTest);
 }
 
 int main() {